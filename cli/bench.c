@@ -0,0 +1,738 @@
+/**
+ * @file bench.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-bench load-generation tool
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <libyang/libyang.h>
+#include <nc_client.h>
+
+#include "compat.h"
+#include "commands.h"
+#include "configuration.h"
+
+#define BENCH_DURATION_DFLT 10      /* 10 seconds */
+#define BENCH_REPLY_TIMEOUT_DFLT 5  /* 5 seconds */
+
+/* used by the commands */
+int done;
+
+/* connected session of the commands */
+extern struct nc_session *session;
+
+int cmd_connect(const char *arg, char **tmp_config_file);
+
+/**
+ * @brief Benchmarked operations.
+ */
+enum bench_op {
+    BENCH_GET = 0,
+    BENCH_GETCONFIG,
+    BENCH_GETDATA,
+    BENCH_EDITCONFIG,
+    BENCH_SUBSCRIBE,
+    BENCH_OP_COUNT
+};
+
+static const char *bench_op_names[BENCH_OP_COUNT] = {"get", "get-config", "get-data", "edit-config", "subscribe"};
+
+/**
+ * @brief Results of an operation.
+ */
+struct bench_result {
+    uint32_t *lat;                  /* latencies of successful requests (us) */
+    uint32_t count;                 /* number of latencies */
+    uint32_t size;                  /* allocated latencies */
+    uint64_t errors;                /* number of failed requests */
+};
+
+/**
+ * @brief Benchmark thread driving a single session.
+ */
+struct bench_thread {
+    pthread_t tid;
+    struct nc_session *session;
+    int subscribe;                  /* whether to subscribe to notifications first */
+    unsigned int seed;              /* random operation choice seed */
+    struct bench_result res[BENCH_OP_COUNT];
+    volatile uint64_t notifications;    /* number of received notifications */
+    struct timespec finish;         /* time the thread finished */
+};
+
+/**
+ * @brief Benchmark parameters.
+ */
+static struct {
+    uint32_t sessions;
+    uint32_t subscribed;
+    double rate;                    /* total target rate (RPC/s), 0 for unlimited */
+    uint32_t duration;              /* seconds */
+    uint32_t timeout;               /* reply timeout (s) */
+    uint32_t weights[BENCH_OP_COUNT];
+    uint32_t weight_sum;
+    const char *filter;
+    char *edit_content;
+
+    struct timespec start;
+    struct timespec end;
+    volatile int stop;
+} bench;
+
+static void
+bench_help(void)
+{
+    printf("Usage: netopeer2-bench [options]\n"
+           "Open concurrent NETCONF sessions, send a mix of RPCs at a target rate, and print\n"
+           "the throughput and latencies as JSON. The authentication methods and keys are\n"
+           "the ones configured in netopeer2-cli, use keys to avoid typing passwords.\n\n"
+           "  -h, --help                Show this help.\n"
+           "  -c, --connect \"ARGS\"      Arguments of the netopeer2-cli connect command (default SSH to localhost).\n"
+           "  -n, --sessions N          Number of concurrent sessions (default 1).\n"
+           "  -r, --rate RATE           Target rate of all the sessions (RPC/s), 0 for as fast as possible (default 0).\n"
+           "  -d, --duration SEC        Duration of the benchmark (default %d).\n"
+           "  -m, --mix OP=W[,OP=W]...  Relative weights of get, get-config, get-data,\n"
+           "                            and edit-config (default get=1).\n"
+           "  -f, --filter FILTER       XPath (starting with '/') or subtree filter of the retrieval RPCs.\n"
+           "  -e, --edit-content FILE   Configuration content of edit-config, merged into running.\n"
+           "  -s, --subscribe N         Number of sessions subscribing to the NETCONF stream first (default 0).\n"
+           "  -t, --timeout SEC         Reply timeout (default %d).\n"
+           "  -o, --output FILE         Write the results into a file instead of stdout.\n\n",
+           BENCH_DURATION_DFLT, BENCH_REPLY_TIMEOUT_DFLT);
+}
+
+static void
+bench_print_clb(NC_VERB_LEVEL level, const char *msg)
+{
+    if (level == NC_VERB_ERROR) {
+        fprintf(stderr, "nc ERROR: %s\n", msg);
+    }
+}
+
+static void
+bench_ly_print_clb(LY_LOG_LEVEL level, const char *msg, const char *path)
+{
+    if (level == LY_LLERR) {
+        if (path) {
+            fprintf(stderr, "ly ERROR: %s (%s)\n", msg, path);
+        } else {
+            fprintf(stderr, "ly ERROR: %s\n", msg);
+        }
+    }
+}
+
+static void
+bench_signal_handler(int UNUSED(sig))
+{
+    bench.stop = 1;
+}
+
+static int64_t
+bench_difftimespec_us(const struct timespec *ts1, const struct timespec *ts2)
+{
+    return (ts2->tv_sec - ts1->tv_sec) * 1000000LL + (ts2->tv_nsec - ts1->tv_nsec) / 1000;
+}
+
+static void
+bench_addtimespec_ns(struct timespec *ts, uint64_t ns)
+{
+    ns += ts->tv_nsec;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+}
+
+/**
+ * @brief Parse the operation mix.
+ *
+ * @param[in] mix Mix specification.
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_parse_mix(const char *mix)
+{
+    const char *ptr, *eq;
+    char *end;
+    size_t len;
+    uint32_t i;
+    long w;
+
+    memset(bench.weights, 0, sizeof bench.weights);
+    for (ptr = mix; *ptr; ptr = (*end == ',') ? end + 1 : end) {
+        eq = strchr(ptr, '=');
+        if (!eq) {
+            ERROR(__func__, "Missing weight in \"%s\".", ptr);
+            return -1;
+        }
+        len = eq - ptr;
+
+        /* subscribe is not part of the mix, it is always sent first */
+        for (i = 0; i < BENCH_SUBSCRIBE; ++i) {
+            if ((strlen(bench_op_names[i]) == len) && !strncmp(bench_op_names[i], ptr, len)) {
+                break;
+            }
+        }
+        if (i == BENCH_SUBSCRIBE) {
+            ERROR(__func__, "Unknown operation \"%.*s\".", (int)len, ptr);
+            return -1;
+        }
+
+        errno = 0;
+        w = strtol(eq + 1, &end, 10);
+        if (errno || (w < 0) || (w > UINT16_MAX) || (end == eq + 1) || (*end && (*end != ','))) {
+            ERROR(__func__, "Invalid weight of \"%s\".", bench_op_names[i]);
+            return -1;
+        }
+        bench.weights[i] = w;
+    }
+
+    bench.weight_sum = 0;
+    for (i = 0; i < BENCH_SUBSCRIBE; ++i) {
+        bench.weight_sum += bench.weights[i];
+    }
+    if (!bench.weight_sum) {
+        ERROR(__func__, "No operation to send.");
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read edit-config content from a file.
+ *
+ * @param[in] path File path.
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_read_content(const char *path)
+{
+    FILE *file;
+    long size;
+
+    file = fopen(path, "r");
+    if (!file) {
+        ERROR(__func__, "Opening \"%s\" failed (%s).", path, strerror(errno));
+        return -1;
+    }
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    bench.edit_content = malloc(size + 1);
+    if (!bench.edit_content || (fread(bench.edit_content, 1, size, file) < (size_t)size)) {
+        ERROR(__func__, "Reading \"%s\" failed.", path);
+        fclose(file);
+        return -1;
+    }
+    bench.edit_content[size] = '\0';
+
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Create the RPC of an operation, reused for all the requests.
+ *
+ * @param[in] op Operation.
+ * @return Created RPC, NULL on error.
+ */
+static struct nc_rpc *
+bench_rpc_new(enum bench_op op)
+{
+    switch (op) {
+    case BENCH_GET:
+        return nc_rpc_get(bench.filter, NC_WD_UNKNOWN, NC_PARAMTYPE_CONST);
+    case BENCH_GETCONFIG:
+        return nc_rpc_getconfig(NC_DATASTORE_RUNNING, bench.filter, NC_WD_UNKNOWN, NC_PARAMTYPE_CONST);
+    case BENCH_GETDATA:
+        return nc_rpc_getdata("ietf-datastores:operational", bench.filter, NULL, NULL, 0, 0, 0, 0, NC_WD_UNKNOWN,
+                NC_PARAMTYPE_CONST);
+    case BENCH_EDITCONFIG:
+        return nc_rpc_edit(NC_DATASTORE_RUNNING, NC_RPC_EDIT_DFLTOP_MERGE, NC_RPC_EDIT_TESTOPT_UNKNOWN,
+                NC_RPC_EDIT_ERROPT_UNKNOWN, bench.edit_content, NC_PARAMTYPE_CONST);
+    case BENCH_SUBSCRIBE:
+        return nc_rpc_subscribe(NULL, NULL, NULL, NULL, NC_PARAMTYPE_CONST);
+    case BENCH_OP_COUNT:
+        break;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Record the latency of a successful request.
+ *
+ * @param[in] res Operation results.
+ * @param[in] lat Latency (us).
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_result_add(struct bench_result *res, int64_t lat)
+{
+    void *mem;
+
+    if (res->count == res->size) {
+        res->size = res->size ? res->size * 2 : 1024;
+        mem = realloc(res->lat, res->size * sizeof *res->lat);
+        if (!mem) {
+            fprintf(stderr, "%s: Memory allocation failed.\n", __func__);
+            return -1;
+        }
+        res->lat = mem;
+    }
+
+    res->lat[res->count++] = (lat > UINT32_MAX) ? UINT32_MAX : lat;
+    return 0;
+}
+
+/**
+ * @brief Send an RPC and wait for its reply.
+ *
+ * @param[in] thr Benchmark thread.
+ * @param[in] rpc RPC to send.
+ * @param[in] op Operation of the RPC.
+ * @param[in] sched Time the RPC was scheduled to be sent, the latency is measured from it so that any sending delay
+ * is included, NULL to measure it from now.
+ * @return 0 on success or an error reply, -1 if the session failed.
+ */
+static int
+bench_send_recv(struct bench_thread *thr, struct nc_rpc *rpc, enum bench_op op, const struct timespec *sched)
+{
+    struct nc_reply *reply;
+    struct timespec ts_start, ts_stop;
+    NC_MSG_TYPE msgtype;
+    uint64_t msgid;
+
+    if (sched) {
+        ts_start = *sched;
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &ts_start);
+    }
+
+    msgtype = nc_send_rpc(thr->session, rpc, bench.timeout * 1000, &msgid);
+    if (msgtype != NC_MSG_RPC) {
+        ++thr->res[op].errors;
+        return (nc_session_get_status(thr->session) == NC_STATUS_RUNNING) ? 0 : -1;
+    }
+
+    do {
+        msgtype = nc_recv_reply(thr->session, rpc, msgid, bench.timeout * 1000, LYD_OPT_DESTRUCT | LYD_OPT_NOSIBLINGS,
+                &reply);
+        if (msgtype == NC_MSG_REPLY_ERR_MSGID) {
+            /* reply to a timed out request */
+            nc_reply_free(reply);
+        }
+    } while ((msgtype == NC_MSG_NOTIF) || (msgtype == NC_MSG_REPLY_ERR_MSGID));
+
+    if (msgtype != NC_MSG_REPLY) {
+        ++thr->res[op].errors;
+        return (nc_session_get_status(thr->session) == NC_STATUS_RUNNING) ? 0 : -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts_stop);
+    if (reply->type == NC_RPL_ERROR) {
+        ++thr->res[op].errors;
+    } else if (bench_result_add(&thr->res[op], bench_difftimespec_us(&ts_start, &ts_stop))) {
+        nc_reply_free(reply);
+        return -1;
+    }
+    nc_reply_free(reply);
+
+    return 0;
+}
+
+static void
+bench_ntf_clb(struct nc_session *ncs, const struct nc_notif *UNUSED(notif))
+{
+    struct bench_thread *thr = nc_session_get_data(ncs);
+
+    __sync_add_and_fetch(&thr->notifications, 1);
+}
+
+/**
+ * @brief Choose the next operation.
+ *
+ * @param[in] thr Benchmark thread.
+ * @return Operation.
+ */
+static enum bench_op
+bench_next_op(struct bench_thread *thr)
+{
+    uint32_t r, i;
+
+    r = rand_r(&thr->seed) % bench.weight_sum;
+    for (i = 0; r >= bench.weights[i]; ++i) {
+        r -= bench.weights[i];
+    }
+
+    return i;
+}
+
+/**
+ * @brief Benchmark thread, the commands ERROR() macro is not thread-safe so it cannot be used.
+ */
+static void *
+bench_thread(void *arg)
+{
+    struct bench_thread *thr = arg;
+    struct nc_rpc *rpcs[BENCH_OP_COUNT] = {NULL};
+    struct timespec next, sched, now;
+    uint64_t interval = 0;
+    enum bench_op op;
+    uint32_t i;
+
+    for (i = 0; i < BENCH_OP_COUNT; ++i) {
+        if (((i < BENCH_SUBSCRIBE) && bench.weights[i]) || ((i == BENCH_SUBSCRIBE) && thr->subscribe)) {
+            rpcs[i] = bench_rpc_new(i);
+            if (!rpcs[i]) {
+                fprintf(stderr, "%s: Creating %s RPC failed.\n", __func__, bench_op_names[i]);
+                goto cleanup;
+            }
+        }
+    }
+
+    if (thr->subscribe) {
+        nc_session_set_data(thr->session, thr);
+        if (bench_send_recv(thr, rpcs[BENCH_SUBSCRIBE], BENCH_SUBSCRIBE, NULL)) {
+            goto cleanup;
+        }
+        if (thr->res[BENCH_SUBSCRIBE].count && nc_recv_notif_dispatch(thr->session, bench_ntf_clb)) {
+            fprintf(stderr, "%s: Failed to create notification thread.\n", __func__);
+        }
+    }
+
+    if (bench.rate > 0) {
+        /* every session sends its share of the rate */
+        interval = (uint64_t)(1000000000.0 * bench.sessions / bench.rate);
+    }
+
+    next = bench.start;
+    while (!bench.stop) {
+        if (interval) {
+            /* send at the scheduled time, right away if late */
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+            sched = next;
+            bench_addtimespec_ns(&next, interval);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (bench_difftimespec_us(&bench.end, &now) >= 0) {
+            break;
+        }
+
+        op = bench_next_op(thr);
+        if (bench_send_recv(thr, rpcs[op], op, interval ? &sched : NULL)) {
+            fprintf(stderr, "%s: Session %u failed.\n", __func__, nc_session_get_id(thr->session));
+            break;
+        }
+    }
+
+cleanup:
+    clock_gettime(CLOCK_MONOTONIC, &thr->finish);
+    for (i = 0; i < BENCH_OP_COUNT; ++i) {
+        nc_rpc_free(rpcs[i]);
+    }
+    return NULL;
+}
+
+static int
+bench_lat_cmp(const void *ptr1, const void *ptr2)
+{
+    uint32_t lat1 = *(uint32_t *)ptr1, lat2 = *(uint32_t *)ptr2;
+
+    return (lat1 > lat2) - (lat1 < lat2);
+}
+
+static uint32_t
+bench_percentile(const uint32_t *lat, uint32_t count, double q)
+{
+    uint64_t idx;
+
+    idx = (uint64_t)(q * count + 0.999999);
+    return lat[idx ? idx - 1 : 0];
+}
+
+/**
+ * @brief Print the results as JSON.
+ *
+ * @param[in] out Output stream.
+ * @param[in] thrs Benchmark threads.
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_report(FILE *out, struct bench_thread *thrs)
+{
+    struct bench_result res;
+    uint64_t requests = 0, errors = 0, sent = 0, notifications = 0, sum;
+    int64_t elapsed_us = 0, us;
+    double elapsed;
+    uint32_t i, j, k;
+    int first = 1;
+
+    for (i = 0; i < bench.sessions; ++i) {
+        us = bench_difftimespec_us(&bench.start, &thrs[i].finish);
+        if (us > elapsed_us) {
+            elapsed_us = us;
+        }
+        notifications += thrs[i].notifications;
+    }
+    elapsed = elapsed_us ? elapsed_us / 1000000.0 : 1;
+
+    fprintf(out, "{\n  \"sessions\": %" PRIu32 ",\n  \"subscribed-sessions\": %" PRIu32 ",\n", bench.sessions,
+            bench.subscribed);
+    fprintf(out, "  \"target-rate\": %.1f,\n  \"duration\": %.3f,\n  \"operations\": {", bench.rate, elapsed);
+
+    for (j = 0; j < BENCH_OP_COUNT; ++j) {
+        /* merge the results of all the threads */
+        memset(&res, 0, sizeof res);
+        for (i = 0; i < bench.sessions; ++i) {
+            res.count += thrs[i].res[j].count;
+            res.errors += thrs[i].res[j].errors;
+        }
+        if (!res.count && !res.errors) {
+            continue;
+        }
+        res.lat = malloc((res.count ? res.count : 1) * sizeof *res.lat);
+        if (!res.lat) {
+            ERROR(__func__, "Memory allocation failed.");
+            return -1;
+        }
+        for (i = 0, k = 0; i < bench.sessions; ++i) {
+            memcpy(res.lat + k, thrs[i].res[j].lat, thrs[i].res[j].count * sizeof *res.lat);
+            k += thrs[i].res[j].count;
+        }
+        qsort(res.lat, res.count, sizeof *res.lat, bench_lat_cmp);
+
+        sum = 0;
+        for (k = 0; k < res.count; ++k) {
+            sum += res.lat[k];
+        }
+        requests += res.count + res.errors;
+        errors += res.errors;
+        if (j != BENCH_SUBSCRIBE) {
+            /* only the mix is sent at the target rate */
+            sent += res.count + res.errors;
+        }
+
+        fprintf(out, "%s\n    \"%s\": {\n      \"requests\": %" PRIu64 ",\n      \"errors\": %" PRIu64 ",\n",
+                first ? "" : ",", bench_op_names[j], res.count + res.errors, res.errors);
+        fprintf(out, "      \"throughput\": %.1f", res.count / elapsed);
+        if (res.count) {
+            fprintf(out, ",\n      \"latency-us\": {\n        \"min\": %" PRIu32 ",\n        \"mean\": %.1f,\n",
+                    res.lat[0], (double)sum / res.count);
+            fprintf(out, "        \"p50\": %" PRIu32 ",\n        \"p99\": %" PRIu32 ",\n        \"p999\": %" PRIu32
+                    ",\n        \"max\": %" PRIu32 "\n      }", bench_percentile(res.lat, res.count, 0.5),
+                    bench_percentile(res.lat, res.count, 0.99), bench_percentile(res.lat, res.count, 0.999),
+                    res.lat[res.count - 1]);
+        }
+        fprintf(out, "\n    }");
+        first = 0;
+
+        free(res.lat);
+    }
+
+    fprintf(out, "\n  },\n  \"requests\": %" PRIu64 ",\n  \"errors\": %" PRIu64 ",\n", requests, errors);
+    fprintf(out, "  \"achieved-rate\": %.1f,\n", sent / elapsed);
+    fprintf(out, "  \"throughput\": %.1f,\n  \"notifications\": %" PRIu64 "\n}\n", (requests - errors) / elapsed,
+            notifications);
+
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct bench_thread *thrs = NULL;
+    struct sigaction action;
+    const char *connect_args = "", *output = NULL;
+    char *cmd = NULL;
+    FILE *out = stdout;
+    uint32_t i, j, connected = 0;
+    int c, r, ret = EXIT_FAILURE, initialized = 0;
+    struct option options[] = {
+        {"help", no_argument, NULL, 'h'},
+        {"connect", required_argument, NULL, 'c'},
+        {"sessions", required_argument, NULL, 'n'},
+        {"rate", required_argument, NULL, 'r'},
+        {"duration", required_argument, NULL, 'd'},
+        {"mix", required_argument, NULL, 'm'},
+        {"filter", required_argument, NULL, 'f'},
+        {"edit-content", required_argument, NULL, 'e'},
+        {"subscribe", required_argument, NULL, 's'},
+        {"timeout", required_argument, NULL, 't'},
+        {"output", required_argument, NULL, 'o'},
+        {NULL, 0, NULL, 0}
+    };
+
+    bench.sessions = 1;
+    bench.duration = BENCH_DURATION_DFLT;
+    bench.timeout = BENCH_REPLY_TIMEOUT_DFLT;
+    bench.weights[BENCH_GET] = 1;
+    bench.weight_sum = 1;
+
+    while ((c = getopt_long(argc, argv, "hc:n:r:d:m:f:e:s:t:o:", options, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            bench_help();
+            return EXIT_SUCCESS;
+        case 'c':
+            connect_args = optarg;
+            break;
+        case 'n':
+            bench.sessions = strtoul(optarg, NULL, 10);
+            break;
+        case 'r':
+            bench.rate = strtod(optarg, NULL);
+            break;
+        case 'd':
+            bench.duration = strtoul(optarg, NULL, 10);
+            break;
+        case 'm':
+            if (bench_parse_mix(optarg)) {
+                goto cleanup;
+            }
+            break;
+        case 'f':
+            bench.filter = optarg;
+            break;
+        case 'e':
+            if (bench_read_content(optarg)) {
+                goto cleanup;
+            }
+            break;
+        case 's':
+            bench.subscribed = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            bench.timeout = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            bench_help();
+            goto cleanup;
+        }
+    }
+
+    if (!bench.sessions || !bench.duration || !bench.timeout || (bench.rate < 0)) {
+        ERROR("netopeer2-bench", "Invalid sessions, duration, timeout, or rate.");
+        goto cleanup;
+    }
+    if (bench.subscribed > bench.sessions) {
+        bench.subscribed = bench.sessions;
+    }
+    if (bench.weights[BENCH_EDITCONFIG] && !bench.edit_content) {
+        ERROR("netopeer2-bench", "Edit-config requires its content.");
+        goto cleanup;
+    }
+    if (output && !(out = fopen(output, "w"))) {
+        ERROR("netopeer2-bench", "Opening \"%s\" failed (%s).", output, strerror(errno));
+        out = stdout;
+        goto cleanup;
+    }
+
+    nc_client_init();
+    initialized = 1;
+
+    memset(&action, 0, sizeof action);
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &action, NULL);
+    action.sa_handler = bench_signal_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    nc_set_print_clb(bench_print_clb);
+    ly_set_log_clb(bench_ly_print_clb, 1);
+
+    /* the same authentication as netopeer2-cli */
+    load_config();
+
+    thrs = calloc(bench.sessions, sizeof *thrs);
+    if (!thrs || (asprintf(&cmd, "connect %s", connect_args) == -1)) {
+        ERROR("netopeer2-bench", "Memory allocation failed.");
+        goto cleanup;
+    }
+
+    /* connect all the sessions */
+    for (connected = 0; (connected < bench.sessions) && !bench.stop; ++connected) {
+        if (cmd_connect(cmd, NULL)) {
+            goto cleanup;
+        }
+        thrs[connected].session = session;
+        session = NULL;
+
+        thrs[connected].subscribe = (connected < bench.subscribed);
+        thrs[connected].seed = connected + 1;
+    }
+    fprintf(stderr, "Connected %" PRIu32 " sessions, running for %" PRIu32 " s...\n", connected, bench.duration);
+
+    /* only the connected sessions are run and reported, if interrupted */
+    bench.sessions = connected;
+    if (bench.subscribed > connected) {
+        bench.subscribed = connected;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &bench.start);
+    bench.end = bench.start;
+    bench_addtimespec_ns(&bench.end, bench.duration * 1000000000ULL);
+
+    for (i = 0; i < bench.sessions; ++i) {
+        if ((r = pthread_create(&thrs[i].tid, NULL, bench_thread, &thrs[i]))) {
+            ERROR("netopeer2-bench", "Creating a thread failed (%s).", strerror(r));
+            bench.stop = 1;
+            for (j = 0; j < i; ++j) {
+                pthread_join(thrs[j].tid, NULL);
+            }
+            goto cleanup;
+        }
+    }
+    for (i = 0; i < bench.sessions; ++i) {
+        pthread_join(thrs[i].tid, NULL);
+    }
+
+    if (bench_report(out, thrs)) {
+        goto cleanup;
+    }
+    ret = EXIT_SUCCESS;
+
+cleanup:
+    if (thrs) {
+        for (i = 0; i < connected; ++i) {
+            nc_session_free(thrs[i].session, NULL);
+            for (j = 0; j < BENCH_OP_COUNT; ++j) {
+                free(thrs[i].res[j].lat);
+            }
+        }
+        free(thrs);
+    }
+    if (initialized) {
+        nc_client_destroy();
+    }
+    free(cmd);
+    free(bench.edit_content);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return ret;
+}
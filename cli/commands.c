@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <stdarg.h>
+#include <inttypes.h>
 #include <ctype.h>
 
 #include <libyang/libyang.h>
@@ -47,6 +48,10 @@
 
 #define CLI_CH_TIMEOUT 60 /* 1 minute */
 #define CLI_RPC_REPLY_TIMEOUT 5 /* 5 seconds */
+#define CLI_BATCH_WINDOW 16 /* outstanding RPCs in batch mode */
+
+/* RPC parameters must outlive the command in batch mode */
+#define CLI_PARAMTYPE (batch ? NC_PARAMTYPE_DUP_AND_FREE : NC_PARAMTYPE_CONST)
 
 #define NC_CAP_WRITABLERUNNING_ID "urn:ietf:params:netconf:capability:writable-running"
 #define NC_CAP_CANDIDATE_ID       "urn:ietf:params:netconf:capability:candidate"
@@ -81,6 +86,35 @@ struct arglist {
     int size;
 };
 
+/* RPC sent in batch mode waiting for its reply */
+struct cli_batch_rpc {
+    struct nc_rpc *rpc;
+    uint64_t msgid;
+    NC_WD_MODE wd_mode;
+    uint32_t line;
+    struct timespec ts_start;
+};
+
+/* batch mode state, replies are received in the order the RPCs were sent */
+struct cli_batch {
+    struct cli_batch_rpc *rpcs;     /* ring buffer of outstanding RPCs */
+    uint32_t window;
+    uint32_t first;
+    uint32_t count;
+    uint32_t line;                  /* line of the command being executed */
+    FILE *output;
+    int timeout_s;
+
+    uint32_t replies;
+    uint32_t failed;
+    int32_t msec_min;
+    int32_t msec_max;
+    int64_t msec_total;
+    int mono;
+};
+
+static struct cli_batch *batch;
+
 static void
 init_arglist(struct arglist *args)
 {
@@ -275,70 +309,14 @@ cli_difftimespec(const struct timespec *ts1, const struct timespec *ts2)
 }
 
 static int
-cli_send_recv(struct nc_rpc *rpc, FILE *output, NC_WD_MODE wd_mode, int timeout_s)
+cli_print_reply(struct nc_rpc *rpc, struct nc_reply *reply, FILE *output, NC_WD_MODE wd_mode)
 {
     char *str, *model_data;
-    int ret = 0, ly_wd, mono;
-    int32_t msec;
+    int ret = 0, ly_wd;
     uint16_t i, j;
-    uint64_t msgid;
     struct lyd_node_anydata *any;
-    NC_MSG_TYPE msgtype;
-    struct nc_reply *reply;
     struct nc_reply_data *data_rpl;
     struct nc_reply_error *error;
-    struct timespec ts_start, ts_stop;
-
-    if (timed) {
-        ret = cli_gettimespec(&ts_start, &mono);
-        if (ret) {
-            ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
-            return ret;
-        }
-    }
-
-    msgtype = nc_send_rpc(session, rpc, 1000, &msgid);
-    if (msgtype == NC_MSG_ERROR) {
-        ERROR(__func__, "Failed to send the RPC.");
-        if (nc_session_get_status(session) != NC_STATUS_RUNNING) {
-            cmd_disconnect(NULL, NULL);
-        }
-        return -1;
-    } else if (msgtype == NC_MSG_WOULDBLOCK) {
-        ERROR(__func__, "Timeout for sending the RPC expired.");
-        return -1;
-    }
-
-recv_reply:
-    msgtype = nc_recv_reply(session, rpc, msgid, timeout_s * 1000,
-                            LYD_OPT_DESTRUCT | LYD_OPT_NOSIBLINGS, &reply);
-    if (msgtype == NC_MSG_ERROR) {
-        ERROR(__func__, "Failed to receive a reply.");
-        if (nc_session_get_status(session) != NC_STATUS_RUNNING) {
-            cmd_disconnect(NULL, NULL);
-        }
-        return -1;
-    } else if (msgtype == NC_MSG_WOULDBLOCK) {
-        ERROR(__func__, "Timeout for receiving a reply expired.");
-        return -1;
-    } else if (msgtype == NC_MSG_NOTIF) {
-        /* read again */
-        goto recv_reply;
-    } else if (msgtype == NC_MSG_REPLY_ERR_MSGID) {
-        /* unexpected message, try reading again to get the correct reply */
-        ERROR(__func__, "Unexpected reply received - ignoring and waiting for the correct reply.");
-        nc_reply_free(reply);
-        goto recv_reply;
-    }
-
-    if (timed) {
-        ret = cli_gettimespec(&ts_stop, &mono);
-        if (ret) {
-            ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
-            nc_reply_free(reply);
-            return ret;
-        }
-    }
 
     switch (reply->type) {
     case NC_RPL_OK:
@@ -485,19 +463,248 @@ recv_reply:
         break;
     default:
         ERROR(__func__, "Internal error.");
+        ret = -1;
+        break;
+    }
+
+    return ret;
+}
+
+static void
+cli_print_msec(FILE *output, const char *label, int32_t msec)
+{
+    fprintf(output, "%s %2dm%d.%03ds\n", label, msec / 60000, (msec % 60000) / 1000, msec % 1000);
+}
+
+static int
+cli_recv_reply(struct nc_rpc *rpc, uint64_t msgid, int timeout_s, struct nc_reply **reply)
+{
+    NC_MSG_TYPE msgtype;
+
+recv_reply:
+    msgtype = nc_recv_reply(session, rpc, msgid, timeout_s * 1000,
+                            LYD_OPT_DESTRUCT | LYD_OPT_NOSIBLINGS, reply);
+    if (msgtype == NC_MSG_ERROR) {
+        ERROR(__func__, "Failed to receive a reply.");
+        if (nc_session_get_status(session) != NC_STATUS_RUNNING) {
+            cmd_disconnect(NULL, NULL);
+        }
+        return -1;
+    } else if (msgtype == NC_MSG_WOULDBLOCK) {
+        ERROR(__func__, "Timeout for receiving a reply expired.");
+        return -1;
+    } else if (msgtype == NC_MSG_NOTIF) {
+        /* read again */
+        goto recv_reply;
+    } else if (msgtype == NC_MSG_REPLY_ERR_MSGID) {
+        /* unexpected message, try reading again to get the correct reply */
+        ERROR(__func__, "Unexpected reply received - ignoring and waiting for the correct reply.");
+        nc_reply_free(*reply);
+        goto recv_reply;
+    }
+
+    return 0;
+}
+
+static int
+cli_send_rpc(struct nc_rpc *rpc, uint64_t *msgid)
+{
+    NC_MSG_TYPE msgtype;
+
+    msgtype = nc_send_rpc(session, rpc, 1000, msgid);
+    if (msgtype == NC_MSG_ERROR) {
+        ERROR(__func__, "Failed to send the RPC.");
+        if (nc_session_get_status(session) != NC_STATUS_RUNNING) {
+            cmd_disconnect(NULL, NULL);
+        }
+        return -1;
+    } else if (msgtype == NC_MSG_WOULDBLOCK) {
+        ERROR(__func__, "Timeout for sending the RPC expired.");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+cli_batch_stats(int ret, int32_t msec)
+{
+    if (ret) {
+        ++batch->failed;
+    }
+
+    if (!batch->replies || (msec < batch->msec_min)) {
+        batch->msec_min = msec;
+    }
+    if (msec > batch->msec_max) {
+        batch->msec_max = msec;
+    }
+    batch->msec_total += msec;
+    ++batch->replies;
+}
+
+static void
+cli_batch_abort(void)
+{
+    /* replies of the remaining RPCs can no longer be matched */
+    while (batch->count) {
+        nc_rpc_free(batch->rpcs[batch->first].rpc);
+        batch->first = (batch->first + 1) % batch->window;
+        --batch->count;
+        ++batch->failed;
+    }
+}
+
+static int
+cli_batch_recv(void)
+{
+    struct cli_batch_rpc *brpc;
+    struct nc_reply *reply;
+    struct timespec ts_stop;
+    int ret;
+    int32_t msec;
+
+    brpc = &batch->rpcs[batch->first];
+
+    if (!session) {
+        ERROR(__func__, "Not connected to a NETCONF server, reply to the RPC on line %u cannot be received.", brpc->line);
+        ret = -1;
+    } else {
+        ret = cli_recv_reply(brpc->rpc, brpc->msgid, batch->timeout_s, &reply);
+    }
+    if (!ret) {
+        ret = cli_gettimespec(&ts_stop, &batch->mono);
+        if (ret) {
+            ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
+        } else {
+            ret = cli_print_reply(brpc->rpc, reply, batch->output, brpc->wd_mode);
+            if (ret == 1) {
+                ERROR(__func__, "RPC on line %u failed.", brpc->line);
+            }
+
+            msec = cli_difftimespec(&brpc->ts_start, &ts_stop);
+            if (timed) {
+                cli_print_msec(batch->output, batch->mono ? "mono" : "real", msec);
+            }
+            cli_batch_stats(ret, msec);
+        }
         nc_reply_free(reply);
+    } else {
+        ++batch->failed;
+    }
+
+    nc_rpc_free(brpc->rpc);
+    batch->first = (batch->first + 1) % batch->window;
+    --batch->count;
+
+    if (ret < 0) {
+        cli_batch_abort();
         return -1;
     }
-    nc_reply_free(reply);
+    return 0;
+}
 
-    if (msgtype == NC_MSG_REPLY_ERR_MSGID) {
-        ERROR(__func__, "Trying to receive another message...\n");
-        goto recv_reply;
+static int
+cli_batch_drain(void)
+{
+    while (batch->count) {
+        if (cli_batch_recv()) {
+            return -1;
+        }
     }
 
-    if (timed) {
+    return 0;
+}
+
+static int
+cli_batch_send(struct nc_rpc **rpc, NC_WD_MODE wd_mode)
+{
+    struct cli_batch_rpc *brpc;
+
+    /* wait for the oldest reply if the window is full */
+    if ((batch->count == batch->window) && cli_batch_recv()) {
+        return -1;
+    }
+
+    brpc = &batch->rpcs[(batch->first + batch->count) % batch->window];
+    if (cli_gettimespec(&brpc->ts_start, &batch->mono)) {
+        ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
+        return -1;
+    }
+    if (cli_send_rpc(*rpc, &brpc->msgid)) {
+        return -1;
+    }
+
+    /* the RPC is freed once its reply is received */
+    brpc->rpc = *rpc;
+    brpc->wd_mode = wd_mode;
+    brpc->line = batch->line;
+    ++batch->count;
+    *rpc = NULL;
+
+    return 0;
+}
+
+static int
+cli_send_recv(struct nc_rpc **rpc, FILE *output, NC_WD_MODE wd_mode, int timeout_s)
+{
+    int ret = 0, mono;
+    int32_t msec;
+    uint64_t msgid;
+    struct nc_reply *reply;
+    struct timespec ts_start, ts_stop;
+
+    if (batch) {
+        if (nc_rpc_get_type(*rpc) != NC_RPC_SUBSCRIBE) {
+            return cli_batch_send(rpc, wd_mode);
+        }
+
+        /* subscription must be confirmed before the notification thread is created */
+        if (cli_batch_drain()) {
+            return -1;
+        }
+        output = batch->output;
+        timeout_s = batch->timeout_s;
+    }
+
+    if (timed || batch) {
+        ret = cli_gettimespec(&ts_start, &mono);
+        if (ret) {
+            ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
+            return ret;
+        }
+    }
+
+    if (cli_send_rpc(*rpc, &msgid)) {
+        return -1;
+    }
+    if (cli_recv_reply(*rpc, msgid, timeout_s, &reply)) {
+        if (batch) {
+            ++batch->failed;
+        }
+        return -1;
+    }
+
+    if (timed || batch) {
+        ret = cli_gettimespec(&ts_stop, &mono);
+        if (ret) {
+            ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
+            nc_reply_free(reply);
+            return ret;
+        }
+    }
+
+    ret = cli_print_reply(*rpc, reply, output, wd_mode);
+    nc_reply_free(reply);
+
+    if (timed || batch) {
         msec = cli_difftimespec(&ts_start, &ts_stop);
-        fprintf(output, "%s %2dm%d.%03ds\n", mono ? "mono" : "real", msec / 60000, (msec % 60000) / 1000, msec % 1000);
+        if (timed) {
+            cli_print_msec(output, mono ? "mono" : "real", msec);
+        }
+        if (batch) {
+            cli_batch_stats(ret, msec);
+        }
     }
 
     return ret;
@@ -1151,6 +1358,16 @@ cmd_timed_help(void)
     printf("timed [--help] [on | off]\n");
 }
 
+void
+cmd_batch_help(void)
+{
+    printf("batch [--help] [--window <count>] [--out <file>] [--rpc-timeout <seconds>] <file>\n\n"
+           "  Execute the commands in <file>, one per line, without waiting for the reply\n"
+           "  of an RPC before sending the next one. At most <count> (default %d) RPCs are\n"
+           "  outstanding at a time. All the replies are printed in order followed by\n"
+           "  the RPC timing summary. Empty lines and lines starting with '#' are skipped.\n", CLI_BATCH_WINDOW);
+}
+
 #ifdef NC_ENABLED_SSH
 
 void
@@ -2932,13 +3149,13 @@ cmd_cancelcommit(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    rpc = nc_rpc_cancel(persist_id, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_cancel(persist_id, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -3023,13 +3240,13 @@ cmd_commit(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    rpc = nc_rpc_commit(confirmed, confirm_timeout, persist, persist_id, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_commit(confirmed, confirm_timeout, persist, persist_id, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -3220,13 +3437,13 @@ cmd_copyconfig(const char *arg, char **tmp_config_file)
     }
 
     /* create requests */
-    rpc = nc_rpc_copy(target, trg, source, src_start, wd, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_copy(target, trg, source, src_start, wd, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -3315,13 +3532,13 @@ cmd_deleteconfig(const char *arg, char **UNUSED(tmp_config_file))
     }
 
     /* create requests */
-    rpc = nc_rpc_delete(target, trg, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_delete(target, trg, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -3394,7 +3611,7 @@ cmd_discardchanges(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -3592,13 +3809,13 @@ cmd_editconfig(const char *arg, char **tmp_config_file)
         goto fail;
     }
 
-    rpc = nc_rpc_edit(target, op, test, err, cont_start, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_edit(target, op, test, err, cont_start, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -3759,16 +3976,16 @@ cmd_get(const char *arg, char **tmp_config_file)
     }
 
     /* create requests */
-    rpc = nc_rpc_get(filter, wd, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_get(filter, wd, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
     if (output) {
-        ret = cli_send_recv(rpc, output, wd, timeout);
+        ret = cli_send_recv(&rpc, output, wd, timeout);
     } else {
-        ret = cli_send_recv(rpc, stdout, wd, timeout);
+        ret = cli_send_recv(&rpc, stdout, wd, timeout);
     }
 
     nc_rpc_free(rpc);
@@ -3953,16 +4170,16 @@ cmd_getconfig(const char *arg, char **tmp_config_file)
     }
 
     /* create requests */
-    rpc = nc_rpc_getconfig(source, filter, wd, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_getconfig(source, filter, wd, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
     if (output) {
-        ret = cli_send_recv(rpc, output, wd, timeout);
+        ret = cli_send_recv(&rpc, output, wd, timeout);
     } else {
-        ret = cli_send_recv(rpc, stdout, wd, timeout);
+        ret = cli_send_recv(&rpc, stdout, wd, timeout);
     }
 
     nc_rpc_free(rpc);
@@ -4056,7 +4273,7 @@ cmd_killsession(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -4149,7 +4366,7 @@ cmd_lock(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -4242,7 +4459,7 @@ cmd_unlock(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -4401,13 +4618,13 @@ cmd_validate(const char *arg, char **tmp_config_file)
     }
 
     /* create requests */
-    rpc = nc_rpc_validate(source, src_start, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_validate(source, src_start, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -4580,13 +4797,13 @@ cmd_subscribe(const char *arg, char **tmp_config_file)
     }
 
     /* create requests */
-    rpc = nc_rpc_subscribe(stream, filter, start, stop, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_subscribe(stream, filter, start, stop, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
     nc_rpc_free(rpc);
 
     if (ret) {
@@ -4715,16 +4932,16 @@ cmd_getschema(const char *arg, char **UNUSED(tmp_config_file))
         goto fail;
     }
 
-    rpc = nc_rpc_getschema(model, version, format, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_getschema(model, version, format, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
     if (output) {
-        ret = cli_send_recv(rpc, output, 0, timeout);
+        ret = cli_send_recv(&rpc, output, 0, timeout);
     } else {
-        ret = cli_send_recv(rpc, stdout, 0, timeout);
+        ret = cli_send_recv(&rpc, stdout, 0, timeout);
     }
 
     nc_rpc_free(rpc);
@@ -4952,16 +5169,16 @@ cmd_getdata(const char *arg, char **tmp_config_file)
 
     /* create requests */
     rpc = nc_rpc_getdata(datastore, filter, config, origin, origin_count, negated_origin, depth, with_origin, wd,
-                         NC_PARAMTYPE_CONST);
+                         CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
     if (output) {
-        ret = cli_send_recv(rpc, output, wd, timeout);
+        ret = cli_send_recv(&rpc, output, wd, timeout);
     } else {
-        ret = cli_send_recv(rpc, stdout, wd, timeout);
+        ret = cli_send_recv(&rpc, stdout, wd, timeout);
     }
 
     nc_rpc_free(rpc);
@@ -5146,13 +5363,13 @@ cmd_editdata(const char *arg, char **tmp_config_file)
         goto fail;
     }
 
-    rpc = nc_rpc_editdata(datastore, op, cont_start, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_editdata(datastore, op, cont_start, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
-    ret = cli_send_recv(rpc, stdout, 0, timeout);
+    ret = cli_send_recv(&rpc, stdout, 0, timeout);
 
     nc_rpc_free(rpc);
 
@@ -5280,16 +5497,16 @@ cmd_userrpc(const char *arg, char **tmp_config_file)
     }
 
     /* create requests */
-    rpc = nc_rpc_act_generic_xml(content, NC_PARAMTYPE_CONST);
+    rpc = nc_rpc_act_generic_xml(content, CLI_PARAMTYPE);
     if (!rpc) {
         ERROR(__func__, "RPC creation failed.");
         goto fail;
     }
 
     if (output) {
-        ret = cli_send_recv(rpc, output, 0, timeout);
+        ret = cli_send_recv(&rpc, output, 0, timeout);
     } else {
-        ret = cli_send_recv(rpc, stdout, 0, timeout);
+        ret = cli_send_recv(&rpc, stdout, 0, timeout);
     }
 
     nc_rpc_free(rpc);
@@ -5326,6 +5543,189 @@ cmd_timed(const char *arg, char **UNUSED(tmp_config_file))
     return 0;
 }
 
+int
+cmd_batch(const char *arg, char **UNUSED(tmp_config_file))
+{
+    int c, i, ret = EXIT_FAILURE, window = CLI_BATCH_WINDOW, timeout = CLI_RPC_REPLY_TIMEOUT;
+    char *line = NULL, *cmdstart, *cmd_name = NULL, *tmp_file;
+    size_t line_len = 0, j;
+    ssize_t len;
+    FILE *input = NULL, *output = NULL;
+    struct cli_batch b;
+    struct timespec ts_start, ts_stop;
+    struct arglist cmd;
+    struct option long_options[] = {
+            {"help", 0, 0, 'h'},
+            {"window", 1, 0, 'w'},
+            {"out", 1, 0, 'o'},
+            {"rpc-timeout", 1, 0, 'r'},
+            {0, 0, 0, 0}
+    };
+    int option_index = 0;
+
+    /* set back to start to be able to use getopt() repeatedly */
+    optind = 0;
+
+    init_arglist(&cmd);
+    if (addargs(&cmd, "%s", arg)) {
+        return EXIT_FAILURE;
+    }
+
+    while ((c = getopt_long(cmd.count, cmd.list, "hw:o:r:", long_options, &option_index)) != -1) {
+        switch (c) {
+        case 'h':
+            cmd_batch_help();
+            ret = EXIT_SUCCESS;
+            goto fail;
+        case 'w':
+            window = atoi(optarg);
+            if (window < 1) {
+                ERROR(__func__, "Invalid window \"%s\".", optarg);
+                goto fail;
+            }
+            break;
+        case 'o':
+            if (output) {
+                ERROR(__func__, "Duplicated \"out\" option.");
+                cmd_batch_help();
+                goto fail;
+            }
+            output = fopen(optarg, "w");
+            if (!output) {
+                ERROR(__func__, "Failed to open file \"%s\" (%s).", optarg, strerror(errno));
+                goto fail;
+            }
+            break;
+        case 'r':
+            timeout = atoi(optarg);
+            if (!timeout) {
+                ERROR(__func__, "Invalid timeout \"%s\".", optarg);
+                goto fail;
+            }
+            break;
+        default:
+            ERROR(__func__, "Unknown option -%c.", c);
+            cmd_batch_help();
+            goto fail;
+        }
+    }
+
+    if (!cmd.list[optind]) {
+        ERROR(__func__, "Missing the file with commands.");
+        cmd_batch_help();
+        goto fail;
+    } else if (cmd.list[optind + 1]) {
+        ERROR(__func__, "Unparsed command arguments.");
+        cmd_batch_help();
+        goto fail;
+    }
+
+    if (batch) {
+        ERROR(__func__, "Nested batches are not supported.");
+        goto fail;
+    }
+
+    input = fopen(cmd.list[optind], "r");
+    if (!input) {
+        ERROR(__func__, "Failed to open file \"%s\" (%s).", cmd.list[optind], strerror(errno));
+        goto fail;
+    }
+
+    memset(&b, 0, sizeof b);
+    b.rpcs = malloc(window * sizeof *b.rpcs);
+    if (!b.rpcs) {
+        ERROR(__func__, "Memory allocation failed (%s:%d)", __FILE__, __LINE__);
+        goto fail;
+    }
+    b.window = window;
+    b.output = output ? output : stdout;
+    b.timeout_s = timeout;
+
+    if (cli_gettimespec(&ts_start, &b.mono)) {
+        ERROR(__func__, "Getting current time failed (%s).", strerror(errno));
+        free(b.rpcs);
+        goto fail;
+    }
+
+    ret = EXIT_SUCCESS;
+    batch = &b;
+    while (!done && ((len = getline(&line, &line_len, input)) != -1)) {
+        ++b.line;
+        if (len && (line[len - 1] == '\n')) {
+            line[len - 1] = '\0';
+        }
+
+        /* isolate the command word */
+        for (cmdstart = line; *cmdstart == ' '; ++cmdstart);
+        if (!*cmdstart || (*cmdstart == '#')) {
+            continue;
+        }
+        for (j = 0; cmdstart[j] && (cmdstart[j] != ' '); ++j);
+        free(cmd_name);
+        cmd_name = strndup(cmdstart, j);
+
+        for (i = 0; commands[i].name; i++) {
+            if (!strcmp(cmd_name, commands[i].name)) {
+                break;
+            }
+        }
+        if (!commands[i].name) {
+            ERROR(__func__, "%s: No such command (line %u).", cmd_name, b.line);
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        /* these commands change the session, all the replies must be received first */
+        if (((commands[i].func == cmd_connect) || (commands[i].func == cmd_listen)
+                || (commands[i].func == cmd_disconnect)) && cli_batch_drain()) {
+            ret = EXIT_FAILURE;
+            break;
+        }
+
+        tmp_file = NULL;
+        if (commands[i].func(cmdstart, &tmp_file)) {
+            ERROR(__func__, "Command on line %u failed.", b.line);
+            free(tmp_file);
+            ret = EXIT_FAILURE;
+            break;
+        }
+        free(tmp_file);
+    }
+
+    /* receive the remaining replies */
+    if (cli_batch_drain()) {
+        ret = EXIT_FAILURE;
+    }
+    batch = NULL;
+
+    if (!cli_gettimespec(&ts_stop, &b.mono)) {
+        fprintf(b.output, "%" PRIu32 " RPCs, %" PRIu32 " failed, %s clock\n", b.replies, b.failed,
+                b.mono ? "mono" : "real");
+        cli_print_msec(b.output, "total", cli_difftimespec(&ts_start, &ts_stop));
+        if (b.replies) {
+            cli_print_msec(b.output, "min  ", b.msec_min);
+            cli_print_msec(b.output, "avg  ", b.msec_total / b.replies);
+            cli_print_msec(b.output, "max  ", b.msec_max);
+        }
+    }
+    if (b.failed) {
+        ret = EXIT_FAILURE;
+    }
+    free(b.rpcs);
+
+fail:
+    clear_arglist(&cmd);
+    if (input) {
+        fclose(input);
+    }
+    if (output) {
+        fclose(output);
+    }
+    free(line);
+    free(cmd_name);
+    return ret;
+}
+
 COMMAND commands[] = {
 #ifdef NC_ENABLED_SSH
         {"auth", cmd_auth, cmd_auth_help, "Manage SSH authentication options"},
@@ -5364,6 +5764,7 @@ COMMAND commands[] = {
         {"edit-data", cmd_editdata, cmd_editdata_help, "ietf-netconf-nmda <edit-data> operation"},
         {"user-rpc", cmd_userrpc, cmd_userrpc_help, "Send your own content in an RPC envelope"},
         {"timed", cmd_timed, cmd_timed_help, "Time all the commands (that communicate with a server) from issuing a RPC to getting a reply"},
+        {"batch", cmd_batch, cmd_batch_help, "Execute commands from a file with pipelined RPCs"},
         /* synonyms for previous commands */
         {"?", cmd_help, NULL, "Display commands description"},
         {"exit", cmd_quit, NULL, "Quit the program"},
@@ -0,0 +1,583 @@
+/**
+ * @file authkeys_cache.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of users authorized SSH keys
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libssh/libssh.h>
+
+#include "config.h"
+#include "authkeys_cache.h"
+#include "hash_table.h"
+#include "log.h"
+
+/* length of a key fingerprint (SHA256) */
+#define NP_AK_FP_LEN 32
+
+/**
+ * @brief Authorized key.
+ */
+struct np_ak_key {
+    char *alg;                      /**< key algorithm */
+    char *data;                     /**< base64-encoded key data */
+    unsigned char fp[NP_AK_FP_LEN]; /**< key fingerprint */
+    ssh_key key;                    /**< imported public key */
+};
+
+/**
+ * @brief Cached authorized keys of a user.
+ */
+struct np_ak_user {
+    char *name;                     /**< user name */
+    char *path;                     /**< authorized_keys file path */
+    time_t resolved;                /**< timestamp of learning the path from the passwd entry */
+
+    int loaded;                     /**< whether the keys are loaded from the file identified below */
+    dev_t dev;                      /**< file device, 0 if there is no file */
+    ino_t ino;                      /**< file inode */
+    struct timespec mtime;          /**< file last modification */
+    off_t size;                     /**< file size */
+
+    struct np_ak_key *keys;         /**< authorized keys */
+    uint32_t key_count;             /**< number of authorized keys */
+    struct np_ht *fp_ht;            /**< hash table of the keys by their fingerprints (struct np_ak_key *) */
+};
+
+static struct {
+    pthread_mutex_t lock;           /**< lock for all the members */
+    struct np_ht *users;            /**< hash table of all the users (struct np_ak_user *) */
+} akcache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int
+np_ak_user_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct np_ak_user *user1 = *(struct np_ak_user **)val1_p, *user2 = *(struct np_ak_user **)val2_p;
+
+    return !strcmp(user1->name, user2->name);
+}
+
+static int
+np_ak_key_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct np_ak_key *key1 = *(struct np_ak_key **)val1_p, *key2 = *(struct np_ak_key **)val2_p;
+
+    return !memcmp(key1->fp, key2->fp, NP_AK_FP_LEN);
+}
+
+static uint32_t
+np_ak_str_hash(const char *str)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, str, strlen(str));
+    return np_hash_multi(hash, NULL, 0);
+}
+
+static uint32_t
+np_ak_fp_hash(const unsigned char *fp)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, fp, NP_AK_FP_LEN);
+    return np_hash_multi(hash, NULL, 0);
+}
+
+/**
+ * @brief Learn the fingerprint of a public key.
+ *
+ * @param[in] key Public key.
+ * @param[out] fp Key fingerprint.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ak_fingerprint(const ssh_key key, unsigned char *fp)
+{
+    unsigned char *hash;
+    size_t hlen;
+
+    if (ssh_get_publickey_hash(key, SSH_PUBLICKEY_HASH_SHA256, &hash, &hlen)) {
+        ERR("Failed to get public key fingerprint.");
+        return -1;
+    }
+
+    memset(fp, 0, NP_AK_FP_LEN);
+    memcpy(fp, hash, hlen < NP_AK_FP_LEN ? hlen : NP_AK_FP_LEN);
+    ssh_clean_pubkey_hash(&hash);
+    return 0;
+}
+
+static void
+np_ak_keys_clear(struct np_ak_user *user)
+{
+    uint32_t i;
+
+    for (i = 0; i < user->key_count; ++i) {
+        free(user->keys[i].alg);
+        free(user->keys[i].data);
+        ssh_key_free(user->keys[i].key);
+    }
+    free(user->keys);
+    user->keys = NULL;
+    user->key_count = 0;
+    np_ht_clear(user->fp_ht);
+    user->loaded = 0;
+}
+
+static void
+np_ak_user_free(struct np_ak_user *user)
+{
+    if (!user) {
+        return;
+    }
+
+    if (user->fp_ht) {
+        np_ak_keys_clear(user);
+        np_ht_free(user->fp_ht);
+    }
+    free(user->name);
+    free(user->path);
+    free(user);
+}
+
+/**
+ * @brief Get the home directory of a user, thread-safe.
+ *
+ * @param[in] username User name.
+ * @param[out] home_dir Home directory of the user.
+ * @return 0 on success, 1 on user not found, -1 on error.
+ */
+static int
+np_ak_getpwdir(const char *username, char **home_dir)
+{
+    struct passwd pwd, *pwd_p;
+    char *buf = NULL;
+    ssize_t buflen;
+    int ret;
+
+    buflen = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (buflen == -1) {
+        buflen = 2048;
+    }
+    buf = malloc(buflen);
+    if (!buf) {
+        EMEM;
+        return -1;
+    }
+    ret = getpwnam_r(username, &pwd, buf, buflen, &pwd_p);
+    if (ret) {
+        ERR("Getting user \"%s\" pwd entry failed (%s).", username, strerror(ret));
+        free(buf);
+        return -1;
+    } else if (!pwd_p) {
+        free(buf);
+        return 1;
+    }
+
+    *home_dir = strdup(pwd.pw_dir);
+    free(buf);
+    if (!*home_dir) {
+        EMEM;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Set the authorized_keys file path of a user, the keys are loaded again if it changed.
+ *
+ * @param[in] user User to update.
+ * @param[in] home_dir Home directory of the user.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ak_user_set_path(struct np_ak_user *user, const char *home_dir)
+{
+    struct timespec ts;
+    char *path;
+
+    if (asprintf(&path, "%s/.ssh/authorized_keys", home_dir) == -1) {
+        EMEM;
+        return -1;
+    }
+
+    if (!user->path || strcmp(user->path, path)) {
+        free(user->path);
+        user->path = path;
+        np_ak_keys_clear(user);
+    } else {
+        free(path);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    user->resolved = ts.tv_sec;
+    return 0;
+}
+
+/**
+ * @brief Find or create a cached user, lock must be held.
+ *
+ * Only existing users are cached so that authentication attempts with unknown user names do not grow the cache.
+ *
+ * @param[in] username User name.
+ * @param[in] home_dir Home directory of the user, NULL if it should be learned from the passwd entry.
+ * @param[out] user_p Cached user.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ak_user_get(const char *username, const char *home_dir, struct np_ak_user **user_p)
+{
+    struct np_ak_user user_find, *user = NULL, *uptr;
+    struct timespec ts;
+    uint32_t hash;
+    char *home = NULL;
+    void *match;
+    int r;
+
+    if (!akcache.users) {
+        akcache.users = np_ht_new(8, sizeof(struct np_ak_user *), np_ak_user_equal, NULL);
+        if (!akcache.users) {
+            EMEM;
+            return -1;
+        }
+    }
+
+    /* find the user */
+    user_find.name = (char *)username;
+    uptr = &user_find;
+    hash = np_ak_str_hash(username);
+    if (!np_ht_find(akcache.users, &uptr, hash, &match)) {
+        user = *(struct np_ak_user **)match;
+    }
+
+    if (!home_dir) {
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        if (!user || (NP2SRV_PASSWD_TTL && (ts.tv_sec - user->resolved >= NP2SRV_PASSWD_TTL))) {
+            /* learn the passwd entry (again) */
+            r = np_ak_getpwdir(username, &home);
+            if (r == 1) {
+                ERR("Failed to find user entry for \"%s\" (User not found).", username);
+                if (user) {
+                    /* the user was removed */
+                    np_ht_remove(akcache.users, &user, hash);
+                    np_ak_user_free(user);
+                }
+                return -1;
+            } else if (r) {
+                return -1;
+            }
+            home_dir = home;
+        }
+    }
+
+    if (!user) {
+        /* new user */
+        user = calloc(1, sizeof *user);
+        if (!user) {
+            EMEM;
+            goto error;
+        }
+        user->name = strdup(username);
+        user->fp_ht = np_ht_new(8, sizeof(struct np_ak_key *), np_ak_key_equal, NULL);
+        if (!user->name || !user->fp_ht) {
+            EMEM;
+            goto error;
+        }
+        if (np_ak_user_set_path(user, home_dir)) {
+            goto error;
+        }
+        if (np_ht_insert(akcache.users, &user, hash, NULL) == -1) {
+            EMEM;
+            goto error;
+        }
+    } else if (home_dir && np_ak_user_set_path(user, home_dir)) {
+        /* passwd entry (re)learned */
+        free(home);
+        return -1;
+    }
+
+    free(home);
+    *user_p = user;
+    return 0;
+
+error:
+    np_ak_user_free(user);
+    free(home);
+    return -1;
+}
+
+/**
+ * @brief Parse an authorized_keys file line and add the key.
+ *
+ * @param[in] user User with the keys.
+ * @param[in] line Line to parse, is modified.
+ * @param[in] line_num Line number.
+ * @return 0 on success (including skipped lines), -1 on error.
+ */
+static int
+np_ak_parse_line(struct np_ak_user *user, char *line, int line_num)
+{
+    enum ssh_keytypes_e ktype = SSH_KEYTYPE_UNKNOWN;
+    struct np_ak_key *key;
+    char *ptr, *ptr2, *alg = NULL, c;
+    ssh_key pub_key;
+    void *mem;
+    int r;
+
+    /* skip empty lines and comments */
+    for (ptr = line; isspace(ptr[0]); ++ptr);
+    if ((ptr[0] == '\0') || (ptr[0] == '#')) {
+        return 0;
+    }
+
+    /* find the key type, there may be options before it */
+    while (ptr[0]) {
+        for (ptr2 = ptr; ptr2[0] && !isspace(ptr2[0]); ++ptr2);
+        c = ptr2[0];
+        ptr2[0] = '\0';
+
+        ktype = ssh_key_type_from_name(ptr);
+        if (ktype != SSH_KEYTYPE_UNKNOWN) {
+            alg = ptr;
+            ptr = c ? ptr2 + 1 : ptr2;
+            break;
+        }
+
+        ptr2[0] = c;
+        for (ptr = ptr2; isspace(ptr[0]); ++ptr);
+    }
+    if (!alg) {
+        WRN("Unknown key type of \"%s\" (line %d).", user->name, line_num);
+        return 0;
+    }
+
+    /* separate key data */
+    for (; isspace(ptr[0]); ++ptr);
+    for (ptr2 = ptr; ptr2[0] && !isspace(ptr2[0]); ++ptr2);
+    ptr2[0] = '\0';
+    if (ptr[0] == '\0') {
+        WRN("Invalid authorized key format of \"%s\" (line %d).", user->name, line_num);
+        return 0;
+    }
+
+    r = ssh_pki_import_pubkey_base64(ptr, ktype, &pub_key);
+    if (r != SSH_OK) {
+        WRN("Failed to import authorized key of \"%s\" (%s, line %d).",
+                user->name, r == SSH_EOF ? "Unexpected end-of-file" : "SSH error", line_num);
+        return 0;
+    }
+
+    /* add the key */
+    mem = realloc(user->keys, (user->key_count + 1) * sizeof *user->keys);
+    if (!mem) {
+        EMEM;
+        ssh_key_free(pub_key);
+        return -1;
+    }
+    user->keys = mem;
+    key = &user->keys[user->key_count];
+    memset(key, 0, sizeof *key);
+    key->key = pub_key;
+    ++user->key_count;
+
+    key->alg = strdup(alg);
+    key->data = strdup(ptr);
+    if (!key->alg || !key->data) {
+        EMEM;
+        return -1;
+    }
+    if (np_ak_fingerprint(pub_key, key->fp)) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Load the authorized keys of a user if the file changed, lock must be held.
+ *
+ * @param[in] user User to load.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ak_user_load(struct np_ak_user *user)
+{
+    struct stat st;
+    struct np_ak_key *kptr;
+    FILE *f = NULL;
+    char *line = NULL;
+    size_t n = 0;
+    uint32_t i;
+    int line_num = 0, rc = -1;
+
+    if (stat(user->path, &st) == -1) {
+        if (errno != ENOENT) {
+            ERR("Failed to open \"%s\" authorized_keys file (%s).", user->path, strerror(errno));
+            return -1;
+        }
+        if (!user->loaded || user->dev) {
+            VRB("User \"%s\" has no authorized_keys file.", user->name);
+            np_ak_keys_clear(user);
+            user->dev = 0;
+            user->loaded = 1;
+        }
+        return 0;
+    }
+
+    if (user->loaded && (user->dev == st.st_dev) && (user->ino == st.st_ino) && (user->size == st.st_size)
+            && (user->mtime.tv_sec == st.st_mtim.tv_sec) && (user->mtime.tv_nsec == st.st_mtim.tv_nsec)) {
+        /* not changed */
+        return 0;
+    }
+
+    /* parse the file again */
+    np_ak_keys_clear(user);
+
+    f = fopen(user->path, "r");
+    if (!f) {
+        ERR("Failed to open \"%s\" authorized_keys file (%s).", user->path, strerror(errno));
+        goto cleanup;
+    }
+    if (fstat(fileno(f), &st) == -1) {
+        ERR("Failed to stat \"%s\" authorized_keys file (%s).", user->path, strerror(errno));
+        goto cleanup;
+    }
+
+    while (getline(&line, &n, f) > -1) {
+        ++line_num;
+        if (np_ak_parse_line(user, line, line_num)) {
+            goto cleanup;
+        }
+    }
+    if (!feof(f)) {
+        WRN("Failed reading from authorized_keys file of \"%s\".", user->name);
+        goto cleanup;
+    }
+
+    /* index all the keys */
+    for (i = 0; i < user->key_count; ++i) {
+        kptr = &user->keys[i];
+        if (np_ht_insert(user->fp_ht, &kptr, np_ak_fp_hash(kptr->fp), NULL) == -1) {
+            EMEM;
+            goto cleanup;
+        }
+    }
+
+    user->dev = st.st_dev;
+    user->ino = st.st_ino;
+    user->size = st.st_size;
+    user->mtime = st.st_mtim;
+    user->loaded = 1;
+
+    /* success */
+    rc = 0;
+
+cleanup:
+    if (f) {
+        fclose(f);
+    }
+    free(line);
+    if (rc) {
+        np_ak_keys_clear(user);
+    }
+    return rc;
+}
+
+int
+np_authkeys_check(const char *username, const ssh_key key)
+{
+    struct np_ak_user *user;
+    struct np_ak_key key_find, *kptr;
+    void *match;
+    int ret = 1;
+
+    if (np_ak_fingerprint(key, key_find.fp)) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&akcache.lock);
+
+    if (np_ak_user_get(username, NULL, &user) || np_ak_user_load(user)) {
+        goto cleanup;
+    }
+
+    kptr = &key_find;
+    if (!np_ht_find(user->fp_ht, &kptr, np_ak_fp_hash(key_find.fp), &match)) {
+        kptr = *(struct np_ak_key **)match;
+        if (!ssh_key_cmp(key, kptr->key, SSH_KEY_CMP_PUBLIC)) {
+            /* key matches */
+            ret = 0;
+        }
+    }
+
+cleanup:
+    pthread_mutex_unlock(&akcache.lock);
+    return ret;
+}
+
+int
+np_authkeys_foreach(const char *username, const char *home_dir, np_authkeys_cb cb, void *cb_data)
+{
+    struct np_ak_user *user;
+    uint32_t i;
+    int ret = -1;
+
+    pthread_mutex_lock(&akcache.lock);
+
+    if (np_ak_user_get(username, home_dir, &user) || np_ak_user_load(user)) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < user->key_count; ++i) {
+        ret = cb(user->keys[i].alg, user->keys[i].data, cb_data);
+        if (ret) {
+            goto cleanup;
+        }
+    }
+
+    /* success */
+    ret = 0;
+
+cleanup:
+    pthread_mutex_unlock(&akcache.lock);
+    return ret;
+}
+
+void
+np_authkeys_destroy(void)
+{
+    struct np_ak_user **uptr;
+    uint32_t idx = 0;
+
+    pthread_mutex_lock(&akcache.lock);
+    if (akcache.users) {
+        while ((uptr = np_ht_iter_next(akcache.users, &idx))) {
+            np_ak_user_free(*uptr);
+        }
+        np_ht_free(akcache.users);
+        akcache.users = NULL;
+    }
+    pthread_mutex_unlock(&akcache.lock);
+}
@@ -0,0 +1,57 @@
+/**
+ * @file authkeys_cache.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of users authorized SSH keys header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_AUTHKEYS_CACHE_H_
+#define NP2SRV_AUTHKEYS_CACHE_H_
+
+#include <libssh/libssh.h>
+
+/**
+ * @brief Callback for iterating over authorized keys of a user.
+ *
+ * @param[in] alg Key algorithm.
+ * @param[in] data Base64-encoded key data.
+ * @param[in] cb_data User callback data.
+ * @return 0 to continue, non-zero to stop the iteration with this return value.
+ */
+typedef int (*np_authkeys_cb)(const char *alg, const char *data, void *cb_data);
+
+/**
+ * @brief Check whether a key is among the authorized keys of a user.
+ *
+ * The authorized_keys file is parsed again only if it changed.
+ *
+ * @param[in] username User name.
+ * @param[in] key Public key to check.
+ * @return 0 if authorized, 1 if not or on error.
+ */
+int np_authkeys_check(const char *username, const ssh_key key);
+
+/**
+ * @brief Iterate over all the authorized keys of a user.
+ *
+ * @param[in] username User name.
+ * @param[in] home_dir Home directory of the user, NULL if not known.
+ * @param[in] cb Callback to call for every key.
+ * @param[in] cb_data User data for the callback.
+ * @return 0 on success, -1 on error, or non-zero value returned by @p cb.
+ */
+int np_authkeys_foreach(const char *username, const char *home_dir, np_authkeys_cb cb, void *cb_data);
+
+/**
+ * @brief Free the cache.
+ */
+void np_authkeys_destroy(void);
+
+#endif /* NP2SRV_AUTHKEYS_CACHE_H_ */
@@ -11,6 +11,8 @@
  *
  *     https://opensource.org/licenses/BSD-3-Clause
  */
+#define _GNU_SOURCE
+
 #include "config.h"
 
 #include <stdlib.h>
@@ -19,6 +21,8 @@
 #include <errno.h>
 
 #ifdef NP2SRV_URL_CAPAB
+# include <pthread.h>
+# include <unistd.h>
 # include <curl/curl.h>
 
 # ifdef CURL_GLOBAL_ACK_EINTR
@@ -33,11 +37,32 @@
 #include <nc_server.h>
 
 #include "common.h"
+#include "filter_cache.h"
+#include "hash_table.h"
 #include "log.h"
 #include "netconf_acm.h"
 #include "netconf_monitoring.h"
+#include "notif_fanout.h"
+#include "schema_index.h"
+#include "session_setup.h"
+
+struct np2srv np2srv = {
+    .unix_mode = -1,
+    .unix_uid = -1,
+    .unix_gid = -1,
+    .worker_dflt_count = NP2SRV_THREAD_COUNT,
+    .worker_lock = PTHREAD_MUTEX_INITIALIZER,
+    .worker_cond = PTHREAD_COND_INITIALIZER,
+    .sessions_lock = PTHREAD_RWLOCK_INITIALIZER
+};
 
-struct np2srv np2srv = {.unix_mode = -1, .unix_uid = -1, .unix_gid = -1};
+/**
+ * @brief Record of the sessions hash table.
+ */
+struct np_sessions_rec {
+    uint32_t nc_id;             /**< NETCONF session ID */
+    struct np2srv_sess *sess;   /**< session internal data */
+};
 
 int
 np_sleep(uint32_t ms)
@@ -49,34 +74,125 @@ np_sleep(uint32_t ms)
     return nanosleep(&ts, NULL);
 }
 
-const char *
-np_get_nc_sess_user(sr_session_ctx_t *session)
+static int
+np_sessions_rec_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
 {
-    struct nc_session *nc_sess = NULL;
-    uint32_t nc_sid, i;
+    struct np_sessions_rec *rec1 = val1_p, *rec2 = val2_p;
 
-    nc_sid = sr_session_get_nc_id(session);
-    for (i = 0; (nc_sess = nc_ps_get_session(np2srv.nc_ps, i)); ++i) {
-        if (nc_session_get_id(nc_sess) == nc_sid) {
-            break;
+    return rec1->nc_id == rec2->nc_id;
+}
+
+static uint32_t
+np_sessions_hash(uint32_t nc_id)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, &nc_id, sizeof nc_id);
+    return np_hash_multi(hash, NULL, 0);
+}
+
+int
+np_sessions_init(void)
+{
+    np2srv.sessions = np_ht_new(np2srv.nc_max_sessions ? np2srv.nc_max_sessions : 8, sizeof(struct np_sessions_rec),
+            np_sessions_rec_equal, NULL);
+    if (!np2srv.sessions) {
+        EMEM;
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+np_sessions_destroy(void)
+{
+    np_ht_free(np2srv.sessions);
+    np2srv.sessions = NULL;
+}
+
+int
+np_sessions_add(struct np2srv_sess *sess)
+{
+    struct np_sessions_rec rec;
+    int r;
+
+    rec.nc_id = nc_session_get_id(sess->nc_sess);
+    rec.sess = sess;
+
+    pthread_rwlock_wrlock(&np2srv.sessions_lock);
+    r = np_ht_insert(np2srv.sessions, &rec, np_sessions_hash(rec.nc_id), NULL);
+    pthread_rwlock_unlock(&np2srv.sessions_lock);
+
+    if (r) {
+        if (r == -1) {
+            EMEM;
+        } else {
+            EINT;
         }
+        return -1;
     }
-    if (!nc_sess) {
+    return 0;
+}
+
+void
+np_sessions_del(struct np2srv_sess *sess)
+{
+    struct np_sessions_rec rec;
+
+    rec.nc_id = nc_session_get_id(sess->nc_sess);
+
+    pthread_rwlock_wrlock(&np2srv.sessions_lock);
+    np_ht_remove(np2srv.sessions, &rec, np_sessions_hash(rec.nc_id));
+    pthread_rwlock_unlock(&np2srv.sessions_lock);
+}
+
+struct np2srv_sess *
+np_sessions_find(uint32_t nc_id)
+{
+    struct np_sessions_rec rec, *match;
+
+    rec.nc_id = nc_id;
+    if (np_ht_find(np2srv.sessions, &rec, np_sessions_hash(nc_id), (void **)&match)) {
+        return NULL;
+    }
+
+    return match->sess;
+}
+
+struct np2srv_sess *
+np_get_nc_sess(sr_session_ctx_t *session)
+{
+    struct np2srv_sess *sess;
+
+    /* the session cannot be freed while processing its own request */
+    pthread_rwlock_rdlock(&np2srv.sessions_lock);
+    sess = np_sessions_find(sr_session_get_nc_id(session));
+    pthread_rwlock_unlock(&np2srv.sessions_lock);
+
+    return sess;
+}
+
+struct ncac_user *
+np_get_nc_sess_user(sr_session_ctx_t *session)
+{
+    struct np2srv_sess *sess;
+
+    sess = np_get_nc_sess(session);
+    if (!sess) {
         return NULL;
     }
 
-    return nc_session_get_username(nc_sess);
+    return sess->nacm_user;
 }
 
 void
 np2srv_ntf_new_cb(sr_session_ctx_t *UNUSED(session), const sr_ev_notif_type_t notif_type, const struct lyd_node *notif,
         time_t timestamp, void *private_data)
 {
-    struct nc_server_notif *nc_ntf = NULL;
     struct nc_session *ncs = (struct nc_session *)private_data;
     struct lyd_node *ly_ntf = NULL;
-    NC_MSG_TYPE msg_type;
-    char buf[26], *datetime;
+    struct np_ntf ntf;
 
     /* create these notifications, sysrepo only emulates them */
     if (notif_type == SR_EV_NOTIF_REPLAY_COMPLETE) {
@@ -87,35 +203,11 @@ np2srv_ntf_new_cb(sr_session_ctx_t *UNUSED(session), const sr_ev_notif_type_t no
         notif = ly_ntf;
     }
 
-    /* find the top-level node */
-    while (notif->parent) {
-        notif = notif->parent;
-    }
+    /* the filter was already applied by sysrepo, the subscription is finished once its last notification is sent */
+    np_ntf_prepare(&ntf, notif, timestamp);
+    np_ntf_enqueue(&ntf, ncs, NULL, notif_type == SR_EV_NOTIF_STOP);
 
-    /* check NACM */
-    if (ncac_check_operation(notif, nc_session_get_username(ncs))) {
-        goto cleanup;
-    }
-
-    /* create the notification object */
-    datetime = nc_time2datetime(timestamp, NULL, buf);
-    nc_ntf = nc_server_notif_new((struct lyd_node *)notif, datetime, NC_PARAMTYPE_CONST);
-
-    /* send the notification */
-    msg_type = nc_server_notif_send(ncs, nc_ntf, NP2SRV_NOTIF_SEND_TIMEOUT);
-    if ((msg_type == NC_MSG_ERROR) || (msg_type == NC_MSG_WOULDBLOCK)) {
-        ERR("Sending a notification to session %d %s.", nc_session_get_id(ncs), msg_type == NC_MSG_ERROR ? "failed" : "timed out");
-        goto cleanup;
-    }
-    ncm_session_notification(ncs);
-
-    if (notif_type == SR_EV_NOTIF_STOP) {
-        /* subscription finished */
-        nc_session_set_notif_status(ncs, 0);
-    }
-
-cleanup:
-    nc_server_notif_free(nc_ntf);
+    np_ntf_clear(&ntf);
     lyd_free_withsiblings(ly_ntf);
 }
 
@@ -123,18 +215,34 @@ void
 np2srv_new_session_cb(const char *UNUSED(client_name), struct nc_session *new_session)
 {
     int c, monitored = 0;
-    sr_val_t *event_data;
+    uint64_t start;
+    struct np2srv_sess *sess = NULL;
     sr_session_ctx_t *sr_sess = NULL;
-    const struct lys_module *mod;
-    char *host = NULL;
+
+    start = np_sess_setup_now();
+
+    sess = calloc(1, sizeof *sess);
+    if (!sess) {
+        EMEM;
+        goto error;
+    }
+    np_ntf_queue_init(&sess->ntf_queue);
 
     /* start sysrepo session for every NETCONF session (so that it can be used for notification subscriptions) */
-    c = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, &sr_sess);
+    c = np_sess_setup_sr_session(&sr_sess);
     if (c != SR_ERR_OK) {
         ERR("Failed to start a sysrepo session (%s).", sr_strerror(c));
         goto error;
     }
-    nc_session_set_data(new_session, sr_sess);
+    sess->nc_sess = new_session;
+    sess->sr_sess = sr_sess;
+
+    /* NACM user with its groups cached for the whole session */
+    sess->nacm_user = ncac_user_new(nc_session_get_username(new_session));
+    if (!sess->nacm_user) {
+        goto error;
+    }
+    nc_session_set_data(new_session, sess);
     sr_session_set_nc_id(sr_sess, nc_session_get_id(new_session));
 
     switch (nc_session_get_ti(new_session)) {
@@ -155,6 +263,15 @@ np2srv_new_session_cb(const char *UNUSED(client_name), struct nc_session *new_se
         break;
     }
 
+    /* make the session findable by its ID before any of its RPCs can be processed */
+    if (np_sessions_add(sess)) {
+        goto error;
+    }
+
+    /* generate ietf-netconf-notification's netconf-session-start event for sysrepo, sent later but always
+     * before the netconf-session-end event queued once the session is polled */
+    np_sess_setup_notif_start(new_session);
+
     c = 0;
     while ((c < 3) && nc_ps_add_session(np2srv.nc_ps, new_session)) {
         /* presumably timeout, give it a shot 2 times */
@@ -165,35 +282,13 @@ np2srv_new_session_cb(const char *UNUSED(client_name), struct nc_session *new_se
     if (c == 3) {
         /* there is some serious problem in synchronization/system planner */
         EINT;
+        np_sessions_del(sess);
+        nc_session_set_term_reason(new_session, NC_SESSION_TERM_OTHER);
+        np_sess_setup_notif_end(new_session);
         goto error;
     }
 
-    if ((mod = ly_ctx_get_module(sr_get_context(np2srv.sr_conn), "ietf-netconf-notifications", NULL, 1))) {
-        /* generate ietf-netconf-notification's netconf-session-start event for sysrepo */
-        if (nc_session_get_ti(new_session) != NC_TI_UNIX) {
-            host = (char *)nc_session_get_host(new_session);
-        }
-        event_data = calloc(3, sizeof *event_data);
-        event_data[0].xpath = "/ietf-netconf-notifications:netconf-session-start/username";
-        event_data[0].type = SR_STRING_T;
-        event_data[0].data.string_val = (char *)nc_session_get_username(new_session);
-        event_data[1].xpath = "/ietf-netconf-notifications:netconf-session-start/session-id";
-        event_data[1].type = SR_UINT32_T;
-        event_data[1].data.uint32_val = nc_session_get_id(new_session);
-        if (host) {
-            event_data[2].xpath = "/ietf-netconf-notifications:netconf-session-start/source-host";
-            event_data[2].type = SR_STRING_T;
-            event_data[2].data.string_val = host;
-        }
-        c = sr_event_notif_send(np2srv.sr_sess, "/ietf-netconf-notifications:netconf-session-start", event_data, host ? 3 : 2);
-        if (c != SR_ERR_OK) {
-            WRN("Failed to send a notification (%s).", sr_strerror(c));
-        } else {
-            VRB("Generated new event (netconf-session-start).");
-        }
-        free(event_data);
-    }
-
+    np_sess_setup_done(start, 0);
     return;
 
 error:
@@ -201,7 +296,13 @@ error:
         ncm_session_del(new_session);
     }
     sr_session_stop(sr_sess);
+    if (sess) {
+        np_ntf_queue_close(&sess->ntf_queue);
+        ncac_user_free(sess->nacm_user);
+        free(sess);
+    }
     nc_session_free(new_session, NULL);
+    np_sess_setup_done(start, 1);
 }
 
 #ifdef NP2SRV_URL_CAPAB
@@ -216,6 +317,12 @@ np2srv_url_setcap(void)
     const char *url_protocol_str[] = {"scp", "http", "https", "ftp", "sftp", "ftps", "file", NULL};
     const char *main_cpblt = "urn:ietf:params:netconf:capability:url:1.0?scheme=";
 
+    /* global init, once for the whole server */
+    if (curl_global_init(URL_INIT_FLAGS) != CURLE_OK) {
+        ERR("Failed to initialize curl.");
+        return EXIT_FAILURE;
+    }
+
     curl_data = curl_version_info(CURLVERSION_NOW);
     for (i = 0; curl_data->protocols[i]; ++i) {
         for (j = 0; url_protocol_str[j]; ++j) {
@@ -257,118 +364,433 @@ np2srv_url_setcap(void)
     return EXIT_SUCCESS;
 }
 
-struct np2srv_url_mem {
-    char *memory;
+/**
+ * @brief Pool of curl handles, they keep their connections alive for reuse.
+ */
+static struct {
+    pthread_mutex_t lock;
+    struct {
+        CURL *curl;             /**< curl handle */
+        char *dest;             /**< destination of the last transfer */
+    } handles[NP2SRV_URL_POOL_SIZE];
+    uint32_t count;
+} url_pool = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * @brief Downloaded data.
+ */
+struct np2srv_url_buf {
+    char *data;
     size_t size;
+    size_t alloc;
+};
+
+/**
+ * @brief Data printed into a pipe for uploading.
+ */
+struct np2srv_url_print {
+    const struct lyd_node *config;  /**< data to print */
+    int options;                    /**< printer options */
+    int fds[2];                     /**< pipe */
+    ATOMIC_T failed;                /**< set if printing failed, before closing the pipe */
+    char *errmsg;                   /**< printer error message, libyang errors are thread-local */
+    char *errpath;                  /**< printer error path */
 };
 
+/**
+ * @brief Get the destination of a URL (scheme and authority).
+ */
+static char *
+url_dest(const char *url)
+{
+    const char *ptr;
+
+    ptr = strstr(url, "://");
+    if (!ptr) {
+        return strdup(url);
+    }
+    ptr += 3;
+    ptr += strcspn(ptr, "/");
+
+    return strndup(url, ptr - url);
+}
+
+/**
+ * @brief Get a curl handle, preferably one with a connection to the same destination.
+ *
+ * @param[in] url URL to be transferred.
+ * @return curl handle, NULL on error.
+ */
+static CURL *
+url_handle_get(const char *url)
+{
+    CURL *curl = NULL;
+    char *dest;
+    uint32_t i;
+
+    dest = url_dest(url);
+
+    pthread_mutex_lock(&url_pool.lock);
+    if (url_pool.count) {
+        for (i = 0; i < url_pool.count; ++i) {
+            if (dest && !strcmp(url_pool.handles[i].dest, dest)) {
+                break;
+            }
+        }
+        if (i == url_pool.count) {
+            /* no connection to this destination, use any handle */
+            i = url_pool.count - 1;
+        }
+
+        curl = url_pool.handles[i].curl;
+        free(url_pool.handles[i].dest);
+        --url_pool.count;
+        if (i < url_pool.count) {
+            url_pool.handles[i] = url_pool.handles[url_pool.count];
+        }
+    }
+    pthread_mutex_unlock(&url_pool.lock);
+    free(dest);
+
+    if (!curl) {
+        curl = curl_easy_init();
+        if (!curl) {
+            ERR("Failed to create a curl handle.");
+            return NULL;
+        }
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    return curl;
+}
+
+/**
+ * @brief Return a curl handle into the pool.
+ *
+ * @param[in] curl curl handle.
+ * @param[in] url URL that was transferred.
+ */
+static void
+url_handle_put(CURL *curl, const char *url)
+{
+    char *dest;
+
+    /* keeps live connections and caches */
+    curl_easy_reset(curl);
+
+    dest = url_dest(url);
+    pthread_mutex_lock(&url_pool.lock);
+    if (dest && (url_pool.count < NP2SRV_URL_POOL_SIZE)) {
+        url_pool.handles[url_pool.count].curl = curl;
+        url_pool.handles[url_pool.count].dest = dest;
+        ++url_pool.count;
+        curl = NULL;
+        dest = NULL;
+    }
+    pthread_mutex_unlock(&url_pool.lock);
+
+    free(dest);
+    if (curl) {
+        curl_easy_cleanup(curl);
+    }
+}
+
+void
+np2srv_url_destroy(void)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&url_pool.lock);
+    for (i = 0; i < url_pool.count; ++i) {
+        curl_easy_cleanup(url_pool.handles[i].curl);
+        free(url_pool.handles[i].dest);
+    }
+    url_pool.count = 0;
+    pthread_mutex_unlock(&url_pool.lock);
+
+    curl_global_cleanup();
+}
+
 static size_t
 url_writedata(char *ptr, size_t size, size_t nmemb, void *userdata)
 {
-    int *fd = (int *)userdata;
-    return write(*fd, ptr, size * nmemb);
+    struct np2srv_url_buf *buf = (struct np2srv_url_buf *)userdata;
+    size_t len = size * nmemb;
+    char *mem;
+
+    /* keep space for the terminating zero */
+    if (buf->size + len + 1 > buf->alloc) {
+        buf->alloc = (buf->alloc ? buf->alloc * 2 : 4096);
+        if (buf->alloc < buf->size + len + 1) {
+            buf->alloc = buf->size + len + 1;
+        }
+        mem = realloc(buf->data, buf->alloc);
+        if (!mem) {
+            EMEM;
+            return 0;
+        }
+        buf->data = mem;
+    }
+
+    memcpy(buf->data + buf->size, ptr, len);
+    buf->size += len;
+    buf->data[buf->size] = '\0';
+    return len;
 }
 
 static size_t
 url_readdata(void *ptr, size_t size, size_t nmemb, void *userdata)
 {
-    size_t copied = 0, aux_size = size * nmemb;
-    struct np2srv_url_mem *data = (struct np2srv_url_mem *)userdata;
+    struct np2srv_url_print *print = (struct np2srv_url_print *)userdata;
+    ssize_t r;
+
+    /* the data are being printed into the pipe */
+    do {
+        r = read(print->fds[0], ptr, size * nmemb);
+    } while ((r == -1) && (errno == EINTR));
+    if (r == -1) {
+        ERR("Failed to read printed data (%s).", strerror(errno));
+        return CURL_READFUNC_ABORT;
+    } else if (!r && ATOMIC_LOAD_FENCE(print->failed)) {
+        /* not the end of the data, do not finish a truncated upload */
+        return CURL_READFUNC_ABORT;
+    }
 
-    if (aux_size < 1 || data->size == 0) {
-        /* no space or nothing left */
-        return 0;
+    return r;
+}
+
+static ssize_t
+url_print_clb(void *arg, const void *buf, size_t count)
+{
+    int fd = *(int *)arg;
+    size_t written = 0;
+    ssize_t r;
+
+    while (written < count) {
+        r = write(fd, (const char *)buf + written, count - written);
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* upload aborted, SIGPIPE is ignored */
+            return -1;
+        }
+        written += r;
     }
 
-    copied = (data->size > aux_size) ? aux_size : data->size;
-    memcpy(ptr, data->memory, copied);
-    data->memory = data->memory + copied; /* move pointer */
-    data->size = data->size - copied; /* decrease amount of data left */
-    return copied;
+    return count;
 }
 
-static int
-url_open(const char *url)
+static ssize_t
+url_count_clb(void *arg, const void *UNUSED(buf), size_t count)
 {
-    CURL *curl;
-    CURLcode res;
-    char curl_buffer[CURL_ERROR_SIZE];
-    char url_tmp_name[(sizeof P_tmpdir / sizeof(char)) + 15] = P_tmpdir "/np2srv-XXXXXX";
-    int url_tmpfile;
+    *(size_t *)arg += count;
+    return count;
+}
 
-    /* prepare temporary file ... */
-    if ((url_tmpfile = mkstemp(url_tmp_name)) < 0) {
-        ERR("Failed to create a temporary file (%s).", strerror(errno));
-        return -1;
+static void *
+url_print_thread(void *arg)
+{
+    struct np2srv_url_print *print = (struct np2srv_url_print *)arg;
+    struct ly_ctx *ly_ctx;
+
+    if (lyd_print_clb(url_print_clb, &print->fds[1], print->config, LYD_XML, print->options)) {
+        /* learn the error of this thread */
+        ly_ctx = print->config->schema->module->ctx;
+        if (ly_errmsg(ly_ctx)) {
+            print->errmsg = strdup(ly_errmsg(ly_ctx));
+        }
+        if (ly_errpath(ly_ctx)) {
+            print->errpath = strdup(ly_errpath(ly_ctx));
+        }
+        ATOMIC_STORE_FENCE(print->failed, 1);
     }
 
-    /* and hide it from the file system */
-    unlink(url_tmp_name);
+    /* EOF for the reader, which aborts the upload on failure */
+    close(print->fds[1]);
+    print->fds[1] = -1;
+    return NULL;
+}
+
+/**
+ * @brief Download data from a URL.
+ *
+ * The whole file is kept in memory, libyang can parse only complete documents, not a stream.
+ *
+ * @param[in] url URL to download.
+ * @return Downloaded data, NULL on error.
+ */
+static char *
+url_download(const char *url)
+{
+    CURL *curl;
+    CURLcode res;
+    char curl_buffer[CURL_ERROR_SIZE];
+    struct np2srv_url_buf buf = {0};
 
     DBG("Getting file from URL: %s (via curl)", url);
 
-    /* set up libcurl */
-    curl_global_init(URL_INIT_FLAGS);
-    curl = curl_easy_init();
-    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl = url_handle_get(url);
+    if (!curl) {
+        return NULL;
+    }
+    curl_buffer[0] = '\0';
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, url_writedata);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &url_tmpfile);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
     curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_buffer);
     res = curl_easy_perform(curl);
+    url_handle_put(curl, url);
+
     if (res != CURLE_OK) {
         ERR("Failed to download data (curl: %s).", curl_buffer);
-        close(url_tmpfile);
-        url_tmpfile = -1;
-    } else {
-        /* move back to the beginning of the output file */
-        lseek(url_tmpfile, 0, SEEK_SET);
+        free(buf.data);
+        return NULL;
+    } else if (!buf.data) {
+        /* empty file */
+        return strdup("");
     }
 
-    /* cleanup */
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
+    return buf.data;
+}
+
+/**
+ * @brief Prepare uploading to a temporary file renamed only after the whole upload succeeds,
+ * supported for FTP (RNFR/RNTO).
+ *
+ * @param[in] curl curl handle.
+ * @param[in] url URL to upload to.
+ * @param[out] tmp_url URL of the temporary file, NULL if not supported for the URL.
+ * @param[out] quote Commands renaming the temporary file, NULL if not supported for the URL.
+ * @return 0 on success, -1 on error.
+ */
+static int
+url_upload_tmp(CURL *curl, const char *url, char **tmp_url, struct curl_slist **quote)
+{
+    struct curl_slist *list;
+    const char *name;
+    char *file = NULL, *cmd = NULL;
+    int ret = -1;
+
+    *tmp_url = NULL;
+    *quote = NULL;
 
-    return url_tmpfile;
+    if (strncmp(url, "ftp://", 6) && strncmp(url, "ftps://", 7)) {
+        return 0;
+    }
+    name = strrchr(strstr(url, "://") + 3, '/');
+    if (!name || !name[1] || strpbrk(name, ";?")) {
+        /* no file name or some parameters, upload directly */
+        return 0;
+    }
+    ++name;
+
+    file = curl_easy_unescape(curl, name, 0, NULL);
+    if (!file || (asprintf(tmp_url, "%s.tmp", url) == -1)) {
+        *tmp_url = NULL;
+        EMEM;
+        goto cleanup;
+    }
+
+    /* the working directory is the one of the file when the commands are sent */
+    if (asprintf(&cmd, "RNFR %s.tmp", file) == -1) {
+        cmd = NULL;
+        EMEM;
+        goto cleanup;
+    }
+    list = curl_slist_append(*quote, cmd);
+    free(cmd);
+    if (!list) {
+        EMEM;
+        goto cleanup;
+    }
+    *quote = list;
+
+    if (asprintf(&cmd, "RNTO %s", file) == -1) {
+        cmd = NULL;
+        EMEM;
+        goto cleanup;
+    }
+    list = curl_slist_append(*quote, cmd);
+    free(cmd);
+    if (!list) {
+        EMEM;
+        goto cleanup;
+    }
+    *quote = list;
+
+    /* success */
+    ret = 0;
+
+cleanup:
+    curl_free(file);
+    if (ret) {
+        free(*tmp_url);
+        *tmp_url = NULL;
+        curl_slist_free_all(*quote);
+        *quote = NULL;
+    }
+    return ret;
 }
 
 struct lyd_node *
 op_parse_url(const char *url, int options, int *rc, sr_session_ctx_t *sr_sess)
 {
-    struct lyd_node *config, *data;
+    struct lyd_node *config = NULL;
+    struct lyxml_elem *xml;
     struct ly_ctx *ly_ctx;
-    int fd;
+    char *data;
 
     ly_ctx = (struct ly_ctx *)sr_get_context(np2srv.sr_conn);
 
-    fd = url_open(url);
-    if (fd == -1) {
+    data = url_download(url);
+    if (!data) {
         *rc = SR_ERR_INVAL_ARG;
         sr_set_error(sr_sess, NULL, "Could not open URL.");
         return NULL;
     }
 
-    /* do not validate the whole context, we just want to load the config anyxml */
-    config = lyd_parse_fd(ly_ctx, fd, LYD_XML, LYD_OPT_CONFIG | LYD_OPT_TRUSTED);
+    /* parse the transferred data directly as the config, without an intermediate anydata */
+    xml = lyxml_parse_mem(ly_ctx, data, 0);
+    free(data);
     if (ly_errno) {
         *rc = SR_ERR_LY;
         sr_set_error(sr_sess, ly_errpath(ly_ctx), ly_errmsg(ly_ctx));
         return NULL;
     }
+    if (!xml || strcmp(xml->name, "config") || !xml->ns || strcmp(xml->ns->value, "urn:ietf:params:xml:ns:netconf:base:1.0")) {
+        lyxml_free_withsiblings(ly_ctx, xml);
+        *rc = SR_ERR_INVAL_ARG;
+        sr_set_error(sr_sess, NULL, "URL does not contain a NETCONF config.");
+        return NULL;
+    }
 
-    data = op_parse_config((struct lyd_node_anydata *)config, options, rc, sr_sess);
-    lyd_free_withsiblings(config);
-    return data;
+    if (xml->child) {
+        config = lyd_parse_xml(ly_ctx, &xml->child, options);
+        if (ly_errno) {
+            *rc = SR_ERR_LY;
+            sr_set_error(sr_sess, ly_errpath(ly_ctx), ly_errmsg(ly_ctx));
+        }
+    }
+    lyxml_free_withsiblings(ly_ctx, xml);
+
+    return config;
 }
 
 int
 op_export_url(const char *url, struct lyd_node *data, int options, int *rc, sr_session_ctx_t *sr_sess)
 {
-    CURL *curl;
-    CURLcode res;
-    struct np2srv_url_mem mem_data;
-    char curl_buffer[CURL_ERROR_SIZE], *str_data;
+    CURL *curl = NULL;
+    CURLcode res = CURLE_OK;
+    struct np2srv_url_print print;
+    struct curl_slist *quote = NULL;
+    char curl_buffer[CURL_ERROR_SIZE], *tmp_url = NULL;
     struct lyd_node *config;
     struct ly_ctx *ly_ctx;
+    pthread_t tid;
+    size_t size = 0;
+    int ret = -1, r;
 
     ly_ctx = (struct ly_ctx *)sr_get_context(np2srv.sr_conn);
 
@@ -379,40 +801,100 @@ op_export_url(const char *url, struct lyd_node *data, int options, int *rc, sr_s
         return -1;
     }
 
-    lyd_print_mem(&str_data, config, LYD_XML, options);
-    /* do not free data */
-    ((struct lyd_node_anydata *)config)->value.tree = NULL;
-    lyd_free_withsiblings(config);
+    print.config = config;
+    print.options = options;
+    print.fds[0] = -1;
+    print.fds[1] = -1;
+    ATOMIC_STORE_RELAXED(print.failed, 0);
+    print.errmsg = NULL;
+    print.errpath = NULL;
+
+    if (!strncmp(url, "scp://", 6)) {
+        /* SCP needs to know the size in advance, print it once without storing, which costs
+         * one more printing of the data but not the memory for all of it */
+        lyd_print_clb(url_count_clb, &size, config, LYD_XML, options);
+    }
 
     DBG("Uploading file to URL: %s (via curl)", url);
 
-    /* fill the structure for libcurl's READFUNCTION */
-    mem_data.memory = str_data;
-    mem_data.size = strlen(str_data);
+    /* the data are printed in a thread while being uploaded */
+    if (pipe(print.fds) == -1) {
+        ERR("Failed to create a pipe (%s).", strerror(errno));
+        *rc = SR_ERR_SYS;
+        sr_set_error(sr_sess, NULL, "Failed to create a pipe.");
+        goto cleanup;
+    }
+    r = pthread_create(&tid, NULL, url_print_thread, &print);
+    if (r) {
+        ERR("Failed to create a thread (%s).", strerror(r));
+        *rc = SR_ERR_SYS;
+        sr_set_error(sr_sess, NULL, "Failed to create a thread.");
+        goto cleanup;
+    }
+
+    curl = url_handle_get(url);
+    if (curl && url_upload_tmp(curl, url, &tmp_url, &quote)) {
+        /* stop the printer */
+        url_handle_put(curl, url);
+        curl = NULL;
+    }
+    if (curl) {
+        curl_buffer[0] = '\0';
+        if (tmp_url) {
+            /* the file is replaced only by the complete data */
+            curl_easy_setopt(curl, CURLOPT_URL, tmp_url);
+            curl_easy_setopt(curl, CURLOPT_POSTQUOTE, quote);
+        }
+        curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &print);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, url_readdata);
+        if (size) {
+            curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)size);
+        }
+        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_buffer);
+        res = curl_easy_perform(curl);
+    }
 
-    /* set up libcurl */
-    curl_global_init(URL_INIT_FLAGS);
-    curl = curl_easy_init();
-    curl_easy_setopt(curl, CURLOPT_URL, url);
-    curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
-    curl_easy_setopt(curl, CURLOPT_READDATA, &mem_data);
-    curl_easy_setopt(curl, CURLOPT_READFUNCTION, url_readdata);
-    curl_easy_setopt(curl, CURLOPT_INFILESIZE, (long)mem_data.size);
-    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_buffer);
-    res = curl_easy_perform(curl);
-    free(str_data);
+    /* stop the printer if the upload did not read everything */
+    close(print.fds[0]);
+    print.fds[0] = -1;
+    pthread_join(tid, NULL);
 
+    if (!curl) {
+        *rc = SR_ERR_SYS;
+        sr_set_error(sr_sess, NULL, "Failed to prepare the upload.");
+        goto cleanup;
+    }
+    url_handle_put(curl, url);
     if (res != CURLE_OK) {
         ERR("Failed to upload data (curl: %s).", curl_buffer);
         *rc = SR_ERR_SYS;
         sr_set_error(sr_sess, NULL, curl_buffer);
-        return -1;
+        goto cleanup;
+    } else if (ATOMIC_LOAD_RELAXED(print.failed)) {
+        *rc = SR_ERR_LY;
+        sr_set_error(sr_sess, print.errpath, print.errmsg ? print.errmsg : "Failed to print the data.");
+        goto cleanup;
     }
 
-    /* cleanup */
-    curl_easy_cleanup(curl);
-    curl_global_cleanup();
-    return 0;
+    /* success */
+    ret = 0;
+
+cleanup:
+    if (print.fds[0] > -1) {
+        close(print.fds[0]);
+    }
+    if (print.fds[1] > -1) {
+        close(print.fds[1]);
+    }
+    free(tmp_url);
+    curl_slist_free_all(quote);
+    free(print.errmsg);
+    free(print.errpath);
+    /* do not free data */
+    ((struct lyd_node_anydata *)config)->value.tree = NULL;
+    lyd_free_withsiblings(config);
+    return ret;
 }
 
 #else
@@ -423,6 +905,11 @@ np2srv_url_setcap(void)
     return EXIT_SUCCESS;
 }
 
+void
+np2srv_url_destroy(void)
+{
+}
+
 #endif
 
 struct lyd_node *
@@ -440,7 +927,9 @@ op_parse_config(struct lyd_node_anydata *config, int options, int *rc, sr_sessio
         root = lyd_parse_mem(ly_ctx, config->value.str, LYD_XML, options);
         break;
     case LYD_ANYDATA_DATATREE:
-        root = lyd_dup_withsiblings(config->value.tree, LYD_DUP_OPT_RECURSIVE);
+        /* take over the already parsed tree */
+        root = config->value.tree;
+        config->value.tree = NULL;
         break;
     case LYD_ANYDATA_XML:
         root = lyd_parse_xml(ly_ctx, &config->value.xml, options);
@@ -461,6 +950,26 @@ op_parse_config(struct lyd_node_anydata *config, int options, int *rc, sr_sessio
         sr_set_error(sr_sess, ly_errpath(ly_ctx), ly_errmsg(ly_ctx));
     }
 
+    /* the unparsed value is not needed anymore, do not keep both in memory */
+    switch (config->value_type) {
+    case LYD_ANYDATA_CONSTSTRING:
+    case LYD_ANYDATA_SXML:
+        lydict_remove(ly_ctx, config->value.str);
+        config->value.str = NULL;
+        break;
+    case LYD_ANYDATA_XML:
+        lyxml_free_withsiblings(ly_ctx, config->value.xml);
+        config->value.xml = NULL;
+        break;
+    case LYD_ANYDATA_LYB:
+        free(config->value.mem);
+        config->value.mem = NULL;
+        break;
+    default:
+        /* dynamic values are never stored */
+        break;
+    }
+
     return root;
 }
 
@@ -495,7 +1004,7 @@ op_filter_xpath_add_filter(char *new_filter, char ***filters, int *filter_count)
 }
 
 static int
-filter_xpath_buf_add_attrs(struct ly_ctx *ctx, struct lyxml_attr *attr, char **buf, int size)
+filter_xpath_buf_add_attrs(struct lyxml_attr *attr, char **buf, int size)
 {
     const struct lys_module *module;
     struct lyxml_attr *next;
@@ -506,7 +1015,7 @@ filter_xpath_buf_add_attrs(struct ly_ctx *ctx, struct lyxml_attr *attr, char **b
         if (next->type == LYXML_ATTR_STD) {
             module = NULL;
             if (next->ns) {
-                module = ly_ctx_get_module_by_ns(ctx, next->ns->value, NULL, 1);
+                module = np_schema_index_module_by_ns(next->ns->value);
             }
             if (!module) {
                 /* attribute without namespace or with unknown one will not match anything anyway */
@@ -573,7 +1082,7 @@ filter_xpath_buf_add_top_content(struct ly_ctx *ctx, struct lyxml_elem *elem, co
     sprintf(buf, "/%s:%s[text()='%s']", elem_module_name, elem->name, content);
     free(content);
 
-    size = filter_xpath_buf_add_attrs(ctx, elem->attr, &buf, size);
+    size = filter_xpath_buf_add_attrs(elem->attr, &buf, size);
     if (!size) {
         free(buf);
         return 0;
@@ -601,7 +1110,7 @@ filter_xpath_buf_add_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const
 
     if (!elem_module_name && elem->ns && (elem->ns->value != last_ns)
             && strcmp(elem->ns->value, "urn:ietf:params:xml:ns:netconf:base:1.0")) {
-        module = ly_ctx_get_module_by_ns(ctx, elem->ns->value, NULL, 1);
+        module = np_schema_index_module_by_ns(elem->ns->value);
         if (!module) {
             /* not really an error */
             return 0;
@@ -621,7 +1130,7 @@ filter_xpath_buf_add_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const
             elem->name);
     size = new_size;
 
-    size = filter_xpath_buf_add_attrs(ctx, elem->attr, buf, size);
+    size = filter_xpath_buf_add_attrs(elem->attr, buf, size);
     if (!size) {
         return 0;
     } else if (size < 1) {
@@ -652,7 +1161,7 @@ filter_xpath_buf_add_content(struct ly_ctx *ctx, struct lyxml_elem *elem, const
 
 /* containment/selection node with optional namespace and attributes */
 static int
-filter_xpath_buf_add_node(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *elem_module_name,
+filter_xpath_buf_add_node(struct lyxml_elem *elem, const char *elem_module_name,
                          const char *last_ns, char **buf, int size)
 {
     const struct lys_module *module;
@@ -661,7 +1170,7 @@ filter_xpath_buf_add_node(struct ly_ctx *ctx, struct lyxml_elem *elem, const cha
 
     if (!elem_module_name && elem->ns && (elem->ns->value != last_ns)
             && strcmp(elem->ns->value, "urn:ietf:params:xml:ns:netconf:base:1.0")) {
-        module = ly_ctx_get_module_by_ns(ctx, elem->ns->value, NULL, 1);
+        module = np_schema_index_module_by_ns(elem->ns->value);
         if (!module) {
             /* not really an error */
             return 0;
@@ -681,7 +1190,7 @@ filter_xpath_buf_add_node(struct ly_ctx *ctx, struct lyxml_elem *elem, const cha
             elem->name);
     size = new_size;
 
-    size = filter_xpath_buf_add_attrs(ctx, elem->attr, buf, size);
+    size = filter_xpath_buf_add_attrs(elem->attr, buf, size);
 
     return size;
 }
@@ -697,7 +1206,7 @@ filter_xpath_buf_add(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *el
     int only_content_match_node = 1;
 
     /* containment node, selection node */
-    size = filter_xpath_buf_add_node(ctx, elem, elem_module_name, last_ns, buf, size);
+    size = filter_xpath_buf_add_node(elem, elem_module_name, last_ns, buf, size);
     if (!size) {
         free(*buf);
         *buf = NULL;
@@ -752,7 +1261,7 @@ filter_xpath_buf_add(struct ly_ctx *ctx, struct lyxml_elem *elem, const char *el
 
         /* child selection node or content match node */
         } else {
-            new_size = filter_xpath_buf_add_node(ctx, child, NULL, last_ns, &buf_new, new_size);
+            new_size = filter_xpath_buf_add_node(child, NULL, last_ns, &buf_new, new_size);
             if (!new_size) {
                 free(buf_new);
                 continue;
@@ -778,47 +1287,28 @@ error:
 static int
 op_filter_build_xpath_from_subtree(struct ly_ctx *ctx, struct lyxml_elem *elem, char ***filters, int *filter_count)
 {
-    const struct lys_module *module, **modules, **modules_new;
-    const struct lys_node *node;
+    const struct lys_module *module, **modules;
     struct lyxml_elem *next;
     char *buf;
     uint32_t i, module_count;
 
+    /* all the module lookups are done in the index */
+    if (np_schema_index_rdlock(ctx)) {
+        return -1;
+    }
+
     LY_TREE_FOR(elem, next) {
         /* first filter node, it must always have a namespace */
-        modules = NULL;
-        module_count = 0;
         if (next->ns && strcmp(next->ns->value, "urn:ietf:params:xml:ns:netconf:base:1.0")) {
-            modules = malloc(sizeof *modules);
-            if (!modules) {
-                EMEM;
-                goto error;
-            }
-            module_count = 1;
-            modules[0] = ly_ctx_get_module_by_ns(ctx, next->ns->value, NULL, 1);
-            if (!modules[0]) {
+            module = np_schema_index_module_by_ns(next->ns->value);
+            if (!module) {
                 /* not really an error */
-                free(modules);
                 continue;
             }
+            modules = &module;
+            module_count = 1;
         } else {
-            i = 0;
-            while ((module = ly_ctx_get_module_iter(ctx, &i))) {
-                node = NULL;
-                while ((node = lys_getnext(node, NULL, module, 0))) {
-                    if (!strcmp(node->name, next->name)) {
-                        modules_new = realloc(modules, (module_count + 1) * sizeof *modules);
-                        if (!modules_new) {
-                            EMEM;
-                            goto error;
-                        }
-                        ++module_count;
-                        modules = modules_new;
-                        modules[module_count - 1] = module;
-                        break;
-                    }
-                }
-            }
+            modules = np_schema_index_top_modules(next->name, &module_count);
         }
 
         buf = NULL;
@@ -835,13 +1325,13 @@ op_filter_build_xpath_from_subtree(struct ly_ctx *ctx, struct lyxml_elem *elem,
                 }
             }
         }
-        free(modules);
     }
 
+    np_schema_index_unlock();
     return 0;
 
 error:
-    free(modules);
+    np_schema_index_unlock();
     for (i = 0; (signed)i < *filter_count; ++i) {
         free((*filters)[i]);
     }
@@ -855,8 +1345,8 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
     struct lyd_attr *attr;
     struct lyxml_elem *subtree_filter;
     struct ly_ctx *ly_ctx;
-    int free_filter, ret;
-    char *path;
+    int free_filter, ret, start_count;
+    char *path, *cache_key = NULL;
 
     ly_ctx = lyd_node_module(filter_node)->ctx;
 
@@ -892,6 +1382,17 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
         switch (((struct lyd_node_anydata *)filter_node)->value_type) {
         case LYD_ANYDATA_CONSTSTRING:
         case LYD_ANYDATA_STRING:
+            /* the same filters are usually repeated, try the cache first */
+            cache_key = np_filter_cache_key(((struct lyd_node_anydata *)filter_node)->value.str);
+            if (!cache_key) {
+                return -1;
+            }
+            ret = np_filter_cache_get(ly_ctx, cache_key, filters, filter_count);
+            if (ret < 1) {
+                free(cache_key);
+                return ret;
+            }
+
             subtree_filter = lyxml_parse_mem(ly_ctx, ((struct lyd_node_anydata *)filter_node)->value.str, LYXML_PARSE_MULTIROOT);
             free_filter = 1;
             break;
@@ -904,16 +1405,24 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
             return -1;
         }
         if (!subtree_filter) {
+            free(cache_key);
             return -1;
         }
 
+        start_count = *filter_count;
         ret = op_filter_build_xpath_from_subtree(ly_ctx, subtree_filter, filters, filter_count);
         if (free_filter) {
             lyxml_free(ly_ctx, subtree_filter);
         }
         if (ret) {
+            free(cache_key);
             return -1;
         }
+
+        if (cache_key) {
+            np_filter_cache_put(ly_ctx, cache_key, *filters + start_count, *filter_count - start_count);
+            free(cache_key);
+        }
     } else {
         /* xpath */
         if (!attr->value_str || !attr->value_str[0]) {
@@ -933,3 +1442,40 @@ op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_coun
 
     return 0;
 }
+
+int
+op_filter_data_get(sr_session_ctx_t *session, uint32_t max_depth, sr_get_oper_options_t get_opts, char **filters,
+        int filter_count, struct lyd_node **data)
+{
+    char *xpath, *ptr;
+    size_t len = 0;
+    int i, rc;
+
+    *data = NULL;
+
+    if (!filter_count) {
+        /* nothing to retrieve */
+        return SR_ERR_OK;
+    } else if (filter_count == 1) {
+        return sr_get_data(session, filters[0], max_depth, NP2SRV_SYSREPO_TIMEOUT, get_opts, data);
+    }
+
+    /* retrieve all the filters at once using their union, no merging needed */
+    for (i = 0; i < filter_count; ++i) {
+        len += strlen(filters[i]) + 3;
+    }
+    xpath = malloc(len + 1);
+    if (!xpath) {
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+
+    ptr = xpath;
+    for (i = 0; i < filter_count; ++i) {
+        ptr += sprintf(ptr, "%s%s", i ? " | " : "", filters[i]);
+    }
+
+    rc = sr_get_data(session, xpath, max_depth, NP2SRV_SYSREPO_TIMEOUT, get_opts, data);
+    free(xpath);
+    return rc;
+}
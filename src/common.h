@@ -25,6 +25,8 @@
 
 #include "compat.h"
 #include "config.h"
+#include "netconf_monitoring.h"
+#include "notif_fanout.h"
 
 /* server internal data */
 struct np2srv {
@@ -41,15 +43,57 @@ struct np2srv {
 
     struct nc_pollsession *nc_ps;   /**< libnetconf2 pollsession structure */
     uint16_t nc_max_sessions;       /**< maximum number of running sessions */
-    pthread_t workers[NP2SRV_THREAD_COUNT]; /**< worker threads handling sessions */
+
+    uint32_t worker_dflt_count;     /**< worker thread count set on the command line */
+    uint32_t worker_dflt_max;       /**< maximum worker thread count set on the command line, 0 for no auto-scaling */
+    ATOMIC_T worker_target;         /**< configured worker thread count */
+    ATOMIC_T worker_max;            /**< maximum worker thread count, 0 for no auto-scaling */
+    ATOMIC_T worker_count;          /**< current worker thread count */
+    ATOMIC_T worker_busy;           /**< number of worker threads currently handling a request */
+    uint32_t worker_threads;        /**< number of running worker threads, including those being stopped */
+    uint32_t worker_next_idx;       /**< index of the next started worker thread */
+    pthread_mutex_t worker_lock;    /**< lock for starting and stopping worker threads */
+    pthread_cond_t worker_cond;     /**< condition signalled when a worker thread stops */
+
+    struct np_ht *sessions;         /**< hash table of all the NETCONF sessions by their ID */
+    pthread_rwlock_t sessions_lock; /**< lock for the sessions hash table */
 };
 extern struct np2srv np2srv;
 
-extern ATOMIC_T skip_nacm_sr_sid;
+/* NETCONF session internal data */
+struct np2srv_sess {
+    struct nc_session *nc_sess;     /**< NETCONF session */
+    sr_session_ctx_t *sr_sess;      /**< sysrepo session of the NETCONF session */
+    struct ncac_user *nacm_user;    /**< NACM user of the session with cached groups */
+    struct ncm_session_stats stats; /**< ietf-netconf-monitoring counters of the session */
+    struct np_ntf_queue ntf_queue;  /**< outbound notification queue of the session */
+    ATOMIC_T copy_nacm;             /**< NACM check of the copy-config being executed (enum np2srv_copy_nacm) */
+};
+
+/**
+ * @brief NACM check of the changes made by a session.
+ */
+enum np2srv_copy_nacm {
+    NP2SRV_COPY_NACM_WRITE = 0, /**< standard write access check */
+    NP2SRV_COPY_NACM_READ,      /**< write access and read access to the data copied from another datastore */
+    NP2SRV_COPY_NACM_SKIP       /**< no check */
+};
 
 int np_sleep(uint32_t ms);
 
-const char *np_get_nc_sess_user(sr_session_ctx_t *session);
+int np_sessions_init(void);
+
+void np_sessions_destroy(void);
+
+int np_sessions_add(struct np2srv_sess *sess);
+
+void np_sessions_del(struct np2srv_sess *sess);
+
+struct np2srv_sess *np_sessions_find(uint32_t nc_id);
+
+struct np2srv_sess *np_get_nc_sess(sr_session_ctx_t *session);
+
+struct ncac_user *np_get_nc_sess_user(sr_session_ctx_t *session);
 
 void np2srv_ntf_new_cb(sr_session_ctx_t *session, const sr_ev_notif_type_t notif_type, const struct lyd_node *notif,
         time_t timestamp, void *private_data);
@@ -58,6 +102,8 @@ void np2srv_new_session_cb(const char *client_name, struct nc_session *new_sessi
 
 int np2srv_url_setcap(void);
 
+void np2srv_url_destroy(void);
+
 #ifdef NP2SRV_URL_CAPAB
 
 struct lyd_node *op_parse_url(const char *url, int options, int *rc, sr_session_ctx_t *sr_sess);
@@ -66,8 +112,21 @@ int op_export_url(const char *url, struct lyd_node *data, int options, int *rc,
 
 #endif
 
+/**
+ * @brief Parse config anydata into a data tree. The anydata value is consumed, a data tree
+ * is moved out of it and any other value is freed once parsed so it can be used only once.
+ *
+ * @param[in] config Config anydata node.
+ * @param[in] options libyang parser options.
+ * @param[out] rc Sysrepo error value, set on error.
+ * @param[in] sr_sess Sysrepo session to set the error message on.
+ * @return Parsed data tree, NULL if empty or on error.
+ */
 struct lyd_node *op_parse_config(struct lyd_node_anydata *config, int options, int *rc, sr_session_ctx_t *sr_sess);
 
 int op_filter_create(struct lyd_node *filter_node, char ***filters, int *filter_count);
 
+int op_filter_data_get(sr_session_ctx_t *session, uint32_t max_depth, sr_get_oper_options_t get_opts, char **filters,
+        int filter_count, struct lyd_node **data);
+
 #endif /* NP2SRV_COMMON_H_ */
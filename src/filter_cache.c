@@ -0,0 +1,386 @@
+/**
+ * @file filter_cache.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of subtree filters translated to XPath
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+#include "common.h"
+#include "filter_cache.h"
+#include "hash_table.h"
+#include "log.h"
+
+/**
+ * @brief Cached subtree filter.
+ */
+struct np_fcache_entry {
+    char *key;                      /**< normalized subtree filter */
+    uint32_t hash;                  /**< hash of the key */
+    char **filters;                 /**< XPath filters */
+    int filter_count;               /**< number of filters */
+
+    struct np_fcache_entry *prev;   /**< more recently used entry */
+    struct np_fcache_entry *next;   /**< less recently used entry */
+};
+
+static struct {
+    pthread_mutex_t lock;           /**< lock for all the members */
+    const struct ly_ctx *ly_ctx;    /**< context of the cached filters */
+    uint16_t module_set_id;         /**< module set ID of the context */
+    struct np_ht *ht;               /**< hash table of all the entries (struct np_fcache_entry *) */
+    struct np_fcache_entry *first;  /**< most recently used entry */
+    struct np_fcache_entry *last;   /**< least recently used entry */
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t flushes;
+} fcache = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int
+np_filter_cache_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct np_fcache_entry *entry1 = *(struct np_fcache_entry **)val1_p, *entry2 = *(struct np_fcache_entry **)val2_p;
+
+    return !strcmp(entry1->key, entry2->key);
+}
+
+static void
+np_filter_cache_entry_free(struct np_fcache_entry *entry)
+{
+    int i;
+
+    for (i = 0; i < entry->filter_count; ++i) {
+        free(entry->filters[i]);
+    }
+    free(entry->filters);
+    free(entry->key);
+    free(entry);
+}
+
+/**
+ * @brief Unlink an entry from the LRU list, lock must be held.
+ */
+static void
+np_filter_cache_unlink(struct np_fcache_entry *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        fcache.first = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        fcache.last = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = NULL;
+}
+
+/**
+ * @brief Link an entry as the most recently used, lock must be held.
+ */
+static void
+np_filter_cache_link_first(struct np_fcache_entry *entry)
+{
+    entry->prev = NULL;
+    entry->next = fcache.first;
+    if (fcache.first) {
+        fcache.first->prev = entry;
+    } else {
+        fcache.last = entry;
+    }
+    fcache.first = entry;
+}
+
+/**
+ * @brief Remove all the entries, lock must be held.
+ */
+static void
+np_filter_cache_clear(void)
+{
+    struct np_fcache_entry *entry, *next;
+
+    for (entry = fcache.first; entry; entry = next) {
+        next = entry->next;
+        np_filter_cache_entry_free(entry);
+    }
+    fcache.first = NULL;
+    fcache.last = NULL;
+    if (fcache.ht) {
+        np_ht_clear(fcache.ht);
+    }
+}
+
+/**
+ * @brief Make sure the cache is usable for a context, lock must be held.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_filter_cache_prepare(const struct ly_ctx *ly_ctx)
+{
+    if (!fcache.ht) {
+        fcache.ht = np_ht_new(NP2SRV_FILTER_CACHE_SIZE * 2, sizeof(struct np_fcache_entry *), np_filter_cache_equal,
+                NULL);
+        if (!fcache.ht) {
+            EMEM;
+            return -1;
+        }
+    }
+
+    if ((fcache.ly_ctx != ly_ctx) || (fcache.module_set_id != ly_ctx_get_module_set_id(ly_ctx))) {
+        /* schema changed, the filters may no longer be valid */
+        if (fcache.first) {
+            np_filter_cache_clear();
+            ++fcache.flushes;
+        }
+        fcache.ly_ctx = ly_ctx;
+        fcache.module_set_id = ly_ctx_get_module_set_id(ly_ctx);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Append copies of filters to an array of filters.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_filter_cache_copy(char **src, int src_count, char ***filters, int *filter_count)
+{
+    char **new_filters;
+    int i;
+
+    if (!src_count) {
+        return 0;
+    }
+
+    new_filters = realloc(*filters, (*filter_count + src_count) * sizeof **filters);
+    if (!new_filters) {
+        EMEM;
+        return -1;
+    }
+    *filters = new_filters;
+
+    for (i = 0; i < src_count; ++i) {
+        (*filters)[*filter_count] = strdup(src[i]);
+        if (!(*filters)[*filter_count]) {
+            EMEM;
+            return -1;
+        }
+        ++(*filter_count);
+    }
+
+    return 0;
+}
+
+char *
+np_filter_cache_key(const char *filter)
+{
+    const char *ptr, *ws;
+    char *key;
+    size_t len = 0;
+
+    key = malloc(strlen(filter) + 1);
+    if (!key) {
+        EMEM;
+        return NULL;
+    }
+
+    for (ptr = filter; *ptr; ) {
+        if (isspace(*ptr) && (!len || (key[len - 1] == '>'))) {
+            /* skip whitespace that is the only text between elements */
+            for (ws = ptr; isspace(*ws); ++ws);
+            if (!*ws || (*ws == '<')) {
+                ptr = ws;
+                continue;
+            }
+        }
+        key[len++] = *ptr;
+        ++ptr;
+    }
+    key[len] = '\0';
+
+    return key;
+}
+
+int
+np_filter_cache_get(const struct ly_ctx *ly_ctx, const char *key, char ***filters, int *filter_count)
+{
+    struct np_fcache_entry entry_key, *entry_p, **match;
+    int ret = 1;
+
+    entry_key.key = (char *)key;
+    entry_key.hash = np_hash_multi(np_hash_multi(0, key, strlen(key)), NULL, 0);
+    entry_p = &entry_key;
+
+    pthread_mutex_lock(&fcache.lock);
+
+    if (np_filter_cache_prepare(ly_ctx)) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (np_ht_find(fcache.ht, &entry_p, entry_key.hash, (void **)&match)) {
+        ++fcache.misses;
+        goto cleanup;
+    }
+    ++fcache.hits;
+
+    /* move to the front */
+    np_filter_cache_unlink(*match);
+    np_filter_cache_link_first(*match);
+
+    if (np_filter_cache_copy((*match)->filters, (*match)->filter_count, filters, filter_count)) {
+        ret = -1;
+        goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    pthread_mutex_unlock(&fcache.lock);
+    return ret;
+}
+
+void
+np_filter_cache_put(const struct ly_ctx *ly_ctx, const char *key, char **filters, int filter_count)
+{
+    struct np_fcache_entry *entry, *evicted;
+    int r;
+
+    /* prepare the entry outside the lock */
+    entry = calloc(1, sizeof *entry);
+    if (!entry) {
+        EMEM;
+        return;
+    }
+    entry->key = strdup(key);
+    if (!entry->key) {
+        EMEM;
+        goto error;
+    }
+    entry->hash = np_hash_multi(np_hash_multi(0, key, strlen(key)), NULL, 0);
+    if (np_filter_cache_copy(filters, filter_count, &entry->filters, &entry->filter_count)) {
+        goto error;
+    }
+
+    pthread_mutex_lock(&fcache.lock);
+
+    if (np_filter_cache_prepare(ly_ctx)) {
+        pthread_mutex_unlock(&fcache.lock);
+        goto error;
+    }
+
+    if (!np_ht_find(fcache.ht, &entry, entry->hash, NULL)) {
+        /* cached by another thread meanwhile, do not evict anything */
+        pthread_mutex_unlock(&fcache.lock);
+        goto error;
+    }
+
+    if (fcache.ht->used >= NP2SRV_FILTER_CACHE_SIZE) {
+        /* evict the least recently used entry */
+        evicted = fcache.last;
+        np_ht_remove(fcache.ht, &evicted, evicted->hash);
+        np_filter_cache_unlink(evicted);
+        np_filter_cache_entry_free(evicted);
+        ++fcache.evictions;
+    }
+
+    r = np_ht_insert(fcache.ht, &entry, entry->hash, NULL);
+    if (r) {
+        /* an error */
+        pthread_mutex_unlock(&fcache.lock);
+        goto error;
+    }
+    np_filter_cache_link_first(entry);
+
+    pthread_mutex_unlock(&fcache.lock);
+    return;
+
+error:
+    np_filter_cache_entry_free(entry);
+}
+
+void
+np_filter_cache_destroy(void)
+{
+    pthread_mutex_lock(&fcache.lock);
+    np_filter_cache_clear();
+    np_ht_free(fcache.ht);
+    fcache.ht = NULL;
+    fcache.ly_ctx = NULL;
+    pthread_mutex_unlock(&fcache.lock);
+}
+
+/* /netopeer2-monitoring:netopeer2-state/filter-cache */
+int
+np_filter_cache_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name),
+        const char *UNUSED(path), const char *UNUSED(request_xpath), uint32_t UNUSED(request_id),
+        struct lyd_node **parent, void *UNUSED(private_data))
+{
+    struct lyd_node *cont;
+    uint32_t hits, misses, entries, evictions, flushes;
+    char num_str[11];
+
+    assert(*parent);
+
+    pthread_mutex_lock(&fcache.lock);
+    hits = fcache.hits;
+    misses = fcache.misses;
+    entries = fcache.ht ? fcache.ht->used : 0;
+    evictions = fcache.evictions;
+    flushes = fcache.flushes;
+    pthread_mutex_unlock(&fcache.lock);
+
+    cont = lyd_new_path(*parent, NULL, "filter-cache", NULL, 0, 0);
+    if (!cont) {
+        return SR_ERR_INTERNAL;
+    }
+
+    sprintf(num_str, "%u", hits);
+    if (!lyd_new_path(cont, NULL, "hits", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", misses);
+    if (!lyd_new_path(cont, NULL, "misses", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", entries);
+    if (!lyd_new_path(cont, NULL, "entries", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", evictions);
+    if (!lyd_new_path(cont, NULL, "evictions", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", flushes);
+    if (!lyd_new_path(cont, NULL, "flushes", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return SR_ERR_OK;
+}
@@ -0,0 +1,61 @@
+/**
+ * @file filter_cache.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of subtree filters translated to XPath header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_FILTER_CACHE_H_
+#define NP2SRV_FILTER_CACHE_H_
+
+#include <stdint.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+/**
+ * @brief Create the cache key of a subtree filter, whitespace between its elements is removed.
+ *
+ * @param[in] filter Subtree filter XML.
+ * @return Cache key, NULL on error.
+ */
+char *np_filter_cache_key(const char *filter);
+
+/**
+ * @brief Find a subtree filter in the cache and append copies of its XPath filters.
+ *
+ * @param[in] ly_ctx libyang context, the cache is flushed if its module set changed.
+ * @param[in] key Cache key of the subtree filter.
+ * @param[in,out] filters Array of filters to append to.
+ * @param[in,out] filter_count Number of filters.
+ * @return 0 if found, 1 if not found, -1 on error.
+ */
+int np_filter_cache_get(const struct ly_ctx *ly_ctx, const char *key, char ***filters, int *filter_count);
+
+/**
+ * @brief Store copies of the XPath filters of a subtree filter in the cache,
+ * the least recently used subtree filter is evicted if the cache is full.
+ *
+ * @param[in] ly_ctx libyang context used for creating the filters.
+ * @param[in] key Cache key of the subtree filter.
+ * @param[in] filters Array of filters.
+ * @param[in] filter_count Number of filters.
+ */
+void np_filter_cache_put(const struct ly_ctx *ly_ctx, const char *key, char **filters, int filter_count);
+
+/**
+ * @brief Free the cache.
+ */
+void np_filter_cache_destroy(void);
+
+int np_filter_cache_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path,
+        const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data);
+
+#endif /* NP2SRV_FILTER_CACHE_H_ */
@@ -0,0 +1,261 @@
+/**
+ * @file hash_table.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server generic hash table
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hash_table.h"
+
+/* enlarge when this percentage of records is used (removed records included) */
+#define NP_HT_ENLARGE_PERCENTAGE 75
+
+#define NP_HT_REC(ht, idx) ((struct np_ht_rec *)&(ht)->recs[(size_t)(idx) * (ht)->rec_size])
+
+uint32_t
+np_hash_multi(uint32_t hash, const void *key_part, size_t len)
+{
+    const unsigned char *data = key_part;
+    size_t i;
+
+    /* one-at-a-time hash by Bob Jenkins */
+    if (key_part) {
+        for (i = 0; i < len; ++i) {
+            hash += data[i];
+            hash += (hash << 10);
+            hash ^= (hash >> 6);
+        }
+    } else {
+        hash += (hash << 3);
+        hash ^= (hash >> 11);
+        hash += (hash << 15);
+    }
+
+    return hash;
+}
+
+struct np_ht *
+np_ht_new(uint32_t size, uint16_t val_size, np_ht_value_equal_cb val_equal, void *cb_data)
+{
+    struct np_ht *ht;
+    uint32_t real_size;
+
+    /* round up to a power of 2 */
+    for (real_size = 8; real_size < size; real_size <<= 1);
+
+    ht = malloc(sizeof *ht);
+    if (!ht) {
+        return NULL;
+    }
+
+    ht->used = 0;
+    ht->invalid = 0;
+    ht->size = real_size;
+    ht->val_equal = val_equal;
+    ht->cb_data = cb_data;
+    ht->val_size = val_size;
+    /* keep the values aligned */
+    ht->rec_size = ((offsetof(struct np_ht_rec, val) + val_size + sizeof(void *) - 1) / sizeof(void *)) * sizeof(void *);
+
+    ht->recs = calloc(ht->size, ht->rec_size);
+    if (!ht->recs) {
+        free(ht);
+        return NULL;
+    }
+
+    return ht;
+}
+
+void
+np_ht_free(struct np_ht *ht)
+{
+    if (!ht) {
+        return;
+    }
+
+    free(ht->recs);
+    free(ht);
+}
+
+void
+np_ht_clear(struct np_ht *ht)
+{
+    memset(ht->recs, 0, (size_t)ht->size * ht->rec_size);
+    ht->used = 0;
+    ht->invalid = 0;
+}
+
+/**
+ * @brief Find a record with a value or the first usable record for it.
+ *
+ * @param[in] ht Hash table.
+ * @param[in] val_p Value to find.
+ * @param[in] hash Value hash.
+ * @param[out] rec_p Found record, if found, or the first removed/empty record.
+ * @return 0 if found, 1 if not.
+ */
+static int
+np_ht_find_rec(struct np_ht *ht, void *val_p, uint32_t hash, struct np_ht_rec **rec_p)
+{
+    struct np_ht_rec *rec, *free_rec = NULL;
+    uint32_t i, idx;
+
+    idx = hash & (ht->size - 1);
+    for (i = 0; i < ht->size; ++i) {
+        rec = NP_HT_REC(ht, idx);
+        if (!rec->hits) {
+            /* end of the collision chain */
+            *rec_p = free_rec ? free_rec : rec;
+            return 1;
+        } else if (rec->hits == -1) {
+            if (!free_rec) {
+                free_rec = rec;
+            }
+        } else if ((rec->hash == hash) && ht->val_equal(val_p, rec->val, ht->cb_data)) {
+            *rec_p = rec;
+            return 0;
+        }
+
+        idx = (idx + 1) & (ht->size - 1);
+    }
+
+    *rec_p = free_rec;
+    return 1;
+}
+
+/**
+ * @brief Resize a hash table to double its size and rehash all the values.
+ *
+ * @param[in] ht Hash table to enlarge.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ht_resize(struct np_ht *ht)
+{
+    unsigned char *old_recs;
+    uint32_t old_size, i;
+    struct np_ht_rec *rec, *new_rec;
+
+    old_recs = ht->recs;
+    old_size = ht->size;
+
+    /* only double the size if there were not too many removed records */
+    if (ht->used * 2 > old_size) {
+        ht->size <<= 1;
+    }
+    ht->recs = calloc(ht->size, ht->rec_size);
+    if (!ht->recs) {
+        ht->recs = old_recs;
+        ht->size = old_size;
+        return -1;
+    }
+    ht->used = 0;
+    ht->invalid = 0;
+
+    for (i = 0; i < old_size; ++i) {
+        rec = (struct np_ht_rec *)&old_recs[(size_t)i * ht->rec_size];
+        if (rec->hits < 1) {
+            continue;
+        }
+
+        /* cannot be found, there are no removed records */
+        np_ht_find_rec(ht, rec->val, rec->hash, &new_rec);
+        memcpy(new_rec, rec, ht->rec_size);
+        ++ht->used;
+    }
+
+    free(old_recs);
+    return 0;
+}
+
+int
+np_ht_find(struct np_ht *ht, void *val_p, uint32_t hash, void **match_p)
+{
+    struct np_ht_rec *rec;
+
+    if (np_ht_find_rec(ht, val_p, hash, &rec)) {
+        return 1;
+    }
+
+    if (match_p) {
+        *match_p = rec->val;
+    }
+    return 0;
+}
+
+int
+np_ht_insert(struct np_ht *ht, void *val_p, uint32_t hash, void **match_p)
+{
+    struct np_ht_rec *rec;
+
+    if (!np_ht_find_rec(ht, val_p, hash, &rec)) {
+        if (match_p) {
+            *match_p = rec->val;
+        }
+        return 1;
+    }
+
+    if (((ht->used + ht->invalid + 1) * 100) / ht->size >= NP_HT_ENLARGE_PERCENTAGE) {
+        if (np_ht_resize(ht)) {
+            return -1;
+        }
+        np_ht_find_rec(ht, val_p, hash, &rec);
+    }
+
+    if (rec->hits == -1) {
+        --ht->invalid;
+    }
+    rec->hash = hash;
+    rec->hits = 1;
+    memcpy(rec->val, val_p, ht->val_size);
+    ++ht->used;
+
+    if (match_p) {
+        *match_p = rec->val;
+    }
+    return 0;
+}
+
+int
+np_ht_remove(struct np_ht *ht, void *val_p, uint32_t hash)
+{
+    struct np_ht_rec *rec;
+
+    if (np_ht_find_rec(ht, val_p, hash, &rec)) {
+        return 1;
+    }
+
+    rec->hits = -1;
+    --ht->used;
+    ++ht->invalid;
+    return 0;
+}
+
+void *
+np_ht_iter_next(struct np_ht *ht, uint32_t *idx)
+{
+    struct np_ht_rec *rec;
+
+    while (*idx < ht->size) {
+        rec = NP_HT_REC(ht, *idx);
+        ++(*idx);
+        if (rec->hits == 1) {
+            return rec->val;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file hash_table.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server generic hash table header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_HASH_TABLE_H_
+#define NP2SRV_HASH_TABLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Callback for checking hash table values equivalence.
+ *
+ * @param[in] val1_p Pointer to the first value.
+ * @param[in] val2_p Pointer to the second value.
+ * @param[in] cb_data User callback data.
+ * @return non-zero if values are equal, 0 otherwise.
+ */
+typedef int (*np_ht_value_equal_cb)(void *val1_p, void *val2_p, void *cb_data);
+
+/**
+ * @brief Hash table record.
+ */
+struct np_ht_rec {
+    uint32_t hash;      /**< hash of the value */
+    int32_t hits;       /**< 0 - empty record, -1 - removed record, 1 - used record */
+    unsigned char val[1];   /**< beginning of the value (of size np_ht.rec_size - 8) */
+};
+
+/**
+ * @brief Open-addressing hash table with linear probing storing values of a fixed size.
+ * It is not thread-safe, callers are expected to provide their own locking.
+ */
+struct np_ht {
+    uint32_t used;      /**< number of used records */
+    uint32_t invalid;   /**< number of removed records */
+    uint32_t size;      /**< number of all records, always a power of 2 */
+    np_ht_value_equal_cb val_equal; /**< value equivalence callback */
+    void *cb_data;      /**< user data for the callback */
+    uint16_t val_size;  /**< size of a stored value */
+    uint16_t rec_size;  /**< size of one record */
+    unsigned char *recs;    /**< hash table records */
+};
+
+/**
+ * @brief Compute hash from (several) string(s) or raw data.
+ *
+ * Usage:
+ * - init hash to 0
+ * - repeatedly call ::np_hash_multi(), where hash is the return value from the previous call
+ * - call ::np_hash_multi() with key_part = NULL to get the final hash
+ *
+ * @param[in] hash Previous hash.
+ * @param[in] key_part Data to hash.
+ * @param[in] len Length of @p key_part.
+ * @return Hash with the new data hashed.
+ */
+uint32_t np_hash_multi(uint32_t hash, const void *key_part, size_t len);
+
+/**
+ * @brief Create new hash table.
+ *
+ * @param[in] size Starting size of the hash table (rounded up to a power of 2).
+ * @param[in] val_size Size in bytes of the stored values.
+ * @param[in] val_equal Value equivalence callback.
+ * @param[in] cb_data User data for the callback.
+ * @return Empty hash table, NULL on error.
+ */
+struct np_ht *np_ht_new(uint32_t size, uint16_t val_size, np_ht_value_equal_cb val_equal, void *cb_data);
+
+/**
+ * @brief Free a hash table (but not the stored values).
+ *
+ * @param[in] ht Hash table to free.
+ */
+void np_ht_free(struct np_ht *ht);
+
+/**
+ * @brief Remove all the values from a hash table, keep its size.
+ *
+ * @param[in] ht Hash table to clear.
+ */
+void np_ht_clear(struct np_ht *ht);
+
+/**
+ * @brief Find a value in a hash table.
+ *
+ * @param[in] ht Hash table to search in.
+ * @param[in] val_p Pointer to the value to find.
+ * @param[in] hash Hash of the value.
+ * @param[out] match_p Optional pointer to the stored matching value.
+ * @return 0 if found, 1 if not found.
+ */
+int np_ht_find(struct np_ht *ht, void *val_p, uint32_t hash, void **match_p);
+
+/**
+ * @brief Insert a value into a hash table, it may be enlarged.
+ *
+ * @param[in] ht Hash table to insert into.
+ * @param[in] val_p Pointer to the value to insert, it is copied.
+ * @param[in] hash Hash of the value.
+ * @param[out] match_p Optional pointer to the stored value (new or the already existing equal one).
+ * @return 0 on success, 1 if an equal value already exists, -1 on error.
+ */
+int np_ht_insert(struct np_ht *ht, void *val_p, uint32_t hash, void **match_p);
+
+/**
+ * @brief Remove a value from a hash table.
+ *
+ * @param[in] ht Hash table to remove from.
+ * @param[in] val_p Pointer to the value to remove.
+ * @param[in] hash Hash of the value.
+ * @return 0 on success, 1 if not found.
+ */
+int np_ht_remove(struct np_ht *ht, void *val_p, uint32_t hash);
+
+/**
+ * @brief Iterate over all the stored values.
+ *
+ * @param[in] ht Hash table to iterate over.
+ * @param[in,out] idx Iterator index, set to 0 for the first call.
+ * @return Pointer to the next stored value, NULL if there are no more.
+ */
+void *np_ht_iter_next(struct np_ht *ht, uint32_t *idx);
+
+#endif /* NP2SRV_HASH_TABLE_H_ */
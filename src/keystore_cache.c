@@ -0,0 +1,575 @@
+/**
+ * @file keystore_cache.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of keystore and truststore data
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <nc_server.h>
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+#include "common.h"
+#include "keystore_cache.h"
+#include "log.h"
+#include "netconf_server.h"
+
+/**
+ * @brief Cached asymmetric key.
+ */
+struct np_ks_key {
+    char *name;                     /**< key name */
+    char *privkey_data;             /**< private key data, NULL if not usable */
+    NC_SSH_KEY_TYPE privkey_type;   /**< private key type */
+};
+
+/**
+ * @brief Cached certificate of an asymmetric key.
+ */
+struct np_ks_cert {
+    char *name;                     /**< certificate name */
+    char *cert_data;                /**< certificate data */
+    uint32_t key_idx;               /**< index of the asymmetric key of the certificate */
+};
+
+/**
+ * @brief Cached keystore data.
+ */
+struct np_ks_data {
+    struct np_ks_key *keys;
+    uint32_t key_count;
+    struct np_ks_cert *certs;
+    uint32_t cert_count;
+};
+
+/**
+ * @brief Cached truststore certificate list.
+ */
+struct np_ts_list {
+    char *name;                     /**< certificate list name */
+    char **certs;                   /**< certificates data */
+    int cert_count;                 /**< number of certificates */
+};
+
+/**
+ * @brief Cached truststore data.
+ */
+struct np_ts_data {
+    struct np_ts_list *lists;
+    uint32_t list_count;
+};
+
+static struct {
+    pthread_rwlock_t lock;          /**< lock for all the members */
+    int ks_valid;                   /**< whether keystore data are loaded */
+    struct np_ks_data ks;           /**< keystore data */
+    int ts_valid;                   /**< whether truststore data are loaded */
+    struct np_ts_data ts;           /**< truststore data */
+} kscache = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+/**
+ * @brief Get the value of a child leaf.
+ *
+ * @param[in] parent Parent data node.
+ * @param[in] name Child leaf name.
+ * @return Leaf canonical value, NULL if not found.
+ */
+static const char *
+np_ks_child_value(const struct lyd_node *parent, const char *name)
+{
+    const struct lyd_node *node;
+
+    LY_TREE_FOR(parent->child, node) {
+        if (!strcmp(node->schema->name, name)) {
+            return ((struct lyd_node_leaf_list *)node)->value_str;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+np_ks_free(struct np_ks_data *ks)
+{
+    uint32_t i;
+
+    for (i = 0; i < ks->key_count; ++i) {
+        free(ks->keys[i].name);
+        free(ks->keys[i].privkey_data);
+    }
+    free(ks->keys);
+    for (i = 0; i < ks->cert_count; ++i) {
+        free(ks->certs[i].name);
+        free(ks->certs[i].cert_data);
+    }
+    free(ks->certs);
+    memset(ks, 0, sizeof *ks);
+}
+
+static void
+np_ts_free(struct np_ts_data *ts)
+{
+    uint32_t i;
+    int j;
+
+    for (i = 0; i < ts->list_count; ++i) {
+        free(ts->lists[i].name);
+        for (j = 0; j < ts->lists[i].cert_count; ++j) {
+            free(ts->lists[i].certs[j]);
+        }
+        free(ts->lists[i].certs);
+    }
+    free(ts->lists);
+    memset(ts, 0, sizeof *ts);
+}
+
+/**
+ * @brief Load and parse all the asymmetric keys and their certificates.
+ *
+ * @param[in] session Sysrepo session to use.
+ * @param[out] ks Loaded keystore data.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ks_load(sr_session_ctx_t *session, struct np_ks_data *ks)
+{
+    struct lyd_node *data = NULL;
+    struct ly_set *keys = NULL, *certs = NULL;
+    struct np_ks_key *key;
+    struct np_ks_cert *cert;
+    const char *name, *value;
+    uint32_t i, j;
+    int r, rc = -1;
+    void *mem;
+
+    memset(ks, 0, sizeof *ks);
+
+    r = sr_get_subtree(session, "/ietf-keystore:keystore", 0, &data);
+    if (r != SR_ERR_OK) {
+        ERR("Getting keystore data failed (%s).", sr_strerror(r));
+        goto cleanup;
+    } else if (!data) {
+        /* empty keystore */
+        rc = 0;
+        goto cleanup;
+    }
+
+    keys = lyd_find_path(data, "asymmetric-keys/asymmetric-key");
+    if (!keys) {
+        /* libyang error printed */
+        goto cleanup;
+    }
+    if (keys->number) {
+        ks->keys = calloc(keys->number, sizeof *ks->keys);
+        if (!ks->keys) {
+            EMEM;
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < keys->number; ++i) {
+        key = &ks->keys[ks->key_count];
+        key->name = strdup(((struct lyd_node_leaf_list *)keys->set.d[i]->child)->value_str);
+        if (!key->name) {
+            EMEM;
+            goto cleanup;
+        }
+        ++ks->key_count;
+
+        /* a key without a usable private key is still cached so that it is properly reported when used */
+        if (np2srv_sr_get_privkey(keys->set.d[i], &key->privkey_data, &key->privkey_type)) {
+            key->privkey_data = NULL;
+        }
+
+        /* certificates of the key */
+        certs = lyd_find_path(keys->set.d[i], "certificates/certificate");
+        if (!certs) {
+            goto cleanup;
+        }
+        if (certs->number) {
+            mem = realloc(ks->certs, (ks->cert_count + certs->number) * sizeof *ks->certs);
+            if (!mem) {
+                EMEM;
+                goto cleanup;
+            }
+            ks->certs = mem;
+        }
+        for (j = 0; j < certs->number; ++j) {
+            name = np_ks_child_value(certs->set.d[j], "name");
+            value = np_ks_child_value(certs->set.d[j], "cert");
+            if (!name || !value) {
+                continue;
+            }
+
+            cert = &ks->certs[ks->cert_count];
+            cert->name = strdup(name);
+            cert->cert_data = strdup(value);
+            cert->key_idx = ks->key_count - 1;
+            ++ks->cert_count;
+            if (!cert->name || !cert->cert_data) {
+                EMEM;
+                goto cleanup;
+            }
+        }
+        ly_set_free(certs);
+        certs = NULL;
+    }
+
+    /* success */
+    rc = 0;
+
+cleanup:
+    ly_set_free(certs);
+    ly_set_free(keys);
+    lyd_free_withsiblings(data);
+    if (rc) {
+        np_ks_free(ks);
+    }
+    return rc;
+}
+
+/**
+ * @brief Load all the truststore certificate lists.
+ *
+ * @param[in] session Sysrepo session to use.
+ * @param[out] ts Loaded truststore data.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ts_load(sr_session_ctx_t *session, struct np_ts_data *ts)
+{
+    struct lyd_node *data = NULL;
+    struct ly_set *lists = NULL, *certs = NULL;
+    struct np_ts_list *list;
+    uint32_t i, j;
+    int r, rc = -1;
+
+    memset(ts, 0, sizeof *ts);
+
+    r = sr_get_subtree(session, "/ietf-truststore:truststore", 0, &data);
+    if (r != SR_ERR_OK) {
+        ERR("Getting truststore data failed (%s).", sr_strerror(r));
+        goto cleanup;
+    } else if (!data) {
+        /* empty truststore */
+        rc = 0;
+        goto cleanup;
+    }
+
+    lists = lyd_find_path(data, "certificates");
+    if (!lists) {
+        /* libyang error printed */
+        goto cleanup;
+    }
+    if (lists->number) {
+        ts->lists = calloc(lists->number, sizeof *ts->lists);
+        if (!ts->lists) {
+            EMEM;
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < lists->number; ++i) {
+        list = &ts->lists[ts->list_count];
+        list->name = strdup(((struct lyd_node_leaf_list *)lists->set.d[i]->child)->value_str);
+        if (!list->name) {
+            EMEM;
+            goto cleanup;
+        }
+        ++ts->list_count;
+
+        /* all the certificates */
+        certs = lyd_find_path(lists->set.d[i], "certificate/cert");
+        if (!certs) {
+            goto cleanup;
+        }
+        if (certs->number) {
+            list->certs = malloc(certs->number * sizeof *list->certs);
+            if (!list->certs) {
+                EMEM;
+                goto cleanup;
+            }
+        }
+        for (j = 0; j < certs->number; ++j) {
+            list->certs[j] = strdup(((struct lyd_node_leaf_list *)certs->set.d[j])->value_str);
+            if (!list->certs[j]) {
+                EMEM;
+                goto cleanup;
+            }
+            ++list->cert_count;
+        }
+        ly_set_free(certs);
+        certs = NULL;
+    }
+
+    /* success */
+    rc = 0;
+
+cleanup:
+    ly_set_free(certs);
+    ly_set_free(lists);
+    lyd_free_withsiblings(data);
+    if (rc) {
+        np_ts_free(ts);
+    }
+    return rc;
+}
+
+/**
+ * @brief READ lock the cache, load the required data if not yet loaded.
+ *
+ * @param[in] truststore Whether truststore or keystore data are required.
+ * @return 0 on success (lock is held), -1 on error.
+ */
+static int
+np_kscache_rdlock(int truststore)
+{
+    sr_session_ctx_t *sr_sess;
+    int *valid, r;
+
+    valid = truststore ? &kscache.ts_valid : &kscache.ks_valid;
+
+    pthread_rwlock_rdlock(&kscache.lock);
+    if (*valid) {
+        return 0;
+    }
+    pthread_rwlock_unlock(&kscache.lock);
+
+    /* the data were not loaded by the change subscription, load them now */
+    pthread_rwlock_wrlock(&kscache.lock);
+    if (!*valid) {
+        if (sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, &sr_sess) != SR_ERR_OK) {
+            pthread_rwlock_unlock(&kscache.lock);
+            return -1;
+        }
+        r = truststore ? np_ts_load(sr_sess, &kscache.ts) : np_ks_load(sr_sess, &kscache.ks);
+        sr_session_stop(sr_sess);
+        if (r) {
+            pthread_rwlock_unlock(&kscache.lock);
+            return -1;
+        }
+        *valid = 1;
+    }
+    pthread_rwlock_unlock(&kscache.lock);
+
+    /* the data can only be replaced meanwhile */
+    pthread_rwlock_rdlock(&kscache.lock);
+    return 0;
+}
+
+/**
+ * @brief Copy key data, lock must be held.
+ */
+static int
+np_ks_key_copy(const struct np_ks_key *key, char **privkey_data, NC_SSH_KEY_TYPE *privkey_type)
+{
+    if (!key->privkey_data) {
+        ERR("Failed to find asymmetric key \"%s\" information.", key->name);
+        return -1;
+    }
+
+    *privkey_data = strdup(key->privkey_data);
+    if (!*privkey_data) {
+        EMEM;
+        return -1;
+    }
+    *privkey_type = key->privkey_type;
+
+    return 0;
+}
+
+int
+np_keystore_cache_privkey(const char *name, char **privkey_data, NC_SSH_KEY_TYPE *privkey_type)
+{
+    uint32_t i;
+    int rc = -1;
+
+    if (np_kscache_rdlock(0)) {
+        return -1;
+    }
+
+    for (i = 0; i < kscache.ks.key_count; ++i) {
+        if (!strcmp(kscache.ks.keys[i].name, name)) {
+            break;
+        }
+    }
+    if (i == kscache.ks.key_count) {
+        ERR("Hostkey \"%s\" not found.", name);
+        goto cleanup;
+    }
+
+    rc = np_ks_key_copy(&kscache.ks.keys[i], privkey_data, privkey_type);
+
+cleanup:
+    pthread_rwlock_unlock(&kscache.lock);
+    return rc;
+}
+
+int
+np_keystore_cache_cert(const char *name, char **cert_data, char **privkey_data, NC_SSH_KEY_TYPE *privkey_type)
+{
+    struct np_ks_cert *cert;
+    uint32_t i;
+    int rc = -1;
+
+    if (np_kscache_rdlock(0)) {
+        return -1;
+    }
+
+    for (i = 0; i < kscache.ks.cert_count; ++i) {
+        if (!strcmp(kscache.ks.certs[i].name, name)) {
+            break;
+        }
+    }
+    if (i == kscache.ks.cert_count) {
+        ERR("Server certificate \"%s\" not found.", name);
+        goto cleanup;
+    }
+    cert = &kscache.ks.certs[i];
+
+    if (np_ks_key_copy(&kscache.ks.keys[cert->key_idx], privkey_data, privkey_type)) {
+        goto cleanup;
+    }
+    *cert_data = strdup(cert->cert_data);
+    if (!*cert_data) {
+        EMEM;
+        free(*privkey_data);
+        *privkey_data = NULL;
+        goto cleanup;
+    }
+
+    /* success */
+    rc = 0;
+
+cleanup:
+    pthread_rwlock_unlock(&kscache.lock);
+    return rc;
+}
+
+int
+np_keystore_cache_cert_list(const char *name, char ***cert_data, int *cert_data_count)
+{
+    struct np_ts_list *list;
+    uint32_t i;
+    int j, rc = -1;
+
+    if (np_kscache_rdlock(1)) {
+        return -1;
+    }
+
+    for (i = 0; i < kscache.ts.list_count; ++i) {
+        if (!strcmp(kscache.ts.lists[i].name, name)) {
+            break;
+        }
+    }
+    if (i == kscache.ts.list_count) {
+        ERR("Certificate list \"%s\" not found.", name);
+        goto cleanup;
+    }
+    list = &kscache.ts.lists[i];
+
+    if (!list->cert_count) {
+        WRN("Certificate list \"%s\" does not define any actual certificates.", name);
+        rc = 0;
+        goto cleanup;
+    }
+
+    *cert_data = malloc(list->cert_count * sizeof **cert_data);
+    if (!*cert_data) {
+        EMEM;
+        goto cleanup;
+    }
+    for (j = 0; j < list->cert_count; ++j) {
+        (*cert_data)[j] = strdup(list->certs[j]);
+        if (!(*cert_data)[j]) {
+            EMEM;
+            while (j) {
+                --j;
+                free((*cert_data)[j]);
+            }
+            free(*cert_data);
+            *cert_data = NULL;
+            goto cleanup;
+        }
+    }
+    *cert_data_count = list->cert_count;
+
+    /* success */
+    rc = 0;
+
+cleanup:
+    pthread_rwlock_unlock(&kscache.lock);
+    return rc;
+}
+
+void
+np_keystore_cache_destroy(void)
+{
+    pthread_rwlock_wrlock(&kscache.lock);
+    np_ks_free(&kscache.ks);
+    kscache.ks_valid = 0;
+    np_ts_free(&kscache.ts);
+    kscache.ts_valid = 0;
+    pthread_rwlock_unlock(&kscache.lock);
+}
+
+/* /ietf-keystore:keystore/asymmetric-keys, /ietf-truststore:truststore/certificates */
+int
+np_keystore_cache_change_cb(sr_session_ctx_t *session, const char *module_name, const char *UNUSED(xpath),
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    struct np_ks_data ks, old_ks;
+    struct np_ts_data ts, old_ts;
+    int r;
+
+    memset(&old_ks, 0, sizeof old_ks);
+    memset(&old_ts, 0, sizeof old_ts);
+
+    /* load the new data without holding the lock, then replace the cached data */
+    if (!strcmp(module_name, "ietf-keystore")) {
+        r = np_ks_load(session, &ks);
+
+        pthread_rwlock_wrlock(&kscache.lock);
+        old_ks = kscache.ks;
+        if (r) {
+            /* load the data again when they are needed */
+            memset(&kscache.ks, 0, sizeof kscache.ks);
+            kscache.ks_valid = 0;
+        } else {
+            kscache.ks = ks;
+            kscache.ks_valid = 1;
+        }
+        pthread_rwlock_unlock(&kscache.lock);
+    } else {
+        r = np_ts_load(session, &ts);
+
+        pthread_rwlock_wrlock(&kscache.lock);
+        old_ts = kscache.ts;
+        if (r) {
+            memset(&kscache.ts, 0, sizeof kscache.ts);
+            kscache.ts_valid = 0;
+        } else {
+            kscache.ts = ts;
+            kscache.ts_valid = 1;
+        }
+        pthread_rwlock_unlock(&kscache.lock);
+    }
+
+    np_ks_free(&old_ks);
+    np_ts_free(&old_ts);
+    return SR_ERR_OK;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file keystore_cache.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of keystore and truststore data header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_KEYSTORE_CACHE_H_
+#define NP2SRV_KEYSTORE_CACHE_H_
+
+#include <stdint.h>
+
+#include <nc_server.h>
+#include <sysrepo.h>
+
+/**
+ * @brief Get a copy of a cached private key.
+ *
+ * @param[in] name Asymmetric key name.
+ * @param[out] privkey_data Private key data.
+ * @param[out] privkey_type Private key type.
+ * @return 0 on success, -1 on error.
+ */
+int np_keystore_cache_privkey(const char *name, char **privkey_data, NC_SSH_KEY_TYPE *privkey_type);
+
+/**
+ * @brief Get a copy of a cached certificate and its private key.
+ *
+ * @param[in] name Certificate name.
+ * @param[out] cert_data Certificate data.
+ * @param[out] privkey_data Private key data of the certificate.
+ * @param[out] privkey_type Private key type.
+ * @return 0 on success, -1 on error.
+ */
+int np_keystore_cache_cert(const char *name, char **cert_data, char **privkey_data, NC_SSH_KEY_TYPE *privkey_type);
+
+/**
+ * @brief Get a copy of a cached truststore certificate list.
+ *
+ * @param[in] name Certificate list name.
+ * @param[out] cert_data Array of certificate data.
+ * @param[out] cert_data_count Number of certificates.
+ * @return 0 on success, -1 on error.
+ */
+int np_keystore_cache_cert_list(const char *name, char ***cert_data, int *cert_data_count);
+
+/**
+ * @brief Free the cache.
+ */
+void np_keystore_cache_destroy(void);
+
+/* /ietf-keystore:keystore/asymmetric-keys, /ietf-truststore:truststore/certificates */
+int np_keystore_cache_change_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath,
+        sr_event_t event, uint32_t request_id, void *private_data);
+
+#endif /* NP2SRV_KEYSTORE_CACHE_H_ */
@@ -13,12 +13,17 @@
  */
 #define _DEFAULT_SOURCE
 
+#include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <sys/types.h>
 #include <syslog.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <nc_server.h>
@@ -33,98 +38,346 @@ uint8_t np2_libssh_verbose_level;
 uint8_t np2_sr_verbose_level;
 uint8_t np2_stderr_log;
 
+/**
+ * @brief Sources of log messages.
+ */
+enum np2log_src {
+    NP2LOG_NP = 0,  /**< netopeer2-server */
+    NP2LOG_LN,      /**< libnetconf2 */
+    NP2LOG_LY,      /**< libyang */
+    NP2LOG_SR,      /**< sysrepo */
+    NP2LOG_SRC_COUNT
+};
+
+static const char *np2log_src_names[NP2LOG_SRC_COUNT] = {"NP", "LN", "LY", "SR"};
+
+/**
+ * @brief Log message record in the ring buffer.
+ */
+struct np2log_rec {
+    ATOMIC_T seq;                       /**< sequence number, position + 1 when written and position + size when read */
+    int priority;                       /**< syslog priority */
+    enum np2log_src src;                /**< message source */
+    char *long_msg;                     /**< allocated message if it did not fit into msg */
+    char msg[NP2SRV_MSG_LEN_START];     /**< message */
+};
+
+/**
+ * @brief Logger state.
+ *
+ * Any thread writes messages into the ring buffer without locking and the logging thread prints them.
+ */
+static struct {
+    struct np2log_rec ring[NP2SRV_LOG_RING_SIZE];   /**< ring buffer of messages */
+    ATOMIC_T tail;                      /**< position of the next written message */
+    uint32_t head;                      /**< position of the next read message, used only by the logging thread */
+
+    ATOMIC_T running;                   /**< whether the logging thread is running, otherwise messages are printed directly */
+    ATOMIC_T sleeping;                  /**< whether the logging thread waits for new messages */
+    pthread_t tid;                      /**< logging thread */
+    pthread_mutex_t lock;               /**< lock for the condition */
+    pthread_cond_t cond;                /**< condition signalled when a message is written */
+
+    struct {
+        time_t window;                  /**< second the messages are counted in */
+        uint32_t count;                 /**< number of messages printed in the window */
+        uint32_t suppressed;            /**< number of messages suppressed in the window */
+    } rate[NP2LOG_SRC_COUNT];           /**< rate limiting of every source, used only by the logging thread */
+
+    ATOMIC_T dropped;                   /**< number of messages dropped because the ring buffer was full */
+    ATOMIC_T suppressed;                /**< number of messages suppressed by rate limiting */
+} logger = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * @brief Print a log message to syslog and stderr.
+ *
+ * @param[in] priority Syslog priority.
+ * @param[in] src Message source.
+ * @param[in] msg Message.
+ */
 static void
-np2log(int priority, const char *src, const char *fmt, ...)
+np2log_write(int priority, enum np2log_src src, const char *msg)
 {
-    char *format;
-    va_list ap;
+    const char *prio_str;
 
-    va_start(ap, fmt);
-    vsyslog(priority, fmt, ap);
-    va_end(ap);
+    syslog(priority, "%s", msg);
 
     if (np2_stderr_log) {
-        format = malloc(11 + strlen(fmt) + 2);
-        if (!format) {
-            fprintf(stderr, "[ERR]: Memory allocation failed (%s:%d)", __FILE__, __LINE__);
-            return;
-        }
-
         switch (priority) {
         case LOG_ERR:
-            sprintf(format, "[ERR]: %s: %s\n", src, fmt);
+            prio_str = "ERR";
             break;
         case LOG_WARNING:
-            sprintf(format, "[WRN]: %s: %s\n", src, fmt);
+            prio_str = "WRN";
             break;
         case LOG_INFO:
-            sprintf(format, "[INF]: %s: %s\n", src, fmt);
+            prio_str = "INF";
             break;
         case LOG_DEBUG:
-            sprintf(format, "[DBG]: %s: %s\n", src, fmt);
+            prio_str = "DBG";
             break;
         default:
-            sprintf(format, "[UNKNOWN]: %s: %s\n", src, fmt);
+            prio_str = "UNKNOWN";
             break;
         }
 
-        va_start(ap, fmt);
-        vfprintf(stderr, format, ap);
-        va_end(ap);
+        fprintf(stderr, "[%s]: %s: %s\n", prio_str, np2log_src_names[src], msg);
+    }
+}
 
-        free(format);
+/**
+ * @brief Print a message into a buffer, allocate it if the buffer is too small.
+ *
+ * @param[in] buf Buffer of ::NP2SRV_MSG_LEN_START size.
+ * @param[out] long_msg Allocated message, NULL if it fit into @p buf.
+ * @param[in] fmt Message format.
+ * @param[in] ap Format arguments.
+ */
+static void
+np2log_format(char *buf, char **long_msg, const char *fmt, va_list ap)
+{
+    va_list ap2;
+    int len;
+
+    *long_msg = NULL;
+
+    va_copy(ap2, ap);
+    len = vsnprintf(buf, NP2SRV_MSG_LEN_START, fmt, ap);
+    if (len == -1) {
+        buf[0] = '\0';
+    } else if (len >= NP2SRV_MSG_LEN_START) {
+        /* print the whole message, keep the truncated one if it fails */
+        *long_msg = malloc(len + 1);
+        if (*long_msg) {
+            vsnprintf(*long_msg, len + 1, fmt, ap2);
+        }
     }
+    va_end(ap2);
 }
 
 /**
- * @brief Encode message characters (% -> %%) to avoid printf arg problems.
+ * @brief Print a message from the ring buffer, unless its source is rate limited.
+ *
+ * @param[in] rec Message record.
+ * @param[in] now Current time.
  */
-static const char *
-np2log_encode(const char *msg, char **buf)
+static void
+np2log_rec_write(struct np2log_rec *rec, time_t now)
 {
-    const char *ptr1, *ptr2;
-    size_t buf_len, buf_size = 1;
-    void *mem;
-
-    *buf = NULL;
-    if ((ptr2 = strchr(msg, '%'))) {
-        /* something to encode */
-        ptr1 = msg;
-        do {
-            /* enlarge buffer */
-            buf_len = buf_size - 1;
-            buf_size += (ptr2 - ptr1) + 2;
-            mem = realloc(*buf, buf_size * sizeof **buf);
-            if (!mem) {
-                EMEM;
-                return "";
+    if (logger.rate[rec->src].window != now) {
+        logger.rate[rec->src].window = now;
+        logger.rate[rec->src].count = 0;
+    }
+
+    if (logger.rate[rec->src].count >= NP2SRV_LOG_RATE_LIMIT) {
+        ++logger.rate[rec->src].suppressed;
+        ATOMIC_INC_FENCE(logger.suppressed);
+        return;
+    }
+    ++logger.rate[rec->src].count;
+
+    np2log_write(rec->priority, rec->src, rec->long_msg ? rec->long_msg : rec->msg);
+}
+
+/**
+ * @brief Print summaries of messages suppressed in the finished rate limiting windows.
+ *
+ * @param[in] now Current time.
+ */
+static void
+np2log_suppressed_write(time_t now)
+{
+    char msg[64];
+    uint32_t i;
+
+    for (i = 0; i < NP2LOG_SRC_COUNT; ++i) {
+        if (logger.rate[i].suppressed && (logger.rate[i].window != now)) {
+            sprintf(msg, "%" PRIu32 " messages suppressed.", logger.rate[i].suppressed);
+            np2log_write(LOG_WARNING, i, msg);
+            logger.rate[i].suppressed = 0;
+        }
+    }
+}
+
+/**
+ * @brief Print all the messages in the ring buffer, only one thread at a time.
+ *
+ * @return Number of printed messages.
+ */
+static uint32_t
+np2log_drain(void)
+{
+    struct np2log_rec *rec;
+    uint32_t count = 0;
+    time_t now = time(NULL);
+
+    while (1) {
+        rec = &logger.ring[logger.head % NP2SRV_LOG_RING_SIZE];
+        if ((uint32_t)ATOMIC_LOAD_FENCE(rec->seq) != logger.head + 1) {
+            /* not written yet */
+            break;
+        }
+
+        np2log_rec_write(rec, now);
+        free(rec->long_msg);
+        rec->long_msg = NULL;
+
+        /* the record can be written again */
+        ATOMIC_STORE_FENCE(rec->seq, logger.head + NP2SRV_LOG_RING_SIZE);
+        ++logger.head;
+        ++count;
+    }
+
+    np2log_suppressed_write(now);
+    return count;
+}
+
+/**
+ * @brief Logging thread.
+ */
+static void *
+np2log_thread(void *UNUSED(arg))
+{
+    struct timespec ts;
+
+    while (ATOMIC_LOAD_RELAXED(logger.running)) {
+        if (np2log_drain()) {
+            continue;
+        }
+
+        /* wait for new messages, wake up regularly to print suppressed message summaries */
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        pthread_mutex_lock(&logger.lock);
+        ATOMIC_STORE_FENCE(logger.sleeping, 1);
+        if ((uint32_t)ATOMIC_LOAD_FENCE(logger.ring[logger.head % NP2SRV_LOG_RING_SIZE].seq) != logger.head + 1) {
+            pthread_cond_timedwait(&logger.cond, &logger.lock, &ts);
+        }
+        ATOMIC_STORE_FENCE(logger.sleeping, 0);
+        pthread_mutex_unlock(&logger.lock);
+    }
+
+    /* print the rest */
+    np2log_drain();
+    return NULL;
+}
+
+int
+np2log_start(void)
+{
+    uint32_t i;
+    int r;
+
+    for (i = 0; i < NP2SRV_LOG_RING_SIZE; ++i) {
+        ATOMIC_STORE_RELAXED(logger.ring[i].seq, i);
+    }
+    ATOMIC_STORE_RELAXED(logger.tail, 0);
+    logger.head = 0;
+
+    ATOMIC_STORE_FENCE(logger.running, 1);
+    if ((r = pthread_create(&logger.tid, NULL, np2log_thread, NULL))) {
+        ATOMIC_STORE_FENCE(logger.running, 0);
+        ERR("Creating the logging thread failed (%s).", strerror(r));
+        return -1;
+    }
+
+    return 0;
+}
+
+void
+np2log_stop(void)
+{
+    if (!ATOMIC_LOAD_FENCE(logger.running)) {
+        return;
+    }
+
+    ATOMIC_STORE_FENCE(logger.running, 0);
+    pthread_mutex_lock(&logger.lock);
+    pthread_cond_signal(&logger.cond);
+    pthread_mutex_unlock(&logger.lock);
+    pthread_join(logger.tid, NULL);
+
+    /* messages written while the thread was finishing */
+    np2log_drain();
+}
+
+/**
+ * @brief Log a message, it is only written into the ring buffer if the logging thread is running.
+ *
+ * @param[in] priority Syslog priority.
+ * @param[in] src Message source.
+ * @param[in] fmt Message format.
+ * @param[in] ap Format arguments.
+ */
+static void
+np2log_vmsg(int priority, enum np2log_src src, const char *fmt, va_list ap)
+{
+    struct np2log_rec *rec;
+    char buf[NP2SRV_MSG_LEN_START], *long_msg;
+    uint_fast32_t expected;
+    uint32_t pos, seq;
+
+    if (!ATOMIC_LOAD_FENCE(logger.running)) {
+        /* print directly */
+        np2log_format(buf, &long_msg, fmt, ap);
+        np2log_write(priority, src, long_msg ? long_msg : buf);
+        free(long_msg);
+        return;
+    }
+
+    /* claim a record */
+    pos = ATOMIC_LOAD_RELAXED(logger.tail);
+    while (1) {
+        rec = &logger.ring[pos % NP2SRV_LOG_RING_SIZE];
+        seq = ATOMIC_LOAD_FENCE(rec->seq);
+        if (seq == pos) {
+            /* free, try to take it (expected may be overwritten) */
+            expected = pos;
+            if (ATOMIC_CAS_RELAXED(logger.tail, expected, pos + 1)) {
+                break;
             }
-            *buf = mem;
-
-            /* copy preceding message */
-            strncpy(*buf + buf_len, ptr1, ptr2 - ptr1);
-            buf_len += ptr2 - ptr1;
-
-            /* copy % */
-            strcpy(*buf + buf_len, "%%");
-
-            /* next iter */
-            ptr1 = ptr2 + 1;
-        } while ((ptr2 = strchr(ptr1, '%')));
-
-        /* copy remaining message */
-        buf_len = buf_size - 1;
-        buf_size += strlen(ptr1);
-        mem = realloc(*buf, buf_size * sizeof **buf);
-        if (!mem) {
-            EMEM;
-            return "";
+        } else if ((int32_t)(seq - pos) < 0) {
+            /* not read yet, the buffer is full */
+            ATOMIC_INC_FENCE(logger.dropped);
+            return;
         }
-        *buf = mem;
-        strcpy(*buf + buf_len, ptr1);
+
+        /* taken by another thread */
+        pos = ATOMIC_LOAD_RELAXED(logger.tail);
+    }
+
+    /* write the message */
+    rec->priority = priority;
+    rec->src = src;
+    np2log_format(rec->msg, &rec->long_msg, fmt, ap);
+    ATOMIC_STORE_FENCE(rec->seq, pos + 1);
+
+    if (ATOMIC_LOAD_FENCE(logger.sleeping)) {
+        /* wake up the logging thread */
+        pthread_mutex_lock(&logger.lock);
+        pthread_cond_signal(&logger.cond);
+        pthread_mutex_unlock(&logger.lock);
     }
+}
 
-    return (*buf ? *buf : msg);
+/**
+ * @brief Log a message.
+ *
+ * @param[in] priority Syslog priority.
+ * @param[in] src Message source.
+ * @param[in] fmt Message format.
+ */
+static void
+np2log(int priority, enum np2log_src src, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    np2log_vmsg(priority, src, fmt, ap);
+    va_end(ap);
 }
 
 /**
@@ -134,8 +387,6 @@ void
 np2log_cb_nc2(NC_VERB_LEVEL level, const char *msg)
 {
     int priority = LOG_ERR;
-    const char *log_msg;
-    char *buf;
 
     if (level > np2_verbose_level) {
         return;
@@ -157,9 +408,7 @@ np2log_cb_nc2(NC_VERB_LEVEL level, const char *msg)
         break;
     }
 
-    log_msg = np2log_encode(msg, &buf);
-    np2log(priority, "LN", log_msg);
-    free(buf);
+    np2log(priority, NP2LOG_LN, "%s", msg);
 }
 
 /**
@@ -169,8 +418,6 @@ void
 np2log_cb_ly(LY_LOG_LEVEL level, const char *msg, const char *path)
 {
     int priority;
-    const char *log_msg;
-    char *buf;
 
     if (level > np2_verbose_level) {
         return;
@@ -194,21 +441,17 @@ np2log_cb_ly(LY_LOG_LEVEL level, const char *msg, const char *path)
         return;
     }
 
-    log_msg = np2log_encode(msg, &buf);
     if (path) {
-        np2log(priority, "LY", "%s (%s)", log_msg, path);
+        np2log(priority, NP2LOG_LY, "%s (%s)", msg, path);
     } else {
-        np2log(priority, "LY", log_msg);
+        np2log(priority, NP2LOG_LY, "%s", msg);
     }
-    free(buf);
 }
 
 void
 np2log_cb_sr(sr_log_level_t level, const char *msg)
 {
     int priority = LOG_ERR;
-    const char *log_msg;
-    char *buf;
 
     if (level > np2_sr_verbose_level) {
         return;
@@ -231,9 +474,7 @@ np2log_cb_sr(sr_log_level_t level, const char *msg)
         return;
     }
 
-    log_msg = np2log_encode(msg, &buf);
-    np2log(priority, "SR", log_msg);
-    free(buf);
+    np2log(priority, NP2LOG_SR, "%s", msg);
 }
 
 /**
@@ -244,45 +485,13 @@ np2log_cb_sr(sr_log_level_t level, const char *msg)
 void
 np2log_printf(NC_VERB_LEVEL level, const char *format, ...)
 {
-    va_list ap, ap2;
-    ssize_t msg_len = NP2SRV_MSG_LEN_START, req_len;
-    char *msg, *mem;
+    va_list ap;
     int priority = LOG_ERR;
 
     if (level > np2_verbose_level) {
         return;
     }
 
-    va_start(ap, format);
-    va_copy(ap2, ap);
-
-    /* initial length */
-    msg = malloc(msg_len);
-    if (!msg) {
-        goto cleanup;
-    }
-
-    /* learn how much bytes are needed */
-    req_len = vsnprintf(msg, msg_len, format, ap);
-    if (req_len == -1) {
-        goto cleanup;
-    } else if (req_len >= NP2SRV_MSG_LEN_START) {
-        /* the intial size was not enough */
-        msg_len = req_len + 1;
-        mem = realloc(msg, msg_len);
-        if (!mem) {
-            free(msg);
-            goto cleanup;
-        }
-        msg = mem;
-
-        /* now print the full message */
-        req_len = vsnprintf(msg, msg_len, format, ap2);
-        if (req_len == -1) {
-            goto cleanup;
-        }
-    }
-
     switch (level) {
     case NC_VERB_ERROR:
         priority = LOG_ERR;;
@@ -298,11 +507,36 @@ np2log_printf(NC_VERB_LEVEL level, const char *format, ...)
         priority = LOG_DEBUG;
         break;
     }
-    /* no need to encode in this case */
-    np2log(priority, "NP", msg);
 
-cleanup:
-    free(msg);
+    va_start(ap, format);
+    np2log_vmsg(priority, NP2LOG_NP, format, ap);
     va_end(ap);
-    va_end(ap2);
+}
+
+/* /netopeer2-monitoring:netopeer2-state/logging */
+int
+np2log_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name), const char *UNUSED(path),
+        const char *UNUSED(request_xpath), uint32_t UNUSED(request_id), struct lyd_node **parent,
+        void *UNUSED(private_data))
+{
+    struct lyd_node *cont;
+    char num_str[11];
+
+    assert(*parent);
+
+    cont = lyd_new_path(*parent, NULL, "logging", NULL, 0, 0);
+    if (!cont) {
+        return SR_ERR_INTERNAL;
+    }
+
+    sprintf(num_str, "%" PRIu32, (uint32_t)ATOMIC_LOAD_RELAXED(logger.dropped));
+    if (!lyd_new_leaf(cont, NULL, "dropped-messages", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu32, (uint32_t)ATOMIC_LOAD_RELAXED(logger.suppressed));
+    if (!lyd_new_leaf(cont, NULL, "suppressed-messages", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return SR_ERR_OK;
 }
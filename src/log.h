@@ -56,6 +56,23 @@ void np2log_printf(NC_VERB_LEVEL level, const char *format, ...);
 #define EMEM ERR("Memory allocation failed (%s:%d)", __FILE__, __LINE__)
 #define EINT ERR("Internal error (%s:%d)", __FILE__, __LINE__)
 
+/**
+ * @brief Start the logging thread, messages are then printed asynchronously.
+ *
+ * Until it is started, messages are printed directly.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int np2log_start(void);
+
+/**
+ * @brief Stop the logging thread after printing all the messages, they are then printed directly again.
+ */
+void np2log_stop(void);
+
+int np2log_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path, const char *request_xpath,
+        uint32_t request_id, struct lyd_node **parent, void *private_data);
+
 /**
  * @brief printer callback for libnetconf2
  */
@@ -24,13 +24,18 @@
 #include <stdio.h>
 #include <pwd.h>
 #include <grp.h>
+#include <assert.h>
+#include <time.h>
 
 #include <libyang/libyang.h>
 #include <nc_server.h>
 #include <sysrepo.h>
 
 #include "config.h"
+#include "authkeys_cache.h"
 #include "common.h"
+#include "filter_cache.h"
+#include "keystore_cache.h"
 #include "log.h"
 #include "netconf.h"
 #include "netconf_server.h"
@@ -39,13 +44,15 @@
 #include "netconf_acm.h"
 #include "netconf_monitoring.h"
 #include "netconf_nmda.h"
+#include "notif_fanout.h"
+#include "rpc_sched.h"
+#include "rpc_stats.h"
+#include "schema_index.h"
+#include "session_setup.h"
 
 /** @brief flag for main loop */
 ATOMIC_T loop_continue = 1;
 
-/* SR SID of session to skip diff check for */
-ATOMIC_T skip_nacm_sr_sid;
-
 static void *worker_thread(void *arg);
 static int np2srv_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path,
         const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data);
@@ -79,8 +86,18 @@ signal_handler(int sig)
     }
 }
 
+/**
+ * @brief Cached nc-notifications stream data, they change only with the context.
+ */
+static struct {
+    pthread_mutex_t lock;
+    const struct ly_ctx *ly_ctx;    /**< context of the cached data */
+    uint16_t module_set_id;         /**< module set ID of the context */
+    struct lyd_node *data;          /**< cached data */
+} ntf_streams = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
 static struct lyd_node *
-np2srv_ntf_get_data(sr_conn_ctx_t *sr_conn)
+np2srv_ntf_build_data(sr_conn_ctx_t *sr_conn)
 {
     struct lyd_node *root, *stream, *sr_data = NULL, *sr_mod, *rep_sup;
     struct ly_set *set;
@@ -163,9 +180,37 @@ error:
     return NULL;
 }
 
+static struct lyd_node *
+np2srv_ntf_get_data(sr_conn_ctx_t *sr_conn)
+{
+    const struct ly_ctx *ly_ctx;
+    struct lyd_node *data = NULL;
+
+    ly_ctx = sr_get_context(sr_conn);
+
+    pthread_mutex_lock(&ntf_streams.lock);
+    if ((ntf_streams.ly_ctx != ly_ctx) || (ntf_streams.module_set_id != ly_ctx_get_module_set_id(ly_ctx))) {
+        /* modules changed, rebuild */
+        lyd_free_withsiblings(ntf_streams.data);
+        ntf_streams.ly_ctx = NULL;
+        ntf_streams.data = np2srv_ntf_build_data(sr_conn);
+        if (!ntf_streams.data) {
+            goto cleanup;
+        }
+        ntf_streams.ly_ctx = ly_ctx;
+        ntf_streams.module_set_id = ly_ctx_get_module_set_id(ly_ctx);
+    }
+
+    data = lyd_dup(ntf_streams.data, LYD_DUP_OPT_RECURSIVE);
+
+cleanup:
+    pthread_mutex_unlock(&ntf_streams.lock);
+    return data;
+}
+
 static int
 np2srv_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *module_name, const char *path,
-        const char *UNUSED(request_xpath), uint32_t UNUSED(request_id), struct lyd_node **parent, void *UNUSED(private_data))
+        const char *request_xpath, uint32_t UNUSED(request_id), struct lyd_node **parent, void *UNUSED(private_data))
 {
     struct lyd_node *data = NULL, *node;
     struct ly_set *set = NULL;
@@ -173,7 +218,7 @@ np2srv_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *module_name,
 
     /* get the full module state data tree */
     if (!strcmp(module_name, "ietf-netconf-monitoring")) {
-        data = ncm_get_data(np2srv.sr_conn);
+        data = ncm_get_data(np2srv.sr_conn, request_xpath);
     } else if (!strcmp(module_name, "nc-notifications")) {
         data = np2srv_ntf_get_data(np2srv.sr_conn);
     } else {
@@ -211,29 +256,21 @@ cleanup:
     return ret;
 }
 
-static int
-np2srv_dummy_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name), const char *UNUSED(xpath),
-        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
-{
-    return SR_ERR_OK;
-}
-
 static void
 np2srv_del_session_cb(struct nc_session *session)
 {
-    int i, rc;
-    char *host = NULL;
-    sr_val_t *event_data;
-    sr_session_ctx_t *sr_sess;
-    const struct lys_module *mod;
+    struct np2srv_sess *sess;
 
     if (nc_ps_del_session(np2srv.nc_ps, session)) {
         ERR("Removing session from ps failed.");
     }
 
-    /* stop sysrepo session (also stop any sysrepo notification subscriptions) */
-    sr_sess = nc_session_get_data(session);
-    sr_session_stop(sr_sess);
+    /* the session cannot be found anymore */
+    sess = nc_session_get_data(session);
+    np_sessions_del(sess);
+
+    /* no more notifications are sent to the session */
+    np_ntf_fanout_del(session);
 
     switch (nc_session_get_ti(session)) {
 #ifdef NC_ENABLED_SSH
@@ -250,59 +287,225 @@ np2srv_del_session_cb(struct nc_session *session)
         break;
     }
 
-    if ((mod = ly_ctx_get_module(sr_get_context(np2srv.sr_conn), "ietf-netconf-notifications", NULL, 1))) {
-        /* generate ietf-netconf-notification's netconf-session-end event for sysrepo */
-        if (nc_session_get_ti(session) != NC_TI_UNIX) {
-            host = (char *)nc_session_get_host(session);
-        }
-        event_data = calloc(5, sizeof *event_data);
-        i = 0;
-
-        event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/username";
-        event_data[i].type = SR_STRING_T;
-        event_data[i++].data.string_val = (char*)nc_session_get_username(session);
-        event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/session-id";
-        event_data[i].type = SR_UINT32_T;
-        event_data[i++].data.uint32_val = nc_session_get_id(session);
-        if (host) {
-            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/source-host";
-            event_data[i].type = SR_STRING_T;
-            event_data[i++].data.string_val = host;
-        }
-        if (nc_session_get_killed_by(session)) {
-            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/killed-by";
-            event_data[i].type = SR_UINT32_T;
-            event_data[i++].data.uint32_val = nc_session_get_killed_by(session);
+    /* stop sysrepo session (also stop any sysrepo notification subscriptions) */
+    sr_session_stop(sess->sr_sess);
+    np_ntf_queue_close(&sess->ntf_queue);
+    ncac_user_free(sess->nacm_user);
+    free(sess);
+
+    /* generate ietf-netconf-notification's netconf-session-end event for sysrepo, sent later */
+    np_sess_setup_notif_end(session);
+
+    nc_session_free(session, NULL);
+}
+
+/**
+ * @brief Start a new worker thread, worker lock must be held.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+np2srv_worker_start(void)
+{
+    pthread_t tid;
+    int *idx, r;
+
+    idx = malloc(sizeof *idx);
+    if (!idx) {
+        EMEM;
+        return -1;
+    }
+    *idx = np2srv.worker_next_idx++;
+
+    r = pthread_create(&tid, NULL, worker_thread, idx);
+    if (r) {
+        ERR("Failed to create worker thread %d (%s).", *idx, strerror(r));
+        free(idx);
+        return -1;
+    }
+    pthread_detach(tid);
+
+    ATOMIC_INC_FENCE(np2srv.worker_count);
+    ++np2srv.worker_threads;
+
+    /* waiting RPCs may now be allowed */
+    np2srv_rpc_sched_workers_changed();
+    return 0;
+}
+
+/**
+ * @brief Set worker thread counts, start any missing workers. Extra workers stop themselves.
+ *
+ * @param[in] count Worker thread count.
+ * @param[in] max_count Maximum worker thread count for auto-scaling, 0 to disable it.
+ */
+static void
+np2srv_workers_set(uint32_t count, uint32_t max_count)
+{
+    if (count > NP2SRV_MAX_THREAD_COUNT) {
+        WRN("Only up to %d worker threads are supported.", NP2SRV_MAX_THREAD_COUNT);
+        count = NP2SRV_MAX_THREAD_COUNT;
+    }
+    if (max_count > NP2SRV_MAX_THREAD_COUNT) {
+        WRN("Only up to %d worker threads are supported.", NP2SRV_MAX_THREAD_COUNT);
+        max_count = NP2SRV_MAX_THREAD_COUNT;
+    }
+    if (max_count && (max_count < count)) {
+        max_count = count;
+    }
+
+    pthread_mutex_lock(&np2srv.worker_lock);
+
+    ATOMIC_STORE_RELAXED(np2srv.worker_target, count);
+    ATOMIC_STORE_RELAXED(np2srv.worker_max, max_count);
+
+    /* only if the workers are already running */
+    if (ATOMIC_LOAD_RELAXED(np2srv.worker_count) && ATOMIC_LOAD_RELAXED(loop_continue)) {
+        while ((ATOMIC_LOAD_RELAXED(np2srv.worker_count) < count) && !np2srv_worker_start());
+    }
+
+    pthread_mutex_unlock(&np2srv.worker_lock);
+
+    /* waiting RPCs may not be allowed to wait anymore */
+    np2srv_rpc_sched_workers_changed();
+}
+
+/**
+ * @brief Start another worker thread if all of them are busy and auto-scaling allows it.
+ */
+static void
+np2srv_workers_scale_up(void)
+{
+    uint32_t count;
+
+    pthread_mutex_lock(&np2srv.worker_lock);
+
+    count = ATOMIC_LOAD_RELAXED(np2srv.worker_count);
+    if (ATOMIC_LOAD_RELAXED(loop_continue) && (count < ATOMIC_LOAD_RELAXED(np2srv.worker_max))
+            && (ATOMIC_LOAD_RELAXED(np2srv.worker_busy) >= count)) {
+        if (!np2srv_worker_start()) {
+            VRB("All %u worker threads busy, started another one.", count);
         }
-        event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/termination-reason";
-        event_data[i].type = SR_ENUM_T;
-        switch (nc_session_get_term_reason(session)) {
-        case NC_SESSION_TERM_CLOSED:
-            event_data[i++].data.enum_val = "closed";
-            break;
-        case NC_SESSION_TERM_KILLED:
-            event_data[i++].data.enum_val = "killed";
-            break;
-        case NC_SESSION_TERM_DROPPED:
-            event_data[i++].data.enum_val = "dropped";
-            break;
-        case NC_SESSION_TERM_TIMEOUT:
-            event_data[i++].data.enum_val = "timeout";
-            break;
-        default:
-            event_data[i++].data.enum_val = "other";
-            break;
+    }
+
+    pthread_mutex_unlock(&np2srv.worker_lock);
+}
+
+/**
+ * @brief Learn whether a worker thread should stop.
+ *
+ * @param[in] idle_since Time the worker became idle, 0 if it is not.
+ * @return non-zero if the worker was removed and should stop, 0 otherwise.
+ */
+static int
+np2srv_worker_retire(time_t idle_since)
+{
+    struct timespec ts;
+    uint32_t count, max_count;
+    int retire = 0;
+
+    if (ATOMIC_LOAD_RELAXED(np2srv.worker_count) <= ATOMIC_LOAD_RELAXED(np2srv.worker_target)) {
+        /* fast path, no extra workers */
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    pthread_mutex_lock(&np2srv.worker_lock);
+
+    count = ATOMIC_LOAD_RELAXED(np2srv.worker_count);
+    max_count = ATOMIC_LOAD_RELAXED(np2srv.worker_max);
+    if (count > ATOMIC_LOAD_RELAXED(np2srv.worker_target)) {
+        if (!max_count || (count > max_count)) {
+            /* count was decreased */
+            retire = 1;
+        } else if (idle_since && (ts.tv_sec - idle_since >= NP2SRV_WORKER_IDLE_TIMEOUT)) {
+            /* auto-scaled worker idle for too long */
+            retire = 1;
         }
-        rc = sr_event_notif_send(np2srv.sr_sess, "/ietf-netconf-notifications:netconf-session-end", event_data, i);
-        if (rc != SR_ERR_OK) {
-            WRN("Failed to send a notification (%s).", sr_strerror(rc));
-        } else {
-            VRB("Generated new event (netconf-session-end).");
+    }
+    if (retire) {
+        ATOMIC_DEC_FENCE(np2srv.worker_count);
+    }
+
+    pthread_mutex_unlock(&np2srv.worker_lock);
+
+    return retire;
+}
+
+/* /netopeer2-monitoring:netopeer2-server/workers */
+static int
+np2srv_workers_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    sr_change_iter_t *iter;
+    sr_change_oper_t op;
+    const struct lyd_node *node;
+    const char *prev_val, *prev_list;
+    bool prev_dflt;
+    uint32_t count, max_count;
+    int rc;
+
+    count = ATOMIC_LOAD_RELAXED(np2srv.worker_target);
+    max_count = ATOMIC_LOAD_RELAXED(np2srv.worker_max);
+
+    rc = sr_get_changes_iter(session, xpath, &iter);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting changes iter failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
+        if (!strcmp(node->schema->name, "count")) {
+            if (op == SR_OP_DELETED) {
+                count = np2srv.worker_dflt_count;
+            } else if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
+                count = ((struct lyd_node_leaf_list *)node)->value.uint16;
+            }
+        } else if (!strcmp(node->schema->name, "max-count")) {
+            if (op == SR_OP_DELETED) {
+                max_count = np2srv.worker_dflt_max;
+            } else if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
+                max_count = ((struct lyd_node_leaf_list *)node)->value.uint16;
+            }
         }
-        free(event_data);
+    }
+    sr_free_change_iter(iter);
+    if (rc != SR_ERR_NOT_FOUND) {
+        ERR("Getting next change failed (%s).", sr_strerror(rc));
+        return rc;
     }
 
-    nc_session_free(session, NULL);
+    np2srv_workers_set(count, max_count);
+    return SR_ERR_OK;
+}
+
+/* /netopeer2-monitoring:netopeer2-state/workers */
+static int
+np2srv_workers_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name),
+        const char *UNUSED(path), const char *UNUSED(request_xpath), uint32_t UNUSED(request_id),
+        struct lyd_node **parent, void *UNUSED(private_data))
+{
+    struct lyd_node *cont;
+    char num_str[11];
+
+    assert(*parent);
+
+    cont = lyd_new_path(*parent, NULL, "workers", NULL, 0, 0);
+    if (!cont) {
+        return SR_ERR_INTERNAL;
+    }
+
+    sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(np2srv.worker_count));
+    if (!lyd_new_path(cont, NULL, "count", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(np2srv.worker_busy));
+    if (!lyd_new_path(cont, NULL, "busy", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return SR_ERR_OK;
 }
 
 static struct nc_server_error *
@@ -388,6 +591,60 @@ np2srv_err_reply_sr(const sr_error_info_t *err_info)
     return reply;
 }
 
+/**
+ * @brief Execute a data retrieval RPC directly instead of sending it to sysrepo.
+ *
+ * Their output can be huge and sending them through sysrepo would print the whole output into a buffer
+ * and parse it again, with all the copies existing at the same time. This way there is only the one data
+ * tree and libnetconf2 prints it directly into the session using fixed-size chunks.
+ *
+ * @param[in] sr_sess Sysrepo session of the NETCONF session.
+ * @param[in] rpc RPC to execute.
+ * @param[out] output RPC output.
+ * @return 1 if the RPC is not a data retrieval RPC, otherwise sysrepo error value.
+ */
+static int
+np2srv_rpc_data_direct(sr_session_ctx_t *sr_sess, struct lyd_node *rpc, struct lyd_node **output)
+{
+    sr_rpc_tree_cb rpc_cb;
+    sr_datastore_t ds;
+    char *op_path;
+    int rc;
+
+    if (!strcmp(lyd_node_module(rpc)->name, "ietf-netconf")
+            && (!strcmp(rpc->schema->name, "get") || !strcmp(rpc->schema->name, "get-config"))) {
+        rpc_cb = np2srv_rpc_get_cb;
+    } else if (!strcmp(lyd_node_module(rpc)->name, "ietf-netconf-nmda") && !strcmp(rpc->schema->name, "get-data")) {
+        rpc_cb = np2srv_rpc_getdata_cb;
+    } else {
+        return 1;
+    }
+
+    if (asprintf(&op_path, "/%s:%s", lyd_node_module(rpc)->name, rpc->schema->name) == -1) {
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+
+    /* output is always the RPC itself with the output nodes */
+    *output = lyd_dup(rpc, 0);
+    if (!*output) {
+        free(op_path);
+        return SR_ERR_LY;
+    }
+
+    /* the callback switches the datastore of the session */
+    ds = sr_session_get_ds(sr_sess);
+    rc = rpc_cb(sr_sess, op_path, rpc, SR_EV_RPC, 0, *output, NULL);
+    sr_session_switch_ds(sr_sess, ds);
+    free(op_path);
+
+    if (rc != SR_ERR_OK) {
+        lyd_free_withsiblings(*output);
+        *output = NULL;
+    }
+    return rc;
+}
+
 static struct nc_server_reply *
 np2srv_rpc_cb(struct lyd_node *rpc, struct nc_session *ncs)
 {
@@ -400,11 +657,25 @@ np2srv_rpc_cb(struct lyd_node *rpc, struct nc_session *ncs)
     NC_WD_MODE nc_wd;
     struct ly_set *nodeset;
     struct nc_server_error *e;
+    enum np2srv_rpc_class rpc_class;
+    uint64_t phase_start;
     char *str;
     int rc;
 
+    np2srv_rpc_stats_start(rpc, nc_session_get_id(ncs));
+
+    /* this worker is busy, make sure there is another one available if allowed */
+    ATOMIC_INC_FENCE(np2srv.worker_busy);
+    if (ATOMIC_LOAD_RELAXED(np2srv.worker_max)
+            && (ATOMIC_LOAD_RELAXED(np2srv.worker_busy) >= ATOMIC_LOAD_RELAXED(np2srv.worker_count))) {
+        np2srv_workers_scale_up();
+    }
+
     /* check NACM */
-    if ((node = ncac_check_operation(rpc, nc_session_get_username(ncs)))) {
+    phase_start = np2srv_rpc_stats_now();
+    node = ncac_check_operation(rpc, ((struct np2srv_sess *)nc_session_get_data(ncs))->nacm_user);
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_NACM_CHECK, phase_start);
+    if (node) {
         e = nc_err(NC_ERR_ACCESS_DENIED, NC_ERR_TYPE_APP);
 
         /* set path */
@@ -418,14 +689,26 @@ np2srv_rpc_cb(struct lyd_node *rpc, struct nc_session *ncs)
         free(str);
 
         reply = nc_server_reply_err(e);
+        np2srv_rpc_stats_reply(NULL);
         goto cleanup;
     }
 
     /* get this user session with its NC id (but not user name) */
-    sr_sess = nc_session_get_data(ncs);
+    sr_sess = ((struct np2srv_sess *)nc_session_get_data(ncs))->sr_sess;
+
+    /* wait until this RPC class can be executed */
+    phase_start = np2srv_rpc_stats_now();
+    rpc_class = np2srv_rpc_sched_enter(rpc);
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_SCHED, phase_start);
 
-    /* sysrepo API */
-    rc = sr_rpc_send_tree(sr_sess, rpc, NP2SRV_RPC_TIMEOUT, &output);
+    /* data retrieval directly (timing its own phases), any other RPCs using sysrepo API */
+    rc = np2srv_rpc_data_direct(sr_sess, rpc, &output);
+    if (rc == 1) {
+        phase_start = np2srv_rpc_stats_now();
+        rc = sr_rpc_send_tree(sr_sess, rpc, NP2SRV_RPC_TIMEOUT, &output);
+        np2srv_rpc_stats_phase(NP2SRV_PHASE_DATASTORE, phase_start);
+    }
+    np2srv_rpc_sched_leave(rpc_class);
     if (rc != SR_ERR_OK) {
         ERR("Failed to send an RPC (%s).", sr_strerror(rc));
         goto cleanup;
@@ -458,22 +741,29 @@ np2srv_rpc_cb(struct lyd_node *rpc, struct nc_session *ncs)
         }
         ly_set_free(nodeset);
 
+        np2srv_rpc_stats_reply(output);
         reply = nc_server_reply_data(output, nc_wd, NC_PARAMTYPE_FREE);
     } else {
         lyd_free_withsiblings(output);
+        np2srv_rpc_stats_reply(NULL);
         reply = nc_server_reply_ok();
     }
 
 cleanup:
     if (!reply) {
+        err_info = NULL;
         if (sr_sess) {
             sr_get_error(sr_sess, &err_info);
+        }
+        if (err_info && err_info->err_count) {
             reply = np2srv_err_reply_sr(err_info);
         } else {
             e = nc_err(NC_ERR_OP_FAILED, NC_ERR_TYPE_APP);
             reply = nc_server_reply_err(e);
         }
+        np2srv_rpc_stats_reply(NULL);
     }
+    ATOMIC_DEC_FENCE(np2srv.worker_busy);
     return reply;
 }
 
@@ -482,24 +772,26 @@ np2srv_diff_check_cb(sr_session_ctx_t *session, const struct lyd_node *diff)
 {
     const struct lyd_node *node;
     char *path;
-    const char *user;
+    struct np2srv_sess *sess;
+    uint32_t copy_nacm;
 
-    if (ATOMIC_LOAD_RELAXED(skip_nacm_sr_sid) == sr_session_get_id(session)) {
-        /* skip the NACM check */
-        return SR_ERR_OK;
-    }
-
-    user = np_get_nc_sess_user(session);
-    if (!user) {
+    sess = np_get_nc_sess(session);
+    if (!sess) {
         EINT;
         return SR_ERR_INTERNAL;
     }
 
-    if ((node = ncac_check_diff(diff, user))) {
+    copy_nacm = ATOMIC_LOAD_RELAXED(sess->copy_nacm);
+    if (copy_nacm == NP2SRV_COPY_NACM_SKIP) {
+        /* skip the NACM check */
+        return SR_ERR_OK;
+    }
+
+    if ((node = ncac_check_diff(diff, sess->nacm_user, copy_nacm == NP2SRV_COPY_NACM_READ))) {
         /* access denied */
         path = lys_data_path(node->schema);
         sr_set_error(session, path, "Access to the data model \"%s\" is denied because \"%s\" NACM authorization failed.",
-                lyd_node_module(node)->name, user);
+                lyd_node_module(node)->name, sess->nacm_user->name);
         free(path);
         return SR_ERR_UNAUTHORIZED;
     }
@@ -622,6 +914,14 @@ np2srv_check_schemas(sr_session_ctx_t *sr_sess)
         return -1;
     }
 
+    /* .. netopeer2-monitoring */
+    mod_name = "netopeer2-monitoring";
+    mod = ly_ctx_get_module(ly_ctx, mod_name, NULL, 1);
+    if (!mod || !mod->implemented) {
+        ERR("Module \"%s\" not implemented in sysrepo.", mod_name);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -657,7 +957,9 @@ server_init(void)
     ncm_init();
 
     /* init NACM */
-    ncac_init();
+    if (ncac_init()) {
+        goto error;
+    }
 
     /* init libnetconf2 (it modifies only the dictionary) */
     if (nc_server_init((struct ly_ctx *)ly_ctx)) {
@@ -667,6 +969,21 @@ server_init(void)
     /* prepare poll session structure for libnetconf2 */
     np2srv.nc_ps = nc_ps_new();
 
+    /* prepare session table for finding sessions by their ID */
+    if (np_sessions_init()) {
+        goto error;
+    }
+
+    /* pre-create sysrepo sessions and send session notifications in a separate thread */
+    if (np_sess_setup_start()) {
+        goto error;
+    }
+
+    /* build the schema index for translating subtree filters */
+    if (np_schema_index_update(ly_ctx)) {
+        goto error;
+    }
+
     /* set with-defaults capability basic-mode */
     nc_server_set_capab_withdefaults(NC_WD_EXPLICIT, NC_WD_ALL | NC_WD_ALL_TAG | NC_WD_TRIM | NC_WD_EXPLICIT);
 
@@ -882,18 +1199,18 @@ server_data_subscribe(void)
     SR_CONFIG_SUBSCR(mod_name, xpath, np2srv_ch_client_endpt_tls_client_ctn_cb);
 
     /*
-     * ietf-keystore (just for in-use operational data)
+     * ietf-keystore (in-use operational data and the cache of parsed keys)
      */
     mod_name = "ietf-keystore";
     xpath = "/ietf-keystore:keystore/asymmetric-keys";
-    SR_CONFIG_SUBSCR(mod_name, xpath, np2srv_dummy_cb);
+    SR_CONFIG_SUBSCR(mod_name, xpath, np_keystore_cache_change_cb);
 
     /*
-     * ietf-truststore (just for in-use operational data)
+     * ietf-truststore (in-use operational data and the cache of certificate lists)
      */
     mod_name = "ietf-truststore";
     xpath = "/ietf-truststore:truststore/certificates";
-    SR_CONFIG_SUBSCR(mod_name, xpath, np2srv_dummy_cb);
+    SR_CONFIG_SUBSCR(mod_name, xpath, np_keystore_cache_change_cb);
 
     /*
      * ietf-netconf-acm
@@ -921,6 +1238,49 @@ server_data_subscribe(void)
     xpath = "/ietf-netconf-acm:nacm/denied-notifications";
     SR_OPER_SUBSCR(mod_name, xpath, ncac_state_data_cb);
 
+    /*
+     * netopeer2-monitoring
+     */
+    mod_name = "netopeer2-monitoring";
+    xpath = "/netopeer2-monitoring:netopeer2-server/workers";
+    SR_CONFIG_SUBSCR(mod_name, xpath, np2srv_workers_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-server/rpc-classes/rpc-class";
+    SR_CONFIG_SUBSCR(mod_name, xpath, np2srv_rpc_sched_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-server/notifications";
+    SR_CONFIG_SUBSCR(mod_name, xpath, np_ntf_queue_config_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-server/rpc-statistics";
+    SR_CONFIG_SUBSCR(mod_name, xpath, np2srv_rpc_stats_config_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-server/sessions";
+    SR_CONFIG_SUBSCR(mod_name, xpath, np_sess_setup_config_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-server/nacm";
+    SR_CONFIG_SUBSCR(mod_name, xpath, ncac_server_params_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/nacm-cache";
+    SR_OPER_SUBSCR(mod_name, xpath, ncac_cache_state_data_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/workers";
+    SR_OPER_SUBSCR(mod_name, xpath, np2srv_workers_state_data_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/rpc-classes";
+    SR_OPER_SUBSCR(mod_name, xpath, np2srv_rpc_sched_state_data_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/rpc-statistics";
+    SR_OPER_SUBSCR(mod_name, xpath, np2srv_rpc_stats_state_data_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/logging";
+    SR_OPER_SUBSCR(mod_name, xpath, np2log_state_data_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/sessions";
+    SR_OPER_SUBSCR(mod_name, xpath, np_sess_setup_state_data_cb);
+
+    xpath = "/netopeer2-monitoring:netopeer2-state/filter-cache";
+    SR_OPER_SUBSCR(mod_name, xpath, np_filter_cache_state_data_cb);
+
     return 0;
 
 error:
@@ -932,28 +1292,71 @@ static void *
 worker_thread(void *arg)
 {
     NC_MSG_TYPE msgtype;
-    int rc, idx = *((int *)arg), monitored;
+    int rc, idx = *((int *)arg), monitored, retired = 0;
+    uint32_t admit_wait;
     struct nc_session *ncs;
+    struct timespec ts;
+    time_t idle_since = 0;
 
     nc_libssh_thread_verbosity(np2_libssh_verbose_level);
 
     while (ATOMIC_LOAD_RELAXED(loop_continue)) {
+        /* stop if there are too many workers, but always keep the first one */
+        if (idx && np2srv_worker_retire(idle_since)) {
+            VRB("Thread %d: stopping worker.", idx);
+            retired = 1;
+            break;
+        }
+
+        /* send queued notifications */
+        np_ntf_queue_flush();
+
         /* try to accept new NETCONF sessions */
         if (nc_server_endpt_count()
                 && (!np2srv.nc_max_sessions || (nc_ps_session_count(np2srv.nc_ps) < np2srv.nc_max_sessions))) {
-            msgtype = nc_accept(0, &ncs);
-            if (msgtype == NC_MSG_HELLO) {
-                np2srv_new_session_cb(NULL, ncs);
+            if ((admit_wait = np_sess_setup_admit())) {
+                /* accept rate limit reached, with no sessions to poll wait until a session can be accepted */
+                if (!nc_ps_session_count(np2srv.nc_ps)) {
+                    np_sleep(admit_wait);
+                }
+            } else {
+                /* with no sessions to poll, wait on the listening sockets instead of sleeping */
+                msgtype = nc_accept(nc_ps_session_count(np2srv.nc_ps) ? 0 : NP2SRV_ACCEPT_TIMEOUT, &ncs);
+                if (msgtype == NC_MSG_HELLO) {
+                    np_sess_setup_accepted();
+                    np2srv_new_session_cb(NULL, ncs);
+                }
             }
         }
 
         /* listen for incoming requests on active NETCONF sessions */
         rc = nc_ps_poll(np2srv.nc_ps, NP2SRV_POLL_IO_TIMEOUT, &ncs);
 
-        if ((rc & (NC_PSPOLL_NOSESSIONS | NC_PSPOLL_TIMEOUT | NC_PSPOLL_ERROR)) && !(rc & NC_PSPOLL_SESSION_TERM)) {
-            /* if there is no active session, timeout, or an error, rest for a while */
-            np_sleep(NP2SRV_PS_BACKOFF_SLEEP);
-            continue;
+        /* the reply of any processed RPC was sent */
+        np2srv_rpc_stats_finish();
+
+        /* remember since when this worker is idle */
+        if (rc & (NC_PSPOLL_TIMEOUT | NC_PSPOLL_NOSESSIONS)) {
+            if (!idle_since) {
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                idle_since = ts.tv_sec;
+            }
+        } else {
+            idle_since = 0;
+        }
+
+        if (!(rc & NC_PSPOLL_SESSION_TERM)) {
+            if (rc & NC_PSPOLL_TIMEOUT) {
+                /* the sessions were already waited on, poll them again right away */
+                continue;
+            } else if ((rc & NC_PSPOLL_ERROR) || ((rc & NC_PSPOLL_NOSESSIONS) && !nc_server_endpt_count())) {
+                /* an error or nothing to wait on (only Call Home), rest for a while */
+                np_sleep(NP2SRV_PS_BACKOFF_SLEEP);
+                continue;
+            } else if (rc & NC_PSPOLL_NOSESSIONS) {
+                /* accepting waits for new sessions */
+                continue;
+            }
         }
 
         switch (nc_session_get_ti(ncs)) {
@@ -1009,8 +1412,17 @@ worker_thread(void *arg)
     }
 
     /* cleanup */
+    np2srv_rpc_stats_thread_destroy();
     nc_thread_destroy();
     free(arg);
+
+    pthread_mutex_lock(&np2srv.worker_lock);
+    if (!retired) {
+        ATOMIC_DEC_FENCE(np2srv.worker_count);
+    }
+    --np2srv.worker_threads;
+    pthread_cond_broadcast(&np2srv.worker_cond);
+    pthread_mutex_unlock(&np2srv.worker_lock);
     return NULL;
 }
 
@@ -1024,7 +1436,8 @@ print_version(void)
 static void
 print_usage(char* progname)
 {
-    fprintf(stdout, "Usage: %s [-dhV] [-U (path)] [-m mode] [-u uid] [-g gid] [-v level] [-c category]\n", progname);
+    fprintf(stdout, "Usage: %s [-dhV] [-U (path)] [-m mode] [-u uid] [-g gid] [-t count] [-T count] [-v level] [-c category]\n",
+            progname);
     fprintf(stdout, " -d        debug mode (do not daemonize and print verbose messages to stderr instead of syslog)\n");
     fprintf(stdout, " -h        display help\n");
     fprintf(stdout, " -V        show program version\n");
@@ -1032,6 +1445,8 @@ print_usage(char* progname)
     fprintf(stdout, " -m mode   set mode for the listening UNIX socket\n");
     fprintf(stdout, " -u uid    set UID/user for the listening UNIX socket\n");
     fprintf(stdout, " -g gid    set GID/group for the listening UNIX socket\n");
+    fprintf(stdout, " -t count  number of worker threads handling sessions (default %d)\n", NP2SRV_THREAD_COUNT);
+    fprintf(stdout, " -T count  maximum number of worker threads, enables auto-scaling (at most %d)\n", NP2SRV_MAX_THREAD_COUNT);
     fprintf(stdout, " -v level  verbose output level:\n");
     fprintf(stdout, "               0 - errors\n");
     fprintf(stdout, "               1 - errors and warnings\n");
@@ -1051,7 +1466,7 @@ int
 main(int argc, char *argv[])
 {
     int ret = EXIT_SUCCESS;
-    int c, *idx, i;
+    int c, *idx;
     int daemonize = 1, verb = 0;
     int pidfd;
     char pid[8];
@@ -1067,7 +1482,7 @@ main(int argc, char *argv[])
     np2_stderr_log = 1;
 
     /* process command line options */
-    while ((c = getopt(argc, argv, "dhVU::m:u:g:v:c:")) != -1) {
+    while ((c = getopt(argc, argv, "dhVU::m:u:g:t:T:v:c:")) != -1) {
         switch (c) {
         case 'd':
             daemonize = 0;
@@ -1138,6 +1553,20 @@ main(int argc, char *argv[])
                 np2srv.unix_gid = grp->gr_gid;
             }
             break;
+        case 't':
+            np2srv.worker_dflt_count = strtoul(optarg, &ptr, 10);
+            if (*ptr || !np2srv.worker_dflt_count || (np2srv.worker_dflt_count > NP2SRV_MAX_THREAD_COUNT)) {
+                ERR("Invalid worker thread count \"%s\".", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'T':
+            np2srv.worker_dflt_max = strtoul(optarg, &ptr, 10);
+            if (*ptr || (np2srv.worker_dflt_max > NP2SRV_MAX_THREAD_COUNT)) {
+                ERR("Invalid maximum worker thread count \"%s\".", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
         case 'c':
 #ifndef NDEBUG
             if (verb) {
@@ -1251,6 +1680,9 @@ main(int argc, char *argv[])
     action.sa_handler = SIG_IGN;
     sigaction(SIGPIPE, &action, NULL);
 
+    /* print messages asynchronously, directly if it fails */
+    np2log_start();
+
     /* set printer callbacks for the used libraries and set proper log levels */
     nc_set_print_clb(np2log_cb_nc2); /* libnetconf2 */
     ly_set_log_clb(np2log_cb_ly, 1); /* libyang */
@@ -1262,6 +1694,9 @@ main(int argc, char *argv[])
         goto cleanup;
     }
 
+    /* worker thread counts from the command line, may be overwritten by configuration */
+    np2srv_workers_set(np2srv.worker_dflt_count, np2srv.worker_dflt_max);
+
     /* subscribe to sysrepo */
     if (server_rpc_subscribe()) {
         ret = EXIT_FAILURE;
@@ -1272,26 +1707,25 @@ main(int argc, char *argv[])
         goto cleanup;
     }
 
-    /* start additional worker threads */
-    for (i = 1; i < NP2SRV_THREAD_COUNT; ++i) {
-        idx = malloc(sizeof *idx);
-        *idx = i;
-        pthread_create(&np2srv.workers[*idx], NULL, worker_thread, idx);
-    }
+    /* one worker will use this thread, start the additional ones */
+    pthread_mutex_lock(&np2srv.worker_lock);
+    ATOMIC_INC_FENCE(np2srv.worker_count);
+    np2srv.worker_threads = 1;
+    np2srv.worker_next_idx = 1;
+    while ((ATOMIC_LOAD_RELAXED(np2srv.worker_count) < ATOMIC_LOAD_RELAXED(np2srv.worker_target))
+            && !np2srv_worker_start());
+    pthread_mutex_unlock(&np2srv.worker_lock);
 
-    /* one worker will use this thread */
-    np2srv.workers[0] = pthread_self();
     idx = malloc(sizeof *idx);
     *idx = 0;
     worker_thread(idx);
 
     /* wait for other worker threads to finish */
-    for (i = 1; i < NP2SRV_THREAD_COUNT; ++i) {
-        c = pthread_join(np2srv.workers[i], NULL);
-        if (c) {
-            ERR("Failed to join worker thread %d (%s).", i, strerror(c));
-        }
+    pthread_mutex_lock(&np2srv.worker_lock);
+    while (np2srv.worker_threads) {
+        pthread_cond_wait(&np2srv.worker_cond, &np2srv.worker_lock);
     }
+    pthread_mutex_unlock(&np2srv.worker_lock);
 
 cleanup:
     VRB("Server terminated.");
@@ -1300,6 +1734,7 @@ cleanup:
     sr_unsubscribe(np2srv.sr_rpc_sub);
     sr_unsubscribe(np2srv.sr_data_sub);
     sr_unsubscribe(np2srv.sr_notif_sub);
+    np_ntf_fanout_destroy();
 
     /* remove all CH clients so they do not reconnect */
     nc_server_ch_del_client(NULL);
@@ -1313,12 +1748,23 @@ cleanup:
         }
         nc_ps_free(np2srv.nc_ps);
     }
+    np_sess_setup_stop();
+    np_sessions_destroy();
+    np_schema_index_destroy();
+    np_filter_cache_destroy();
+    np_keystore_cache_destroy();
+    np_authkeys_destroy();
+    np2srv_rpc_stats_destroy();
 
     /* libnetconf2 cleanup */
     nc_server_destroy();
 
+    /* URL capability cleanup */
+    np2srv_url_destroy();
+
     /* monitoring cleanup */
     ncm_destroy();
+    lyd_free_withsiblings(ntf_streams.data);
 
     /* NACM cleanup */
     ncac_destroy();
@@ -1326,5 +1772,8 @@ cleanup:
     /* removes the context and clears all the sessions */
     sr_disconnect(np2srv.sr_conn);
 
+    /* print all the remaining messages */
+    np2log_stop();
+
     return ret;
 }
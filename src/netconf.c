@@ -29,6 +29,9 @@
 #include "common.h"
 #include "log.h"
 #include "netconf_acm.h"
+#include "notif_fanout.h"
+#include "rpc_stats.h"
+#include "schema_index.h"
 
 int
 np2srv_rpc_get_cb(sr_session_ctx_t *session, const char *op_path, const struct lyd_node *input, sr_event_t UNUSED(event),
@@ -41,6 +44,7 @@ np2srv_rpc_get_cb(sr_session_ctx_t *session, const char *op_path, const struct l
     struct ly_set *nodeset;
     sr_datastore_t ds = 0;
     sr_get_oper_options_t get_opts = 0;
+    uint64_t phase_start;
 
     /* get know which datastore is being affected */
     if (!strcmp(op_path, "/ietf-netconf:get")) {
@@ -61,6 +65,7 @@ np2srv_rpc_get_cb(sr_session_ctx_t *session, const char *op_path, const struct l
     }
 
     /* create filters */
+    phase_start = np2srv_rpc_stats_now();
     nodeset = lyd_find_path(input, "filter");
     if (nodeset->number) {
         node = nodeset->set.d[0];
@@ -87,42 +92,50 @@ np2srv_rpc_get_cb(sr_session_ctx_t *session, const char *op_path, const struct l
         }
     }
 
+    /* do not even retrieve data the user cannot read */
+    if (ncac_read_filters_restrict(lyd_node_module(input)->ctx, np_get_nc_sess_user(session), &filters, &filter_count)) {
+        rc = SR_ERR_NOMEM;
+        goto cleanup;
+    }
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_FILTER, phase_start);
+
     /* we do not care here about with-defaults mode, it does not change anything */
 
-get_sr_data:
     /* update sysrepo session datastore */
     sr_session_switch_ds(session, ds);
 
     /*
      * create the data tree for the data reply
      */
-    for (i = 0; i < filter_count; i++) {
-        rc = sr_get_data(session, filters[i], 0, NP2SRV_SYSREPO_TIMEOUT, get_opts, &node);
-        if (rc != SR_ERR_OK) {
-            ERR("Getting data \"%s\" from sysrepo failed (%s).", filters[i], sr_strerror(rc));
-            sr_get_error(session, &err_info);
-            sr_set_error(session, err_info->err[0].xpath, err_info->err[0].message);
-            goto cleanup;
-        }
-
-        if (!data_get) {
-            data_get = node;
-        } else if (node && lyd_merge(data_get, node, LYD_OPT_DESTRUCT | LYD_OPT_EXPLICIT)) {
-            lyd_free_withsiblings(node);
-            rc = SR_ERR_LY;
-            goto cleanup;
+    phase_start = np2srv_rpc_stats_now();
+    rc = op_filter_data_get(session, 0, get_opts, filters, filter_count, &data_get);
+    if ((rc == SR_ERR_OK) && !strcmp(op_path, "/ietf-netconf:get")) {
+        /* operational includes only enabled running data, append only the state data to all the running data */
+        sr_session_switch_ds(session, SR_DS_OPERATIONAL);
+        rc = op_filter_data_get(session, 0, SR_OPER_NO_CONFIG, filters, filter_count, &node);
+        if ((rc == SR_ERR_OK) && node) {
+            if (!data_get) {
+                data_get = node;
+            } else if (lyd_merge(data_get, node, LYD_OPT_DESTRUCT | LYD_OPT_EXPLICIT)) {
+                lyd_free_withsiblings(node);
+                np2srv_rpc_stats_phase(NP2SRV_PHASE_DATASTORE, phase_start);
+                rc = SR_ERR_LY;
+                goto cleanup;
+            }
         }
     }
-
-    if (!strcmp(op_path, "/ietf-netconf:get") && (ds == SR_DS_RUNNING)) {
-        /* we have running data, now append state data */
-        ds = SR_DS_OPERATIONAL;
-       // get_opts = SR_OPER_NO_CONFIG;
-        goto get_sr_data;
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_DATASTORE, phase_start);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting data from sysrepo failed (%s).", sr_strerror(rc));
+        sr_get_error(session, &err_info);
+        sr_set_error(session, err_info->err[0].xpath, err_info->err[0].message);
+        goto cleanup;
     }
 
     /* perform correct NACM filtering */
+    phase_start = np2srv_rpc_stats_now();
     ncac_check_data_read_filter(&data_get, np_get_nc_sess_user(session));
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_NACM_FILTER, phase_start);
 
     /* add output */
     node = lyd_new_output_anydata(output, NULL, "data", data_get, LYD_ANYDATA_DATATREE);
@@ -226,6 +239,10 @@ np2srv_rpc_editconfig_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
         if (rc != SR_ERR_OK) {
             goto cleanup;
         }
+
+        /* the edit is copied into the session, free it as soon as possible */
+        lyd_free_withsiblings(config);
+        config = NULL;
     }
 
     if (!strcmp(testop, "test-then-set")) {
@@ -255,6 +272,7 @@ np2srv_rpc_copyconfig_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
     struct ly_set *nodeset;
     const sr_error_info_t *err_info;
     struct lyd_node *config = NULL;
+    struct np2srv_sess *sess;
     int rc = SR_ERR_OK, run_to_start = 0;
 #ifdef NP2SRV_URL_CAPAB
     struct lyd_node_leaf_list *leaf;
@@ -330,8 +348,9 @@ np2srv_rpc_copyconfig_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
         goto cleanup;
     }
 
+#ifdef NP2SRV_URL_CAPAB
     /* NACM checks */
-    if (!config && !run_to_start) {
+    if (!config && trg_url) {
         /* get source datastore data and filter them */
         sr_session_switch_ds(session, sds);
         rc = sr_get_data(session, "/*", 0, NP2SRV_SYSREPO_TIMEOUT, 0, &config);
@@ -340,6 +359,7 @@ np2srv_rpc_copyconfig_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
         }
         ncac_check_data_read_filter(&config, np_get_nc_sess_user(session));
     }
+#endif
 
     /* update sysrepo session datastore */
     sr_session_switch_ds(session, ds);
@@ -376,12 +396,18 @@ np2srv_rpc_copyconfig_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
             rc = sr_replace_config(session, NULL, config, NP2SRV_SYSREPO_TIMEOUT, NP2SRV_DATA_CHANGE_WAIT);
             config = NULL;
         } else {
-            assert(run_to_start);
+            sess = np_get_nc_sess(session);
+            if (!sess) {
+                EINT;
+                rc = SR_ERR_INTERNAL;
+                goto cleanup;
+            }
 
-            /* set SID to skip NACM check, only one copy-config can be executed at once */
-            ATOMIC_STORE_RELAXED(skip_nacm_sr_sid, sr_session_get_id(session));
+            /* sysrepo applies only the difference, which is NACM-checked including read access to the copied
+             * data, the special copy-config from running to startup is not checked at all */
+            ATOMIC_STORE_RELAXED(sess->copy_nacm, run_to_start ? NP2SRV_COPY_NACM_SKIP : NP2SRV_COPY_NACM_READ);
             rc = sr_copy_config(session, NULL, sds, NP2SRV_SYSREPO_TIMEOUT, NP2SRV_DATA_CHANGE_WAIT);
-            ATOMIC_STORE_RELAXED(skip_nacm_sr_sid, 0);
+            ATOMIC_STORE_RELAXED(sess->copy_nacm, NP2SRV_COPY_NACM_WRITE);
         }
         if (rc != SR_ERR_OK) {
             sr_get_error(session, &err_info);
@@ -504,9 +530,9 @@ int
 np2srv_rpc_kill_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), const struct lyd_node *input,
         sr_event_t UNUSED(event), uint32_t UNUSED(request_id), struct lyd_node *UNUSED(output), void *UNUSED(private_data))
 {
-    struct nc_session *kill_sess;
+    struct np2srv_sess *kill_sess;
     struct ly_set *nodeset;
-    uint32_t kill_sid, i;
+    uint32_t kill_sid;
     int rc = SR_ERR_OK;
 
     nodeset = lyd_find_path(input, "session-id");
@@ -519,21 +545,21 @@ np2srv_rpc_kill_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), const
         goto cleanup;
     }
 
-    for (i = 0; (kill_sess = nc_ps_get_session(np2srv.nc_ps, i)); ++i) {
-        if (nc_session_get_id(kill_sess) == kill_sid) {
-            break;
-        }
-    }
+    /* keep the session from being freed while killing it */
+    pthread_rwlock_rdlock(&np2srv.sessions_lock);
+    kill_sess = np_sessions_find(kill_sid);
     if (!kill_sess) {
+        pthread_rwlock_unlock(&np2srv.sessions_lock);
         rc = SR_ERR_INVAL_ARG;
         sr_set_error(session, NULL, "Session with the specified \"session-id\" not found.");
         goto cleanup;
     }
 
     /* kill the session */
-    nc_session_set_status(kill_sess, NC_STATUS_INVALID);
-    nc_session_set_term_reason(kill_sess, NC_SESSION_TERM_KILLED);
-    nc_session_set_killed_by(kill_sess, sr_session_get_nc_id(session));
+    nc_session_set_status(kill_sess->nc_sess, NC_STATUS_INVALID);
+    nc_session_set_term_reason(kill_sess->nc_sess, NC_SESSION_TERM_KILLED);
+    nc_session_set_killed_by(kill_sess->nc_sess, sr_session_get_nc_id(session));
+    pthread_rwlock_unlock(&np2srv.sessions_lock);
 
     /* success */
 
@@ -652,22 +678,19 @@ np2srv_rpc_subscribe_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
         sr_event_t UNUSED(event), uint32_t UNUSED(request_id), struct lyd_node *UNUSED(output), void *UNUSED(private_data))
 {
     struct ly_set *nodeset;
-    const struct lys_module *ly_mod;
-    struct lys_node *root, *next, *elem, *parent;
-    struct nc_session *ncs;
+    const struct lys_module **mods;
+    struct np2srv_sess *sess;
     const char *stream;
     char **filters = NULL, *xp = NULL, *mem;
     time_t start = 0, stop = 0;
     int rc = SR_ERR_OK, i, len, filter_count = 0;
-    uint32_t idx;
+    uint32_t idx, mod_count;
 
     /* find this NETCONF session */
-    for (i = 0; (ncs = nc_ps_get_session(np2srv.nc_ps, i)); ++i) {
-        if (nc_session_get_id(ncs) == sr_session_get_nc_id(session)) {
-            break;
-        }
-    }
-    if (!ncs) {
+    pthread_rwlock_rdlock(&np2srv.sessions_lock);
+    sess = np_sessions_find(sr_session_get_nc_id(session));
+    pthread_rwlock_unlock(&np2srv.sessions_lock);
+    if (!sess) {
         ERR("Failed to find NETCONF session SID %u.", sr_session_get_nc_id(session));
         rc = SR_ERR_INTERNAL;
         goto cleanup;
@@ -725,40 +748,34 @@ np2srv_rpc_subscribe_cb(sr_session_ctx_t *session, const char *UNUSED(op_path),
     ly_set_free(nodeset);
 
     /* set ongoing notifications flag */
-    nc_session_set_notif_status(ncs, 1);
+    nc_session_set_notif_status(sess->nc_sess, 1);
 
     /* sysrepo API */
     if (!strcmp(stream, "NETCONF")) {
-        /* subscribe to all modules with notifications */
-        idx = 0;
-        while ((ly_mod = ly_ctx_get_module_iter(lyd_node_module(input)->ctx, &idx))) {
-            rc = SR_ERR_OK;
-            LY_TREE_FOR(ly_mod->data, root) {
-                LY_TREE_DFS_BEGIN(root, next, elem) {
-                    if (elem->nodetype == LYS_NOTIF) {
-                        /* check that we are not in a grouping */
-                        parent = lys_parent(elem);
-                        while (parent && (parent->nodetype != LYS_GROUPING)) {
-                            parent = lys_parent(parent);
-                        }
-                        if (!parent) {
-                            rc = sr_event_notif_subscribe_tree(nc_session_get_data(ncs), ly_mod->name, xp, start, stop,
-                                    np2srv_ntf_new_cb, ncs, np2srv.sr_notif_sub ? SR_SUBSCR_CTX_REUSE : 0, &np2srv.sr_notif_sub);
-                            break;
-                        }
-                    }
-                    LY_TREE_DFS_END(root, next, elem);
-                }
-                if (elem && (elem->nodetype == LYS_NOTIF)) {
-                   break;
-                }
-            }
-            if (rc != SR_ERR_OK) {
+        if (!start && !stop) {
+            /* one shared subscription of all the modules with notifications */
+            rc = np_ntf_fanout_add_all(sess->nc_sess, lyd_node_module(input)->ctx, xp);
+        } else {
+            /* subscribe to all modules with notifications */
+            if (np_schema_index_rdlock(lyd_node_module(input)->ctx)) {
+                rc = SR_ERR_INTERNAL;
                 goto cleanup;
             }
+            mods = np_schema_index_notif_modules(&mod_count);
+            for (idx = 0; idx < mod_count; ++idx) {
+                rc = sr_event_notif_subscribe_tree(sess->sr_sess, mods[idx]->name, xp, start, stop, np2srv_ntf_new_cb,
+                        sess->nc_sess, np2srv.sr_notif_sub ? SR_SUBSCR_CTX_REUSE : 0, &np2srv.sr_notif_sub);
+                if (rc != SR_ERR_OK) {
+                    break;
+                }
+            }
+            np_schema_index_unlock();
         }
+    } else if (!start && !stop) {
+        /* notifications without replay are delivered to all the sessions at once */
+        rc = np_ntf_fanout_add(sess->nc_sess, stream, xp);
     } else {
-        rc = sr_event_notif_subscribe_tree(nc_session_get_data(ncs), stream, xp, start, stop, np2srv_ntf_new_cb, ncs,
+        rc = sr_event_notif_subscribe_tree(sess->sr_sess, stream, xp, start, stop, np2srv_ntf_new_cb, sess->nc_sess,
                 np2srv.sr_notif_sub ? SR_SUBSCR_CTX_REUSE : 0, &np2srv.sr_notif_sub);
     }
     if (rc != SR_ERR_OK) {
@@ -773,8 +790,9 @@ cleanup:
     }
     free(filters);
     free(xp);
-    if (ncs && rc) {
-        nc_session_set_notif_status(ncs, 0);
+    if (sess && rc) {
+        np_ntf_fanout_del(sess->nc_sess);
+        nc_session_set_notif_status(sess->nc_sess, 0);
     }
     return rc;
 }
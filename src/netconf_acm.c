@@ -30,6 +30,540 @@
 
 struct ncac nacm;
 
+/* invalid group set ID */
+#define NCAC_GS_INVALID UINT32_MAX
+
+/**
+ * @brief Cached NACM decision.
+ */
+struct ncac_cache_rec {
+    const struct lys_node *node;    /**< Checked schema node. */
+    uint32_t gs_id;                 /**< Group set ID of the user. */
+    uint8_t oper;                   /**< Checked operation. */
+    uint8_t allowed;                /**< Whether the access is allowed. */
+
+    struct ncac_cache_rec *prev;    /**< More recently used decision. */
+    struct ncac_cache_rec *next;    /**< Less recently used decision. */
+};
+
+/**
+ * @brief Cache hash table value equal callback.
+ */
+static int
+ncac_cache_rec_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct ncac_cache_rec *rec1 = *(struct ncac_cache_rec **)val1_p, *rec2 = *(struct ncac_cache_rec **)val2_p;
+
+    return (rec1->node == rec2->node) && (rec1->gs_id == rec2->gs_id) && (rec1->oper == rec2->oper);
+}
+
+/**
+ * @brief Get hash of a cache record.
+ *
+ * @param[in] rec Cache record.
+ * @return Record hash.
+ */
+static uint32_t
+ncac_cache_rec_hash(const struct ncac_cache_rec *rec)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, &rec->node, sizeof rec->node);
+    hash = np_hash_multi(hash, &rec->gs_id, sizeof rec->gs_id);
+    hash = np_hash_multi(hash, &rec->oper, sizeof rec->oper);
+    return np_hash_multi(hash, NULL, 0);
+}
+
+/**
+ * @brief Unlink a decision from the LRU list, cache lock must be held.
+ *
+ * @param[in] snap Snapshot of the cache.
+ * @param[in] rec Cached decision.
+ */
+static void
+ncac_cache_unlink(struct ncac_config *snap, struct ncac_cache_rec *rec)
+{
+    if (rec->prev) {
+        rec->prev->next = rec->next;
+    } else {
+        snap->cache_first = rec->next;
+    }
+    if (rec->next) {
+        rec->next->prev = rec->prev;
+    } else {
+        snap->cache_last = rec->prev;
+    }
+    rec->prev = NULL;
+    rec->next = NULL;
+}
+
+/**
+ * @brief Link a decision as the most recently used, cache lock must be held.
+ *
+ * @param[in] snap Snapshot of the cache.
+ * @param[in] rec Cached decision.
+ */
+static void
+ncac_cache_link_first(struct ncac_config *snap, struct ncac_cache_rec *rec)
+{
+    rec->prev = NULL;
+    rec->next = snap->cache_first;
+    if (snap->cache_first) {
+        snap->cache_first->prev = rec;
+    } else {
+        snap->cache_last = rec;
+    }
+    snap->cache_first = rec;
+}
+
+/**
+ * @brief NACM decision remembered for a single check, the group set is the same for all of them.
+ */
+struct ncac_memo_rec {
+    const struct lys_node *node;    /**< Checked schema node. */
+    uint8_t oper;                   /**< Checked operation. */
+    uint8_t allowed;                /**< Whether the access is allowed. */
+};
+
+/**
+ * @brief Check memo hash table value equal callback.
+ */
+static int
+ncac_memo_rec_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct ncac_memo_rec *rec1 = val1_p, *rec2 = val2_p;
+
+    return (rec1->node == rec2->node) && (rec1->oper == rec2->oper);
+}
+
+/**
+ * @brief Get hash of a check memo record.
+ *
+ * @param[in] rec Memo record.
+ * @return Record hash.
+ */
+static uint32_t
+ncac_memo_rec_hash(const struct ncac_memo_rec *rec)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, &rec->node, sizeof rec->node);
+    hash = np_hash_multi(hash, &rec->oper, sizeof rec->oper);
+    return np_hash_multi(hash, NULL, 0);
+}
+
+/**
+ * @brief Rules with a specific target schema node.
+ */
+struct ncac_rule_index_rec {
+    const struct lys_node *node;    /**< Target schema node of all the rules. */
+    struct ncac_rule **rules;       /**< Rules ordered by their order. */
+    uint32_t rule_count;            /**< Number of rules. */
+};
+
+/**
+ * @brief Rule index hash table value equal callback.
+ */
+static int
+ncac_rule_index_rec_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct ncac_rule_index_rec *rec1 = val1_p, *rec2 = val2_p;
+
+    return rec1->node == rec2->node;
+}
+
+/**
+ * @brief Get hash of a schema node for the rule index.
+ *
+ * @param[in] node Schema node.
+ * @return Node hash.
+ */
+static uint32_t
+ncac_rule_index_hash(const struct lys_node *node)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, &node, sizeof node);
+    return np_hash_multi(hash, NULL, 0);
+}
+
+/**
+ * @brief Resolve a rule path target to a schema node.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] target Rule path target.
+ * @return Resolved schema node, NULL if the target cannot be resolved.
+ */
+static const struct lys_node *
+ncac_rule_target_resolve(struct ly_ctx *ly_ctx, const char *target)
+{
+    const struct lys_node *node;
+
+    if (strchr(target, '[') || strchr(target, '*')) {
+        /* instances or wildcards, matched as strings */
+        return NULL;
+    }
+
+    /* the target is a data path without choices and cases, the same as JSON schema node ID */
+    node = ly_ctx_get_node(ly_ctx, NULL, target, 0);
+    if (node && (node->nodetype & (LYS_USES | LYS_CHOICE | LYS_CASE | LYS_GROUPING | LYS_INPUT | LYS_OUTPUT))) {
+        node = NULL;
+    }
+    return node;
+}
+
+static void
+ncac_remove_rules(struct ncac_rule_list *list)
+{
+    struct ncac_rule *rule, *tmp;
+    struct ly_ctx *ly_ctx;
+
+    ly_ctx = (struct ly_ctx *)sr_get_context(np2srv.sr_conn);
+
+    LY_TREE_FOR_SAFE(list->rules, tmp, rule) {
+        lydict_remove(ly_ctx, rule->name);
+        lydict_remove(ly_ctx, rule->module_name);
+        lydict_remove(ly_ctx, rule->target);
+        lydict_remove(ly_ctx, rule->comment);
+        free(rule);
+    }
+    list->rules = NULL;
+}
+
+
+/**
+ * @brief Free all the groups and rule lists of a configuration.
+ *
+ * @param[in] ly_ctx libyang context for dictionary.
+ * @param[in] conf Configuration to clear.
+ */
+static void
+ncac_config_clear(struct ly_ctx *ly_ctx, struct ncac_config *conf)
+{
+    struct ncac_group *group;
+    struct ncac_rule_list *rule_list, *tmp;
+    uint32_t i, j;
+
+    for (i = 0; i < conf->group_count; ++i) {
+        group = &conf->groups[i];
+        lydict_remove(ly_ctx, group->name);
+        for (j = 0; j < group->user_count; ++j) {
+            lydict_remove(ly_ctx, group->users[j]);
+        }
+        free(group->users);
+    }
+    free(conf->groups);
+    conf->groups = NULL;
+    conf->group_count = 0;
+
+    LY_TREE_FOR_SAFE(conf->rule_lists, tmp, rule_list) {
+        lydict_remove(ly_ctx, rule_list->name);
+        for (i = 0; i < rule_list->group_count; ++i) {
+            lydict_remove(ly_ctx, rule_list->groups[i]);
+        }
+        free(rule_list->groups);
+        ncac_remove_rules(rule_list);
+        free(rule_list);
+    }
+    conf->rule_lists = NULL;
+}
+
+/**
+ * @brief Build the rule index and generic rules of a snapshot.
+ *
+ * @param[in] snap Snapshot to use.
+ * @return 0 on success, -1 on error.
+ */
+static int
+ncac_rule_index_build(struct ncac_config *snap)
+{
+    struct ncac_rule_list *rlist;
+    struct ncac_rule *rule;
+    struct ncac_rule_index_rec rec, *match;
+    uint32_t order = 0, hash;
+    void *mem;
+
+    snap->rule_index = np_ht_new(64, sizeof(struct ncac_rule_index_rec), ncac_rule_index_rec_equal, NULL);
+    if (!snap->rule_index) {
+        EMEM;
+        return -1;
+    }
+
+    for (rlist = snap->rule_lists; rlist; rlist = rlist->next) {
+        for (rule = rlist->rules; rule; rule = rule->next) {
+            rule->order = order++;
+            rule->rlist = rlist;
+
+            if (!rule->target_node) {
+                mem = realloc(snap->generic_rules, (snap->generic_rule_count + 1) * sizeof *snap->generic_rules);
+                if (!mem) {
+                    EMEM;
+                    return -1;
+                }
+                snap->generic_rules = mem;
+                snap->generic_rules[snap->generic_rule_count] = rule;
+                ++snap->generic_rule_count;
+                continue;
+            }
+
+            /* find or create the record of the node */
+            rec.node = rule->target_node;
+            rec.rules = NULL;
+            rec.rule_count = 0;
+            hash = ncac_rule_index_hash(rec.node);
+            if (np_ht_insert(snap->rule_index, &rec, hash, (void **)&match) == -1) {
+                EMEM;
+                return -1;
+            }
+
+            mem = realloc(match->rules, (match->rule_count + 1) * sizeof *match->rules);
+            if (!mem) {
+                EMEM;
+                return -1;
+            }
+            match->rules = mem;
+            match->rules[match->rule_count] = rule;
+            ++match->rule_count;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Free a snapshot.
+ *
+ * @param[in] ly_ctx libyang context for dictionary.
+ * @param[in] snap Snapshot to free.
+ */
+static void
+ncac_snapshot_free(struct ly_ctx *ly_ctx, struct ncac_config *snap)
+{
+    struct ncac_rule_index_rec *rec;
+    struct ncac_cache_rec *crec, *cnext;
+    uint32_t i, j, idx = 0;
+
+    ncac_config_clear(ly_ctx, snap);
+
+    if (snap->rule_index) {
+        while ((rec = np_ht_iter_next(snap->rule_index, &idx))) {
+            free(rec->rules);
+        }
+        np_ht_free(snap->rule_index);
+    }
+    free(snap->generic_rules);
+
+    for (i = 0; i < snap->group_set_count; ++i) {
+        for (j = 0; j < snap->group_sets[i]->group_count; ++j) {
+            lydict_remove(ly_ctx, snap->group_sets[i]->groups[j]);
+        }
+        free(snap->group_sets[i]->groups);
+        free(snap->group_sets[i]);
+    }
+    free(snap->group_sets);
+
+    if (snap->cache) {
+        if (snap->cache->used) {
+            ATOMIC_INC_FENCE(nacm.cache_flushes);
+        }
+        np_ht_free(snap->cache);
+    }
+    for (crec = snap->cache_first; crec; crec = cnext) {
+        cnext = crec->next;
+        free(crec);
+    }
+    pthread_mutex_destroy(&snap->cache_lock);
+    free(snap);
+}
+
+/**
+ * @brief Create a snapshot of the current configuration. NACM lock is expected to be held.
+ *
+ * @param[in] ly_ctx libyang context for dictionary.
+ * @return Created snapshot, NULL on error.
+ */
+static struct ncac_config *
+ncac_snapshot_new(struct ly_ctx *ly_ctx)
+{
+    struct ncac_config *snap;
+    struct ncac_group *group;
+    struct ncac_rule_list *rlist, *snap_rlist, *last_rlist = NULL;
+    struct ncac_rule *rule, *snap_rule, *last_rule;
+    uint32_t i, j;
+
+    snap = calloc(1, sizeof *snap);
+    if (!snap) {
+        EMEM;
+        return NULL;
+    }
+    pthread_mutex_init(&snap->cache_lock, NULL);
+    snap->refcount = 1;
+    snap->generation = nacm.conf.generation;
+    snap->enabled = nacm.conf.enabled;
+    snap->default_read_deny = nacm.conf.default_read_deny;
+    snap->default_write_deny = nacm.conf.default_write_deny;
+    snap->default_exec_deny = nacm.conf.default_exec_deny;
+    snap->enable_external_groups = nacm.conf.enable_external_groups;
+
+    /* copy groups */
+    if (nacm.conf.group_count) {
+        snap->groups = calloc(nacm.conf.group_count, sizeof *snap->groups);
+        if (!snap->groups) {
+            goto error_mem;
+        }
+        snap->group_count = nacm.conf.group_count;
+    }
+    for (i = 0; i < nacm.conf.group_count; ++i) {
+        group = &snap->groups[i];
+        group->name = lydict_insert(ly_ctx, nacm.conf.groups[i].name, 0);
+        if (!nacm.conf.groups[i].user_count) {
+            continue;
+        }
+
+        group->users = malloc(nacm.conf.groups[i].user_count * sizeof *group->users);
+        if (!group->users) {
+            goto error_mem;
+        }
+        for (j = 0; j < nacm.conf.groups[i].user_count; ++j) {
+            group->users[j] = (char *)lydict_insert(ly_ctx, nacm.conf.groups[i].users[j], 0);
+            ++group->user_count;
+        }
+    }
+
+    /* copy rule lists */
+    for (rlist = nacm.conf.rule_lists; rlist; rlist = rlist->next) {
+        snap_rlist = calloc(1, sizeof *snap_rlist);
+        if (!snap_rlist) {
+            goto error_mem;
+        }
+        if (last_rlist) {
+            last_rlist->next = snap_rlist;
+        } else {
+            snap->rule_lists = snap_rlist;
+        }
+        last_rlist = snap_rlist;
+
+        snap_rlist->name = lydict_insert(ly_ctx, rlist->name, 0);
+        if (rlist->group_count) {
+            snap_rlist->groups = malloc(rlist->group_count * sizeof *snap_rlist->groups);
+            if (!snap_rlist->groups) {
+                goto error_mem;
+            }
+            for (i = 0; i < rlist->group_count; ++i) {
+                snap_rlist->groups[i] = (char *)lydict_insert(ly_ctx, rlist->groups[i], 0);
+                ++snap_rlist->group_count;
+            }
+        }
+
+        /* copy rules */
+        last_rule = NULL;
+        for (rule = rlist->rules; rule; rule = rule->next) {
+            snap_rule = calloc(1, sizeof *snap_rule);
+            if (!snap_rule) {
+                goto error_mem;
+            }
+            if (last_rule) {
+                last_rule->next = snap_rule;
+            } else {
+                snap_rlist->rules = snap_rule;
+            }
+            last_rule = snap_rule;
+
+            snap_rule->name = lydict_insert(ly_ctx, rule->name, 0);
+            snap_rule->module_name = lydict_insert(ly_ctx, rule->module_name, 0);
+            snap_rule->target = lydict_insert(ly_ctx, rule->target, 0);
+            snap_rule->target_node = rule->target_node;
+            snap_rule->target_type = rule->target_type;
+            snap_rule->operations = rule->operations;
+            snap_rule->action_deny = rule->action_deny;
+            snap_rule->comment = lydict_insert(ly_ctx, rule->comment, 0);
+        }
+    }
+
+    /* build the rule index and decision cache */
+    if (ncac_rule_index_build(snap)) {
+        goto error;
+    }
+    snap->cache = np_ht_new(1024, sizeof(struct ncac_cache_rec *), ncac_cache_rec_equal, NULL);
+    if (!snap->cache) {
+        goto error_mem;
+    }
+
+    return snap;
+
+error_mem:
+    EMEM;
+error:
+    ncac_snapshot_free(ly_ctx, snap);
+    return NULL;
+}
+
+/**
+ * @brief Get the current snapshot, it must be released with ::ncac_snapshot_put().
+ *
+ * @return Current snapshot.
+ */
+static struct ncac_config *
+ncac_snapshot_get(void)
+{
+    struct ncac_config *snap;
+
+    pthread_mutex_lock(&nacm.snapshot_lock);
+    snap = nacm.snapshot;
+    ++snap->refcount;
+    pthread_mutex_unlock(&nacm.snapshot_lock);
+
+    return snap;
+}
+
+/**
+ * @brief Release a snapshot, the last reference frees it.
+ *
+ * @param[in] snap Snapshot to release.
+ */
+static void
+ncac_snapshot_put(struct ncac_config *snap)
+{
+    uint32_t refcount;
+
+    pthread_mutex_lock(&nacm.snapshot_lock);
+    refcount = --snap->refcount;
+    pthread_mutex_unlock(&nacm.snapshot_lock);
+
+    if (!refcount) {
+        ncac_snapshot_free((struct ly_ctx *)sr_get_context(np2srv.sr_conn), snap);
+    }
+}
+
+/**
+ * @brief Publish the current configuration as a new snapshot. NACM lock is expected to be held.
+ *
+ * @return SR_ERR value.
+ */
+static int
+ncac_snapshot_publish(void)
+{
+    struct ncac_config *snap, *old;
+
+    snap = ncac_snapshot_new((struct ly_ctx *)sr_get_context(np2srv.sr_conn));
+    if (!snap) {
+        ERR("Publishing new NACM configuration failed.");
+        return SR_ERR_NOMEM;
+    }
+
+    /* swap the snapshots, checks in progress keep using the old one */
+    pthread_mutex_lock(&nacm.snapshot_lock);
+    old = nacm.snapshot;
+    nacm.snapshot = snap;
+    pthread_mutex_unlock(&nacm.snapshot_lock);
+
+    if (old) {
+        ncac_snapshot_put(old);
+    }
+    return SR_ERR_OK;
+}
+
+
 /* /ietf-netconf-acm:nacm */
 int
 ncac_nacm_params_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
@@ -56,52 +590,103 @@ ncac_nacm_params_cb(sr_session_ctx_t *session, const char *UNUSED(module_name),
 
     pthread_mutex_lock(&nacm.lock);
 
+    /* invalidate all cached decisions */
+    ++nacm.conf.generation;
+
     while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
         if (!strcmp(node->schema->name, "enable-nacm")) {
             if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
                 if (((struct lyd_node_leaf_list *)node)->value.bln) {
-                    nacm.enabled = 1;
+                    nacm.conf.enabled = 1;
                 } else {
-                    nacm.enabled = 0;
+                    nacm.conf.enabled = 0;
                 }
             }
         } else if (!strcmp(node->schema->name, "read-default")) {
             if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
                 if (!strcmp(((struct lyd_node_leaf_list *)node)->value_str, "permit")) {
-                    nacm.default_read_deny = 0;
+                    nacm.conf.default_read_deny = 0;
                 } else {
-                    nacm.default_read_deny = 1;
+                    nacm.conf.default_read_deny = 1;
                 }
             }
         } else if (!strcmp(node->schema->name, "write-default")) {
             if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
                 if (!strcmp(((struct lyd_node_leaf_list *)node)->value_str, "permit")) {
-                    nacm.default_write_deny = 0;
+                    nacm.conf.default_write_deny = 0;
                 } else {
-                    nacm.default_write_deny = 1;
+                    nacm.conf.default_write_deny = 1;
                 }
             }
         } else if (!strcmp(node->schema->name, "exec-default")) {
             if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
                 if (!strcmp(((struct lyd_node_leaf_list *)node)->value_str, "permit")) {
-                    nacm.default_exec_deny = 0;
+                    nacm.conf.default_exec_deny = 0;
                 } else {
-                    nacm.default_exec_deny = 1;
+                    nacm.conf.default_exec_deny = 1;
                 }
             }
         } else if (!strcmp(node->schema->name, "enable-external-groups")) {
             if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
                 if (((struct lyd_node_leaf_list *)node)->value.bln) {
-                    nacm.enable_external_groups = 1;
+                    nacm.conf.enable_external_groups = 1;
                 } else {
-                    nacm.enable_external_groups = 0;
+                    nacm.conf.enable_external_groups = 0;
                 }
             }
         }
     }
-
-    pthread_mutex_unlock(&nacm.lock);
-
+
+    /* publish the new configuration */
+    if (rc == SR_ERR_NOT_FOUND) {
+        rc = ncac_snapshot_publish();
+        if (rc != SR_ERR_OK) {
+            pthread_mutex_unlock(&nacm.lock);
+            sr_free_change_iter(iter);
+            return rc;
+        }
+        rc = SR_ERR_NOT_FOUND;
+    }
+
+    pthread_mutex_unlock(&nacm.lock);
+
+    sr_free_change_iter(iter);
+    if (rc != SR_ERR_NOT_FOUND) {
+        ERR("Getting next change failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    return SR_ERR_OK;
+}
+
+/* /netopeer2-monitoring:netopeer2-server/nacm */
+int
+ncac_server_params_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    sr_change_iter_t *iter;
+    sr_change_oper_t op;
+    const struct lyd_node *node;
+    const char *prev_val, *prev_list;
+    bool prev_dflt;
+    int rc;
+
+    rc = sr_get_changes_iter(session, xpath, &iter);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting changes iter failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
+        if (!strcmp(node->schema->name, "groups-ttl")) {
+            /* applies to the cached groups right away */
+            if (op == SR_OP_DELETED) {
+                ATOMIC_STORE_RELAXED(nacm.groups_ttl, NP2SRV_NACM_GROUPS_TTL);
+            } else if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
+                ATOMIC_STORE_RELAXED(nacm.groups_ttl, ((struct lyd_node_leaf_list *)node)->value.uint32);
+            }
+        }
+    }
     sr_free_change_iter(iter);
     if (rc != SR_ERR_NOT_FOUND) {
         ERR("Getting next change failed (%s).", sr_strerror(rc));
@@ -121,22 +706,18 @@ ncac_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_
 
     assert(*parent);
 
-    pthread_mutex_lock(&nacm.lock);
-
     if (!strcmp(path, "/ietf-netconf-acm:nacm/denied-operations")) {
-        sprintf(num_str, "%u", nacm.denied_operations);
+        sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.denied_operations));
         node = lyd_new_path(*parent, NULL, "denied-operations", num_str, 0, 0);
     } else if (!strcmp(path, "/ietf-netconf-acm:nacm/denied-data-writes")) {
-        sprintf(num_str, "%u", nacm.denied_data_writes);
+        sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.denied_data_writes));
         node = lyd_new_path(*parent, NULL, "denied-data-writes", num_str, 0, 0);
     } else {
         assert(!strcmp(path, "/ietf-netconf-acm:nacm/denied-notifications"));
-        sprintf(num_str, "%u", nacm.denied_notifications);
+        sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.denied_notifications));
         node = lyd_new_path(*parent, NULL, "denied-notifications", num_str, 0, 0);
     }
 
-    pthread_mutex_unlock(&nacm.lock);
-
     if (!node) {
         return SR_ERR_INTERNAL;
     }
@@ -144,6 +725,54 @@ ncac_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_
     return SR_ERR_OK;
 }
 
+/* /netopeer2-monitoring:netopeer2-state/nacm-cache */
+int
+ncac_cache_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name), const char *UNUSED(path),
+        const char *UNUSED(request_xpath), uint32_t UNUSED(request_id), struct lyd_node **parent, void *UNUSED(private_data))
+{
+    struct lyd_node *cont;
+    struct ncac_config *snap;
+    uint32_t entries;
+    char num_str[11];
+
+    assert(*parent);
+
+    /* entries of the current cache */
+    snap = ncac_snapshot_get();
+    pthread_mutex_lock(&snap->cache_lock);
+    entries = snap->cache->used;
+    pthread_mutex_unlock(&snap->cache_lock);
+    ncac_snapshot_put(snap);
+
+    cont = lyd_new_path(*parent, NULL, "nacm-cache", NULL, 0, 0);
+    if (!cont) {
+        return SR_ERR_INTERNAL;
+    }
+
+    sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.cache_hits));
+    if (!lyd_new_path(cont, NULL, "hits", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.cache_misses));
+    if (!lyd_new_path(cont, NULL, "misses", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", entries);
+    if (!lyd_new_path(cont, NULL, "entries", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.cache_evictions));
+    if (!lyd_new_path(cont, NULL, "evictions", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(nacm.cache_flushes));
+    if (!lyd_new_path(cont, NULL, "flushes", num_str, 0, 0)) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return SR_ERR_OK;
+}
+
 /* /ietf-netconf-acm:nacm/groups/group */
 int
 ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
@@ -176,6 +805,9 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
 
     pthread_mutex_lock(&nacm.lock);
 
+    /* invalidate all cached decisions */
+    ++nacm.conf.generation;
+
     while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
         if (!strcmp(node->schema->name, "group")) {
             /* name must be present */
@@ -185,15 +817,15 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
             switch (op) {
             case SR_OP_CREATED:
                 /* add new group */
-                mem = realloc(nacm.groups, (nacm.group_count + 1) * sizeof *nacm.groups);
+                mem = realloc(nacm.conf.groups, (nacm.conf.group_count + 1) * sizeof *nacm.conf.groups);
                 if (!mem) {
                     EMEM;
                     pthread_mutex_unlock(&nacm.lock);
                     return SR_ERR_NOMEM;
                 }
-                nacm.groups = mem;
-                group = &nacm.groups[nacm.group_count];
-                ++nacm.group_count;
+                nacm.conf.groups = mem;
+                group = &nacm.conf.groups[nacm.conf.group_count];
+                ++nacm.conf.group_count;
 
                 group->name = lydict_insert(ly_ctx, group_name, 0);
                 group->users = NULL;
@@ -201,14 +833,14 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
                 break;
             case SR_OP_DELETED:
                 /* find it */
-                for (i = 0; i < nacm.group_count; ++i) {
+                for (i = 0; i < nacm.conf.group_count; ++i) {
                     /* both in dictionary */
-                    if (nacm.groups[i].name == group_name) {
-                        group = &nacm.groups[i];
+                    if (nacm.conf.groups[i].name == group_name) {
+                        group = &nacm.conf.groups[i];
                         break;
                     }
                 }
-                assert(i < nacm.group_count);
+                assert(i < nacm.conf.group_count);
 
                 /* delete it */
                 lydict_remove(ly_ctx, group->name);
@@ -217,13 +849,13 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
                 }
                 free(group->users);
 
-                --nacm.group_count;
-                if (i < nacm.group_count) {
-                    memcpy(group, &nacm.groups[nacm.group_count], sizeof *group);
+                --nacm.conf.group_count;
+                if (i < nacm.conf.group_count) {
+                    memcpy(group, &nacm.conf.groups[nacm.conf.group_count], sizeof *group);
                 }
-                if (!nacm.group_count) {
-                    free(nacm.groups);
-                    nacm.groups = NULL;
+                if (!nacm.conf.group_count) {
+                    free(nacm.conf.groups);
+                    nacm.conf.groups = NULL;
                 }
                 group = NULL;
                 break;
@@ -237,10 +869,10 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
             assert(!strcmp(node->parent->child->schema->name, "name"));
             group_name = ((struct lyd_node_leaf_list *)node->parent->child)->value_str;
             group = NULL;
-            for (i = 0; i < nacm.group_count; ++i) {
+            for (i = 0; i < nacm.conf.group_count; ++i) {
                 /* both in dictionary */
-                if (nacm.groups[i].name == group_name) {
-                    group = &nacm.groups[i];
+                if (nacm.conf.groups[i].name == group_name) {
+                    group = &nacm.conf.groups[i];
                     break;
                 }
             }
@@ -288,6 +920,17 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
         }
     }
 
+    /* publish the new configuration */
+    if (rc == SR_ERR_NOT_FOUND) {
+        rc = ncac_snapshot_publish();
+        if (rc != SR_ERR_OK) {
+            pthread_mutex_unlock(&nacm.lock);
+            sr_free_change_iter(iter);
+            return rc;
+        }
+        rc = SR_ERR_NOT_FOUND;
+    }
+
     pthread_mutex_unlock(&nacm.lock);
 
     sr_free_change_iter(iter);
@@ -299,24 +942,6 @@ ncac_group_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const
     return SR_ERR_OK;
 }
 
-static void
-ncac_remove_rules(struct ncac_rule_list *list)
-{
-    struct ncac_rule *rule, *tmp;
-    struct ly_ctx *ly_ctx;
-
-    ly_ctx = (struct ly_ctx *)sr_get_context(np2srv.sr_conn);
-
-    LY_TREE_FOR_SAFE(list->rules, tmp, rule) {
-        lydict_remove(ly_ctx, rule->name);
-        lydict_remove(ly_ctx, rule->module_name);
-        lydict_remove(ly_ctx, rule->target);
-        lydict_remove(ly_ctx, rule->comment);
-        free(rule);
-    }
-    list->rules = NULL;
-}
-
 /* /ietf-netconf-acm:nacm/rule-list */
 int
 ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
@@ -349,6 +974,9 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
 
     pthread_mutex_lock(&nacm.lock);
 
+    /* invalidate all cached decisions */
+    ++nacm.conf.generation;
+
     while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
         if (!strcmp(node->schema->name, "rule-list")) {
             /* name must be present */
@@ -359,7 +987,7 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
             case SR_OP_MOVED:
                 /* find it */
                 prev_rlist = NULL;
-                for (rlist = nacm.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next) {
+                for (rlist = nacm.conf.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next) {
                     prev_rlist = rlist;
                 }
                 assert(rlist);
@@ -368,7 +996,7 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
                 if (prev_rlist) {
                     prev_rlist->next = rlist->next;
                 } else {
-                    nacm.rule_lists = rlist->next;
+                    nacm.conf.rule_lists = rlist->next;
                 }
                 /* fallthrough */
             case SR_OP_CREATED:
@@ -389,7 +1017,7 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
                     assert(strchr(prev_list, '\''));
                     prev_list = strchr(prev_list, '\'') + 1;
                     len = strchr(prev_list, '\'') - prev_list;
-                    prev_rlist = nacm.rule_lists;
+                    prev_rlist = nacm.conf.rule_lists;
                     while (prev_rlist && strncmp(prev_rlist->name, prev_list, len)) {
                         prev_rlist = prev_rlist->next;
                     }
@@ -403,14 +1031,14 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
                     rlist->next = prev_rlist->next;
                     prev_rlist->next = rlist;
                 } else {
-                    rlist->next = nacm.rule_lists;
-                    nacm.rule_lists = rlist;
+                    rlist->next = nacm.conf.rule_lists;
+                    nacm.conf.rule_lists = rlist;
                 }
                 break;
             case SR_OP_DELETED:
                 /* find it */
                 prev_rlist = NULL;
-                for (rlist = nacm.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next) {
+                for (rlist = nacm.conf.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next) {
                     prev_rlist = rlist;
                 }
                 assert(rlist);
@@ -425,7 +1053,7 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
                 if (prev_rlist) {
                     prev_rlist->next = rlist->next;
                 } else {
-                    nacm.rule_lists = rlist->next;
+                    nacm.conf.rule_lists = rlist->next;
                 }
                 free(rlist);
                 rlist = NULL;
@@ -439,7 +1067,7 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
             /* name must be present */
             assert(!strcmp(node->parent->child->schema->name, "name"));
             rlist_name = ((struct lyd_node_leaf_list *)node->parent->child)->value_str;
-            for (rlist = nacm.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next);
+            for (rlist = nacm.conf.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next);
 
             if (!strcmp(node->schema->name, "group")) {
                 if ((op == SR_OP_DELETED) && !rlist) {
@@ -484,6 +1112,17 @@ ncac_rule_list_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), co
         }
     }
 
+    /* publish the new configuration */
+    if (rc == SR_ERR_NOT_FOUND) {
+        rc = ncac_snapshot_publish();
+        if (rc != SR_ERR_OK) {
+            pthread_mutex_unlock(&nacm.lock);
+            sr_free_change_iter(iter);
+            return rc;
+        }
+        rc = SR_ERR_NOT_FOUND;
+    }
+
     pthread_mutex_unlock(&nacm.lock);
 
     sr_free_change_iter(iter);
@@ -526,12 +1165,15 @@ ncac_rule_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const c
 
     pthread_mutex_lock(&nacm.lock);
 
+    /* invalidate all cached decisions */
+    ++nacm.conf.generation;
+
     while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
         if (!strcmp(node->schema->name, "rule")) {
             /* find parent rule list */
             assert(!strcmp(node->parent->child->schema->name, "name"));
             rlist_name = ((struct lyd_node_leaf_list *)node->parent->child)->value_str;
-            for (rlist = nacm.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next);
+            for (rlist = nacm.conf.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next);
             if ((op == SR_OP_DELETED) && !rlist) {
                 /* even parent rule-list was deleted */
                 continue;
@@ -625,7 +1267,7 @@ ncac_rule_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const c
             /* find parent rule list */
             assert(!strcmp(node->parent->parent->child->schema->name, "name"));
             rlist_name = ((struct lyd_node_leaf_list *)node->parent->parent->child)->value_str;
-            for (rlist = nacm.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next);
+            for (rlist = nacm.conf.rule_lists; rlist && (rlist->name != rlist_name); rlist = rlist->next);
             if ((op == SR_OP_DELETED) && !rlist) {
                 /* even parent rule-list was deleted */
                 continue;
@@ -652,6 +1294,7 @@ ncac_rule_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const c
                 }
             } else if (!strcmp(node->schema->name, "rpc-name") || !strcmp(node->schema->name, "notification-name")
                         || !strcmp(node->schema->name, "path")) {
+                rule->target_node = NULL;
                 if (op == SR_OP_DELETED) {
                     lydict_remove(ly_ctx, rule->target);
                     rule->target = NULL;
@@ -671,6 +1314,9 @@ ncac_rule_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const c
                     } else {
                         assert(!strcmp(node->schema->name, "path"));
                         rule->target_type = NCAC_TARGET_DATA;
+                        if (rule->target) {
+                            rule->target_node = ncac_rule_target_resolve(ly_ctx, rule->target);
+                        }
                     }
                 }
             } else if (!strcmp(node->schema->name, "access-operations")) {
@@ -714,6 +1360,17 @@ ncac_rule_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const c
         }
     }
 
+    /* publish the new configuration */
+    if (rc == SR_ERR_NOT_FOUND) {
+        rc = ncac_snapshot_publish();
+        if (rc != SR_ERR_OK) {
+            pthread_mutex_unlock(&nacm.lock);
+            sr_free_change_iter(iter);
+            return rc;
+        }
+        rc = SR_ERR_NOT_FOUND;
+    }
+
     pthread_mutex_unlock(&nacm.lock);
 
     sr_free_change_iter(iter);
@@ -725,42 +1382,36 @@ ncac_rule_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const c
     return SR_ERR_OK;
 }
 
-void
+int
 ncac_init(void)
 {
     pthread_mutex_init(&nacm.lock, NULL);
+    pthread_mutex_init(&nacm.snapshot_lock, NULL);
+    ATOMIC_STORE_RELAXED(nacm.groups_ttl, NP2SRV_NACM_GROUPS_TTL);
+
+    /* publish empty configuration */
+    nacm.snapshot = ncac_snapshot_new((struct ly_ctx *)sr_get_context(np2srv.sr_conn));
+    if (!nacm.snapshot) {
+        return -1;
+    }
+
+    return 0;
 }
 
 void
 ncac_destroy(void)
 {
-    struct ncac_group *group;
-    struct ncac_rule_list *rule_list, *tmp;
     struct ly_ctx *ly_ctx;
-    uint32_t i, j;
 
     ly_ctx = (struct ly_ctx *)sr_get_context(np2srv.sr_conn);
 
-    for (i = 0; i < nacm.group_count; ++i) {
-        group = &nacm.groups[i];
-        lydict_remove(ly_ctx, group->name);
-        for (j = 0; j < group->user_count; ++j) {
-            lydict_remove(ly_ctx, group->users[j]);
-        }
-        free(group->users);
-    }
-    free(nacm.groups);
-
-    LY_TREE_FOR_SAFE(nacm.rule_lists, tmp, rule_list) {
-        lydict_remove(ly_ctx, rule_list->name);
-        for (i = 0; i < rule_list->group_count; ++i) {
-            lydict_remove(ly_ctx, rule_list->groups[i]);
-        }
-        free(rule_list->groups);
-        ncac_remove_rules(rule_list);
-        free(rule_list);
+    ncac_config_clear(ly_ctx, &nacm.conf);
+    if (nacm.snapshot) {
+        ncac_snapshot_put(nacm.snapshot);
+        nacm.snapshot = NULL;
     }
 
+    pthread_mutex_destroy(&nacm.snapshot_lock);
     pthread_mutex_destroy(&nacm.lock);
 }
 
@@ -813,34 +1464,36 @@ ncac_getpwnam(const char *user, uid_t *uid, gid_t *gid)
  * @brief Check NACM acces for the data tree. If this check passes, no other check is necessary.
  * If not, each node must be checked separately to decide.
  *
- * @param[in] top_node Top-level node of the data.
- * @param[in] user User, whose access to check.
+ * @param[in] snap NACM snapshot to use.
+ * @param[in] top_node Top-level node of the data, NULL if not known.
+ * @param[in] recovery Whether the user is the recovery user.
  * @return non-zero if access allowed, 0 if more checks are required.
  */
 static int
-ncac_allowed_tree(const struct lys_node *top_node, const char *user)
+ncac_allowed_tree(const struct ncac_config *snap, const struct lys_node *top_node, char recovery)
 {
-    struct lys_node *parent;
-    uid_t user_uid;
+    struct lys_node *parent = NULL;
 
-    for (parent = lys_parent(top_node); parent && (parent->nodetype & (LYS_USES | LYS_CASE | LYS_CHOICE)); parent = lys_parent(parent));
+    for (parent = top_node ? lys_parent(top_node) : NULL; parent && (parent->nodetype & (LYS_USES | LYS_CASE | LYS_CHOICE)); parent = lys_parent(parent));
     if (parent) {
         EINT;
         return 0;
     }
 
     /* 1) NACM is off */
-    if (!nacm.enabled) {
+    if (!snap->enabled) {
         return 1;
     }
 
     /* 2) recovery session allowed */
-    if (!ncac_getpwnam(user, &user_uid, NULL) && (user_uid == NP2SRV_NACM_RECOVERY_UID)) {
+    if (recovery) {
         return 1;
     }
 
     /* 3) <close-session> and notifications <replayComplete>, <notificationComplete> always allowed */
-    if ((top_node->nodetype == LYS_RPC) && !strcmp(top_node->name, "close-session")
+    if (!top_node) {
+        return 0;
+    } else if ((top_node->nodetype == LYS_RPC) && !strcmp(top_node->name, "close-session")
                 && !strcmp(lys_node_module(top_node)->name, "ietf-netconf")) {
         return 1;
     } else if ((top_node->nodetype == LYS_NOTIF) && !strcmp(lys_node_module(top_node)->name, "nc-notifications")) {
@@ -854,13 +1507,14 @@ ncac_allowed_tree(const struct lys_node *top_node, const char *user)
  * @brief Collect all NACM groups for a user. If enabled, even system ones.
  *
  * @param[in] ly_ctx libyang context for dictionary.
+ * @param[in] conf NACM configuration to use.
  * @param[in] user User to collect groups for.
  * @param[out] groups Array of collected groups.
  * @param[out] group_count Number of collected groups.
  * @return 0 on success, -1 on error.
  */
 static int
-ncac_collect_groups(struct ly_ctx *ly_ctx, const char *user, char ***groups, uint32_t *group_count)
+ncac_collect_groups(struct ly_ctx *ly_ctx, const struct ncac_config *conf, const char *user, char ***groups, uint32_t *group_count)
 {
     struct group grp, *grp_p;
     gid_t user_gid;
@@ -878,23 +1532,23 @@ ncac_collect_groups(struct ly_ctx *ly_ctx, const char *user, char ***groups, uin
     *group_count = 0;
 
     /* collect NACM groups */
-    for (i = 0; i < nacm.group_count; ++i) {
-        for (j = 0; j < nacm.groups[i].user_count; ++j) {
-            if (nacm.groups[i].users[j] == user_dict) {
+    for (i = 0; i < conf->group_count; ++i) {
+        for (j = 0; j < conf->groups[i].user_count; ++j) {
+            if (conf->groups[i].users[j] == user_dict) {
                 mem = realloc(*groups, (*group_count + 1) * sizeof **groups);
                 if (!mem) {
                     EMEM;
                     goto cleanup;
                 }
                 *groups = mem;
-                (*groups)[*group_count] = (char *)lydict_insert(ly_ctx, nacm.groups[i].name, 0);
+                (*groups)[*group_count] = (char *)lydict_insert(ly_ctx, conf->groups[i].name, 0);
                 ++(*group_count);
             }
         }
     }
 
     /* collect system groups */
-    if (nacm.enable_external_groups) {
+    if (conf->enable_external_groups) {
         ret = ncac_getpwnam(user, NULL, &user_gid);
         if (ret) {
             if (ret == 1) {
@@ -973,121 +1627,324 @@ cleanup:
 }
 
 /**
- * @brief Check NACM access for a single node.
- *
- * @param[in] node Node to check.
- * @param[in] user User, whose access to check.
- * @param[in] oper Operation to check.
- * @return non-zero if access allowed, 0 if not.
+ * @brief Compare dictionary group pointers for qsort().
  */
 static int
-ncac_allowed_node(const struct lys_node *node, const char *user, uint8_t oper)
+ncac_group_ptr_cmp(const void *ptr1, const void *ptr2)
 {
-    struct ncac_rule_list *rlist;
-    struct ncac_rule *rule;
-    struct ly_ctx *ly_ctx;
-    char **groups, *path;
-    uint32_t i, j, group_count;
-    int allowed = 0, cmp;
+    const char *group1 = *(const char **)ptr1, *group2 = *(const char **)ptr2;
 
-    ly_ctx = lys_node_module(node)->ctx;
+    if (group1 < group2) {
+        return -1;
+    } else if (group1 > group2) {
+        return 1;
+    }
+    return 0;
+}
 
-    /*
-     * ref https://tools.ietf.org/html/rfc8341#section-3.4.4
-     */
+/**
+ * @brief Collect all NACM groups for a user and get the ID of this group set in a snapshot.
+ *
+ * @param[in] ly_ctx libyang context for dictionary.
+ * @param[in] snap NACM snapshot to use.
+ * @param[in] user User to collect groups for.
+ * @return Group set ID, NCAC_GS_INVALID on error.
+ */
+static uint32_t
+ncac_group_set_get(struct ly_ctx *ly_ctx, struct ncac_config *snap, const char *user)
+{
+    struct ncac_group_set *gs = NULL;
+    char **groups;
+    uint32_t i, group_count, gs_id = NCAC_GS_INVALID;
+    void *mem;
 
     /* 4) collect groups */
-    if (ncac_collect_groups(ly_ctx, user, &groups, &group_count)) {
+    if (ncac_collect_groups(ly_ctx, snap, user, &groups, &group_count)) {
         goto cleanup;
     }
 
-    /* 5) no groups */
-    if (!group_count) {
-        goto step10;
+    /* sort the dictionary pointers so that any group order results in the same set */
+    if (group_count > 1) {
+        qsort(groups, group_count, sizeof *groups, ncac_group_ptr_cmp);
     }
 
-    /* 6) find matching rule lists */
-    for (rlist = nacm.rule_lists; rlist; rlist = rlist->next) {
-        for (i = 0; i < rlist->group_count; ++i) {
-            if (strcmp(rlist->groups[i], "*")) {
-                for (j = 0; j < group_count; ++j) {
-                    if (rlist->groups[i] == groups[j]) {
-                        break;
-                    }
-                }
-                if (j < group_count) {
-                    /* match */
-                    break;
-                }
-            } else {
-                /* match for all groups */
-                break;
-            }
+    pthread_mutex_lock(&snap->cache_lock);
+
+    /* learn whether this group set exists already */
+    for (i = 0; i < snap->group_set_count; ++i) {
+        if ((snap->group_sets[i]->group_count == group_count)
+                && (!group_count || !memcmp(snap->group_sets[i]->groups, groups, group_count * sizeof *groups))) {
+            gs_id = i;
+            goto unlock;
         }
-        if (i == rlist->group_count) {
-            /* no match */
-            continue;
+    }
+
+    /* add new group set, it takes the groups */
+    gs = malloc(sizeof *gs);
+    mem = realloc(snap->group_sets, (snap->group_set_count + 1) * sizeof *snap->group_sets);
+    if (!gs || !mem) {
+        EMEM;
+        if (mem) {
+            snap->group_sets = mem;
         }
+        free(gs);
+        goto unlock;
+    }
+    snap->group_sets = mem;
+    gs->groups = groups;
+    gs->group_count = group_count;
+    snap->group_sets[snap->group_set_count] = gs;
+    gs_id = snap->group_set_count;
+    ++snap->group_set_count;
 
-        /* 7) find matching rules */
-        for (rule = rlist->rules; rule; rule = rule->next) {
-            /* module name matching */
-            if (rule->module_name && (rule->module_name != lys_node_module(node)->name)) {
-                continue;
+unlock:
+    pthread_mutex_unlock(&snap->cache_lock);
+
+cleanup:
+    if (gs_id == NCAC_GS_INVALID || !gs) {
+        /* groups were not taken */
+        for (i = 0; i < group_count; ++i) {
+            lydict_remove(ly_ctx, groups[i]);
+        }
+        free(groups);
+    }
+    return gs_id;
+}
+
+struct ncac_user *
+ncac_user_new(const char *name)
+{
+    struct ncac_user *user;
+
+    user = calloc(1, sizeof *user);
+    if (!user) {
+        EMEM;
+        return NULL;
+    }
+
+    user->name = lydict_insert((struct ly_ctx *)sr_get_context(np2srv.sr_conn), name, 0);
+    user->gs_id = NCAC_GS_INVALID;
+    pthread_mutex_init(&user->lock, NULL);
+    return user;
+}
+
+void
+ncac_user_free(struct ncac_user *user)
+{
+    if (!user) {
+        return;
+    }
+
+    lydict_remove((struct ly_ctx *)sr_get_context(np2srv.sr_conn), user->name);
+    pthread_mutex_destroy(&user->lock);
+    free(user);
+}
+
+/**
+ * @brief Get recovery status and groups of a user, collect them again if NACM configuration changed
+ * or they expired.
+ *
+ * @param[in] ly_ctx libyang context for dictionary.
+ * @param[in] snap NACM snapshot to use.
+ * @param[in] user User to refresh.
+ * @param[out] recovery Whether the user is the recovery user.
+ * @param[out] gs_id Group set ID of the user groups in @p snap.
+ */
+static void
+ncac_user_refresh(struct ly_ctx *ly_ctx, struct ncac_config *snap, struct ncac_user *user, char *recovery, uint32_t *gs_id)
+{
+    struct timespec ts;
+    uid_t user_uid;
+    uint32_t ttl;
+
+    pthread_mutex_lock(&user->lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ttl = ATOMIC_LOAD_RELAXED(nacm.groups_ttl);
+    if ((user->gs_id != NCAC_GS_INVALID) && (user->generation == snap->generation)
+            && (!ttl || (ts.tv_sec - user->resolved < ttl))) {
+        /* valid */
+        goto cleanup;
+    }
+
+    /* recovery user */
+    if (!ncac_getpwnam(user->name, &user_uid, NULL) && (user_uid == NP2SRV_NACM_RECOVERY_UID)) {
+        user->recovery = 1;
+    } else {
+        user->recovery = 0;
+    }
+
+    /* groups */
+    user->gs_id = ncac_group_set_get(ly_ctx, snap, user->name);
+    user->generation = snap->generation;
+    user->resolved = ts.tv_sec;
+
+cleanup:
+    *recovery = user->recovery;
+    *gs_id = user->gs_id;
+    pthread_mutex_unlock(&user->lock);
+}
+
+/**
+ * @brief Check whether a rule list applies to a group set.
+ *
+ * @param[in] rlist Rule list to check.
+ * @param[in] gs Group set of the user.
+ * @return non-zero if it applies, 0 if not.
+ */
+static int
+ncac_rule_list_match(const struct ncac_rule_list *rlist, const struct ncac_group_set *gs)
+{
+    uint32_t i, j;
+
+    for (i = 0; i < rlist->group_count; ++i) {
+        if (!strcmp(rlist->groups[i], "*")) {
+            /* match for all groups */
+            return 1;
+        }
+
+        for (j = 0; j < gs->group_count; ++j) {
+            if (rlist->groups[i] == gs->groups[j]) {
+                return 1;
             }
+        }
+    }
 
-            /* target (rule) type matching */
-            switch (rule->target_type) {
-            case NCAC_TARGET_RPC:
-                if (node->nodetype != LYS_RPC) {
-                    continue;
-                }
-                if (rule->target && (rule->target != node->name)) {
-                    /* exact match needed */
-                    continue;
-                }
-                break;
-            case NCAC_TARGET_NOTIF:
-                /* only top-level notification */
-                if (lys_parent(node) || (node->nodetype != LYS_NOTIF)) {
-                    continue;
-                }
-                if (rule->target && (rule->target != node->name)) {
-                    /* exact match needed */
-                    continue;
-                }
-                break;
-            case NCAC_TARGET_DATA:
-                if (node->nodetype & (LYS_RPC | LYS_NOTIF)) {
-                    continue;
-                }
-                /* fallthrough */
-            case NCAC_TARGET_ANY:
-                if (rule->target) {
-                    path = lys_data_path(node);
-                    /* exact match or is a descendant (specified in RFC 8341 page 27) */
-                    cmp = strncmp(path, rule->target, strlen(rule->target));
-                    free(path);
-                    if (cmp) {
-                        continue;
-                    }
+    return 0;
+}
+
+/**
+ * @brief Check whether a rule matches a node. The node is expected to be the rule target
+ * node or its descendant if the rule target was resolved.
+ *
+ * @param[in] rule Rule to check.
+ * @param[in] node Node to check.
+ * @param[in] oper Operation to check.
+ * @param[in,out] path Data path of @p node, generated if needed.
+ * @return non-zero if the rule matches, 0 if not.
+ */
+static int
+ncac_rule_match(const struct ncac_rule *rule, const struct lys_node *node, uint8_t oper, char **path)
+{
+    /* access operation matching */
+    if (!(rule->operations & oper)) {
+        return 0;
+    }
+
+    /* module name matching */
+    if (rule->module_name && (rule->module_name != lys_node_module(node)->name)) {
+        return 0;
+    }
+
+    /* target (rule) type matching */
+    switch (rule->target_type) {
+    case NCAC_TARGET_RPC:
+        if (node->nodetype != LYS_RPC) {
+            return 0;
+        }
+        if (rule->target && (rule->target != node->name)) {
+            /* exact match needed */
+            return 0;
+        }
+        break;
+    case NCAC_TARGET_NOTIF:
+        /* only top-level notification */
+        if (lys_parent(node) || (node->nodetype != LYS_NOTIF)) {
+            return 0;
+        }
+        if (rule->target && (rule->target != node->name)) {
+            /* exact match needed */
+            return 0;
+        }
+        break;
+    case NCAC_TARGET_DATA:
+        if (node->nodetype & (LYS_RPC | LYS_NOTIF)) {
+            return 0;
+        }
+        /* fallthrough */
+    case NCAC_TARGET_ANY:
+        if (rule->target && !rule->target_node) {
+            if (!*path) {
+                *path = lys_data_path(node);
+                if (!*path) {
+                    EMEM;
+                    return 0;
                 }
-                break;
             }
+            /* exact match or is a descendant (specified in RFC 8341 page 27) */
+            if (strncmp(*path, rule->target, strlen(rule->target))) {
+                return 0;
+            }
+        }
+        break;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Evaluate NACM rules and defaults for a single node.
+ *
+ * @param[in] snap NACM snapshot to use.
+ * @param[in] node Node to check.
+ * @param[in] gs Group set of the user.
+ * @param[in] oper Operation to check.
+ * @return non-zero if access allowed, 0 if not.
+ */
+static int
+ncac_allowed_node_eval(const struct ncac_config *snap, const struct lys_node *node, const struct ncac_group_set *gs, uint8_t oper)
+{
+    const struct ncac_rule *rule, *match = NULL;
+    const struct lys_node *parent;
+    struct ncac_rule_index_rec rec, *index_rec;
+    char *path = NULL;
+    uint32_t i;
+
+    /*
+     * ref https://tools.ietf.org/html/rfc8341#section-3.4.4
+     */
+
+    /* 4) groups were collected before */
+
+    /* 5) no groups */
+    if (!gs->group_count) {
+        goto step10;
+    }
 
-            /* access operation matching */
-            if (!(rule->operations & oper)) {
-                continue;
-            }
+    /* 6) and 7) find the first matching rule of a matching rule list, first in the rules without a schema node */
+    for (i = 0; i < snap->generic_rule_count; ++i) {
+        rule = snap->generic_rules[i];
+        if (ncac_rule_list_match(rule->rlist, gs) && ncac_rule_match(rule, node, oper, &path)) {
+            match = rule;
+            break;
+        }
+    }
+    free(path);
+
+    /* then in the rules targeting the node or any of its parents, they can only be preceding the generic rule */
+    for (parent = node; parent; parent = lys_parent(parent)) {
+        rec.node = parent;
+        if (np_ht_find(snap->rule_index, &rec, ncac_rule_index_hash(parent), (void **)&index_rec)) {
+            continue;
+        }
 
-            /* 8) rule matched */
-            if (!rule->action_deny) {
-                allowed = 1;
+        for (i = 0; i < index_rec->rule_count; ++i) {
+            rule = index_rec->rules[i];
+            if (match && (rule->order > match->order)) {
+                break;
+            }
+            if (ncac_rule_list_match(rule->rlist, gs) && ncac_rule_match(rule, node, oper, NULL)) {
+                match = rule;
+                break;
             }
-            goto cleanup;
         }
     }
 
+    if (match) {
+        /* 8) rule matched */
+        return !match->action_deny;
+    }
+
     /* 9) no matching rule found */
 
 step10:
@@ -1095,11 +1952,11 @@ step10:
     for (i = 0; i < node->ext_size; ++i) {
         if (!strcmp(node->ext[i]->def->module->name, "ietf-netconf-acm")) {
             if (!strcmp(node->ext[i]->def->name, "default-deny-all")) {
-                goto cleanup;
+                return 0;
             }
             if ((oper & (NCAC_OP_CREATE | NCAC_OP_UPDATE | NCAC_OP_DELETE))
                         && !strcmp(node->ext[i]->def->name, "default-deny-write")) {
-                goto cleanup;
+                return 0;
             }
         }
     }
@@ -1109,51 +1966,213 @@ step10:
     /* 12) check defaults */
     switch (oper) {
     case NCAC_OP_READ:
-        if (nacm.default_read_deny) {
-            goto cleanup;
+        if (snap->default_read_deny) {
+            return 0;
         }
         break;
     case NCAC_OP_CREATE:
     case NCAC_OP_UPDATE:
     case NCAC_OP_DELETE:
-        if (nacm.default_write_deny) {
-            goto cleanup;
+        if (snap->default_write_deny) {
+            return 0;
         }
         break;
     case NCAC_OP_EXEC:
-        if (nacm.default_exec_deny) {
-            goto cleanup;
+        if (snap->default_exec_deny) {
+            return 0;
         }
         break;
     default:
         EINT;
-        goto cleanup;
+        return 0;
     }
 
     /* success */
-    allowed = 1;
+    return 1;
+}
 
-cleanup:
-    for (i = 0; i < group_count; ++i) {
-        lydict_remove(ly_ctx, groups[i]);
+/**
+ * @brief Context of a single NACM check.
+ */
+struct ncac_check {
+    struct ncac_config *snap;       /**< NACM snapshot used for the check. */
+    const struct ncac_group_set *gs;    /**< Group set of the user, NULL if it could not be collected. */
+    uint32_t gs_id;                 /**< Group set ID. */
+    uint32_t hits;                  /**< Cache hits of this check. */
+    uint32_t misses;                /**< Cache misses of this check. */
+    struct np_ht *memo;             /**< Decisions of this check (struct ncac_memo_rec), no locking needed. */
+};
+
+/**
+ * @brief Start a NACM check, check access for the whole data tree.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] top_node Top-level node of the data, NULL if the check is not for a specific data tree.
+ * @param[in] user User, whose access to check.
+ * @param[out] check Check context to initialize, must be finished with ::ncac_check_end().
+ * @return non-zero if access allowed, 0 if more checks are required.
+ */
+static int
+ncac_check_start(struct ly_ctx *ly_ctx, const struct lys_node *top_node, struct ncac_user *user, struct ncac_check *check)
+{
+    char recovery = 0;
+
+    memset(check, 0, sizeof *check);
+    check->gs_id = NCAC_GS_INVALID;
+    check->snap = ncac_snapshot_get();
+
+    if (check->snap->enabled) {
+        ncac_user_refresh(ly_ctx, check->snap, user, &recovery, &check->gs_id);
     }
-    free(groups);
-    return allowed;
+
+    if (ncac_allowed_tree(check->snap, top_node, recovery)) {
+        return 1;
+    }
+
+    if (check->gs_id != NCAC_GS_INVALID) {
+        pthread_mutex_lock(&check->snap->cache_lock);
+        check->gs = check->snap->group_sets[check->gs_id];
+        pthread_mutex_unlock(&check->snap->cache_lock);
+    }
+    return 0;
 }
 
-const struct lyd_node *
-ncac_check_operation(const struct lyd_node *data, const char *user)
+/**
+ * @brief Finish a NACM check.
+ *
+ * @param[in] check Check context.
+ */
+static void
+ncac_check_end(struct ncac_check *check)
 {
-    const struct lyd_node *op;
-    int allowed = 0;
+    if (check->hits) {
+        ATOMIC_ADD_RELAXED(nacm.cache_hits, check->hits);
+    }
+    if (check->misses) {
+        ATOMIC_ADD_RELAXED(nacm.cache_misses, check->misses);
+    }
+    np_ht_free(check->memo);
+    ncac_snapshot_put(check->snap);
+}
 
-    pthread_mutex_lock(&nacm.lock);
+/**
+ * @brief Check NACM access for a single node, use the decision memo of the check and the decision cache.
+ *
+ * Decisions are remembered in the check so that a filtering pass with many instances of the same
+ * schema nodes accesses the shared cache only once for each of them.
+ *
+ * @param[in] check NACM check context.
+ * @param[in] node Node to check.
+ * @param[in] oper Operation to check.
+ * @return non-zero if access allowed, 0 if not.
+ */
+static int
+ncac_allowed_node(struct ncac_check *check, const struct lys_node *node, uint8_t oper)
+{
+    struct ncac_config *snap = check->snap;
+    struct ncac_memo_rec mrec, *mmatch;
+    struct ncac_cache_rec rec, *rec_p, **match, *evicted;
+    uint32_t mhash, hash;
+    int found;
+
+    if (!check->gs) {
+        /* groups could not be collected */
+        return 0;
+    }
 
-    /* check access for the whole data tree first */
-    if (ncac_allowed_tree(data->schema, user)) {
-        allowed = 1;
-        goto cleanup;
+    mrec.node = node;
+    mrec.oper = oper;
+    mrec.allowed = 0;
+    mhash = ncac_memo_rec_hash(&mrec);
+
+    /* decision of this check */
+    if (!check->memo) {
+        check->memo = np_ht_new(64, sizeof mrec, ncac_memo_rec_equal, NULL);
+    } else if (!np_ht_find(check->memo, &mrec, mhash, (void **)&mmatch)) {
+        ++check->hits;
+        return mmatch->allowed;
+    }
+
+    rec.node = node;
+    rec.gs_id = check->gs_id;
+    rec.oper = oper;
+    rec.allowed = 0;
+    hash = ncac_cache_rec_hash(&rec);
+    rec_p = &rec;
+
+    /* cached decision */
+    pthread_mutex_lock(&snap->cache_lock);
+    found = !np_ht_find(snap->cache, &rec_p, hash, (void **)&match);
+    if (found) {
+        rec.allowed = (*match)->allowed;
+
+        /* move to the front */
+        ncac_cache_unlink(snap, *match);
+        ncac_cache_link_first(snap, *match);
+    }
+    pthread_mutex_unlock(&snap->cache_lock);
+    if (found) {
+        ++check->hits;
+        goto memo;
+    }
+    ++check->misses;
+
+    rec.allowed = ncac_allowed_node_eval(snap, node, check->gs, oper) ? 1 : 0;
+
+    /* store the decision */
+    rec_p = malloc(sizeof *rec_p);
+    if (!rec_p) {
+        EMEM;
+        goto memo;
+    }
+    *rec_p = rec;
+
+    pthread_mutex_lock(&snap->cache_lock);
+    if (!np_ht_find(snap->cache, &rec_p, hash, NULL)) {
+        /* cached by another thread meanwhile, do not evict anything */
+        pthread_mutex_unlock(&snap->cache_lock);
+        free(rec_p);
+        goto memo;
+    }
+
+    if (snap->cache->used >= NP2SRV_NACM_CACHE_SIZE) {
+        /* evict the least recently used decision */
+        evicted = snap->cache_last;
+        np_ht_remove(snap->cache, &evicted, ncac_cache_rec_hash(evicted));
+        ncac_cache_unlink(snap, evicted);
+        free(evicted);
+        ATOMIC_INC_FENCE(nacm.cache_evictions);
+    }
+
+    if (np_ht_insert(snap->cache, &rec_p, hash, NULL)) {
+        EMEM;
+        pthread_mutex_unlock(&snap->cache_lock);
+        free(rec_p);
+        goto memo;
+    }
+    ncac_cache_link_first(snap, rec_p);
+    pthread_mutex_unlock(&snap->cache_lock);
+
+memo:
+    mrec.allowed = rec.allowed;
+    if (check->memo && (np_ht_insert(check->memo, &mrec, mhash, NULL) == -1)) {
+        EMEM;
     }
+    return rec.allowed;
+}
+
+/**
+ * @brief Check whether an operation is allowed for a user in a started NACM check.
+ *
+ * @param[in] data Top-level node of the operation.
+ * @param[in] check NACM check context, access to the whole data tree was not allowed.
+ * @return NULL if access allowed, otherwise the denied access data node.
+ */
+static const struct lyd_node *
+ncac_check_operation_nodes(const struct lyd_node *data, struct ncac_check *check)
+{
+    const struct lyd_node *op;
+    int allowed = 0;
 
     op = data;
     while (op) {
@@ -1193,21 +2212,21 @@ ncac_check_operation(const struct lyd_node *data, const char *user)
 
     if (op->schema->nodetype & (LYS_RPC | LYS_ACTION)) {
         /* check X access on the RPC/action */
-        if (!ncac_allowed_node(op->schema, user, NCAC_OP_EXEC)) {
+        if (!ncac_allowed_node(check, op->schema, NCAC_OP_EXEC)) {
             goto cleanup;
         }
     } else {
         assert(op->schema->nodetype == LYS_NOTIF);
 
         /* check R access on the notification */
-        if (!ncac_allowed_node(op->schema, user, NCAC_OP_READ)) {
+        if (!ncac_allowed_node(check, op->schema, NCAC_OP_READ)) {
             goto cleanup;
         }
     }
 
     for (data = op->parent; data; data = data->parent) {
         /* check R access on the parents */
-        if (!ncac_allowed_node(data->schema, user, NCAC_OP_READ)) {
+        if (!ncac_allowed_node(check, data->schema, NCAC_OP_READ)) {
             goto cleanup;
         }
     }
@@ -1219,29 +2238,92 @@ cleanup:
         op = NULL;
     } else {
         if (op->schema->nodetype & (LYS_RPC | LYS_ACTION)) {
-            ++nacm.denied_operations;
+            ATOMIC_INC_FENCE(nacm.denied_operations);
         } else {
-            ++nacm.denied_notifications;
+            ATOMIC_INC_FENCE(nacm.denied_notifications);
         }
     }
-    pthread_mutex_unlock(&nacm.lock);
     return op;
 }
 
+const struct lyd_node *
+ncac_check_operation(const struct lyd_node *data, struct ncac_user *user)
+{
+    const struct lyd_node *op = NULL;
+    struct ncac_check check;
+
+    /* check access for the whole data tree first */
+    if (!ncac_check_start(lys_node_module(data->schema)->ctx, data->schema, user, &check)) {
+        op = ncac_check_operation_nodes(data, &check);
+    }
+
+    ncac_check_end(&check);
+    return op;
+}
+
+int
+ncac_check_notif_memo(const struct lyd_node *notif, struct ncac_user *user, struct ncac_notif_memo *memo)
+{
+    struct ncac_check check;
+    uint32_t i;
+    void *mem;
+    int allowed;
+
+    /* the decision is learned and stored for the generation and group set of a single snapshot */
+    if (ncac_check_start(lys_node_module(notif->schema)->ctx, notif->schema, user, &check)) {
+        allowed = 1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < memo->count; ++i) {
+        if ((memo->decisions[i].generation == check.snap->generation) && (memo->decisions[i].gs_id == check.gs_id)) {
+            if (!memo->decisions[i].allowed) {
+                ATOMIC_INC_FENCE(nacm.denied_notifications);
+            }
+            allowed = memo->decisions[i].allowed;
+            goto cleanup;
+        }
+    }
+
+    allowed = ncac_check_operation_nodes(notif, &check) ? 0 : 1;
+
+    /* store the decision, not an error if it fails */
+    mem = realloc(memo->decisions, (memo->count + 1) * sizeof *memo->decisions);
+    if (mem) {
+        memo->decisions = mem;
+        memo->decisions[memo->count].generation = check.snap->generation;
+        memo->decisions[memo->count].gs_id = check.gs_id;
+        memo->decisions[memo->count].allowed = allowed;
+        ++memo->count;
+    }
+
+cleanup:
+    ncac_check_end(&check);
+    return allowed;
+}
+
+void
+ncac_notif_memo_clear(struct ncac_notif_memo *memo)
+{
+    free(memo->decisions);
+    memo->decisions = NULL;
+    memo->count = 0;
+}
+
 /**
  * @brief Filter out any siblings for which the user does not have R access, recursively.
  *
  * @param[in,out] first First sibling to filter.
- * @param[in] user User for the NACM filtering.
+ * @param[in] check NACM check context.
  */
 static void
-ncac_check_data_read_filter_r(struct lyd_node **first, const char *user)
+ncac_check_data_read_filter_r(struct lyd_node **first, struct ncac_check *check)
 {
     struct lyd_node *next, *elem;
 
     LY_TREE_FOR_SAFE(*first, next, elem) {
         /* check access for each sibling */
-        if (!ncac_allowed_node(elem->schema, user, NCAC_OP_READ)) {
+        if (!ncac_allowed_node(check, elem->schema, NCAC_OP_READ)) {
             if ((elem == *first) && !(*first)->parent) {
                 *first = (*first)->next;
             }
@@ -1251,35 +2333,306 @@ ncac_check_data_read_filter_r(struct lyd_node **first, const char *user)
 
         /* check children recursively */
         if (!(elem->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST | LYS_ANYDATA)) && elem->child) {
-            ncac_check_data_read_filter_r(&elem->child, user);
+            ncac_check_data_read_filter_r(&elem->child, check);
         }
     }
 }
 
 void
-ncac_check_data_read_filter(struct lyd_node **data, const char *user)
+ncac_check_data_read_filter(struct lyd_node **data, struct ncac_user *user)
 {
+    struct ncac_check check;
+
     assert(data);
 
-    pthread_mutex_lock(&nacm.lock);
+    if (!*data) {
+        return;
+    }
 
-    if (*data && !ncac_allowed_tree((*data)->schema, user)) {
-        ncac_check_data_read_filter_r(data, user);
+    if (!ncac_check_start(lys_node_module((*data)->schema)->ctx, (*data)->schema, user, &check)) {
+        ncac_check_data_read_filter_r(data, &check);
     }
+    ncac_check_end(&check);
+}
 
-    pthread_mutex_unlock(&nacm.lock);
+/**
+ * @brief Learn the module and top-level node selected by a simple absolute XPath filter.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] xpath XPath filter.
+ * @param[out] mod Selected module, NULL for all the modules.
+ * @param[out] node Selected top-level node, NULL for all the top-level nodes of @p mod.
+ * @return 0 on success, 1 if the filter is not simple and cannot be restricted.
+ */
+static int
+ncac_read_filter_parse(struct ly_ctx *ly_ctx, const char *xpath, const struct lys_module **mod,
+        const struct lys_node **node)
+{
+    const char *name;
+    char *mod_name;
+    size_t len;
+
+    *mod = NULL;
+    *node = NULL;
+
+    if (!strcmp(xpath, "/*")) {
+        return 0;
+    }
+
+    /* only a single absolute path */
+    if ((xpath[0] != '/') || strchr(xpath, '|')) {
+        return 1;
+    }
+
+    /* module name */
+    len = strcspn(xpath + 1, ":/[ ");
+    if (!len || (xpath[1 + len] != ':')) {
+        return 1;
+    }
+    mod_name = strndup(xpath + 1, len);
+    if (!mod_name) {
+        EMEM;
+        return 1;
+    }
+    *mod = ly_ctx_get_module(ly_ctx, mod_name, NULL, 1);
+    free(mod_name);
+    if (!*mod) {
+        return 1;
+    }
+
+    /* node name */
+    name = xpath + 1 + len + 1;
+    len = strcspn(name, "/[ ");
+    if (!len || (name[len] && (name[len] != '/') && (name[len] != '['))) {
+        return 1;
+    }
+    if ((len == 1) && (name[0] == '*')) {
+        return 0;
+    }
+
+    while ((*node = lys_getnext(*node, NULL, *mod, 0))) {
+        if (!strncmp((*node)->name, name, len) && !(*node)->name[len]) {
+            return 0;
+        }
+    }
+
+    /* unknown node, let sysrepo handle it */
+    return 1;
+}
+
+/**
+ * @brief Restrict a filter selecting whole modules to only their readable top-level nodes.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] check NACM check context.
+ * @param[in] mod Selected module, NULL for all the implemented modules.
+ * @param[in,out] xpath XPath filter, replaced by a union of readable top-level nodes if any are denied,
+ * set to NULL if all of them are. Kept if there are more than ::NP2SRV_NACM_FILTER_EXPAND_MAX readable nodes
+ * because evaluating such a union would be more expensive than filtering the retrieved data.
+ * @return 0 on success, -1 on error.
+ */
+static int
+ncac_read_filter_expand(struct ly_ctx *ly_ctx, struct ncac_check *check, const struct lys_module *mod, char **xpath)
+{
+    const struct lys_module *m;
+    const struct lys_node *node;
+    uint32_t idx = 0;
+    size_t len = 0, size = 0, node_len;
+    char *union_xp = NULL, *mem;
+    uint32_t readable = 0;
+    int denied = 0;
+
+    m = mod ? mod : ly_ctx_get_module_iter(ly_ctx, &idx);
+    while (m) {
+        node = NULL;
+        while (m->implemented && (node = lys_getnext(node, NULL, m, 0))) {
+            if (!(node->nodetype & (LYS_CONTAINER | LYS_LIST | LYS_LEAF | LYS_LEAFLIST | LYS_ANYDATA))) {
+                continue;
+            }
+
+            /* denied top-level node means its whole subtree is denied */
+            if (!ncac_allowed_node(check, node, NCAC_OP_READ)) {
+                denied = 1;
+                continue;
+            }
+
+            if (++readable > NP2SRV_NACM_FILTER_EXPAND_MAX) {
+                /* keep the original filter, denied data are filtered out after retrieval */
+                free(union_xp);
+                return 0;
+            }
+
+            node_len = 3 + 1 + strlen(m->name) + 1 + strlen(node->name);
+            if (len + node_len + 1 > size) {
+                size = (len + node_len + 1) * 2;
+                mem = realloc(union_xp, size);
+                if (!mem) {
+                    EMEM;
+                    free(union_xp);
+                    return -1;
+                }
+                union_xp = mem;
+            }
+            len += sprintf(union_xp + len, "%s/%s:%s", len ? " | " : "", m->name, node->name);
+        }
+
+        m = mod ? NULL : ly_ctx_get_module_iter(ly_ctx, &idx);
+    }
+
+    if (!denied) {
+        /* keep the original filter */
+        free(union_xp);
+        return 0;
+    }
+
+    free(*xpath);
+    *xpath = union_xp;
+    return 0;
+}
+
+int
+ncac_read_filters_restrict(struct ly_ctx *ly_ctx, struct ncac_user *user, char ***filters, int *filter_count)
+{
+    struct ncac_check check;
+    const struct lys_module *mod;
+    const struct lys_node *node;
+    int i, ret = 0;
+
+    if (ncac_check_start(ly_ctx, NULL, user, &check)) {
+        /* everything is readable */
+        goto cleanup;
+    }
+
+    for (i = 0; i < *filter_count; ) {
+        if (!ncac_read_filter_parse(ly_ctx, (*filters)[i], &mod, &node)) {
+            if (node) {
+                if (!ncac_allowed_node(&check, node, NCAC_OP_READ)) {
+                    /* whole filter denied */
+                    free((*filters)[i]);
+                    (*filters)[i] = NULL;
+                }
+            } else if (ncac_read_filter_expand(ly_ctx, &check, mod, &(*filters)[i])) {
+                ret = -1;
+                goto cleanup;
+            }
+        }
+
+        if (!(*filters)[i]) {
+            /* nothing readable, do not retrieve anything */
+            --(*filter_count);
+            if (i < *filter_count) {
+                memmove(&(*filters)[i], &(*filters)[i + 1], (*filter_count - i) * sizeof **filters);
+            }
+            continue;
+        }
+        ++i;
+    }
+
+cleanup:
+    ncac_check_end(&check);
+    return ret;
+}
+
+/**
+ * @brief Check whether a rule target with instance predicates can select instances of a schema node,
+ * its ancestors, or descendants.
+ *
+ * @param[in] target Rule target.
+ * @param[in] path Schema data path of the node.
+ * @return non-zero if it can, 0 if not.
+ */
+static int
+ncac_target_selects_instances(const char *target, const char *path)
+{
+    const char *t = target, *p = path;
+    int predicate = 0;
+
+    while (*t && *p) {
+        if (*t == '[') {
+            /* skip the predicate, its quoted values may include brackets */
+            predicate = 1;
+            for (++t; *t && (*t != ']'); ++t) {
+                if ((*t == '\'') || (*t == '"')) {
+                    t = strchr(t + 1, *t);
+                    if (!t) {
+                        return 1;
+                    }
+                }
+            }
+            if (*t) {
+                ++t;
+            }
+            continue;
+        }
+        if (*t != *p) {
+            return 0;
+        }
+        ++t;
+        ++p;
+    }
+
+    if (!*t) {
+        /* the target selects an ancestor or the node itself */
+        return predicate && (!*p || (*p == '/'));
+    }
+
+    /* the target selects the node or its descendants */
+    return (*t == '[') || (*t == '/');
+}
+
+int
+ncac_read_instances_uniform(struct ly_ctx *ly_ctx, struct ncac_user *user, const struct lys_node *node)
+{
+    struct ncac_check check;
+    const struct ncac_rule *rule;
+    char *path = NULL;
+    uint32_t i;
+    int ret = 1;
+
+    if (ncac_check_start(ly_ctx, NULL, user, &check) || !check.gs) {
+        /* everything is readable or nothing is */
+        goto cleanup;
+    }
+
+    for (i = 0; i < check.snap->generic_rule_count; ++i) {
+        rule = check.snap->generic_rules[i];
+        if (!rule->target || !strchr(rule->target, '[') || !(rule->operations & NCAC_OP_READ)
+                || ((rule->target_type != NCAC_TARGET_DATA) && (rule->target_type != NCAC_TARGET_ANY))
+                || !ncac_rule_list_match(rule->rlist, check.gs)) {
+            continue;
+        }
+
+        if (!path) {
+            path = lys_data_path(node);
+            if (!path) {
+                EMEM;
+                ret = 0;
+                goto cleanup;
+            }
+        }
+        if (ncac_target_selects_instances(rule->target, path)) {
+            ret = 0;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    free(path);
+    ncac_check_end(&check);
+    return ret;
 }
 
 /**
  * @brief Check whether diff node siblings can be applied by a user, recursively with children.
  *
  * @param[in] diff First diff sibling.
- * @param[in] user User for the NACM check.
+ * @param[in] check NACM check context.
  * @param[in] parent_op Inherited parent operation.
+ * @param[in] src_read Whether R access is also required for created and replaced nodes.
  * @return NULL if access allowed, otherwise the denied access data node.
  */
 static const struct lyd_node *
-ncac_check_diff_r(const struct lyd_node *diff, const char *user, const char *parent_op)
+ncac_check_diff_r(const struct lyd_node *diff, struct ncac_check *check, const char *parent_op, int src_read)
 {
     const char *op;
     struct lyd_attr *attr;
@@ -1326,14 +2679,20 @@ ncac_check_diff_r(const struct lyd_node *diff, const char *user, const char *par
         }
 
         /* check access for the node */
-        if (oper && !ncac_allowed_node(diff->schema, user, oper)) {
+        if (oper && !ncac_allowed_node(check, diff->schema, oper)) {
+            node = diff;
+            break;
+        }
+
+        /* the new value is read from the source */
+        if (src_read && (oper & (NCAC_OP_CREATE | NCAC_OP_UPDATE)) && !ncac_allowed_node(check, diff->schema, NCAC_OP_READ)) {
             node = diff;
             break;
         }
 
         /* go recursively */
         if (!(diff->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST | LYS_ANYDATA)) && diff->child) {
-            node = ncac_check_diff_r(diff->child, user, op);
+            node = ncac_check_diff_r(diff->child, check, op, src_read);
         }
     }
 
@@ -1341,20 +2700,19 @@ ncac_check_diff_r(const struct lyd_node *diff, const char *user, const char *par
 }
 
 const struct lyd_node *
-ncac_check_diff(const struct lyd_node *diff, const char *user)
+ncac_check_diff(const struct lyd_node *diff, struct ncac_user *user, int src_read)
 {
     const struct lyd_node *node = NULL;
-
-    pthread_mutex_lock(&nacm.lock);
+    struct ncac_check check;
 
     /* any node can be used in this case */
-    if (!ncac_allowed_tree(diff->schema, user)) {
-        node = ncac_check_diff_r(diff, user, NULL);
+    if (!ncac_check_start(lys_node_module(diff->schema)->ctx, diff->schema, user, &check)) {
+        node = ncac_check_diff_r(diff, &check, NULL, src_read);
         if (node) {
-            ++nacm.denied_data_writes;
+            ATOMIC_INC_FENCE(nacm.denied_data_writes);
         }
     }
 
-    pthread_mutex_unlock(&nacm.lock);
+    ncac_check_end(&check);
     return node;
 }
@@ -17,9 +17,13 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <time.h>
 
 #include <libyang/libyang.h>
 
+#include "config.h"
+#include "hash_table.h"
+
 #define NCAC_OP_CREATE 0x01 /**< NACM operation create */
 #define NCAC_OP_READ   0x02 /**< NACM operation read */
 #define NCAC_OP_UPDATE 0x04 /**< NACM operation update */
@@ -38,19 +42,31 @@ typedef enum ncac_target_type {
 } NCAC_TARGET_TYPE;
 
 /**
- * @brief Main NACM container structure.
+ * @brief NACM user of a NETCONF session with its cached groups.
  */
-struct ncac {
+struct ncac_user {
+    const char *name;               /**< User name (in dictionary). */
+    char recovery;                  /**< Whether the user is the recovery user. */
+    uint32_t gs_id;                 /**< Group set ID of the user groups. */
+    uint32_t generation;            /**< NACM configuration generation the groups were collected for. */
+    time_t resolved;                /**< Monotonic time (s) the groups were collected at. */
+    pthread_mutex_t lock;           /**< Lock for refreshing the cached information. */
+};
+
+/**
+ * @brief NACM configuration. The current one is modified by the configuration callbacks and its copies
+ * are published as immutable snapshots, which are used for all the checks.
+ */
+struct ncac_config {
+    uint32_t refcount;              /**< Number of snapshot references, protected by the snapshot lock. */
+    uint32_t generation;            /**< NACM configuration generation, changed on every configuration change. */
+
     char enabled;                   /**< Whether NACM is enabled. */
     char default_read_deny;         /**< Whether default NACM read action is "deny" (otherwise "permit"). */
     char default_write_deny;        /**< Whether default NACM write action is "deny" (otherwise "permit"). */
     char default_exec_deny;         /**< Whether default NACM exec action is "deny" (otherwise "permit"). */
     char enable_external_groups;    /**< Whether external (system) groups are taken into consideration for NACM. */
 
-    uint32_t denied_operations;     /**< Counter of denied operations (RPC or action). */
-    uint32_t denied_data_writes;    /**< Counter of denied data writes. */
-    uint32_t denied_notifications;  /**< Counter of denied notifications. */
-
     /**
      * @brief NACM group.
      */
@@ -76,17 +92,60 @@ struct ncac {
             const char *name;       /**< Rule name. */
             const char *module_name;    /**< Rule module name. */
             const char *target;     /**< Rule target. */
+            const struct lys_node *target_node; /**< Rule path target resolved to a schema node, if possible. */
             NCAC_TARGET_TYPE target_type;   /**< Rule target type. */
             uint8_t operations;     /**< Rule operations associated with it. */
             char action_deny;       /**< Whether the rule action is "deny" (otherwise "permit"). */
             const char *comment;    /**< Rule comment. */
+            uint32_t order;         /**< Order of the rule among all the rules of all the rule lists. */
+            struct ncac_rule_list *rlist;   /**< Rule list of the rule. */
             struct ncac_rule *next; /**< Pointer to the next rule. */
         } *rules;                   /**< List of rules in the rule list. */
 
         struct ncac_rule_list *next;    /**< Pointer to the next rule list. */
     } *rule_lists;                  /**< List of all the rule lists. */
 
-    pthread_mutex_t lock;
+    /* snapshot members */
+    struct np_ht *rule_index;       /**< Rules with their target resolved to a schema node, indexed by the node. */
+    struct ncac_rule **generic_rules;   /**< Rules that are not in the index ordered by their order. */
+    uint32_t generic_rule_count;    /**< Number of generic rules. */
+
+    /**
+     * @brief Set of NACM groups of a user, its index in the array is its ID.
+     */
+    struct ncac_group_set {
+        char **groups;              /**< Sorted array of groups. */
+        uint32_t group_count;       /**< Number of groups. */
+    } **group_sets;                 /**< Array of all the used group sets. */
+    uint32_t group_set_count;       /**< Number of group sets. */
+
+    struct np_ht *cache;            /**< Cache of NACM decisions for a group set, schema node, and operation
+                                         (struct ncac_cache_rec *). */
+    struct ncac_cache_rec *cache_first; /**< Most recently used cached decision. */
+    struct ncac_cache_rec *cache_last;  /**< Least recently used cached decision. */
+    pthread_mutex_t cache_lock;     /**< Lock for the cache and group sets. */
+};
+
+/**
+ * @brief Main NACM container structure.
+ */
+struct ncac {
+    struct ncac_config conf;        /**< Current NACM configuration. */
+    pthread_mutex_t lock;           /**< Lock for modifying the current configuration. */
+
+    struct ncac_config *snapshot;   /**< Last published configuration snapshot. */
+    pthread_mutex_t snapshot_lock;  /**< Lock for acquiring and releasing snapshots. */
+
+    ATOMIC_T groups_ttl;            /**< Timeout (s) after which user groups are collected again, 0 for never. */
+
+    ATOMIC_T denied_operations;     /**< Counter of denied operations (RPC or action). */
+    ATOMIC_T denied_data_writes;    /**< Counter of denied data writes. */
+    ATOMIC_T denied_notifications;  /**< Counter of denied notifications. */
+
+    ATOMIC_T cache_hits;            /**< Counter of decisions found in the cache. */
+    ATOMIC_T cache_misses;          /**< Counter of decisions not found in the cache. */
+    ATOMIC_T cache_evictions;       /**< Counter of decisions evicted from a full cache. */
+    ATOMIC_T cache_flushes;         /**< Counter of cache flushes. */
 };
 
 int ncac_nacm_params_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
@@ -104,9 +163,30 @@ int ncac_rule_list_cb(sr_session_ctx_t *session, const char *module_name, const
 int ncac_rule_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
         uint32_t request_id, void *private_data);
 
-void ncac_init(void);
+int ncac_server_params_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
+        uint32_t request_id, void *private_data);
+
+int ncac_cache_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path,
+        const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data);
+
+int ncac_init(void);
 void ncac_destroy(void);
 
+/**
+ * @brief Create a NACM user for a NETCONF session.
+ *
+ * @param[in] name User name.
+ * @return Created NACM user, NULL on error.
+ */
+struct ncac_user *ncac_user_new(const char *name);
+
+/**
+ * @brief Free a NACM user.
+ *
+ * @param[in] user NACM user to free.
+ */
+void ncac_user_free(struct ncac_user *user);
+
 /**
  * @brief Check whether an operation is allowed for a user.
  *
@@ -119,7 +199,37 @@ void ncac_destroy(void);
  * @param[in] user User for the NACM check.
  * @return NULL if access allowed, otherwise the denied access data node.
  */
-const struct lyd_node *ncac_check_operation(const struct lyd_node *data, const char *user);
+const struct lyd_node *ncac_check_operation(const struct lyd_node *data, struct ncac_user *user);
+
+/**
+ * @brief NACM decisions of a single notification sent to several users. Users with the same groups share
+ * the decision so the notification is checked only once for each group set.
+ */
+struct ncac_notif_memo {
+    struct {
+        uint32_t generation;        /**< NACM configuration generation of the decision. */
+        uint32_t gs_id;             /**< Group set ID of the decision. */
+        char allowed;               /**< Whether the notification is allowed. */
+    } *decisions;
+    uint32_t count;                 /**< Number of decisions. */
+};
+
+/**
+ * @brief Check whether a notification is allowed for a user, reuse the decisions of users with the same groups.
+ *
+ * @param[in] notif Top-level node of the notification.
+ * @param[in] user User for the NACM check.
+ * @param[in,out] memo Decisions of the notification, zeroed for the first check.
+ * @return non-zero if access allowed, 0 if denied.
+ */
+int ncac_check_notif_memo(const struct lyd_node *notif, struct ncac_user *user, struct ncac_notif_memo *memo);
+
+/**
+ * @brief Free NACM decisions of a notification.
+ *
+ * @param[in] memo Decisions to free.
+ */
+void ncac_notif_memo_clear(struct ncac_notif_memo *memo);
 
 /**
  * @brief Filter out any data for which the user does not have R access.
@@ -130,7 +240,34 @@ const struct lyd_node *ncac_check_operation(const struct lyd_node *data, const c
  * @param[in,out] data Data to filter.
  * @param[in] user User for the NACM filtering.
  */
-void ncac_check_data_read_filter(struct lyd_node **data, const char *user);
+void ncac_check_data_read_filter(struct lyd_node **data, struct ncac_user *user);
+
+/**
+ * @brief Restrict XPath filters so that no data the user does not have R access to are retrieved.
+ *
+ * Filters selecting only denied top-level nodes are removed and filters selecting whole modules are
+ * limited to readable top-level nodes, unless there are too many of them. Retrieved data must still be filtered by ::ncac_check_data_read_filter().
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] user User for the NACM filtering.
+ * @param[in,out] filters Array of XPath filters to restrict.
+ * @param[in,out] filter_count Number of @p filters.
+ * @return 0 on success, -1 on error.
+ */
+int ncac_read_filters_restrict(struct ly_ctx *ly_ctx, struct ncac_user *user, char ***filters, int *filter_count);
+
+/**
+ * @brief Check whether read filtering of a user keeps either all the instances of a schema node or none of them.
+ *
+ * That is not the case if any of the user rules has a target with an instance predicate selecting the node
+ * or its ancestors, the result can then be decided only by filtering the data.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] user User for the NACM filtering.
+ * @param[in] node Schema node of the instances.
+ * @return non-zero if the same decision applies to all the instances, 0 if it may depend on the instance.
+ */
+int ncac_read_instances_uniform(struct ly_ctx *ly_ctx, struct ncac_user *user, const struct lys_node *node);
 
 /**
  * @brief Check whether a diff (simplified edit-config tree) can be
@@ -143,8 +280,10 @@ void ncac_check_data_read_filter(struct lyd_node **data, const char *user);
  *
  * @param[in] diff Diff tree to check.
  * @param[in] user User for the NACM check.
+ * @param[in] src_read Whether R access is also required for created and replaced nodes,
+ * whose values are copied from another datastore.
  * @return NULL if access allowed, otherwise the denied access data node.
  */
-const struct lyd_node *ncac_check_diff(const struct lyd_node *diff, const char *user);
+const struct lyd_node *ncac_check_diff(const struct lyd_node *diff, struct ncac_user *user, int src_read);
 
 #endif /* NP2SRV_NETCONF_ACM_H_ */
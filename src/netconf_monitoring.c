@@ -33,100 +33,101 @@ ncm_init(void)
 {
     stats.netconf_start_time = time(NULL);
     pthread_mutex_init(&stats.lock, NULL);
+    pthread_mutex_init(&stats.cache_lock, NULL);
 }
 
 void
 ncm_destroy(void)
 {
     free(stats.sessions);
-    free(stats.session_stats);
     pthread_mutex_destroy(&stats.lock);
+    lyd_free(stats.cache_capabilities);
+    lyd_free(stats.cache_schemas);
+    pthread_mutex_destroy(&stats.cache_lock);
 }
 
-static uint32_t
-find_session_idx(struct nc_session *session)
+/**
+ * @brief Get the global counters shard of the current thread.
+ *
+ * @return Counters shard.
+ */
+static struct ncm_session_stats *
+ncm_thread_shard(void)
 {
-    uint32_t i;
+    static ATOMIC_T next_shard;
+    static __thread struct ncm_session_stats *shard;
 
-    for (i = 0; i < stats.session_count; ++i) {
-        if (nc_session_get_id(stats.sessions[i]) == nc_session_get_id(session)) {
-            return i;
-        }
+    if (!shard) {
+        /* assign shards to threads in a round-robin fashion */
+        shard = &stats.shards[ATOMIC_INC_FENCE(next_shard) % NCM_SHARD_COUNT].stats;
     }
+    return shard;
+}
 
-    EINT;
-    return 0;
+/**
+ * @brief Get the counters of a session.
+ *
+ * @param[in] session NETCONF session.
+ * @return Session counters.
+ */
+static struct ncm_session_stats *
+ncm_session_stats(struct nc_session *session)
+{
+    return &((struct np2srv_sess *)nc_session_get_data(session))->stats;
 }
 
 void
 ncm_session_rpc(struct nc_session *session)
 {
-    pthread_mutex_lock(&stats.lock);
-
-    ++stats.session_stats[find_session_idx(session)].in_rpcs;
-    ++stats.global_stats.in_rpcs;
-
-    pthread_mutex_unlock(&stats.lock);
+    ATOMIC_ADD_RELAXED(ncm_session_stats(session)->in_rpcs, 1);
+    ATOMIC_ADD_RELAXED(ncm_thread_shard()->in_rpcs, 1);
 }
 
 void
 ncm_session_bad_rpc(struct nc_session *session)
 {
-    pthread_mutex_lock(&stats.lock);
-
-    ++stats.session_stats[find_session_idx(session)].in_bad_rpcs;
-    ++stats.global_stats.in_bad_rpcs;
-
-    pthread_mutex_unlock(&stats.lock);
+    ATOMIC_ADD_RELAXED(ncm_session_stats(session)->in_bad_rpcs, 1);
+    ATOMIC_ADD_RELAXED(ncm_thread_shard()->in_bad_rpcs, 1);
 }
 
 void
 ncm_session_rpc_reply_error(struct nc_session *session)
 {
-    pthread_mutex_lock(&stats.lock);
-
-    ++stats.session_stats[find_session_idx(session)].out_rpc_errors;
-    ++stats.global_stats.out_rpc_errors;
-
-    pthread_mutex_unlock(&stats.lock);
+    ATOMIC_ADD_RELAXED(ncm_session_stats(session)->out_rpc_errors, 1);
+    ATOMIC_ADD_RELAXED(ncm_thread_shard()->out_rpc_errors, 1);
 }
 
 void
 ncm_session_notification(struct nc_session *session)
 {
-    pthread_mutex_lock(&stats.lock);
-
-    ++stats.session_stats[find_session_idx(session)].out_notifications;
-    ++stats.global_stats.out_notifications;
-
-    pthread_mutex_unlock(&stats.lock);
+    ATOMIC_ADD_RELAXED(ncm_session_stats(session)->out_notifications, 1);
+    ATOMIC_ADD_RELAXED(ncm_thread_shard()->out_notifications, 1);
 }
 
 void
 ncm_session_add(struct nc_session *session)
 {
     void *new;
+    uint32_t new_size;
 
-    pthread_mutex_lock(&stats.lock);
+    ATOMIC_ADD_RELAXED(stats.in_sessions, 1);
 
-    ++stats.in_sessions;
+    pthread_mutex_lock(&stats.lock);
 
-    ++stats.session_count;
-    new = realloc(stats.sessions, stats.session_count * sizeof *stats.sessions);
-    if (!new) {
-        EMEM;
-        return;
-    }
-    stats.sessions = new;
-    new = realloc(stats.session_stats, stats.session_count * sizeof *stats.session_stats);
-    if (!new) {
-        EMEM;
-        return;
+    if (stats.session_count == stats.session_size) {
+        new_size = stats.session_size ? stats.session_size * 2 : 8;
+        new = realloc(stats.sessions, new_size * sizeof *stats.sessions);
+        if (!new) {
+            EMEM;
+            pthread_mutex_unlock(&stats.lock);
+            return;
+        }
+        stats.sessions = new;
+        stats.session_size = new_size;
     }
-    stats.session_stats = new;
 
-    stats.sessions[stats.session_count - 1] = session;
-    memset(&stats.session_stats[stats.session_count - 1], 0, sizeof *stats.session_stats);
+    stats.sessions[stats.session_count] = session;
+    ++stats.session_count;
 
     pthread_mutex_unlock(&stats.lock);
 }
@@ -136,21 +137,25 @@ ncm_session_del(struct nc_session *session)
 {
     uint32_t i;
 
-    pthread_mutex_lock(&stats.lock);
-
     if (!nc_session_get_term_reason(session)) {
         EINT;
     }
 
     if (nc_session_get_term_reason(session) != NC_SESSION_TERM_CLOSED) {
-        ++stats.dropped_sessions;
+        ATOMIC_ADD_RELAXED(stats.dropped_sessions, 1);
     }
 
-    i = find_session_idx(session);
-    --stats.session_count;
-    if (stats.session_count && (i < stats.session_count)) {
-        memmove(&stats.sessions[i], &stats.sessions[i + 1], (stats.session_count - i) * sizeof *stats.sessions);
-        memmove(&stats.session_stats[i], &stats.session_stats[i + 1], (stats.session_count - i) * sizeof *stats.session_stats);
+    pthread_mutex_lock(&stats.lock);
+
+    for (i = 0; i < stats.session_count; ++i) {
+        if (stats.sessions[i] == session) {
+            break;
+        }
+    }
+    if (i < stats.session_count) {
+        /* order does not matter, move the last session here */
+        --stats.session_count;
+        stats.sessions[i] = stats.sessions[stats.session_count];
     }
 
     pthread_mutex_unlock(&stats.lock);
@@ -159,100 +164,105 @@ ncm_session_del(struct nc_session *session)
 void
 ncm_bad_hello(void)
 {
-    pthread_mutex_lock(&stats.lock);
+    ATOMIC_ADD_RELAXED(stats.in_bad_hellos, 1);
+}
 
-    ++stats.in_bad_hellos;
+/**
+ * @brief Learn which netconf-state children are requested.
+ *
+ * @param[in] request_xpath Requested XPath, NULL if not known.
+ * @return Bitmask of NCM_PART_* values.
+ */
+static uint32_t
+ncm_requested_parts(const char *request_xpath)
+{
+    static const struct {
+        const char *name;
+        uint32_t part;
+    } parts[] = {
+        {"capabilities", NCM_PART_CAPABILITIES},
+        {"datastores", NCM_PART_DATASTORES},
+        {"schemas", NCM_PART_SCHEMAS},
+        {"sessions", NCM_PART_SESSIONS},
+        {"statistics", NCM_PART_STATISTICS}
+    };
+    const char *prefix = "/ietf-netconf-monitoring:netconf-state", *ptr;
+    size_t len;
+    uint32_t i;
 
-    pthread_mutex_unlock(&stats.lock);
+    if (!request_xpath || strchr(request_xpath, '|') || strncmp(request_xpath, prefix, strlen(prefix))) {
+        return NCM_PART_ALL;
+    }
+    ptr = request_xpath + strlen(prefix);
+    if (ptr[0] != '/') {
+        /* whole container or a predicate */
+        return NCM_PART_ALL;
+    }
+    ++ptr;
+    if (!strncmp(ptr, "ietf-netconf-monitoring:", 24)) {
+        ptr += 24;
+    }
+
+    len = strcspn(ptr, "/[ ");
+    for (i = 0; i < sizeof parts / sizeof *parts; ++i) {
+        if ((strlen(parts[i].name) == len) && !strncmp(ptr, parts[i].name, len)) {
+            return parts[i].part;
+        }
+    }
+
+    /* wildcard or anything else */
+    return NCM_PART_ALL;
 }
 
-struct lyd_node *
-ncm_get_data(sr_conn_ctx_t *conn)
+/**
+ * @brief Build capabilities and schemas containers, they change only with the context.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[out] capabilities Capabilities container.
+ * @param[out] schemas Schemas container.
+ * @return 0 on success, -1 on error.
+ */
+static int
+ncm_build_static(struct ly_ctx *ly_ctx, struct lyd_node **capabilities, struct lyd_node **schemas)
 {
-    struct lyd_node *root = NULL, *cont, *list, *cont2;
+    struct lyd_node *root, *list;
     const struct lys_module *mod;
-    struct ly_ctx *ly_ctx;
     const char **cpblts;
-    char buf[26];
-    uint32_t i, nc_id;
-    int rc, is_locked;
-    time_t ts;
-
-    ly_ctx = (struct ly_ctx *)sr_get_context(conn);
+    uint32_t i;
 
     root = lyd_new_path(NULL, ly_ctx, "/ietf-netconf-monitoring:netconf-state", NULL, 0, 0);
     if (!root) {
-        goto error;
+        return -1;
     }
 
     /* capabilities */
-    cont = lyd_new(root, NULL, "capabilities");
+    *capabilities = lyd_new(root, NULL, "capabilities");
 
     cpblts = nc_server_get_cpblts_version(ly_ctx, LYS_VERSION_1);
     if (!cpblts) {
-        goto error;
+        lyd_free(root);
+        return -1;
     }
 
     for (i = 0; cpblts[i]; ++i) {
-        lyd_new_leaf(cont, NULL, "capability", cpblts[i]);
+        lyd_new_leaf(*capabilities, NULL, "capability", cpblts[i]);
         lydict_remove(ly_ctx, cpblts[i]);
     }
     free(cpblts);
 
-    cont = lyd_new(root, NULL, "datastores");
-
-    list = lyd_new(cont, NULL, "datastore");
-    lyd_new_leaf(list, NULL, "name", "running");
-    rc = sr_get_lock(conn, SR_DS_RUNNING, NULL, &is_locked, NULL, &nc_id, &ts);
-    if (rc != SR_ERR_OK) {
-        WRN("Failed to learn about running lock (%s).", sr_strerror(rc));
-    } else if (is_locked) {
-        cont2 = lyd_new(list, NULL, "global-lock");
-        sprintf(buf, "%u", nc_id);
-        lyd_new_leaf(cont2, NULL, "locked-by-session", buf);
-        nc_time2datetime(ts, NCM_TIMEZONE, buf);
-        lyd_new_leaf(cont2, NULL, "locked-time", buf);
-    }
-
-    list = lyd_new(cont, NULL, "datastore");
-    lyd_new_leaf(list, NULL, "name", "startup");
-    rc = sr_get_lock(conn, SR_DS_STARTUP, NULL, &is_locked, NULL, &nc_id, &ts);
-    if (rc != SR_ERR_OK) {
-        WRN("Failed to learn about startup lock (%s).", sr_strerror(rc));
-    } else if (is_locked) {
-        cont2 = lyd_new(list, NULL, "global-lock");
-        sprintf(buf, "%u", nc_id);
-        lyd_new_leaf(cont2, NULL, "locked-by-session", buf);
-        nc_time2datetime(ts, NCM_TIMEZONE, buf);
-        lyd_new_leaf(cont2, NULL, "locked-time", buf);
-    }
-
-    list = lyd_new(cont, NULL, "datastore");
-    lyd_new_leaf(list, NULL, "name", "candidate");
-    rc = sr_get_lock(conn, SR_DS_CANDIDATE, NULL, &is_locked, NULL, &nc_id, &ts);
-    if (rc != SR_ERR_OK) {
-        WRN("Failed to learn about candidate lock (%s).", sr_strerror(rc));
-    } else if (is_locked) {
-        cont2 = lyd_new(list, NULL, "global-lock");
-        sprintf(buf, "%u", nc_id);
-        lyd_new_leaf(cont2, NULL, "locked-by-session", buf);
-        nc_time2datetime(ts, NCM_TIMEZONE, buf);
-        lyd_new_leaf(cont2, NULL, "locked-time", buf);
-    }
-
     /* schemas */
-    cont = lyd_new(root, NULL, "schemas");
+    *schemas = lyd_new(root, NULL, "schemas");
 
     i = 0;
     while ((mod = ly_ctx_get_module_iter(ly_ctx, &i))) {
-        list = lyd_new(cont, NULL, "schema");
+        list = lyd_new(*schemas, NULL, "schema");
         lyd_new_leaf(list, NULL, "identifier", mod->name);
         lyd_new_leaf(list, NULL, "version", (mod->rev ? mod->rev[0].date : NULL));
         lyd_new_leaf(list, NULL, "format", "yang");
         lyd_new_leaf(list, NULL, "namespace", lys_main_module(mod)->ns);
         lyd_new_leaf(list, NULL, "location", "NETCONF");
 
-        list = lyd_new(cont, NULL, "schema");
+        list = lyd_new(*schemas, NULL, "schema");
         lyd_new_leaf(list, NULL, "identifier", mod->name);
         lyd_new_leaf(list, NULL, "version", (mod->rev ? mod->rev[0].date : NULL));
         lyd_new_leaf(list, NULL, "format", "yin");
@@ -260,7 +270,102 @@ ncm_get_data(sr_conn_ctx_t *conn)
         lyd_new_leaf(list, NULL, "location", "NETCONF");
     }
 
-    /* sessions */
+    /* keep only the containers */
+    lyd_unlink(*capabilities);
+    lyd_unlink(*schemas);
+    lyd_free(root);
+    return 0;
+}
+
+/**
+ * @brief Add copies of the cached capabilities and/or schemas, rebuild them if the context changed.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @param[in] root netconf-state container.
+ * @param[in] part NCM_PART_CAPABILITIES or NCM_PART_SCHEMAS.
+ * @return 0 on success, -1 on error.
+ */
+static int
+ncm_add_static(struct ly_ctx *ly_ctx, struct lyd_node *root, uint32_t part)
+{
+    struct lyd_node *dup;
+    int rc = -1;
+
+    pthread_mutex_lock(&stats.cache_lock);
+
+    if ((stats.cache_ctx != ly_ctx) || (stats.cache_module_set_id != ly_ctx_get_module_set_id(ly_ctx))) {
+        /* context changed, rebuild */
+        lyd_free(stats.cache_capabilities);
+        lyd_free(stats.cache_schemas);
+        stats.cache_capabilities = NULL;
+        stats.cache_schemas = NULL;
+        stats.cache_ctx = NULL;
+
+        if (ncm_build_static(ly_ctx, &stats.cache_capabilities, &stats.cache_schemas)) {
+            goto cleanup;
+        }
+        stats.cache_ctx = ly_ctx;
+        stats.cache_module_set_id = ly_ctx_get_module_set_id(ly_ctx);
+    }
+
+    dup = lyd_dup((part == NCM_PART_CAPABILITIES) ? stats.cache_capabilities : stats.cache_schemas,
+            LYD_DUP_OPT_RECURSIVE);
+    if (!dup || lyd_insert(root, dup)) {
+        lyd_free(dup);
+        goto cleanup;
+    }
+
+    /* success */
+    rc = 0;
+
+cleanup:
+    pthread_mutex_unlock(&stats.cache_lock);
+    return rc;
+}
+
+/**
+ * @brief Add a datastore with its global lock information.
+ */
+static void
+ncm_add_datastore(sr_conn_ctx_t *conn, struct lyd_node *cont, sr_datastore_t ds, const char *name)
+{
+    struct lyd_node *list, *cont2;
+    char buf[26];
+    uint32_t nc_id;
+    int rc, is_locked;
+    time_t ts;
+
+    list = lyd_new(cont, NULL, "datastore");
+    lyd_new_leaf(list, NULL, "name", name);
+    rc = sr_get_lock(conn, ds, NULL, &is_locked, NULL, &nc_id, &ts);
+    if (rc != SR_ERR_OK) {
+        WRN("Failed to learn about %s lock (%s).", name, sr_strerror(rc));
+    } else if (is_locked) {
+        cont2 = lyd_new(list, NULL, "global-lock");
+        sprintf(buf, "%u", nc_id);
+        lyd_new_leaf(cont2, NULL, "locked-by-session", buf);
+        nc_time2datetime(ts, NCM_TIMEZONE, buf);
+        lyd_new_leaf(cont2, NULL, "locked-time", buf);
+    }
+}
+
+/**
+ * @brief Add all the sessions.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+ncm_add_sessions(struct ly_ctx *ly_ctx, struct lyd_node *root)
+{
+    struct lyd_node *cont, *list;
+    const struct lys_module *np2m_mod;
+    struct ncm_session_stats *sess_stats;
+    struct np_ntf_queue *queue;
+    char buf[26];
+    uint32_t i;
+    int rc = 0;
+
+    np2m_mod = ly_ctx_get_module(ly_ctx, "netopeer2-monitoring", NULL, 1);
     pthread_mutex_lock(&stats.lock);
 
     if (stats.session_count) {
@@ -284,46 +389,116 @@ ncm_get_data(sr_conn_ctx_t *conn)
 #endif
             default: /* NC_TI_FD, NC_TI_NONE */
                 ERR("ietf-netconf-monitoring unsupported session transport type.");
-                pthread_mutex_unlock(&stats.lock);
-                goto error;
+                rc = -1;
+                goto cleanup;
             }
             lyd_new_leaf(list, NULL, "username", nc_session_get_username(stats.sessions[i]));
             lyd_new_leaf(list, NULL, "source-host", nc_session_get_host(stats.sessions[i]));
             nc_time2datetime(nc_session_get_start_time(stats.sessions[i]), NCM_TIMEZONE, buf);
             lyd_new_leaf(list, NULL, "login-time", buf);
 
-            sprintf(buf, "%u", stats.session_stats[i].in_rpcs);
+            sess_stats = ncm_session_stats(stats.sessions[i]);
+            sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(sess_stats->in_rpcs));
             lyd_new_leaf(list, NULL, "in-rpcs", buf);
-            sprintf(buf, "%u", stats.session_stats[i].in_bad_rpcs);
+            sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(sess_stats->in_bad_rpcs));
             lyd_new_leaf(list, NULL, "in-bad-rpcs", buf);
-            sprintf(buf, "%u", stats.session_stats[i].out_rpc_errors);
+            sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(sess_stats->out_rpc_errors));
             lyd_new_leaf(list, NULL, "out-rpc-errors", buf);
-            sprintf(buf, "%u", stats.session_stats[i].out_notifications);
+            sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(sess_stats->out_notifications));
             lyd_new_leaf(list, NULL, "out-notifications", buf);
+
+            if (np2m_mod) {
+                queue = &((struct np2srv_sess *)nc_session_get_data(stats.sessions[i]))->ntf_queue;
+                sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(queue->depth));
+                lyd_new_leaf(list, np2m_mod, "notification-queue-depth", buf);
+                sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(queue->dropped));
+                lyd_new_leaf(list, np2m_mod, "dropped-notifications", buf);
+                sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(queue->max_wait));
+                lyd_new_leaf(list, np2m_mod, "max-notification-queue-wait", buf);
+            }
         }
     }
 
-    /* statistics */
+cleanup:
+    pthread_mutex_unlock(&stats.lock);
+    return rc;
+}
+
+/**
+ * @brief Add the global statistics.
+ */
+static void
+ncm_add_statistics(struct lyd_node *root)
+{
+    struct lyd_node *cont;
+    char buf[26];
+    uint32_t i, in_rpcs = 0, in_bad_rpcs = 0, out_rpc_errors = 0, out_notifications = 0;
+
+    /* sum the global counters shards */
+    for (i = 0; i < NCM_SHARD_COUNT; ++i) {
+        in_rpcs += ATOMIC_LOAD_RELAXED(stats.shards[i].stats.in_rpcs);
+        in_bad_rpcs += ATOMIC_LOAD_RELAXED(stats.shards[i].stats.in_bad_rpcs);
+        out_rpc_errors += ATOMIC_LOAD_RELAXED(stats.shards[i].stats.out_rpc_errors);
+        out_notifications += ATOMIC_LOAD_RELAXED(stats.shards[i].stats.out_notifications);
+    }
+
     cont = lyd_new(root, NULL, "statistics");
 
     nc_time2datetime(stats.netconf_start_time, NCM_TIMEZONE, buf);
     lyd_new_leaf(cont, NULL, "netconf-start-time", buf);
-    sprintf(buf, "%u", stats.in_bad_hellos);
+    sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(stats.in_bad_hellos));
     lyd_new_leaf(cont, NULL, "in-bad-hellos", buf);
-    sprintf(buf, "%u", stats.in_sessions);
+    sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(stats.in_sessions));
     lyd_new_leaf(cont, NULL, "in-sessions", buf);
-    sprintf(buf, "%u", stats.dropped_sessions);
+    sprintf(buf, "%u", (uint32_t)ATOMIC_LOAD_RELAXED(stats.dropped_sessions));
     lyd_new_leaf(cont, NULL, "dropped-sessions", buf);
-    sprintf(buf, "%u", stats.global_stats.in_rpcs);
+    sprintf(buf, "%u", in_rpcs);
     lyd_new_leaf(cont, NULL, "in-rpcs", buf);
-    sprintf(buf, "%u", stats.global_stats.in_bad_rpcs);
+    sprintf(buf, "%u", in_bad_rpcs);
     lyd_new_leaf(cont, NULL, "in-bad-rpcs", buf);
-    sprintf(buf, "%u", stats.global_stats.out_rpc_errors);
+    sprintf(buf, "%u", out_rpc_errors);
     lyd_new_leaf(cont, NULL, "out-rpc-errors", buf);
-    sprintf(buf, "%u", stats.global_stats.out_notifications);
+    sprintf(buf, "%u", out_notifications);
     lyd_new_leaf(cont, NULL, "out-notifications", buf);
+}
 
-    pthread_mutex_unlock(&stats.lock);
+struct lyd_node *
+ncm_get_data(sr_conn_ctx_t *conn, const char *request_xpath)
+{
+    struct lyd_node *root = NULL, *cont;
+    struct ly_ctx *ly_ctx;
+    uint32_t parts;
+
+    ly_ctx = (struct ly_ctx *)sr_get_context(conn);
+    parts = ncm_requested_parts(request_xpath);
+
+    root = lyd_new_path(NULL, ly_ctx, "/ietf-netconf-monitoring:netconf-state", NULL, 0, 0);
+    if (!root) {
+        goto error;
+    }
+
+    if ((parts & NCM_PART_CAPABILITIES) && ncm_add_static(ly_ctx, root, NCM_PART_CAPABILITIES)) {
+        goto error;
+    }
+
+    if (parts & NCM_PART_DATASTORES) {
+        cont = lyd_new(root, NULL, "datastores");
+        ncm_add_datastore(conn, cont, SR_DS_RUNNING, "running");
+        ncm_add_datastore(conn, cont, SR_DS_STARTUP, "startup");
+        ncm_add_datastore(conn, cont, SR_DS_CANDIDATE, "candidate");
+    }
+
+    if ((parts & NCM_PART_SCHEMAS) && ncm_add_static(ly_ctx, root, NCM_PART_SCHEMAS)) {
+        goto error;
+    }
+
+    if ((parts & NCM_PART_SESSIONS) && ncm_add_sessions(ly_ctx, root)) {
+        goto error;
+    }
+
+    if (parts & NCM_PART_STATISTICS) {
+        ncm_add_statistics(root);
+    }
 
     if (lyd_validate(&root, LYD_OPT_NOSIBLINGS, NULL)) {
         goto error;
@@ -20,25 +20,54 @@
 #include <nc_server.h>
 #include <sysrepo.h>
 
+#include "config.h"
+
+/** @brief Parts of the netconf-state data, generated only when requested */
+#define NCM_PART_CAPABILITIES 0x01
+#define NCM_PART_DATASTORES 0x02
+#define NCM_PART_SCHEMAS 0x04
+#define NCM_PART_SESSIONS 0x08
+#define NCM_PART_STATISTICS 0x10
+#define NCM_PART_ALL 0x1F
+
+/** @brief Number of shards of the global counters, threads are spread among them */
+#define NCM_SHARD_COUNT 16
+
+/**
+ * @brief Counters of a session, stored in the session internal data and updated with relaxed atomics.
+ */
 struct ncm_session_stats {
-    uint32_t in_rpcs;
-    uint32_t in_bad_rpcs;
-    uint32_t out_rpc_errors;
-    uint32_t out_notifications;
+    ATOMIC_T in_rpcs;
+    ATOMIC_T in_bad_rpcs;
+    ATOMIC_T out_rpc_errors;
+    ATOMIC_T out_notifications;
 };
 
+/**
+ * @brief Shard of the global session counters, each on its own cache line.
+ */
+struct ncm_shard {
+    struct ncm_session_stats stats;
+} __attribute__((aligned(64)));
+
 struct ncm {
     struct nc_session **sessions;
-    struct ncm_session_stats *session_stats;
     uint32_t session_count;
+    uint32_t session_size;
 
     time_t netconf_start_time;
-    uint32_t in_bad_hellos;
-    uint32_t in_sessions;
-    uint32_t dropped_sessions;
-    struct ncm_session_stats global_stats;
+    ATOMIC_T in_bad_hellos;
+    ATOMIC_T in_sessions;
+    ATOMIC_T dropped_sessions;
+    struct ncm_shard shards[NCM_SHARD_COUNT];
+
+    pthread_mutex_t lock;   /**< guards only the sessions membership */
 
-    pthread_mutex_t lock;
+    const struct ly_ctx *cache_ctx;         /**< context of the cached data */
+    uint16_t cache_module_set_id;           /**< module set ID of the context */
+    struct lyd_node *cache_capabilities;    /**< cached capabilities container */
+    struct lyd_node *cache_schemas;         /**< cached schemas container */
+    pthread_mutex_t cache_lock;             /**< guards the cached data */
 };
 
 void ncm_init(void);
@@ -52,6 +81,13 @@ void ncm_session_add(struct nc_session *session);
 void ncm_session_del(struct nc_session *session);
 void ncm_bad_hello(void);
 
-struct lyd_node *ncm_get_data(sr_conn_ctx_t *conn);
+/**
+ * @brief Get the netconf-state data.
+ *
+ * @param[in] conn Sysrepo connection.
+ * @param[in] request_xpath Requested XPath, only the requested child is generated, NULL for all.
+ * @return netconf-state data, NULL on error.
+ */
+struct lyd_node *ncm_get_data(sr_conn_ctx_t *conn, const char *request_xpath);
 
 #endif /* NP2SRV_NETCONF_MONITORING_H_ */
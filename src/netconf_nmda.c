@@ -15,7 +15,9 @@
 #define _GNU_SOURCE
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
+#include <errno.h>
 #include <inttypes.h>
 #include <unistd.h>
 #include <string.h>
@@ -27,65 +29,557 @@
 #include "common.h"
 #include "log.h"
 #include "netconf_acm.h"
+#include "rpc_stats.h"
 
 /**
- * @brief Perform origin filtering.
+ * @brief Maximum number of remembered origin identity results.
+ */
+#define OP_DATA_ORIGIN_MEMO_SIZE 8
+
+/**
+ * @brief Compiled origin filter.
+ */
+struct op_data_origin {
+    const struct lys_ident **filters;   /**< filter identities, any of them can match */
+    uint32_t filter_count;              /**< number of filter identities */
+    int negated;                        /**< whether the filter is negated */
+
+    struct {
+        const struct lys_ident *origin; /**< origin identity of a node */
+        int match;                      /**< whether it matches the filters */
+    } memo[OP_DATA_ORIGIN_MEMO_SIZE];   /**< results of already learned origin identities */
+    uint32_t memo_count;                /**< number of remembered results */
+};
+
+/**
+ * @brief Check whether an identity is derived from or the same as another identity.
+ *
+ * @param[in] ident Identity to check.
+ * @param[in] base Base identity.
+ * @return non-zero if derived or the same, 0 otherwise.
+ */
+static int
+op_data_ident_derived_or_self(const struct lys_ident *ident, const struct lys_ident *base)
+{
+    uint8_t i;
+
+    if (ident == base) {
+        return 1;
+    }
+
+    for (i = 0; i < ident->base_size; ++i) {
+        if (op_data_ident_derived_or_self(ident->base[i], base)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check whether an origin identity matches the (non-negated) filters.
+ *
+ * @param[in] origin Compiled origin filter.
+ * @param[in] ident Origin identity of a node.
+ * @return non-zero on a match, 0 otherwise.
+ */
+static int
+op_data_origin_match(struct op_data_origin *origin, const struct lys_ident *ident)
+{
+    uint32_t i;
+    int match = 0;
+
+    /* there are only a few origins, they repeat a lot */
+    for (i = 0; i < origin->memo_count; ++i) {
+        if (origin->memo[i].origin == ident) {
+            return origin->memo[i].match;
+        }
+    }
+
+    for (i = 0; i < origin->filter_count; ++i) {
+        if (op_data_ident_derived_or_self(ident, origin->filters[i])) {
+            match = 1;
+            break;
+        }
+    }
+
+    if (origin->memo_count < OP_DATA_ORIGIN_MEMO_SIZE) {
+        origin->memo[origin->memo_count].origin = ident;
+        origin->memo[origin->memo_count].match = match;
+        ++origin->memo_count;
+    }
+
+    return match;
+}
+
+/**
+ * @brief Perform origin filtering of sibling subtrees.
+ *
+ * @param[in,out] first First sibling, is updated if freed.
+ * @param[in] origin Compiled origin filter.
+ */
+static void
+op_data_filter_origin_r(struct lyd_node **first, struct op_data_origin *origin)
+{
+    struct lyd_node *node, *next;
+    struct lyd_attr *attr;
+
+    LY_TREE_FOR_SAFE(*first, next, node) {
+        if (node->schema->flags & LYS_CONFIG_R) {
+            /* state nodes are not affected, nor are their descendants */
+            continue;
+        }
+
+        LY_TREE_FOR(node->attr, attr) {
+            if (!strcmp(attr->name, "origin") && !strcmp(attr->annotation->module->name, "ietf-origin")) {
+                break;
+            }
+        }
+
+        if (attr && attr->value.ident && (op_data_origin_match(origin, attr->value.ident) == origin->negated)) {
+            /* free non-matching subtree */
+            if (node == *first) {
+                *first = next;
+            }
+            lyd_free(node);
+            continue;
+        }
+
+        if (!(node->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST | LYS_ANYDATA))) {
+            op_data_filter_origin_r(&node->child, origin);
+        }
+    }
+}
+
+/**
+ * @brief Perform origin filtering in a single pass over the data.
  *
  * @param[in,out] data Data to filter.
- * @param[in] filter Origin filter identity.
- * @param[in] negated Whether the filter is negated.
+ * @param[in] filter_set Set of origin-filter or negated-origin-filter leaves.
  * @return Sysrepo error value.
  */
 static int
-op_data_filter_origin(struct lyd_node **data, const struct lys_ident *filter, int negated)
+op_data_filter_origin(struct lyd_node **data, const struct ly_set *filter_set)
 {
-    struct ly_set *set;
-    struct lyd_node *node;
-    char *xpath;
-    int ret;
+    struct op_data_origin origin;
     uint32_t i;
 
-    if (!*data) {
+    if (!*data || !filter_set->number) {
         return SR_ERR_OK;
     }
 
-    if (negated) {
-        ret = asprintf(&xpath, "//*[@origin and derived-from-or-self(@origin, '%s:%s')]", filter->module->name, filter->name);
+    memset(&origin, 0, sizeof origin);
+    origin.filters = malloc(filter_set->number * sizeof *origin.filters);
+    if (!origin.filters) {
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+
+    /* both filters are a choice so they cannot be mixed, all the values are OR'ed */
+    for (i = 0; i < filter_set->number; ++i) {
+        origin.filters[i] = ((struct lyd_node_leaf_list *)filter_set->set.d[i])->value.ident;
+    }
+    origin.filter_count = filter_set->number;
+    origin.negated = strcmp(filter_set->set.d[0]->schema->name, "origin-filter") ? 1 : 0;
+
+    op_data_filter_origin_r(data, &origin);
+
+    free(origin.filters);
+    return SR_ERR_OK;
+}
+/**
+ * @brief List pagination parameters.
+ */
+struct op_data_page {
+    const char *list_path;  /**< path to the list instances */
+    const struct lys_node *schema;  /**< schema node of the instances, if the path selects a single one */
+    uint32_t limit;         /**< maximum number of instances */
+    uint32_t offset;        /**< number of skipped instances */
+    const char *after;      /**< key predicates of the last instance of the previous page, if known */
+    int descending;         /**< whether the order is reversed */
+    int window;             /**< whether only the page instances and the one following are retrieved */
+};
+
+/**
+ * @brief Learn list pagination parameters.
+ *
+ * A cursor is the offset of the next page followed by the key predicates of the last instance of the previous
+ * page. The page starts after this instance, the offset is used only if it no longer exists.
+ *
+ * @param[in] session Sysrepo session for setting an error.
+ * @param[in] input get-data input.
+ * @param[out] page Pagination parameters.
+ * @return 0 if no pagination requested, 1 if requested, -1 on error.
+ */
+static int
+op_data_page_params(sr_session_ctx_t *session, const struct lyd_node *input, struct op_data_page *page)
+{
+    struct lyd_node_leaf_list *leaf;
+    struct lyd_node *cont, *node;
+    struct ly_set *nodeset;
+    unsigned long offset;
+    char *ptr;
+
+    memset(page, 0, sizeof *page);
+
+    nodeset = lyd_find_path(input, "netopeer2-monitoring:list-pagination");
+    cont = nodeset->number ? nodeset->set.d[0] : NULL;
+    ly_set_free(nodeset);
+    if (!cont) {
+        return 0;
+    }
+
+    LY_TREE_FOR(cont->child, node) {
+        leaf = (struct lyd_node_leaf_list *)node;
+        if (!strcmp(node->schema->name, "list-path")) {
+            page->list_path = leaf->value_str;
+        } else if (!strcmp(node->schema->name, "limit")) {
+            page->limit = leaf->value.uint32;
+        } else if (!strcmp(node->schema->name, "offset")) {
+            page->offset = leaf->value.uint32;
+        } else if (!strcmp(node->schema->name, "cursor")) {
+            errno = 0;
+            offset = strtoul(leaf->value_str, &ptr, 10);
+            if (errno || (ptr == leaf->value_str) || (ptr[0] && (ptr[0] != '[')) || (offset > UINT32_MAX)) {
+                sr_set_error(session, NULL, "Invalid list pagination cursor \"%s\".", leaf->value_str);
+                return -1;
+            }
+            page->offset = offset;
+            page->after = ptr[0] ? ptr : NULL;
+        } else if (!strcmp(node->schema->name, "sort-order")) {
+            page->descending = !strcmp(leaf->value_str, "descending");
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Generate key predicates identifying a list or leaf-list instance.
+ *
+ * @param[in] inst List or leaf-list instance.
+ * @param[out] pred Key predicates, NULL if the instance cannot be identified.
+ * @return 0 on success, -1 on error.
+ */
+static int
+op_data_page_inst_pred(const struct lyd_node *inst, char **pred)
+{
+    const struct lys_node_list *slist;
+    const struct lyd_node *key;
+    const char *name, *value;
+    char *str = NULL, quot;
+    size_t len = 0;
+    uint8_t i;
+    void *mem;
+
+    *pred = NULL;
+
+    if (inst->schema->nodetype == LYS_LEAFLIST) {
+        slist = NULL;
+        key = inst;
     } else {
-        ret = asprintf(&xpath, "//*[@origin and not(derived-from-or-self(@origin, '%s:%s'))]", filter->module->name, filter->name);
+        slist = (const struct lys_node_list *)inst->schema;
+        if (!slist->keys_size) {
+            /* keyless list */
+            return 0;
+        }
+        key = inst->child;
     }
-    if (ret == -1) {
+
+    for (i = 0; !i || (slist && (i < slist->keys_size)); ++i, key = key->next) {
+        if (!key) {
+            /* missing keys */
+            free(str);
+            return 0;
+        }
+
+        name = slist ? key->schema->name : ".";
+        value = ((struct lyd_node_leaf_list *)key)->value_str;
+        quot = strchr(value, '\'') ? '"' : '\'';
+        if ((quot == '"') && strchr(value, '"')) {
+            /* the value cannot be quoted */
+            free(str);
+            return 0;
+        }
+
+        mem = realloc(str, len + strlen(name) + strlen(value) + 6);
+        if (!mem) {
+            free(str);
+            EMEM;
+            return -1;
+        }
+        str = mem;
+        len += sprintf(str + len, "[%s=%c%s%c]", name, quot, value, quot);
+    }
+
+    *pred = str;
+    return 0;
+}
+
+/**
+ * @brief Find the position of the instance identified by key predicates.
+ *
+ * @param[in] set List or leaf-list instances.
+ * @param[in] pred Key predicates of the instance.
+ * @param[in] descending Whether the instances are counted from the last one.
+ * @param[out] pos Position of the instance, untouched if not found.
+ * @return 0 if found, 1 if not, -1 on error.
+ */
+static int
+op_data_page_inst_find(const struct ly_set *set, const char *pred, int descending, uint32_t *pos)
+{
+    char *inst_pred;
+    uint32_t i;
+    int found;
+
+    for (i = 0; i < set->number; ++i) {
+        if (op_data_page_inst_pred(set->set.d[i], &inst_pred)) {
+            return -1;
+        }
+        found = inst_pred && !strcmp(inst_pred, pred);
+        free(inst_pred);
+
+        if (found) {
+            *pos = descending ? set->number - 1 - i : i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Learn the offset of the page following a cursor by retrieving only the keys of the instances.
+ *
+ * @param[in] session Sysrepo session to use, with the datastore switched.
+ * @param[in,out] page Pagination parameters with a cursor, its offset is updated if the instance was found.
+ * @return Sysrepo error value.
+ */
+static int
+op_data_page_locate(sr_session_ctx_t *session, struct op_data_page *page)
+{
+    const struct lys_node_list *slist;
+    struct lyd_node *data = NULL;
+    struct ly_set *set = NULL;
+    char *xpath = NULL;
+    uint32_t pos;
+    int rc, r;
+
+    if (page->schema->nodetype == LYS_LIST) {
+        slist = (const struct lys_node_list *)page->schema;
+        r = asprintf(&xpath, "%s/%s", page->list_path, slist->keys[0]->name);
+    } else {
+        r = asprintf(&xpath, "%s", page->list_path);
+    }
+    if (r == -1) {
         EMEM;
         return SR_ERR_NOMEM;
     }
 
-    set = lyd_find_path(*data, xpath);
+    rc = sr_get_data(session, xpath, 0, NP2SRV_SYSREPO_TIMEOUT, 0, &data);
+    if ((rc != SR_ERR_OK) || !data) {
+        goto cleanup;
+    }
+
+    set = lyd_find_path(data, page->list_path);
+    if (!set) {
+        rc = SR_ERR_INTERNAL;
+        goto cleanup;
+    }
+
+    r = op_data_page_inst_find(set, page->after, page->descending, &pos);
+    if (r == -1) {
+        rc = SR_ERR_NOMEM;
+        goto cleanup;
+    } else if (!r) {
+        page->offset = pos + 1;
+    }
+
+cleanup:
     free(xpath);
+    ly_set_free(set);
+    lyd_free_withsiblings(data);
+    return rc;
+}
+
+/**
+ * @brief Create the filter selecting the list instances.
+ *
+ * Only the page instances and the one following are selected if no instances can be filtered out individually.
+ * Otherwise, all the instances are selected and the page can be cut only after the data are filtered so that any
+ * filtered-out instances are not counted.
+ *
+ * @param[in] session Sysrepo session to use, with the datastore switched.
+ * @param[in] ly_ctx libyang context.
+ * @param[in] user User for the NACM filtering.
+ * @param[in] origin_filter Whether the data are filtered by origin.
+ * @param[in,out] page Pagination parameters, learn whether only the page window is selected.
+ * @param[out] filters Array of the filter.
+ * @param[out] filter_count Number of filters.
+ * @return Sysrepo error value.
+ */
+static int
+op_data_page_filter(sr_session_ctx_t *session, struct ly_ctx *ly_ctx, struct ncac_user *user, int origin_filter,
+        struct op_data_page *page, char ***filters, int *filter_count)
+{
+    struct ly_set *set;
+    int r, rc;
+
+    set = ly_ctx_find_path(ly_ctx, page->list_path);
+    if (set && (set->number == 1) && (set->set.s[0]->nodetype & (LYS_LIST | LYS_LEAFLIST))) {
+        page->schema = set->set.s[0];
+    }
+    ly_set_free(set);
+
+    /* origin filter may filter out any configuration instances */
+    if (page->schema && !origin_filter) {
+        page->window = ncac_read_instances_uniform(ly_ctx, user, page->schema);
+    }
+
+    if (page->window && page->after) {
+        /* the page offset must be known before the window is retrieved */
+        rc = op_data_page_locate(session, page);
+        if (rc != SR_ERR_OK) {
+            return rc;
+        }
+        page->after = NULL;
+    }
+
+    *filters = malloc(sizeof **filters);
+    if (!*filters) {
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+
+    if (!page->window) {
+        r = asprintf(&(*filters)[0], "%s", page->list_path);
+    } else if (page->descending) {
+        r = asprintf(&(*filters)[0], "%s[position() >= last() - %" PRIu64 " and position() <= last() - %" PRIu32 "]",
+                page->list_path, (uint64_t)page->offset + page->limit, page->offset);
+    } else {
+        r = asprintf(&(*filters)[0], "%s[position() > %" PRIu32 " and position() <= %" PRIu64 "]",
+                page->list_path, page->offset, (uint64_t)page->offset + page->limit + 1);
+    }
+    if (r == -1) {
+        free(*filters);
+        *filters = NULL;
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+    *filter_count = 1;
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Cut a page of filtered list instances, remove all the other instances and order them.
+ *
+ * If only the page window was retrieved, it is the beginning of the instances in the requested order.
+ *
+ * @param[in] session Sysrepo session for setting an error.
+ * @param[in] page Pagination parameters.
+ * @param[in,out] data Filtered data.
+ * @param[out] cursor Cursor of the next page, NULL if there is none.
+ * @return Sysrepo error value.
+ */
+static int
+op_data_page_finish(sr_session_ctx_t *session, const struct op_data_page *page, struct lyd_node **data, char **cursor)
+{
+    struct ly_set *set;
+    struct lyd_node *prev, *last_inst = NULL;
+    uint64_t first, last, pos, offset;
+    uint32_t i, count, after_pos;
+    char *pred = NULL;
+    int rc = SR_ERR_OK, r;
+
+    *cursor = NULL;
+    if (!*data) {
+        return SR_ERR_OK;
+    }
+
+    set = lyd_find_path(*data, page->list_path);
     if (!set) {
         return SR_ERR_INTERNAL;
     }
 
-    if (set->number) {
-        /* go backwards to allow safe node freeing */
-        i = set->number;
-        do {
-            --i;
-            node = set->set.d[i];
-            if (node->schema->flags & LYS_CONFIG_R) {
-                /* state nodes are not affected */
-                continue;
+    for (i = 1; i < set->number; ++i) {
+        if (set->set.d[i]->parent != set->set.d[0]->parent) {
+            sr_set_error(session, NULL, "List pagination path \"%s\" selects instances of several lists.", page->list_path);
+            rc = SR_ERR_INVAL_ARG;
+            goto cleanup;
+        }
+    }
+
+    /* offset of the page, continue after the last instance of the previous page if it still exists */
+    offset = page->offset;
+    if (page->after) {
+        r = op_data_page_inst_find(set, page->after, page->descending, &after_pos);
+        if (r == -1) {
+            rc = SR_ERR_NOMEM;
+            goto cleanup;
+        } else if (!r) {
+            offset = (uint64_t)after_pos + 1;
+        }
+    }
+
+    /* positions of the page instances counted in the requested order */
+    first = page->window ? 0 : offset;
+    last = first + page->limit;
+
+    /* free all the instances outside the page */
+    count = 0;
+    for (i = 0; i < set->number; ++i) {
+        pos = page->descending ? set->number - 1 - i : i;
+        if ((pos >= first) && (pos < last)) {
+            if (pos == last - 1) {
+                last_inst = set->set.d[i];
             }
+            set->set.d[count++] = set->set.d[i];
+            continue;
+        }
 
-            /* free non-matching subtree */
-            if (node == *data) {
-                *data = (*data)->next;
+        if (set->set.d[i] == *data) {
+            *data = (*data)->next;
+        }
+        lyd_free(set->set.d[i]);
+    }
+
+    if (last_inst && (set->number > last)) {
+        /* there is a next page */
+        if (op_data_page_inst_pred(last_inst, &pred)) {
+            rc = SR_ERR_NOMEM;
+            goto cleanup;
+        }
+        if (asprintf(cursor, "%" PRIu64 "%s", offset + page->limit, pred ? pred : "") == -1) {
+            *cursor = NULL;
+            EMEM;
+            rc = SR_ERR_NOMEM;
+            goto cleanup;
+        }
+    }
+    set->number = count;
+
+    if (page->descending && (set->number > 1)) {
+        /* reverse the instances */
+        prev = set->set.d[set->number - 1];
+        for (i = set->number - 1; i > 0; --i) {
+            if (lyd_insert_after(prev, set->set.d[i - 1])) {
+                rc = SR_ERR_LY;
+                goto cleanup;
             }
-            lyd_free(node);
-        } while (i);
+            prev = set->set.d[i - 1];
+        }
+
+        /* top-level instances may have been moved before the first sibling */
+        while ((*data)->prev->next) {
+            *data = (*data)->prev;
+        }
     }
-    ly_set_free(set);
 
-    return SR_ERR_OK;
+cleanup:
+    free(pred);
+    ly_set_free(set);
+    return rc;
 }
 
 int
@@ -94,10 +588,12 @@ np2srv_rpc_getdata_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), co
 {
     struct lyd_node_leaf_list *leaf;
     struct lyd_node *node, *data_get = NULL;
-    char **filters = NULL;
-    int filter_count = 0, i, rc = SR_ERR_OK;
+    char **filters = NULL, *cursor = NULL;
+    int filter_count = 0, i, rc = SR_ERR_OK, paged, origin_filter;
     uint32_t max_depth = 0;
+    uint64_t phase_start;
     struct ly_set *nodeset;
+    struct op_data_page page;
     sr_datastore_t ds;
     NC_WD_MODE nc_wd;
     sr_get_oper_options_t get_opts = 0;
@@ -123,11 +619,38 @@ np2srv_rpc_getdata_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), co
         goto cleanup;
     }
 
+    /* update sysrepo session datastore */
+    sr_session_switch_ds(session, ds);
+
+    /* learn list pagination */
+    paged = op_data_page_params(session, input, &page);
+    if (paged == -1) {
+        rc = SR_ERR_INVAL_ARG;
+        goto cleanup;
+    }
+
     /* create filters */
+    phase_start = np2srv_rpc_stats_now();
     nodeset = lyd_find_path(input, "subtree-filter | xpath-filter");
     node = nodeset->number ? nodeset->set.d[0] : NULL;
     ly_set_free(nodeset);
-    if (node && !strcmp(node->schema->name, "subtree-filter")) {
+    if (paged) {
+        if (node) {
+            rc = SR_ERR_INVAL_ARG;
+            sr_set_error(session, NULL, "List pagination cannot be combined with a filter.");
+            goto cleanup;
+        }
+
+        /* the page is cut after filtering */
+        nodeset = lyd_find_path(input, "origin-filter | negated-origin-filter");
+        origin_filter = nodeset->number ? 1 : 0;
+        ly_set_free(nodeset);
+        rc = op_data_page_filter(session, lyd_node_module(input)->ctx, np_get_nc_sess_user(session), origin_filter,
+                &page, &filters, &filter_count);
+        if (rc != SR_ERR_OK) {
+            goto cleanup;
+        }
+    } else if (node && !strcmp(node->schema->name, "subtree-filter")) {
         if (op_filter_create(node, &filters, &filter_count)) {
             rc = SR_ERR_INTERNAL;
             goto cleanup;
@@ -148,6 +671,13 @@ np2srv_rpc_getdata_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), co
         }
     }
 
+    /* do not even retrieve data the user cannot read */
+    if (ncac_read_filters_restrict(lyd_node_module(input)->ctx, np_get_nc_sess_user(session), &filters, &filter_count)) {
+        rc = SR_ERR_NOMEM;
+        goto cleanup;
+    }
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_FILTER, phase_start);
+
     /* config filter */
     nodeset = lyd_find_path(input, "config-filter");
     leaf = nodeset->number ? (struct lyd_node_leaf_list *)nodeset->set.d[0] : NULL;
@@ -193,38 +723,42 @@ np2srv_rpc_getdata_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), co
         }
     }
 
-    /* update sysrepo session datastore */
-    sr_session_switch_ds(session, ds);
-
     /*
      * create the data tree for the data reply
      */
-    for (i = 0; i < filter_count; i++) {
-        rc = sr_get_data(session, filters[i], max_depth, NP2SRV_SYSREPO_TIMEOUT, get_opts, &node);
-        if (rc != SR_ERR_OK) {
-            ERR("Getting data \"%s\" from sysrepo failed (%s).", filters[i], sr_strerror(rc));
-            goto cleanup;
-        }
-
-        if (!data_get) {
-            data_get = node;
-        } else if (node && lyd_merge(data_get, node, LYD_OPT_DESTRUCT | LYD_OPT_EXPLICIT)) {
-            lyd_free_withsiblings(node);
-            rc = SR_ERR_LY;
-            goto cleanup;
-        }
+    phase_start = np2srv_rpc_stats_now();
+    rc = op_filter_data_get(session, max_depth, get_opts, filters, filter_count, &data_get);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting data from sysrepo failed (%s).", sr_strerror(rc));
+        goto cleanup;
     }
 
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_DATASTORE, phase_start);
+
     /* origin filter */
+    phase_start = np2srv_rpc_stats_now();
     nodeset = lyd_find_path(input, "origin-filter | negated-origin-filter");
-    for (i = 0; i < (signed)nodeset->number; ++i) {
-        leaf = (struct lyd_node_leaf_list *)nodeset->set.d[i];
-        op_data_filter_origin(&data_get, leaf->value.ident, strcmp(leaf->schema->name, "origin-filter"));
-    }
+    rc = op_data_filter_origin(&data_get, nodeset);
     ly_set_free(nodeset);
+    if (rc != SR_ERR_OK) {
+        goto cleanup;
+    }
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_FILTER, phase_start);
 
     /* perform correct NACM filtering */
+    phase_start = np2srv_rpc_stats_now();
     ncac_check_data_read_filter(&data_get, np_get_nc_sess_user(session));
+    np2srv_rpc_stats_phase(NP2SRV_PHASE_NACM_FILTER, phase_start);
+
+    if (paged) {
+        /* cut the page only from the readable instances */
+        phase_start = np2srv_rpc_stats_now();
+        rc = op_data_page_finish(session, &page, &data_get, &cursor);
+        if (rc != SR_ERR_OK) {
+            goto cleanup;
+        }
+        np2srv_rpc_stats_phase(NP2SRV_PHASE_FILTER, phase_start);
+    }
 
     /* add output */
     node = lyd_new_output_anydata(output, NULL, "data", data_get, LYD_ANYDATA_DATATREE);
@@ -233,6 +767,16 @@ np2srv_rpc_getdata_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), co
     }
     data_get = NULL;
 
+    if (cursor) {
+        /* cursor of the next page */
+        node = lyd_new_output_leaf(output, ly_ctx_get_module(lyd_node_module(input)->ctx, "netopeer2-monitoring", NULL, 1),
+                "next-cursor", cursor);
+        if (!node) {
+            rc = SR_ERR_LY;
+            goto cleanup;
+        }
+    }
+
     /* success */
 
 cleanup:
@@ -240,6 +784,7 @@ cleanup:
         free(filters[i]);
     }
     free(filters);
+    free(cursor);
     lyd_free_withsiblings(data_get);
     return rc;
 }
@@ -310,6 +855,10 @@ np2srv_rpc_editdata_cb(sr_session_ctx_t *session, const char *UNUSED(op_path), c
         goto cleanup;
     }
 
+    /* the edit is copied into the session, free it as soon as possible */
+    lyd_free_withsiblings(config);
+    config = NULL;
+
     rc = sr_apply_changes(session, NP2SRV_SYSREPO_TIMEOUT, NP2SRV_DATA_CHANGE_WAIT);
     if (rc != SR_ERR_OK) {
         sr_get_error(session, &err_info);
@@ -30,6 +30,8 @@
 #include <sysrepo.h>
 
 #include "common.h"
+#include "authkeys_cache.h"
+#include "keystore_cache.h"
 #include "log.h"
 #include "netconf_server.h"
 
@@ -37,140 +39,15 @@ int
 np2srv_hostkey_cb(const char *name, void *UNUSED(user_data), char **UNUSED(privkey_path), char **privkey_data,
         NC_SSH_KEY_TYPE *privkey_type)
 {
-    sr_session_ctx_t *sr_sess;
-    char *xpath;
-    struct lyd_node *data = NULL;
-    int r, rc = -1;
-
-    r = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, &sr_sess);
-    if (r != SR_ERR_OK) {
-        return -1;
-    }
-
-    /* get hostkey data from sysrepo */
-    if (asprintf(&xpath, "/ietf-keystore:keystore/asymmetric-keys/asymmetric-key[name='%s']", name) == -1) {
-        EMEM;
-        goto cleanup;
-    }
-    r = sr_get_subtree(sr_sess, xpath, 0, &data);
-    free(xpath);
-    if (r != SR_ERR_OK) {
-        goto cleanup;
-    } else if (!data) {
-        ERR("Hostkey \"%s\" not found.", name);
-        goto cleanup;
-    }
-
-    /* parse private key values */
-    if (np2srv_sr_get_privkey(data, privkey_data, privkey_type)) {
-        goto cleanup;
-    }
-
-    /* success */
-    rc = 0;
-
-cleanup:
-    lyd_free_withsiblings(data);
-    sr_session_stop(sr_sess);
-    return rc;
+    /* parsed keys are cached and updated on every keystore change */
+    return np_keystore_cache_privkey(name, privkey_data, privkey_type);
 }
 
 int
 np2srv_pubkey_auth_cb(const struct nc_session *session, ssh_key key, void *UNUSED(user_data))
 {
-    FILE *f = NULL;
-    struct passwd *pwd;
-    ssh_key pub_key = NULL;
-    enum ssh_keytypes_e ktype;
-    const char *username;
-    char *line = NULL, *ptr, *ptr2;
-    size_t n;
-    int r, ret = 1, line_num = 0;
-
-    username = nc_session_get_username(session);
-
-    errno = 0;
-    pwd = getpwnam(username);
-    if (!pwd) {
-        ERR("Failed to find user entry for \"%s\" (%s).", username, errno ? strerror(errno) : "User not found");
-        goto cleanup;
-    }
-
-    /* check any authorized keys */
-    r = asprintf(&line, "%s/.ssh/authorized_keys", pwd->pw_dir);
-    if (r == -1) {
-        EMEM;
-        line = NULL;
-        goto cleanup;
-    }
-    n = r;
-
-    f = fopen(line, "r");
-    if (!f) {
-        if (errno == ENOENT) {
-            VRB("User \"%s\" has no authorized_keys file.");
-        } else {
-            ERR("Failed to open \"%s\" authorized_keys file (%s).", strerror(errno));
-        }
-        goto cleanup;
-    }
-
-    while (getline(&line, &n, f) > -1) {
-        ++line_num;
-
-        /* separate key type */
-        ptr = line;
-        for (ptr2 = ptr; !isspace(ptr2[0]); ++ptr2);
-        if (ptr2[0] == '\0') {
-            WRN("Invalid authorized key format of \"%s\" (line %d).", username, line_num);
-            continue;
-        }
-        ptr2[0] = '\0';
-
-        /* detect key type */
-        ktype = ssh_key_type_from_name(ptr);
-        if (ktype == SSH_KEYTYPE_UNKNOWN) {
-            WRN("Unknown key type \"%s\" (line %d).", ptr, line_num);
-            continue;
-        }
-
-        /* separate key data */
-        ptr = ptr2 + 1;
-        for (ptr2 = ptr; !isspace(ptr2[0]); ++ptr2);
-        ptr2[0] = '\0';
-
-        r = ssh_pki_import_pubkey_base64(ptr, ktype, &pub_key);
-        if (r != SSH_OK) {
-            WRN("Failed to import authorized key of \"%s\" (%s, line %d).",
-                    username, r == SSH_EOF ? "Unexpected end-of-file" : "SSH error", line_num);
-            continue;
-        }
-
-        /* compare public keys */
-        if (!ssh_key_cmp(key, pub_key, SSH_KEY_CMP_PUBLIC)) {
-            /* key matches */
-            ret = 0;
-            goto cleanup;
-        }
-
-        /* not a match, next key */
-        ssh_key_free(pub_key);
-        pub_key = NULL;
-    }
-    if (!feof(f)) {
-        WRN("Failed reading from authorized_keys file of \"%s\".", username);
-        goto cleanup;
-    }
-
-    /* no match */
-
-cleanup:
-    if (f) {
-        fclose(f);
-    }
-    free(line);
-    ssh_key_free(pub_key);
-    return ret;
+    /* authorized keys are cached and indexed, the file is parsed again only when changed */
+    return np_authkeys_check(nc_session_get_username(session), key);
 }
 
 /* /ietf-netconf-server:netconf-server/listen/endpoint/ssh */
@@ -356,41 +233,37 @@ np2srv_endpt_ssh_auth_methods_cb(sr_session_ctx_t *session, const char *UNUSED(m
     return SR_ERR_OK;
 }
 
+/**
+ * @brief Authorized keys of a user being created.
+ */
+struct np2srv_user_keys {
+    struct lyd_node *user;
+    uint8_t key_idx;
+};
+
 static int
-np2srv_user_add_auth_key(const char *alg, size_t alg_len, const char *key, size_t key_len, struct lyd_node *user,
-        uint8_t *key_idx)
+np2srv_user_add_auth_key(const char *alg, const char *key, void *cb_data)
 {
-    char name[7], *str;
+    struct np2srv_user_keys *keys = cb_data;
+    char name[7];
     struct lyd_node *authkey;
 
-    authkey = lyd_new(user, NULL, "authorized-key");
+    authkey = lyd_new(keys->user, NULL, "authorized-key");
     if (!authkey) {
         return -1;
     }
 
     /* name */
-    sprintf(name, "key%d", (*key_idx)++);
+    sprintf(name, "key%d", keys->key_idx++);
     if (!lyd_new_leaf(authkey, NULL, "name", name)) {
         return -1;
     }
 
     /* algorithm */
-    str = strndup(alg, alg_len);
-    if (!str) {
-        EMEM;
-        return -1;
-    }
-    lyd_new_leaf(authkey, NULL, "algorithm", str);
-    free(str);
+    lyd_new_leaf(authkey, NULL, "algorithm", alg);
 
     /* key-data */
-    str = strndup(key, key_len);
-    if (!str) {
-        EMEM;
-        return -1;
-    }
-    lyd_new_leaf(authkey, NULL, "key-data", str);
-    free(str);
+    lyd_new_leaf(authkey, NULL, "key-data", key);
 
     return 0;
 }
@@ -404,12 +277,9 @@ np2srv_endpt_ssh_auth_users_oper_cb(sr_session_ctx_t *UNUSED(session), const cha
         void *UNUSED(private_data))
 {
     struct passwd *pwd;
-    struct lyd_node *users, *user;
-    char *path, *line = NULL, *ptr, *alg, *data;
-    size_t line_len = 0;
-    FILE *f = NULL;
+    struct lyd_node *users;
+    struct np2srv_user_keys keys;
     int rc = SR_ERR_INTERNAL;
-    uint8_t key_idx;
 
     users = lyd_new(*parent, NULL, "users");
     if (!users) {
@@ -418,83 +288,23 @@ np2srv_endpt_ssh_auth_users_oper_cb(sr_session_ctx_t *UNUSED(session), const cha
 
     while ((pwd = getpwent())) {
         /* create user with name */
-        user = lyd_new(users, NULL, "user");
-        if (!user) {
-            return SR_ERR_INTERNAL;
-        }
-        lyd_new_leaf(user, NULL, "name", pwd->pw_name);
-
-        /* check any authorized keys */
-        if (asprintf(&path, "%s/.ssh/authorized_keys", pwd->pw_dir) == -1) {
-            EMEM;
+        keys.user = lyd_new(users, NULL, "user");
+        if (!keys.user) {
             goto cleanup;
         }
-        f = fopen(path, "r");
-        free(path);
-        if (!f) {
-            if (errno != ENOENT) {
-                ERR("Opening \"%s\" authorized key file failed (%s).", strerror(errno));
-                goto cleanup;
-            }
-            continue;
-        }
-
-        /* create authorized keys */
-        key_idx = 1;
-        while (getline(&line, &line_len, f) != -1) {
-            if ((line[0] == '\0') || (line[0] == '#')) {
-                continue;
-            }
-
-            /* find algorithm */
-            ptr = line;
-            while (strncmp(ptr, "ssh-dss", 7) && strncmp(ptr, "ssh-rsa", 7) && strncmp(ptr, "ecdsa", 5)) {
-                ptr = strchr(ptr, ' ');
-                if (!ptr) {
-                    break;
-                }
-                ++ptr;
-            }
-            if (!ptr) {
-                /* unrecognized line */
-                continue;
-            }
-            alg = ptr;
+        lyd_new_leaf(keys.user, NULL, "name", pwd->pw_name);
 
-            /* find data */
-            ptr = strchr(ptr, ' ');
-            if (!ptr) {
-                /* unrecognized line */
-                continue;
-            }
-
-            ++ptr;
-            data = ptr;
-            if (!(ptr = strchr(data, ' ')) && !(ptr = strchr(data, '\n'))) {
-                ptr = data + strlen(data);
-            }
-
-            /* create new authorized key */
-            if (np2srv_user_add_auth_key(alg, strchr(alg, ' ') - alg, data, ptr - data, user, &key_idx)) {
-                goto cleanup;
-            }
-        }
-        if (ferror(f)) {
-            ERR("Reading from an authorized keys file failed (%s).", strerror(errno));
+        /* create authorized keys, from the file only if it changed */
+        keys.key_idx = 1;
+        if (np_authkeys_foreach(pwd->pw_name, pwd->pw_dir, np2srv_user_add_auth_key, &keys)) {
             goto cleanup;
         }
-        fclose(f);
-        f = NULL;
     }
 
     /* success */
     rc = SR_ERR_OK;
 
 cleanup:
-    free(line);
-    if (f) {
-        fclose(f);
-    }
     endpwent();
     return rc;
 }
@@ -23,6 +23,7 @@
 #include <sysrepo.h>
 
 #include "common.h"
+#include "keystore_cache.h"
 #include "log.h"
 #include "netconf_server.h"
 
@@ -30,136 +31,16 @@ int
 np2srv_cert_cb(const char *name, void *UNUSED(user_data), char **UNUSED(cert_path), char **cert_data,
         char **UNUSED(privkey_path), char **privkey_data, NC_SSH_KEY_TYPE *privkey_type)
 {
-    sr_session_ctx_t *sr_sess;
-    char *xpath;
-    struct lyd_node *data = NULL;
-    int r, rc = -1;
-
-    r = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, &sr_sess);
-    if (r != SR_ERR_OK) {
-        return -1;
-    }
-
-    /* get private key data from sysrepo */
-    if (asprintf(&xpath, "/ietf-keystore:keystore/asymmetric-keys/asymmetric-key[certificates/certificate/name='%s']", name) == -1) {
-        EMEM;
-        goto cleanup;
-    }
-    r = sr_get_subtree(sr_sess, xpath, 0, &data);
-    free(xpath);
-    if (r != SR_ERR_OK) {
-        goto cleanup;
-    } else if (!data) {
-        ERR("Server certificate \"%s\" not found.", name);
-        goto cleanup;
-    }
-
-    /* parse private key values */
-    if (np2srv_sr_get_privkey(data, privkey_data, privkey_type)) {
-        goto cleanup;
-    }
-
-    /* get cert data from sysrepo */
-    if (asprintf(&xpath, "/ietf-keystore:keystore/asymmetric-keys/asymmetric-key/certificates/"
-                "certificate[name='%s']/cert", name) == -1) {
-        EMEM;
-        goto cleanup;
-    }
-    lyd_free_withsiblings(data);
-    r = sr_get_subtree(sr_sess, xpath, 0, &data);
-    free(xpath);
-    if (r != SR_ERR_OK) {
-        goto cleanup;
-    } else if (!data) {
-        ERR("Server certificate \"%s\" not found.", name);
-        goto cleanup;
-    }
-
-    /* set cert data */
-    *cert_data = strdup(((struct lyd_node_leaf_list *)data)->value_str);
-    if (!*cert_data) {
-        EMEM;
-        goto cleanup;
-    }
-
-    /* success */
-    rc = 0;
-
-cleanup:
-    lyd_free_withsiblings(data);
-    sr_session_stop(sr_sess);
-    return rc;
+    /* parsed certificates are cached and updated on every keystore change */
+    return np_keystore_cache_cert(name, cert_data, privkey_data, privkey_type);
 }
 
 int
 np2srv_cert_list_cb(const char *name, void *UNUSED(user_data), char ***UNUSED(cert_paths), int *UNUSED(cert_path_count),
         char ***cert_data, int *cert_data_count)
 {
-    sr_session_ctx_t *sr_sess;
-    char *xpath;
-    struct lyd_node *data = NULL;
-    struct ly_set *set = NULL;
-    int r, rc = -1;
-    uint32_t i, j;
-
-    r = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, &sr_sess);
-    if (r != SR_ERR_OK) {
-        return -1;
-    }
-
-    /* get cert list data from sysrepo */
-    if (asprintf(&xpath, "/ietf-truststore:truststore/certificates[name='%s']", name) == -1) {
-        EMEM;
-        goto cleanup;
-    }
-    r = sr_get_subtree(sr_sess, xpath, 0, &data);
-    free(xpath);
-    if (r != SR_ERR_OK) {
-        goto cleanup;
-    } else if (!data) {
-        ERR("Certificate list \"%s\" not found.", name);
-        goto cleanup;
-    }
-
-    /* find all certificates */
-    set = lyd_find_path(data, "certificate/cert");
-    if (!set) {
-        /* libyang error printed */
-        goto cleanup;
-    } else if (!set->number) {
-        WRN("Certificate list \"%s\" does not define any actual certificates.");
-        rc = 0;
-        goto cleanup;
-    }
-
-    *cert_data = malloc(set->number * sizeof **cert_data);
-    if (!*cert_data) {
-        EMEM;
-        goto cleanup;
-    }
-
-    /* collect all cert data */
-    for (i = 0; i < set->number; ++i) {
-        (*cert_data)[i] = strdup(((struct lyd_node_leaf_list *)set->set.d[i])->value_str);
-        if (!(*cert_data)[i]) {
-            EMEM;
-            for (j = 0; j < i - 1; ++j) {
-                free((*cert_data)[i]);
-            }
-            free(*cert_data);
-            goto cleanup;
-        }
-    }
-    *cert_data_count = set->number;
-
-    /* success */
-    rc = 0;
-
-cleanup:
-    lyd_free_withsiblings(data);
-    ly_set_free(set);
-    sr_session_stop(sr_sess);
-    return rc;
+    /* certificate lists are cached and updated on every truststore change */
+    return np_keystore_cache_cert_list(name, cert_data, cert_data_count);
 }
 
 /* /ietf-netconf-server:netconf-server/listen/endpoint/tls */
@@ -0,0 +1,818 @@
+/**
+ * @file notif_fanout.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server delivery of notifications to many sessions
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+#include <nc_server.h>
+#include <sysrepo.h>
+
+#include "common.h"
+#include "log.h"
+#include "netconf_acm.h"
+#include "netconf_monitoring.h"
+#include "notif_fanout.h"
+#include "rpc_stats.h"
+#include "schema_index.h"
+
+/**
+ * @brief Session subscribed to the notifications of a module.
+ */
+struct np_ntf_sub {
+    struct nc_session *ncs;     /**< NETCONF session */
+    char *xpath;                /**< notification filter, NULL if none */
+};
+
+/**
+ * @brief Fan-out of the notifications of a module.
+ */
+struct np_ntf_module {
+    char *name;                 /**< module name */
+    struct np_ntf_sub *subs;    /**< subscribed sessions */
+    uint32_t sub_count;         /**< number of subscribed sessions */
+};
+
+static struct {
+    pthread_rwlock_t lock;      /**< lock for the modules and their sessions */
+    pthread_mutex_t sub_lock;   /**< lock for creating sysrepo subscriptions */
+    struct np_ntf_module *mods; /**< modules with a sysrepo subscription */
+    uint32_t mod_count;         /**< number of modules */
+    sr_subscription_ctx_t *sr_sub;  /**< sysrepo subscription of all the modules */
+    struct np_ntf_sub *all_subs;    /**< sessions subscribed to the notifications of all the modules */
+    uint32_t all_sub_count;     /**< number of sessions subscribed to all the modules */
+    int all_subscribed;         /**< whether all the modules with notifications are subscribed to */
+    uint16_t all_set_id;        /**< module set ID when all the modules were subscribed to */
+
+    ATOMIC_T queue_limit;       /**< maximum number of queued notifications of a session */
+    ATOMIC_T overflow;          /**< enum np_ntf_overflow policy of a full queue */
+
+    pthread_mutex_t msg_lock;   /**< lock for the shared notification reference counts */
+
+    pthread_mutex_t pend_lock;  /**< lock for the pending sessions */
+    uint32_t *pend_ids;         /**< ring buffer of NETCONF IDs of sessions waiting for a worker thread */
+    uint32_t pend_size;         /**< allocated size of the ring buffer */
+    uint32_t pend_head;         /**< index of the first pending session */
+    ATOMIC_T pend_count;        /**< number of pending sessions */
+} fanout = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+    .sub_lock = PTHREAD_MUTEX_INITIALIZER,
+    .queue_limit = NP2SRV_NOTIF_QUEUE_LIMIT,
+    .overflow = NP_NTF_DROP_OLDEST,
+    .msg_lock = PTHREAD_MUTEX_INITIALIZER,
+    .pend_lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/**
+ * @brief Make space for one more item in a ring buffer, its items are moved to its beginning when enlarged.
+ *
+ * @param[in,out] buf Ring buffer.
+ * @param[in,out] size Allocated size of the ring buffer.
+ * @param[in,out] head Index of the first item.
+ * @param[in] count Number of items.
+ * @param[in] item_size Size of one item.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_ring_reserve(void **buf, uint32_t *size, uint32_t *head, uint32_t count, size_t item_size)
+{
+    unsigned char *new_buf;
+    uint32_t new_size, first_part;
+
+    if (count < *size) {
+        return 0;
+    }
+
+    new_size = *size ? *size * 2 : 8;
+    new_buf = malloc(new_size * item_size);
+    if (!new_buf) {
+        EMEM;
+        return -1;
+    }
+
+    /* copy the items in their order */
+    first_part = *size - *head;
+    if (first_part > count) {
+        first_part = count;
+    }
+    if (count) {
+        memcpy(new_buf, (unsigned char *)*buf + *head * item_size, first_part * item_size);
+        memcpy(new_buf + first_part * item_size, *buf, (count - first_part) * item_size);
+    }
+
+    free(*buf);
+    *buf = new_buf;
+    *size = new_size;
+    *head = 0;
+    return 0;
+}
+
+/**
+ * @brief Release a shared notification reference.
+ *
+ * @param[in] msg Shared notification.
+ */
+static void
+np_ntf_msg_release(struct np_ntf_msg *msg)
+{
+    uint32_t refcount;
+
+    pthread_mutex_lock(&fanout.msg_lock);
+    refcount = --msg->refcount;
+    pthread_mutex_unlock(&fanout.msg_lock);
+
+    if (!refcount) {
+        nc_server_notif_free(msg->nc_ntf);
+        lyd_free_withsiblings(msg->notif);
+        free(msg);
+    }
+}
+
+/**
+ * @brief Create a shared notification from a prepared one.
+ *
+ * @param[in] ntf Prepared notification.
+ * @return Shared notification with one reference for the prepared notification, NULL on error.
+ */
+static struct np_ntf_msg *
+np_ntf_msg_new(struct np_ntf *ntf)
+{
+    struct np_ntf_msg *msg;
+
+    msg = calloc(1, sizeof *msg);
+    if (!msg) {
+        EMEM;
+        return NULL;
+    }
+    msg->refcount = 1;
+
+    /* the notification must outlive the sysrepo callback */
+    msg->notif = lyd_dup(ntf->notif, LYD_DUP_OPT_RECURSIVE);
+    if (!msg->notif) {
+        free(msg);
+        return NULL;
+    }
+
+    nc_time2datetime(ntf->timestamp, NULL, msg->eventtime);
+    msg->nc_ntf = nc_server_notif_new(msg->notif, msg->eventtime, NC_PARAMTYPE_CONST);
+    if (!msg->nc_ntf) {
+        lyd_free_withsiblings(msg->notif);
+        free(msg);
+        return NULL;
+    }
+    msg->queued = np2srv_rpc_stats_now();
+
+    return msg;
+}
+
+/**
+ * @brief Add a session among those waiting for a worker thread.
+ *
+ * @param[in] nc_id NETCONF ID of the session.
+ */
+static void
+np_ntf_pending_add(uint32_t nc_id)
+{
+    uint32_t count;
+
+    pthread_mutex_lock(&fanout.pend_lock);
+    count = ATOMIC_LOAD_RELAXED(fanout.pend_count);
+    if (!np_ring_reserve((void **)&fanout.pend_ids, &fanout.pend_size, &fanout.pend_head, count, sizeof *fanout.pend_ids)) {
+        fanout.pend_ids[(fanout.pend_head + count) % fanout.pend_size] = nc_id;
+        ATOMIC_STORE_RELAXED(fanout.pend_count, count + 1);
+    }
+    pthread_mutex_unlock(&fanout.pend_lock);
+}
+
+/**
+ * @brief Take the first session waiting for a worker thread.
+ *
+ * @return NETCONF ID of the session, 0 if there is none.
+ */
+static uint32_t
+np_ntf_pending_take(void)
+{
+    uint32_t nc_id = 0, count;
+
+    pthread_mutex_lock(&fanout.pend_lock);
+    count = ATOMIC_LOAD_RELAXED(fanout.pend_count);
+    if (count) {
+        nc_id = fanout.pend_ids[fanout.pend_head];
+        fanout.pend_head = (fanout.pend_head + 1) % fanout.pend_size;
+        ATOMIC_STORE_RELAXED(fanout.pend_count, count - 1);
+    }
+    pthread_mutex_unlock(&fanout.pend_lock);
+
+    return nc_id;
+}
+
+void
+np_ntf_prepare(struct np_ntf *ntf, const struct lyd_node *notif, time_t timestamp)
+{
+    memset(ntf, 0, sizeof *ntf);
+
+    /* find the top-level node */
+    while (notif->parent) {
+        notif = notif->parent;
+    }
+    ntf->notif = notif;
+    ntf->timestamp = timestamp;
+}
+
+/**
+ * @brief Learn whether a prepared notification matches a filter, each filter is evaluated only once.
+ *
+ * @param[in] ntf Prepared notification.
+ * @param[in] xpath Filter.
+ * @return non-zero if it matches, 0 if not.
+ */
+static int
+np_ntf_filter_match(struct np_ntf *ntf, const char *xpath)
+{
+    struct ly_set *set;
+    uint32_t i;
+    void *mem;
+    int match;
+
+    for (i = 0; i < ntf->filter_count; ++i) {
+        if (!strcmp(ntf->filters[i].xpath, xpath)) {
+            return ntf->filters[i].match;
+        }
+    }
+
+    set = lyd_find_path(ntf->notif, xpath);
+    match = (set && set->number) ? 1 : 0;
+    ly_set_free(set);
+
+    /* remember the result, not an error if it fails */
+    mem = realloc(ntf->filters, (ntf->filter_count + 1) * sizeof *ntf->filters);
+    if (mem) {
+        ntf->filters = mem;
+        ntf->filters[ntf->filter_count].xpath = xpath;
+        ntf->filters[ntf->filter_count].match = match;
+        ++ntf->filter_count;
+    }
+
+    return match;
+}
+
+int
+np_ntf_enqueue(struct np_ntf *ntf, struct nc_session *ncs, const char *xpath, int stop)
+{
+    struct np2srv_sess *sess = nc_session_get_data(ncs);
+    struct np_ntf_queue *queue = &sess->ntf_queue;
+    struct np_ntf_entry *entry;
+    uint32_t limit;
+    int ret = 0, add_pending = 0;
+
+    /* check filter */
+    if (xpath && !np_ntf_filter_match(ntf, xpath)) {
+        return 1;
+    }
+
+    /* check NACM */
+    if (!ncac_check_notif_memo(ntf->notif, sess->nacm_user, &ntf->nacm)) {
+        return 1;
+    }
+
+    if (!ntf->msg) {
+        ntf->msg = np_ntf_msg_new(ntf);
+        if (!ntf->msg) {
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->closed) {
+        ret = 1;
+        goto cleanup;
+    }
+
+    limit = ATOMIC_LOAD_RELAXED(fanout.queue_limit);
+    if (!stop && (queue->count >= limit)) {
+        /* the last notification of a subscription is never dropped */
+        ATOMIC_INC_FENCE(queue->dropped);
+        switch (ATOMIC_LOAD_RELAXED(fanout.overflow)) {
+        case NP_NTF_DROP_OLDEST:
+            entry = &queue->entries[queue->head];
+            if (!entry->stop) {
+                np_ntf_msg_release(entry->msg);
+                queue->head = (queue->head + 1) % queue->size;
+                --queue->count;
+                break;
+            }
+            /* fallthrough */
+        case NP_NTF_DROP_NEWEST:
+            ret = 1;
+            goto cleanup;
+        case NP_NTF_TERMINATE:
+            WRN("Session %d notification queue is full, terminating it.", nc_session_get_id(ncs));
+            nc_session_set_status(ncs, NC_STATUS_INVALID);
+            nc_session_set_term_reason(ncs, NC_SESSION_TERM_OTHER);
+            ret = 1;
+            goto cleanup;
+        }
+    }
+
+    if (np_ring_reserve((void **)&queue->entries, &queue->size, &queue->head, queue->count, sizeof *queue->entries)) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    pthread_mutex_lock(&fanout.msg_lock);
+    ++ntf->msg->refcount;
+    pthread_mutex_unlock(&fanout.msg_lock);
+
+    entry = &queue->entries[(queue->head + queue->count) % queue->size];
+    entry->msg = ntf->msg;
+    entry->stop = stop;
+    ++queue->count;
+    ATOMIC_STORE_RELAXED(queue->depth, queue->count);
+
+    if (!queue->pending && !queue->sending) {
+        /* a worker thread will send it */
+        queue->pending = 1;
+        add_pending = 1;
+    }
+
+cleanup:
+    pthread_mutex_unlock(&queue->lock);
+    if (add_pending) {
+        np_ntf_pending_add(nc_session_get_id(ncs));
+    }
+    return ret;
+}
+
+void
+np_ntf_clear(struct np_ntf *ntf)
+{
+    if (ntf->msg) {
+        np_ntf_msg_release(ntf->msg);
+    }
+    ncac_notif_memo_clear(&ntf->nacm);
+    free(ntf->filters);
+    memset(ntf, 0, sizeof *ntf);
+}
+
+void
+np_ntf_queue_init(struct np_ntf_queue *queue)
+{
+    memset(queue, 0, sizeof *queue);
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+}
+
+void
+np_ntf_queue_close(struct np_ntf_queue *queue)
+{
+    uint32_t i;
+
+    pthread_mutex_lock(&queue->lock);
+    queue->closed = 1;
+    while (queue->sending) {
+        pthread_cond_wait(&queue->cond, &queue->lock);
+    }
+
+    for (i = 0; i < queue->count; ++i) {
+        np_ntf_msg_release(queue->entries[(queue->head + i) % queue->size].msg);
+    }
+    free(queue->entries);
+    queue->entries = NULL;
+    queue->count = 0;
+    pthread_mutex_unlock(&queue->lock);
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->cond);
+}
+
+void
+np_ntf_queue_flush(void)
+{
+    struct np2srv_sess *sess;
+    struct np_ntf_queue *queue;
+    struct np_ntf_entry entry;
+    NC_MSG_TYPE msg_type;
+    uint32_t nc_id, i;
+    uint64_t wait;
+    int add_pending = 0;
+
+    if (!ATOMIC_LOAD_RELAXED(fanout.pend_count) || !(nc_id = np_ntf_pending_take())) {
+        return;
+    }
+
+    /* the session cannot be freed once it is being sent to */
+    pthread_rwlock_rdlock(&np2srv.sessions_lock);
+    sess = np_sessions_find(nc_id);
+    if (!sess) {
+        pthread_rwlock_unlock(&np2srv.sessions_lock);
+        return;
+    }
+    queue = &sess->ntf_queue;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->closed) {
+        pthread_mutex_unlock(&queue->lock);
+        pthread_rwlock_unlock(&np2srv.sessions_lock);
+        return;
+    }
+    queue->pending = 0;
+    queue->sending = 1;
+    pthread_mutex_unlock(&queue->lock);
+    pthread_rwlock_unlock(&np2srv.sessions_lock);
+
+    /* send a batch so that other sessions are not delayed by this one */
+    for (i = 0; i < NP2SRV_NOTIF_SEND_BATCH; ++i) {
+        pthread_mutex_lock(&queue->lock);
+        if (!queue->count || queue->closed) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        entry = queue->entries[queue->head];
+        queue->head = (queue->head + 1) % queue->size;
+        --queue->count;
+        ATOMIC_STORE_RELAXED(queue->depth, queue->count);
+        pthread_mutex_unlock(&queue->lock);
+
+        /* only the sending thread updates it */
+        wait = np2srv_rpc_stats_now() - entry.msg->queued;
+        np2srv_rpc_stats_notif_wait(wait);
+        if (wait > ATOMIC_LOAD_RELAXED(queue->max_wait)) {
+            ATOMIC_STORE_RELAXED(queue->max_wait, wait > UINT32_MAX ? UINT32_MAX : wait);
+        }
+
+        msg_type = nc_server_notif_send(sess->nc_sess, entry.msg->nc_ntf, NP2SRV_NOTIF_SEND_TIMEOUT);
+        np_ntf_msg_release(entry.msg);
+        if ((msg_type == NC_MSG_ERROR) || (msg_type == NC_MSG_WOULDBLOCK)) {
+            ERR("Sending a notification to session %d %s.", nc_id, msg_type == NC_MSG_ERROR ? "failed" : "timed out");
+            ATOMIC_INC_FENCE(queue->dropped);
+            if (msg_type == NC_MSG_ERROR) {
+                break;
+            }
+            continue;
+        }
+        ncm_session_notification(sess->nc_sess);
+
+        if (entry.stop) {
+            /* subscription finished */
+            nc_session_set_notif_status(sess->nc_sess, 0);
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    queue->sending = 0;
+    if (queue->count && !queue->closed) {
+        /* continue later */
+        queue->pending = 1;
+        add_pending = 1;
+    }
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+
+    if (add_pending) {
+        np_ntf_pending_add(nc_id);
+    }
+}
+
+/* /netopeer2-monitoring:netopeer2-server/notifications */
+int
+np_ntf_queue_config_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    sr_change_iter_t *iter;
+    sr_change_oper_t op;
+    const struct lyd_node *node;
+    const char *prev_val, *prev_list, *policy;
+    bool prev_dflt;
+    int rc;
+
+    rc = sr_get_changes_iter(session, xpath, &iter);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting changes iter failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
+        if ((op != SR_OP_CREATED) && (op != SR_OP_MODIFIED)) {
+            /* both leaves have a default value */
+            continue;
+        }
+
+        if (!strcmp(node->schema->name, "queue-limit")) {
+            ATOMIC_STORE_RELAXED(fanout.queue_limit, ((struct lyd_node_leaf_list *)node)->value.uint32);
+        } else if (!strcmp(node->schema->name, "overflow-policy")) {
+            policy = ((struct lyd_node_leaf_list *)node)->value_str;
+            if (!strcmp(policy, "drop-oldest")) {
+                ATOMIC_STORE_RELAXED(fanout.overflow, NP_NTF_DROP_OLDEST);
+            } else if (!strcmp(policy, "drop-newest")) {
+                ATOMIC_STORE_RELAXED(fanout.overflow, NP_NTF_DROP_NEWEST);
+            } else {
+                ATOMIC_STORE_RELAXED(fanout.overflow, NP_NTF_TERMINATE);
+            }
+        }
+    }
+    sr_free_change_iter(iter);
+    if (rc != SR_ERR_NOT_FOUND) {
+        ERR("Getting next change failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Find a module fan-out, lock must be held.
+ *
+ * @param[in] name Module name.
+ * @return Module fan-out, NULL if not found.
+ */
+static struct np_ntf_module *
+np_ntf_fanout_find(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < fanout.mod_count; ++i) {
+        if (!strcmp(fanout.mods[i].name, name)) {
+            return &fanout.mods[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Queue a notification on all the sessions in an array.
+ */
+static void
+np_ntf_fanout_subs(struct np_ntf *ntf, struct np_ntf_sub *subs, uint32_t sub_count)
+{
+    uint32_t i;
+
+    for (i = 0; i < sub_count; ++i) {
+        np_ntf_enqueue(ntf, subs[i].ncs, subs[i].xpath, 0);
+    }
+}
+
+/**
+ * @brief Callback of the shared sysrepo subscriptions, queues a notification on all the subscribed sessions.
+ */
+static void
+np_ntf_fanout_cb(sr_session_ctx_t *UNUSED(session), const sr_ev_notif_type_t UNUSED(notif_type),
+        const struct lyd_node *notif, time_t timestamp, void *UNUSED(private_data))
+{
+    struct np_ntf_module *mod;
+    struct np_ntf ntf;
+
+    np_ntf_prepare(&ntf, notif, timestamp);
+
+    pthread_rwlock_rdlock(&fanout.lock);
+    mod = np_ntf_fanout_find(lyd_node_module(ntf.notif)->name);
+    if (mod) {
+        np_ntf_fanout_subs(&ntf, mod->subs, mod->sub_count);
+    }
+    np_ntf_fanout_subs(&ntf, fanout.all_subs, fanout.all_sub_count);
+    pthread_rwlock_unlock(&fanout.lock);
+
+    np_ntf_clear(&ntf);
+}
+
+/**
+ * @brief Get the fan-out of a module, subscribe to its notifications if not yet, sub lock must be held.
+ *
+ * @param[in] module_name Module name.
+ * @param[out] mod Module fan-out.
+ * @return Sysrepo error value.
+ */
+static int
+np_ntf_fanout_module(const char *module_name, struct np_ntf_module **mod)
+{
+    void *mem;
+    int rc;
+
+    /* the array of modules is changed only with sub lock held */
+    *mod = np_ntf_fanout_find(module_name);
+    if (*mod) {
+        return SR_ERR_OK;
+    }
+
+    /* create the module record first so that a subscription without it cannot exist */
+    pthread_rwlock_wrlock(&fanout.lock);
+    mem = realloc(fanout.mods, (fanout.mod_count + 1) * sizeof *fanout.mods);
+    if (!mem) {
+        pthread_rwlock_unlock(&fanout.lock);
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+    fanout.mods = mem;
+    *mod = &fanout.mods[fanout.mod_count];
+    memset(*mod, 0, sizeof **mod);
+    (*mod)->name = strdup(module_name);
+    if (!(*mod)->name) {
+        pthread_rwlock_unlock(&fanout.lock);
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+    ++fanout.mod_count;
+    pthread_rwlock_unlock(&fanout.lock);
+
+    /* subscribe without holding the lock, the callback may be called meanwhile */
+    rc = sr_event_notif_subscribe_tree(np2srv.sr_sess, module_name, NULL, 0, 0, np_ntf_fanout_cb, NULL,
+            fanout.sr_sub ? SR_SUBSCR_CTX_REUSE : 0, &fanout.sr_sub);
+    if (rc != SR_ERR_OK) {
+        ERR("Subscribing for \"%s\" notifications failed (%s).", module_name, sr_strerror(rc));
+
+        /* remove the record, it is still the last one */
+        pthread_rwlock_wrlock(&fanout.lock);
+        --fanout.mod_count;
+        free(fanout.mods[fanout.mod_count].name);
+        pthread_rwlock_unlock(&fanout.lock);
+        *mod = NULL;
+        return rc;
+    }
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Add a session into an array of subscribed sessions, lock must be held.
+ *
+ * @return Sysrepo error value.
+ */
+static int
+np_ntf_fanout_sub_add(struct np_ntf_sub **subs, uint32_t *sub_count, struct nc_session *ncs, const char *xpath)
+{
+    void *mem;
+
+    mem = realloc(*subs, (*sub_count + 1) * sizeof **subs);
+    if (!mem) {
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+    *subs = mem;
+
+    (*subs)[*sub_count].ncs = ncs;
+    (*subs)[*sub_count].xpath = NULL;
+    if (xpath) {
+        (*subs)[*sub_count].xpath = strdup(xpath);
+        if (!(*subs)[*sub_count].xpath) {
+            EMEM;
+            return SR_ERR_NOMEM;
+        }
+    }
+    ++(*sub_count);
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Remove a session from an array of subscribed sessions, lock must be held.
+ */
+static void
+np_ntf_fanout_sub_del(struct np_ntf_sub *subs, uint32_t *sub_count, struct nc_session *ncs)
+{
+    uint32_t i;
+
+    for (i = 0; i < *sub_count; ) {
+        if (subs[i].ncs != ncs) {
+            ++i;
+            continue;
+        }
+
+        free(subs[i].xpath);
+        --(*sub_count);
+        if (i < *sub_count) {
+            subs[i] = subs[*sub_count];
+        }
+    }
+}
+
+int
+np_ntf_fanout_add(struct nc_session *ncs, const char *module_name, const char *xpath)
+{
+    struct np_ntf_module *mod;
+    int rc;
+
+    /* only one thread may be creating a subscription */
+    pthread_mutex_lock(&fanout.sub_lock);
+
+    rc = np_ntf_fanout_module(module_name, &mod);
+    if (rc != SR_ERR_OK) {
+        goto cleanup;
+    }
+
+    pthread_rwlock_wrlock(&fanout.lock);
+    rc = np_ntf_fanout_sub_add(&mod->subs, &mod->sub_count, ncs, xpath);
+    pthread_rwlock_unlock(&fanout.lock);
+
+cleanup:
+    pthread_mutex_unlock(&fanout.sub_lock);
+    return rc;
+}
+
+int
+np_ntf_fanout_add_all(struct nc_session *ncs, const struct ly_ctx *ly_ctx, const char *xpath)
+{
+    struct np_ntf_module *mod;
+    const struct lys_module **mods;
+    uint32_t i, mod_count;
+    int rc = SR_ERR_OK;
+
+    pthread_mutex_lock(&fanout.sub_lock);
+
+    if (np_schema_index_rdlock(ly_ctx)) {
+        rc = SR_ERR_INTERNAL;
+        goto cleanup;
+    }
+    if (!fanout.all_subscribed || (fanout.all_set_id != np_schema_index_module_set_id())) {
+        /* subscribe to all the modules with notifications, there may be new ones */
+        mods = np_schema_index_notif_modules(&mod_count);
+        for (i = 0; i < mod_count; ++i) {
+            rc = np_ntf_fanout_module(mods[i]->name, &mod);
+            if (rc != SR_ERR_OK) {
+                break;
+            }
+        }
+        if (rc == SR_ERR_OK) {
+            fanout.all_subscribed = 1;
+            fanout.all_set_id = np_schema_index_module_set_id();
+        }
+    }
+    np_schema_index_unlock();
+    if (rc != SR_ERR_OK) {
+        goto cleanup;
+    }
+
+    pthread_rwlock_wrlock(&fanout.lock);
+    rc = np_ntf_fanout_sub_add(&fanout.all_subs, &fanout.all_sub_count, ncs, xpath);
+    pthread_rwlock_unlock(&fanout.lock);
+
+cleanup:
+    pthread_mutex_unlock(&fanout.sub_lock);
+    return rc;
+}
+
+void
+np_ntf_fanout_del(struct nc_session *ncs)
+{
+    uint32_t i;
+
+    pthread_rwlock_wrlock(&fanout.lock);
+    for (i = 0; i < fanout.mod_count; ++i) {
+        np_ntf_fanout_sub_del(fanout.mods[i].subs, &fanout.mods[i].sub_count, ncs);
+    }
+    np_ntf_fanout_sub_del(fanout.all_subs, &fanout.all_sub_count, ncs);
+    pthread_rwlock_unlock(&fanout.lock);
+}
+
+void
+np_ntf_fanout_destroy(void)
+{
+    uint32_t i, j;
+
+    /* no more callbacks */
+    sr_unsubscribe(fanout.sr_sub);
+    fanout.sr_sub = NULL;
+
+    pthread_mutex_lock(&fanout.pend_lock);
+    free(fanout.pend_ids);
+    fanout.pend_ids = NULL;
+    fanout.pend_size = 0;
+    fanout.pend_head = 0;
+    ATOMIC_STORE_RELAXED(fanout.pend_count, 0);
+    pthread_mutex_unlock(&fanout.pend_lock);
+
+    pthread_rwlock_wrlock(&fanout.lock);
+    for (i = 0; i < fanout.mod_count; ++i) {
+        for (j = 0; j < fanout.mods[i].sub_count; ++j) {
+            free(fanout.mods[i].subs[j].xpath);
+        }
+        free(fanout.mods[i].subs);
+        free(fanout.mods[i].name);
+    }
+    free(fanout.mods);
+    fanout.mods = NULL;
+    fanout.mod_count = 0;
+    for (i = 0; i < fanout.all_sub_count; ++i) {
+        free(fanout.all_subs[i].xpath);
+    }
+    free(fanout.all_subs);
+    fanout.all_subs = NULL;
+    fanout.all_sub_count = 0;
+    fanout.all_subscribed = 0;
+    pthread_rwlock_unlock(&fanout.lock);
+}
@@ -0,0 +1,176 @@
+/**
+ * @file notif_fanout.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server delivery of notifications to many sessions header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_NOTIF_FANOUT_H_
+#define NP2SRV_NOTIF_FANOUT_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+#include <nc_server.h>
+#include <sysrepo.h>
+
+#include "config.h"
+#include "netconf_acm.h"
+
+/**
+ * @brief Policy when a session notification queue is full.
+ */
+enum np_ntf_overflow {
+    NP_NTF_DROP_OLDEST = 0,     /**< drop the oldest queued notification */
+    NP_NTF_DROP_NEWEST,         /**< drop the new notification */
+    NP_NTF_TERMINATE            /**< terminate the session */
+};
+
+/**
+ * @brief Notification shared by all the session queues it was queued on.
+ */
+struct np_ntf_msg {
+    uint32_t refcount;                  /**< number of queues with the notification */
+    struct lyd_node *notif;             /**< notification data */
+    char eventtime[26];                 /**< notification event time */
+    struct nc_server_notif *nc_ntf;     /**< libnetconf2 notification sent to all the sessions */
+    uint64_t queued;                    /**< time the notification was first queued (us) */
+};
+
+/**
+ * @brief Queued notification.
+ */
+struct np_ntf_entry {
+    struct np_ntf_msg *msg;             /**< shared notification */
+    int stop;                           /**< whether it is the last notification of the subscription */
+};
+
+/**
+ * @brief Outbound notification queue of a session, notifications are sent by the worker threads.
+ */
+struct np_ntf_queue {
+    pthread_mutex_t lock;               /**< lock for the queue */
+    pthread_cond_t cond;                /**< condition signalled when sending finishes */
+    struct np_ntf_entry *entries;       /**< ring buffer of queued notifications */
+    uint32_t size;                      /**< allocated size of the ring buffer */
+    uint32_t head;                      /**< index of the oldest notification */
+    uint32_t count;                     /**< number of queued notifications */
+    char pending;                       /**< whether the session waits for a worker thread to send */
+    char sending;                       /**< whether a worker thread is sending */
+    char closed;                        /**< whether the session is being freed */
+
+    ATOMIC_T depth;                     /**< number of queued notifications for monitoring */
+    ATOMIC_T dropped;                   /**< number of dropped notifications */
+    ATOMIC_T max_wait;                  /**< longest time a notification was queued (us) */
+};
+
+/**
+ * @brief Notification prepared once for queueing on any number of sessions.
+ */
+struct np_ntf {
+    const struct lyd_node *notif;       /**< top-level node of the notification */
+    time_t timestamp;                   /**< notification timestamp */
+    struct np_ntf_msg *msg;             /**< shared notification, created when first queued */
+    struct ncac_notif_memo nacm;        /**< NACM decisions for the group sets of the sessions */
+
+    struct {
+        const char *xpath;              /**< filter of some sessions */
+        char match;                     /**< whether the notification matches the filter */
+    } *filters;                         /**< evaluated session filters */
+    uint32_t filter_count;              /**< number of evaluated filters */
+};
+
+/**
+ * @brief Prepare a notification for queueing.
+ *
+ * @param[in] ntf Notification to prepare, must be cleared with ::np_ntf_clear().
+ * @param[in] notif Notification data, duplicated only when queued.
+ * @param[in] timestamp Notification timestamp.
+ */
+void np_ntf_prepare(struct np_ntf *ntf, const struct lyd_node *notif, time_t timestamp);
+
+/**
+ * @brief Queue a prepared notification on a session, if it matches its filter and NACM allows it.
+ *
+ * @param[in] ntf Prepared notification.
+ * @param[in] ncs NETCONF session to send to.
+ * @param[in] xpath Session notification filter, NULL if none.
+ * @param[in] stop Whether it is the last notification of the subscription.
+ * @return 0 if queued, 1 if filtered out or dropped, -1 on error.
+ */
+int np_ntf_enqueue(struct np_ntf *ntf, struct nc_session *ncs, const char *xpath, int stop);
+
+/**
+ * @brief Clear a prepared notification.
+ *
+ * @param[in] ntf Notification to clear.
+ */
+void np_ntf_clear(struct np_ntf *ntf);
+
+/**
+ * @brief Initialize a session notification queue.
+ *
+ * @param[in] queue Queue to initialize.
+ */
+void np_ntf_queue_init(struct np_ntf_queue *queue);
+
+/**
+ * @brief Close a session notification queue, wait for any sending to finish, and free it.
+ * No notifications can be queued on the session anymore.
+ *
+ * @param[in] queue Queue to close.
+ */
+void np_ntf_queue_close(struct np_ntf_queue *queue);
+
+/**
+ * @brief Send some queued notifications of a session waiting for a worker thread, if any.
+ */
+void np_ntf_queue_flush(void);
+
+int np_ntf_queue_config_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
+        uint32_t request_id, void *private_data);
+
+/**
+ * @brief Add a session to the notification fan-out of a module. There is a single sysrepo subscription
+ * for each module and every notification is prepared only once for all the sessions.
+ *
+ * @param[in] ncs NETCONF session.
+ * @param[in] module_name Module with the notifications.
+ * @param[in] xpath Session notification filter, NULL if none.
+ * @return Sysrepo error value.
+ */
+int np_ntf_fanout_add(struct nc_session *ncs, const char *module_name, const char *xpath);
+
+/**
+ * @brief Add a session to the notification fan-outs of all the modules with notifications (NETCONF stream).
+ *
+ * @param[in] ncs NETCONF session.
+ * @param[in] ly_ctx libyang context with the modules.
+ * @param[in] xpath Session notification filter, NULL if none.
+ * @return Sysrepo error value.
+ */
+int np_ntf_fanout_add_all(struct nc_session *ncs, const struct ly_ctx *ly_ctx, const char *xpath);
+
+/**
+ * @brief Remove a session from all the notification fan-outs. Once it returns, no more
+ * notifications are being sent to the session.
+ *
+ * @param[in] ncs NETCONF session.
+ */
+void np_ntf_fanout_del(struct nc_session *ncs);
+
+/**
+ * @brief Unsubscribe and free all the notification fan-outs.
+ */
+void np_ntf_fanout_destroy(void);
+
+#endif /* NP2SRV_NOTIF_FANOUT_H_ */
@@ -0,0 +1,309 @@
+/**
+ * @file rpc_sched.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server weighted scheduling of RPC execution
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+#include "common.h"
+#include "log.h"
+#include "rpc_sched.h"
+
+/** @brief Default weight of an RPC class */
+#define NP2SRV_RPC_WEIGHT_DFLT 1
+
+static const char *rpc_class_names[NP2SRV_RPC_CLASS_COUNT] = {"read", "write", "exec"};
+
+/**
+ * @brief RPC scheduling state.
+ */
+static struct {
+    pthread_mutex_t lock;           /**< lock for all the members */
+    pthread_cond_t cond;            /**< condition signalled when an RPC finishes or the workers change */
+
+    uint32_t weight[NP2SRV_RPC_CLASS_COUNT];    /**< configured weight of each class */
+    uint32_t executing[NP2SRV_RPC_CLASS_COUNT]; /**< number of executing RPCs of each class */
+    uint32_t waiting[NP2SRV_RPC_CLASS_COUNT];   /**< number of waiting RPCs of each class */
+    uint64_t requests[NP2SRV_RPC_CLASS_COUNT];  /**< number of all RPCs of each class */
+    uint64_t wait_time[NP2SRV_RPC_CLASS_COUNT]; /**< total wait time of each class (us) */
+    uint64_t max_wait_time[NP2SRV_RPC_CLASS_COUNT]; /**< maximum wait time of each class (us) */
+} sched = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .weight = {NP2SRV_RPC_WEIGHT_DFLT, NP2SRV_RPC_WEIGHT_DFLT, NP2SRV_RPC_WEIGHT_DFLT}
+};
+
+/**
+ * @brief Learn the class of an RPC.
+ *
+ * @param[in] rpc RPC to classify.
+ * @return RPC class.
+ */
+static enum np2srv_rpc_class
+np2srv_rpc_class(const struct lyd_node *rpc)
+{
+    const char *mod_name, *name;
+
+    if (rpc->schema->nodetype != LYS_RPC) {
+        /* action */
+        return NP2SRV_RPC_EXEC;
+    }
+
+    mod_name = lyd_node_module(rpc)->name;
+    name = rpc->schema->name;
+    if (!strcmp(mod_name, "ietf-netconf")) {
+        if (!strcmp(name, "get") || !strcmp(name, "get-config")) {
+            return NP2SRV_RPC_READ;
+        } else if (!strcmp(name, "edit-config") || !strcmp(name, "copy-config") || !strcmp(name, "delete-config")
+                || !strcmp(name, "lock") || !strcmp(name, "unlock") || !strcmp(name, "commit")
+                || !strcmp(name, "discard-changes") || !strcmp(name, "cancel-commit")) {
+            return NP2SRV_RPC_WRITE;
+        }
+    } else if (!strcmp(mod_name, "ietf-netconf-nmda")) {
+        if (!strcmp(name, "get-data")) {
+            return NP2SRV_RPC_READ;
+        } else if (!strcmp(name, "edit-data")) {
+            return NP2SRV_RPC_WRITE;
+        }
+    }
+
+    return NP2SRV_RPC_EXEC;
+}
+
+/**
+ * @brief Learn whether an RPC of a class can be executed now, lock must be held.
+ *
+ * @param[in] rpc_class RPC class.
+ * @return non-zero if it can be executed, 0 if it must wait.
+ */
+static int
+np2srv_rpc_sched_allowed(enum np2srv_rpc_class rpc_class)
+{
+    uint32_t i, workers, max_workers, weight_sum = 0, busy = 0, share;
+
+    /* a waiting RPC keeps its worker, so waiting helps other sessions only if another worker can be started */
+    workers = ATOMIC_LOAD_RELAXED(np2srv.worker_count);
+    max_workers = ATOMIC_LOAD_RELAXED(np2srv.worker_max);
+    if (workers >= max_workers) {
+        return 1;
+    }
+
+    for (i = 0; i < NP2SRV_RPC_CLASS_COUNT; ++i) {
+        weight_sum += sched.weight[i];
+        busy += sched.executing[i] + sched.waiting[i];
+    }
+
+    /* within the share of the class */
+    share = (workers * sched.weight[rpc_class]) / weight_sum;
+    if (sched.executing[rpc_class] < (share ? share : 1)) {
+        return 1;
+    }
+
+    /* above the share, but a worker would still be left for others */
+    if (busy + 1 < workers) {
+        return 1;
+    }
+
+    return 0;
+}
+
+enum np2srv_rpc_class
+np2srv_rpc_sched_enter(const struct lyd_node *rpc)
+{
+    enum np2srv_rpc_class rpc_class;
+    struct timespec start, end;
+    uint64_t wait_time;
+    int waited = 0;
+
+    rpc_class = np2srv_rpc_class(rpc);
+
+    pthread_mutex_lock(&sched.lock);
+
+    ++sched.requests[rpc_class];
+    while (!np2srv_rpc_sched_allowed(rpc_class)) {
+        if (!waited) {
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            waited = 1;
+        }
+        ++sched.waiting[rpc_class];
+        pthread_cond_wait(&sched.cond, &sched.lock);
+        --sched.waiting[rpc_class];
+    }
+    ++sched.executing[rpc_class];
+
+    if (waited) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        wait_time = (end.tv_sec - start.tv_sec) * 1000000LL + (end.tv_nsec - start.tv_nsec) / 1000;
+
+        sched.wait_time[rpc_class] += wait_time;
+        if (wait_time > sched.max_wait_time[rpc_class]) {
+            sched.max_wait_time[rpc_class] = wait_time;
+        }
+    }
+
+    pthread_mutex_unlock(&sched.lock);
+
+    return rpc_class;
+}
+
+void
+np2srv_rpc_sched_leave(enum np2srv_rpc_class rpc_class)
+{
+    pthread_mutex_lock(&sched.lock);
+
+    --sched.executing[rpc_class];
+    if (sched.waiting[0] || sched.waiting[1] || sched.waiting[2]) {
+        pthread_cond_broadcast(&sched.cond);
+    }
+
+    pthread_mutex_unlock(&sched.lock);
+}
+
+void
+np2srv_rpc_sched_workers_changed(void)
+{
+    pthread_mutex_lock(&sched.lock);
+
+    /* the shares and whether RPCs can wait at all depend on the workers */
+    if (sched.waiting[0] || sched.waiting[1] || sched.waiting[2]) {
+        pthread_cond_broadcast(&sched.cond);
+    }
+
+    pthread_mutex_unlock(&sched.lock);
+}
+
+/* /netopeer2-monitoring:netopeer2-server/rpc-classes/rpc-class */
+int
+np2srv_rpc_sched_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    sr_change_iter_t *iter;
+    sr_change_oper_t op;
+    const struct lyd_node *node;
+    const char *prev_val, *prev_list, *name;
+    bool prev_dflt;
+    char *xp;
+    uint32_t i;
+    int rc;
+
+    if (asprintf(&xp, "%s/weight", xpath) == -1) {
+        EMEM;
+        return SR_ERR_NOMEM;
+    }
+    rc = sr_get_changes_iter(session, xp, &iter);
+    free(xp);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting changes iter failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
+        /* find the class */
+        name = ((struct lyd_node_leaf_list *)node->parent->child)->value_str;
+        for (i = 0; i < NP2SRV_RPC_CLASS_COUNT; ++i) {
+            if (!strcmp(rpc_class_names[i], name)) {
+                break;
+            }
+        }
+        if (i == NP2SRV_RPC_CLASS_COUNT) {
+            EINT;
+            continue;
+        }
+
+        pthread_mutex_lock(&sched.lock);
+        if (op == SR_OP_DELETED) {
+            sched.weight[i] = NP2SRV_RPC_WEIGHT_DFLT;
+        } else if ((op == SR_OP_CREATED) || (op == SR_OP_MODIFIED)) {
+            sched.weight[i] = ((struct lyd_node_leaf_list *)node)->value.uint8;
+        }
+
+        /* shares changed */
+        pthread_cond_broadcast(&sched.cond);
+        pthread_mutex_unlock(&sched.lock);
+    }
+    sr_free_change_iter(iter);
+    if (rc != SR_ERR_NOT_FOUND) {
+        ERR("Getting next change failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    return SR_ERR_OK;
+}
+
+/* /netopeer2-monitoring:netopeer2-state/rpc-classes */
+int
+np2srv_rpc_sched_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name),
+        const char *UNUSED(path), const char *UNUSED(request_xpath), uint32_t UNUSED(request_id),
+        struct lyd_node **parent, void *UNUSED(private_data))
+{
+    struct lyd_node *cont, *list;
+    uint32_t executing, waiting, i;
+    uint64_t requests, wait_time, max_wait_time;
+    char num_str[21];
+
+    assert(*parent);
+
+    cont = lyd_new_path(*parent, NULL, "rpc-classes", NULL, 0, 0);
+    if (!cont) {
+        return SR_ERR_INTERNAL;
+    }
+
+    for (i = 0; i < NP2SRV_RPC_CLASS_COUNT; ++i) {
+        pthread_mutex_lock(&sched.lock);
+        executing = sched.executing[i];
+        waiting = sched.waiting[i];
+        requests = sched.requests[i];
+        wait_time = sched.wait_time[i];
+        max_wait_time = sched.max_wait_time[i];
+        pthread_mutex_unlock(&sched.lock);
+
+        list = lyd_new(cont, NULL, "rpc-class");
+        if (!list || !lyd_new_leaf(list, NULL, "name", rpc_class_names[i])) {
+            return SR_ERR_INTERNAL;
+        }
+
+        sprintf(num_str, "%u", executing);
+        if (!lyd_new_leaf(list, NULL, "executing", num_str)) {
+            return SR_ERR_INTERNAL;
+        }
+        sprintf(num_str, "%u", waiting);
+        if (!lyd_new_leaf(list, NULL, "waiting", num_str)) {
+            return SR_ERR_INTERNAL;
+        }
+        sprintf(num_str, "%" PRIu64, requests);
+        if (!lyd_new_leaf(list, NULL, "requests", num_str)) {
+            return SR_ERR_INTERNAL;
+        }
+        sprintf(num_str, "%" PRIu64, wait_time);
+        if (!lyd_new_leaf(list, NULL, "wait-time", num_str)) {
+            return SR_ERR_INTERNAL;
+        }
+        sprintf(num_str, "%" PRIu64, max_wait_time);
+        if (!lyd_new_leaf(list, NULL, "max-wait-time", num_str)) {
+            return SR_ERR_INTERNAL;
+        }
+    }
+
+    return SR_ERR_OK;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file rpc_sched.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server weighted scheduling of RPC execution header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_RPC_SCHED_H_
+#define NP2SRV_RPC_SCHED_H_
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+/**
+ * @brief Classes of RPCs scheduled separately.
+ */
+enum np2srv_rpc_class {
+    NP2SRV_RPC_READ = 0,    /**< retrieving data */
+    NP2SRV_RPC_WRITE,       /**< modifying or locking datastores */
+    NP2SRV_RPC_EXEC,        /**< any other operations */
+    NP2SRV_RPC_CLASS_COUNT
+};
+
+/**
+ * @brief Wait until an RPC can be executed.
+ *
+ * Every RPC class can use a share of the worker threads given by its weight. Above its share, it is executed
+ * only if there would still be a worker thread left for other RPCs. A waiting RPC keeps its worker thread so
+ * it waits only if auto-scaling can start another one, otherwise it is executed right away and only counted.
+ * So the weights have no effect with a fixed number of worker threads (auto-scaling disabled).
+ *
+ * There is no per-session queue, libnetconf2 processes at most one RPC of a session at a time and polls
+ * the sessions in turns.
+ *
+ * @param[in] rpc RPC to be executed.
+ * @return Class of the RPC, to be passed to ::np2srv_rpc_sched_leave().
+ */
+enum np2srv_rpc_class np2srv_rpc_sched_enter(const struct lyd_node *rpc);
+
+/**
+ * @brief Finish execution of an RPC.
+ *
+ * @param[in] rpc_class Class of the RPC.
+ */
+void np2srv_rpc_sched_leave(enum np2srv_rpc_class rpc_class);
+
+/**
+ * @brief Wake any waiting RPCs after the worker thread count or maximum changed.
+ */
+void np2srv_rpc_sched_workers_changed(void);
+
+int np2srv_rpc_sched_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
+        uint32_t request_id, void *private_data);
+
+int np2srv_rpc_sched_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path,
+        const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data);
+
+#endif /* NP2SRV_RPC_SCHED_H_ */
@@ -0,0 +1,564 @@
+/**
+ * @file rpc_stats.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server RPC latency statistics
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+#include "common.h"
+#include "log.h"
+#include "rpc_stats.h"
+
+/**
+ * @brief Operations with separate statistics, the last one is for all the other RPCs and actions.
+ */
+static const struct {
+    const char *module;
+    const char *name;
+} rpc_ops[] = {
+    {"ietf-netconf", "get"},
+    {"ietf-netconf", "get-config"},
+    {"ietf-netconf", "edit-config"},
+    {"ietf-netconf", "copy-config"},
+    {"ietf-netconf", "delete-config"},
+    {"ietf-netconf", "lock"},
+    {"ietf-netconf", "unlock"},
+    {"ietf-netconf", "close-session"},
+    {"ietf-netconf", "kill-session"},
+    {"ietf-netconf", "commit"},
+    {"ietf-netconf", "discard-changes"},
+    {"ietf-netconf", "cancel-commit"},
+    {"ietf-netconf", "validate"},
+    {"ietf-netconf-nmda", "get-data"},
+    {"ietf-netconf-nmda", "edit-data"},
+    {"ietf-netconf-monitoring", "get-schema"},
+    {"notifications", "create-subscription"},
+    {NULL, "other"}
+};
+
+#define NP2SRV_RPC_OP_COUNT (sizeof rpc_ops / sizeof *rpc_ops)
+
+static const char *rpc_phase_names[NP2SRV_PHASE_COUNT] = {
+    "nacm-check", "scheduling", "filter", "datastore", "nacm-filter", "reply", "total"
+};
+
+/**
+ * @brief Histogram with logarithmic buckets, written only by its owner thread.
+ */
+struct np2srv_hist {
+    ATOMIC64_T count;                               /**< number of values */
+    ATOMIC64_T sum;                                 /**< sum of all the values */
+    ATOMIC64_T max;                                 /**< maximum value */
+    ATOMIC64_T buckets[NP2SRV_RPC_STATS_BUCKETS];   /**< bucket i holds values [2^(i-1), 2^i), bucket 0 value 0 */
+};
+
+/**
+ * @brief Statistics of an operation.
+ */
+struct np2srv_rpc_op_stats {
+    struct np2srv_hist phases[NP2SRV_PHASE_COUNT];  /**< duration of every phase (us) */
+    struct np2srv_hist reply_size;                  /**< number of data nodes in the reply */
+};
+
+/**
+ * @brief Statistics of a single thread, never freed so that they are kept once the thread exits.
+ */
+struct np2srv_rpc_stats_slot {
+    struct np2srv_rpc_op_stats ops[NP2SRV_RPC_OP_COUNT];    /**< statistics of every operation */
+    struct np2srv_hist notif_wait;                  /**< time notifications were queued for a session (us) */
+    int used;                                       /**< whether the slot is owned by a thread, lock must be held */
+    struct np2srv_rpc_stats_slot *next;             /**< next slot */
+
+    /* RPC being processed, accessed only by the owner thread */
+    int32_t op;                                     /**< index of the operation, -1 for none */
+    uint32_t nc_id;                                 /**< NETCONF session ID */
+    uint64_t start;                                 /**< processing start time */
+    uint64_t reply_start;                           /**< reply serialization start time, 0 if not started */
+    uint64_t reply_size;                            /**< number of data nodes of the reply */
+    uint32_t phase_mask;                            /**< bitmask of the finished phases */
+    uint64_t phase_time[NP2SRV_PHASE_COUNT];        /**< duration of the finished phases */
+};
+
+static struct {
+    pthread_mutex_t lock;                   /**< lock for the slot list */
+    struct np2srv_rpc_stats_slot *slots;    /**< slots of all the threads */
+    ATOMIC_T slow_threshold;                /**< slow RPC threshold (ms), 0 to disable logging */
+} stats = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+/** @brief Slot of the current thread */
+static __thread struct np2srv_rpc_stats_slot *thread_slot;
+
+uint64_t
+np2srv_rpc_stats_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Get the slot of the current thread, acquire one if it has none.
+ *
+ * @return Thread slot, NULL on error.
+ */
+static struct np2srv_rpc_stats_slot *
+np2srv_rpc_stats_slot(void)
+{
+    struct np2srv_rpc_stats_slot *slot;
+
+    if (thread_slot) {
+        return thread_slot;
+    }
+
+    pthread_mutex_lock(&stats.lock);
+
+    /* reuse a slot of a finished thread */
+    for (slot = stats.slots; slot && slot->used; slot = slot->next) {}
+    if (!slot) {
+        slot = calloc(1, sizeof *slot);
+        if (!slot) {
+            pthread_mutex_unlock(&stats.lock);
+            EMEM;
+            return NULL;
+        }
+        slot->next = stats.slots;
+        stats.slots = slot;
+    }
+    slot->used = 1;
+    slot->op = -1;
+
+    pthread_mutex_unlock(&stats.lock);
+
+    thread_slot = slot;
+    return slot;
+}
+
+void
+np2srv_rpc_stats_thread_destroy(void)
+{
+    if (!thread_slot) {
+        return;
+    }
+
+    pthread_mutex_lock(&stats.lock);
+    thread_slot->used = 0;
+    pthread_mutex_unlock(&stats.lock);
+
+    thread_slot = NULL;
+}
+
+/**
+ * @brief Add a value into a histogram of the current thread.
+ *
+ * @param[in] hist Histogram to update.
+ * @param[in] value Value to add.
+ */
+static void
+np2srv_hist_add(struct np2srv_hist *hist, uint64_t value)
+{
+    uint32_t b;
+
+    b = value ? 64 - __builtin_clzll(value) : 0;
+    if (b >= NP2SRV_RPC_STATS_BUCKETS) {
+        b = NP2SRV_RPC_STATS_BUCKETS - 1;
+    }
+
+    /* only the owner thread writes, no read-modify-write operations needed */
+    ATOMIC_STORE_RELAXED(hist->count, ATOMIC_LOAD_RELAXED(hist->count) + 1);
+    ATOMIC_STORE_RELAXED(hist->sum, ATOMIC_LOAD_RELAXED(hist->sum) + value);
+    if (value > ATOMIC_LOAD_RELAXED(hist->max)) {
+        ATOMIC_STORE_RELAXED(hist->max, value);
+    }
+    ATOMIC_STORE_RELAXED(hist->buckets[b], ATOMIC_LOAD_RELAXED(hist->buckets[b]) + 1);
+}
+
+void
+np2srv_rpc_stats_start(const struct lyd_node *rpc, uint32_t nc_id)
+{
+    struct np2srv_rpc_stats_slot *slot;
+    const char *mod_name;
+    uint32_t i;
+
+    if (!(slot = np2srv_rpc_stats_slot())) {
+        return;
+    }
+
+    mod_name = lyd_node_module(rpc)->name;
+    for (i = 0; rpc_ops[i].module; ++i) {
+        if (!strcmp(rpc_ops[i].name, rpc->schema->name) && !strcmp(rpc_ops[i].module, mod_name)) {
+            break;
+        }
+    }
+
+    slot->op = i;
+    slot->nc_id = nc_id;
+    slot->start = np2srv_rpc_stats_now();
+    slot->reply_start = 0;
+    slot->reply_size = 0;
+    slot->phase_mask = 0;
+    memset(slot->phase_time, 0, sizeof slot->phase_time);
+}
+
+void
+np2srv_rpc_stats_phase(enum np2srv_rpc_phase phase, uint64_t start)
+{
+    struct np2srv_rpc_stats_slot *slot = thread_slot;
+
+    if (!slot || (slot->op == -1)) {
+        /* not called by a worker thread processing an RPC */
+        return;
+    }
+
+    slot->phase_time[phase] += np2srv_rpc_stats_now() - start;
+    slot->phase_mask |= 1 << phase;
+}
+
+/**
+ * @brief Count data nodes of sibling subtrees, including the data trees of anydata nodes.
+ *
+ * @param[in] first First sibling.
+ * @return Number of data nodes.
+ */
+static uint64_t
+np2srv_rpc_stats_tree_size(const struct lyd_node *first)
+{
+    const struct lyd_node *elem;
+    const struct lyd_node_anydata *any;
+    uint64_t size = 0;
+
+    LY_TREE_FOR(first, elem) {
+        ++size;
+        if (elem->schema->nodetype & LYS_ANYDATA) {
+            any = (const struct lyd_node_anydata *)elem;
+            if (any->value_type == LYD_ANYDATA_DATATREE) {
+                size += np2srv_rpc_stats_tree_size(any->value.tree);
+            }
+        } else if (!(elem->schema->nodetype & (LYS_LEAF | LYS_LEAFLIST))) {
+            size += np2srv_rpc_stats_tree_size(elem->child);
+        }
+    }
+
+    return size;
+}
+
+void
+np2srv_rpc_stats_reply(const struct lyd_node *output)
+{
+    struct np2srv_rpc_stats_slot *slot = thread_slot;
+
+    if (!slot || (slot->op == -1)) {
+        return;
+    }
+
+    slot->reply_size = output ? np2srv_rpc_stats_tree_size(output->child) : 0;
+    slot->reply_start = np2srv_rpc_stats_now();
+}
+
+void
+np2srv_rpc_stats_finish(void)
+{
+    struct np2srv_rpc_stats_slot *slot = thread_slot;
+    struct np2srv_rpc_op_stats *op_stats;
+    uint64_t now;
+    uint32_t i, threshold;
+
+    if (!slot || (slot->op == -1)) {
+        return;
+    }
+
+    now = np2srv_rpc_stats_now();
+    if (slot->reply_start) {
+        slot->phase_time[NP2SRV_PHASE_REPLY] += now - slot->reply_start;
+        slot->phase_mask |= 1 << NP2SRV_PHASE_REPLY;
+    }
+    slot->phase_time[NP2SRV_PHASE_TOTAL] = now - slot->start;
+    slot->phase_mask |= 1 << NP2SRV_PHASE_TOTAL;
+
+    op_stats = &slot->ops[slot->op];
+    for (i = 0; i < NP2SRV_PHASE_COUNT; ++i) {
+        if (slot->phase_mask & (1 << i)) {
+            np2srv_hist_add(&op_stats->phases[i], slot->phase_time[i]);
+        }
+    }
+    np2srv_hist_add(&op_stats->reply_size, slot->reply_size);
+
+    threshold = ATOMIC_LOAD_RELAXED(stats.slow_threshold);
+    if (threshold && (slot->phase_time[NP2SRV_PHASE_TOTAL] >= threshold * 1000ULL)) {
+        WRN("Session %u: RPC \"%s\" took %" PRIu64 " us (NACM check %" PRIu64 " us, scheduling %" PRIu64 " us, filter %"
+                PRIu64 " us, datastore %" PRIu64 " us, NACM filter %" PRIu64 " us, reply %" PRIu64 " us, %" PRIu64
+                " data nodes).", slot->nc_id, rpc_ops[slot->op].name, slot->phase_time[NP2SRV_PHASE_TOTAL],
+                slot->phase_time[NP2SRV_PHASE_NACM_CHECK], slot->phase_time[NP2SRV_PHASE_SCHED],
+                slot->phase_time[NP2SRV_PHASE_FILTER], slot->phase_time[NP2SRV_PHASE_DATASTORE],
+                slot->phase_time[NP2SRV_PHASE_NACM_FILTER], slot->phase_time[NP2SRV_PHASE_REPLY], slot->reply_size);
+    }
+
+    slot->op = -1;
+}
+
+void
+np2srv_rpc_stats_notif_wait(uint64_t wait)
+{
+    struct np2srv_rpc_stats_slot *slot;
+
+    if (!(slot = np2srv_rpc_stats_slot())) {
+        return;
+    }
+
+    np2srv_hist_add(&slot->notif_wait, wait);
+}
+
+void
+np2srv_rpc_stats_destroy(void)
+{
+    struct np2srv_rpc_stats_slot *slot, *next;
+
+    pthread_mutex_lock(&stats.lock);
+    for (slot = stats.slots; slot; slot = next) {
+        next = slot->next;
+        free(slot);
+    }
+    stats.slots = NULL;
+    pthread_mutex_unlock(&stats.lock);
+}
+
+/* /netopeer2-monitoring:netopeer2-server/rpc-statistics */
+int
+np2srv_rpc_stats_config_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    sr_change_iter_t *iter;
+    sr_change_oper_t op;
+    const struct lyd_node *node;
+    const char *prev_val, *prev_list;
+    bool prev_dflt;
+    int rc;
+
+    rc = sr_get_changes_iter(session, xpath, &iter);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting changes iter failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
+        if ((op != SR_OP_CREATED) && (op != SR_OP_MODIFIED)) {
+            /* the leaf has a default value */
+            continue;
+        }
+
+        if (!strcmp(node->schema->name, "slow-rpc-threshold")) {
+            ATOMIC_STORE_RELAXED(stats.slow_threshold, ((struct lyd_node_leaf_list *)node)->value.uint32);
+        }
+    }
+    sr_free_change_iter(iter);
+    if (rc != SR_ERR_NOT_FOUND) {
+        ERR("Getting next change failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    return SR_ERR_OK;
+}
+
+/**
+ * @brief Summed histogram of all the threads.
+ */
+struct np2srv_hist_sum {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[NP2SRV_RPC_STATS_BUCKETS];
+};
+
+/**
+ * @brief Add a thread histogram into a summed histogram.
+ *
+ * @param[in,out] hist_sum Summed histogram.
+ * @param[in] hist Thread histogram.
+ */
+static void
+np2srv_hist_sum_add(struct np2srv_hist_sum *hist_sum, struct np2srv_hist *hist)
+{
+    uint64_t max;
+    uint32_t i;
+
+    hist_sum->count += ATOMIC_LOAD_RELAXED(hist->count);
+    hist_sum->sum += ATOMIC_LOAD_RELAXED(hist->sum);
+    max = ATOMIC_LOAD_RELAXED(hist->max);
+    if (max > hist_sum->max) {
+        hist_sum->max = max;
+    }
+    for (i = 0; i < NP2SRV_RPC_STATS_BUCKETS; ++i) {
+        hist_sum->buckets[i] += ATOMIC_LOAD_RELAXED(hist->buckets[i]);
+    }
+}
+
+/**
+ * @brief Create histogram state data.
+ *
+ * @param[in] parent Parent node of the histogram.
+ * @param[in] hist_sum Summed histogram.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np2srv_hist_data(struct lyd_node *parent, const struct np2srv_hist_sum *hist_sum)
+{
+    struct lyd_node *list;
+    char num_str[21];
+    uint32_t i;
+
+    sprintf(num_str, "%" PRIu64, hist_sum->count);
+    if (!lyd_new_leaf(parent, NULL, "count", num_str)) {
+        return -1;
+    }
+    sprintf(num_str, "%" PRIu64, hist_sum->sum);
+    if (!lyd_new_leaf(parent, NULL, "total", num_str)) {
+        return -1;
+    }
+    sprintf(num_str, "%" PRIu64, hist_sum->max);
+    if (!lyd_new_leaf(parent, NULL, "max", num_str)) {
+        return -1;
+    }
+
+    for (i = 0; i < NP2SRV_RPC_STATS_BUCKETS; ++i) {
+        if (!hist_sum->buckets[i]) {
+            continue;
+        }
+
+        list = lyd_new(parent, NULL, "bucket");
+        sprintf(num_str, "%" PRIu64, i ? (uint64_t)1 << (i - 1) : 0);
+        if (!list || !lyd_new_leaf(list, NULL, "lower-bound", num_str)) {
+            return -1;
+        }
+        sprintf(num_str, "%" PRIu64, hist_sum->buckets[i]);
+        if (!lyd_new_leaf(list, NULL, "count", num_str)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* /netopeer2-monitoring:netopeer2-state/rpc-statistics */
+int
+np2srv_rpc_stats_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name),
+        const char *UNUSED(path), const char *UNUSED(request_xpath), uint32_t UNUSED(request_id),
+        struct lyd_node **parent, void *UNUSED(private_data))
+{
+    struct np2srv_rpc_stats_slot *slot;
+    struct np2srv_hist_sum (*phases)[NP2SRV_PHASE_COUNT] = NULL, *sizes = NULL, notif_wait;
+    struct lyd_node *cont, *list, *node;
+    char *name;
+    uint32_t i, j;
+    int rc = SR_ERR_OK;
+
+    assert(*parent);
+
+    phases = calloc(NP2SRV_RPC_OP_COUNT, sizeof *phases);
+    sizes = calloc(NP2SRV_RPC_OP_COUNT, sizeof *sizes);
+    if (!phases || !sizes) {
+        EMEM;
+        rc = SR_ERR_NOMEM;
+        goto cleanup;
+    }
+    memset(&notif_wait, 0, sizeof notif_wait);
+
+    /* sum the statistics of all the threads */
+    pthread_mutex_lock(&stats.lock);
+    for (slot = stats.slots; slot; slot = slot->next) {
+        for (i = 0; i < NP2SRV_RPC_OP_COUNT; ++i) {
+            for (j = 0; j < NP2SRV_PHASE_COUNT; ++j) {
+                np2srv_hist_sum_add(&phases[i][j], &slot->ops[i].phases[j]);
+            }
+            np2srv_hist_sum_add(&sizes[i], &slot->ops[i].reply_size);
+        }
+        np2srv_hist_sum_add(&notif_wait, &slot->notif_wait);
+    }
+    pthread_mutex_unlock(&stats.lock);
+
+    cont = lyd_new_path(*parent, NULL, "rpc-statistics", NULL, 0, 0);
+    if (!cont) {
+        rc = SR_ERR_INTERNAL;
+        goto cleanup;
+    }
+
+    for (i = 0; i < NP2SRV_RPC_OP_COUNT; ++i) {
+        if (!phases[i][NP2SRV_PHASE_TOTAL].count) {
+            /* never executed */
+            continue;
+        }
+
+        if (rpc_ops[i].module) {
+            if (asprintf(&name, "%s:%s", rpc_ops[i].module, rpc_ops[i].name) == -1) {
+                name = NULL;
+            }
+        } else {
+            name = strdup(rpc_ops[i].name);
+        }
+        if (!name) {
+            EMEM;
+            rc = SR_ERR_NOMEM;
+            goto cleanup;
+        }
+        list = lyd_new(cont, NULL, "operation");
+        node = list ? lyd_new_leaf(list, NULL, "name", name) : NULL;
+        free(name);
+        if (!node) {
+            rc = SR_ERR_INTERNAL;
+            goto cleanup;
+        }
+
+        for (j = 0; j < NP2SRV_PHASE_COUNT; ++j) {
+            if (!phases[i][j].count) {
+                continue;
+            }
+
+            node = lyd_new(list, NULL, "phase");
+            if (!node || !lyd_new_leaf(node, NULL, "name", rpc_phase_names[j]) || np2srv_hist_data(node, &phases[i][j])) {
+                rc = SR_ERR_INTERNAL;
+                goto cleanup;
+            }
+        }
+
+        node = lyd_new(list, NULL, "reply-size");
+        if (!node || np2srv_hist_data(node, &sizes[i])) {
+            rc = SR_ERR_INTERNAL;
+            goto cleanup;
+        }
+    }
+
+    if (notif_wait.count) {
+        node = lyd_new(cont, NULL, "notification-queue-wait");
+        if (!node || np2srv_hist_data(node, &notif_wait)) {
+            rc = SR_ERR_INTERNAL;
+            goto cleanup;
+        }
+    }
+
+cleanup:
+    free(phases);
+    free(sizes);
+    return rc;
+}
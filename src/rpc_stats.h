@@ -0,0 +1,95 @@
+/**
+ * @file rpc_stats.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server RPC latency statistics header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_RPC_STATS_H_
+#define NP2SRV_RPC_STATS_H_
+
+#include <stdint.h>
+
+#include <libyang/libyang.h>
+#include <sysrepo.h>
+
+/**
+ * @brief Timed phases of RPC processing.
+ */
+enum np2srv_rpc_phase {
+    NP2SRV_PHASE_NACM_CHECK = 0,    /**< NACM operation check */
+    NP2SRV_PHASE_SCHED,             /**< waiting for the RPC class to be scheduled */
+    NP2SRV_PHASE_FILTER,            /**< filter compilation */
+    NP2SRV_PHASE_DATASTORE,         /**< sysrepo data retrieval or RPC execution */
+    NP2SRV_PHASE_NACM_FILTER,       /**< NACM filtering of the data */
+    NP2SRV_PHASE_REPLY,             /**< reply serialization and sending */
+    NP2SRV_PHASE_TOTAL,             /**< whole RPC */
+    NP2SRV_PHASE_COUNT
+};
+
+/**
+ * @brief Get current monotonic time to be passed to ::np2srv_rpc_stats_phase().
+ *
+ * @return Current time (us).
+ */
+uint64_t np2srv_rpc_stats_now(void);
+
+/**
+ * @brief Start timing an RPC processed by this thread.
+ *
+ * @param[in] rpc RPC being processed.
+ * @param[in] nc_id NETCONF session ID.
+ */
+void np2srv_rpc_stats_start(const struct lyd_node *rpc, uint32_t nc_id);
+
+/**
+ * @brief Record a phase of the RPC processed by this thread, if any.
+ *
+ * @param[in] phase Finished phase.
+ * @param[in] start Start time of the phase returned by ::np2srv_rpc_stats_now().
+ */
+void np2srv_rpc_stats_phase(enum np2srv_rpc_phase phase, uint64_t start);
+
+/**
+ * @brief Record that the reply of the RPC processed by this thread was built and is being serialized.
+ *
+ * @param[in] output RPC output, NULL if none.
+ */
+void np2srv_rpc_stats_reply(const struct lyd_node *output);
+
+/**
+ * @brief Finish timing the RPC processed by this thread, if any, after its reply was sent.
+ */
+void np2srv_rpc_stats_finish(void);
+
+/**
+ * @brief Record the time a notification was queued for a session.
+ *
+ * @param[in] wait Queue wait time (us).
+ */
+void np2srv_rpc_stats_notif_wait(uint64_t wait);
+
+/**
+ * @brief Release the statistics of this thread before it exits, they are kept and reused by another thread.
+ */
+void np2srv_rpc_stats_thread_destroy(void);
+
+/**
+ * @brief Free all the statistics.
+ */
+void np2srv_rpc_stats_destroy(void);
+
+int np2srv_rpc_stats_config_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
+        uint32_t request_id, void *private_data);
+
+int np2srv_rpc_stats_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path,
+        const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data);
+
+#endif /* NP2SRV_RPC_STATS_H_ */
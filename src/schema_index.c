@@ -0,0 +1,335 @@
+/**
+ * @file schema_index.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server index of schema top-level nodes and namespaces
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+
+#include "common.h"
+#include "hash_table.h"
+#include "log.h"
+#include "schema_index.h"
+
+/**
+ * @brief Record of the top-level nodes index.
+ */
+struct np_schema_index_top {
+    const char *name;                   /**< top-level node name */
+    const struct lys_module **modules;  /**< all the modules with a top-level node of this name */
+    uint32_t module_count;              /**< number of modules */
+};
+
+/**
+ * @brief Record of the namespaces index.
+ */
+struct np_schema_index_ns {
+    const char *ns;                     /**< module namespace */
+    const struct lys_module *module;    /**< implemented module */
+};
+
+static struct {
+    pthread_rwlock_t lock;              /**< lock for all the members */
+    const struct ly_ctx *ly_ctx;        /**< indexed context */
+    uint16_t module_set_id;             /**< module set ID of the indexed context */
+    struct np_ht *top_nodes;            /**< index of top-level node names */
+    struct np_ht *namespaces;           /**< index of module namespaces */
+    const struct lys_module **notif_mods;   /**< implemented modules with notifications */
+    uint32_t notif_mod_count;           /**< number of modules with notifications */
+} sidx = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+static int
+np_schema_index_top_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct np_schema_index_top *rec1 = val1_p, *rec2 = val2_p;
+
+    return !strcmp(rec1->name, rec2->name);
+}
+
+static int
+np_schema_index_ns_equal(void *val1_p, void *val2_p, void *UNUSED(cb_data))
+{
+    struct np_schema_index_ns *rec1 = val1_p, *rec2 = val2_p;
+
+    return !strcmp(rec1->ns, rec2->ns);
+}
+
+static uint32_t
+np_schema_index_str_hash(const char *str)
+{
+    uint32_t hash;
+
+    hash = np_hash_multi(0, str, strlen(str));
+    return np_hash_multi(hash, NULL, 0);
+}
+
+/**
+ * @brief Free all the indexed data, write lock must be held.
+ */
+static void
+np_schema_index_clear(void)
+{
+    struct np_schema_index_top *top;
+    uint32_t idx = 0;
+
+    if (sidx.top_nodes) {
+        while ((top = np_ht_iter_next(sidx.top_nodes, &idx))) {
+            free(top->modules);
+        }
+    }
+    np_ht_free(sidx.top_nodes);
+    sidx.top_nodes = NULL;
+    np_ht_free(sidx.namespaces);
+    sidx.namespaces = NULL;
+    free(sidx.notif_mods);
+    sidx.notif_mods = NULL;
+    sidx.notif_mod_count = 0;
+    sidx.ly_ctx = NULL;
+}
+
+/**
+ * @brief Add a top-level node into the index.
+ *
+ * @param[in] node Top-level node.
+ * @param[in] module Module of the node.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_schema_index_add_top(const struct lys_node *node, const struct lys_module *module)
+{
+    struct np_schema_index_top rec, *match;
+    const struct lys_module **mods;
+    int r;
+
+    rec.name = node->name;
+    rec.modules = NULL;
+    rec.module_count = 0;
+
+    r = np_ht_insert(sidx.top_nodes, &rec, np_schema_index_str_hash(rec.name), (void **)&match);
+    if (r == -1) {
+        EMEM;
+        return -1;
+    }
+
+    if (match->module_count && (match->modules[match->module_count - 1] == module)) {
+        /* module already added */
+        return 0;
+    }
+
+    mods = realloc(match->modules, (match->module_count + 1) * sizeof *match->modules);
+    if (!mods) {
+        EMEM;
+        return -1;
+    }
+    match->modules = mods;
+    match->modules[match->module_count] = module;
+    ++match->module_count;
+
+    return 0;
+}
+
+/**
+ * @brief Learn whether a module has any notifications (outside groupings).
+ *
+ * @param[in] module Module to search.
+ * @return non-zero if it has, 0 if not.
+ */
+static int
+np_schema_index_has_notif(const struct lys_module *module)
+{
+    struct lys_node *root, *next, *elem, *parent;
+
+    LY_TREE_FOR(module->data, root) {
+        LY_TREE_DFS_BEGIN(root, next, elem) {
+            if (elem->nodetype == LYS_NOTIF) {
+                /* check that we are not in a grouping */
+                parent = lys_parent(elem);
+                while (parent && (parent->nodetype != LYS_GROUPING)) {
+                    parent = lys_parent(parent);
+                }
+                if (!parent) {
+                    return 1;
+                }
+            }
+            LY_TREE_DFS_END(root, next, elem);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Build the index, write lock must be held.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @return 0 on success, -1 on error.
+ */
+static int
+np_schema_index_build(const struct ly_ctx *ly_ctx)
+{
+    const struct lys_module *module, **mods;
+    const struct lys_node *node;
+    struct np_schema_index_ns ns_rec;
+    uint32_t idx = 0;
+
+    np_schema_index_clear();
+
+    sidx.top_nodes = np_ht_new(1024, sizeof(struct np_schema_index_top), np_schema_index_top_equal, NULL);
+    sidx.namespaces = np_ht_new(256, sizeof(struct np_schema_index_ns), np_schema_index_ns_equal, NULL);
+    if (!sidx.top_nodes || !sidx.namespaces) {
+        EMEM;
+        goto error;
+    }
+
+    while ((module = ly_ctx_get_module_iter(ly_ctx, &idx))) {
+        /* top-level nodes of all the modules */
+        node = NULL;
+        while ((node = lys_getnext(node, NULL, module, 0))) {
+            if (np_schema_index_add_top(node, module)) {
+                goto error;
+            }
+        }
+
+        /* implemented modules with notifications */
+        if (module->implemented && np_schema_index_has_notif(module)) {
+            mods = realloc(sidx.notif_mods, (sidx.notif_mod_count + 1) * sizeof *sidx.notif_mods);
+            if (!mods) {
+                EMEM;
+                goto error;
+            }
+            sidx.notif_mods = mods;
+            sidx.notif_mods[sidx.notif_mod_count] = module;
+            ++sidx.notif_mod_count;
+        }
+
+        /* namespaces of implemented modules */
+        if (module->implemented) {
+            ns_rec.ns = module->ns;
+            ns_rec.module = module;
+            if (np_ht_insert(sidx.namespaces, &ns_rec, np_schema_index_str_hash(ns_rec.ns), NULL) == -1) {
+                EMEM;
+                goto error;
+            }
+        }
+    }
+
+    sidx.ly_ctx = ly_ctx;
+    sidx.module_set_id = ly_ctx_get_module_set_id(ly_ctx);
+    return 0;
+
+error:
+    np_schema_index_clear();
+    return -1;
+}
+
+/**
+ * @brief Learn whether the index is up-to-date for a context, lock must be held.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @return non-zero if up-to-date, 0 if it needs to be rebuilt.
+ */
+static int
+np_schema_index_valid(const struct ly_ctx *ly_ctx)
+{
+    return (sidx.ly_ctx == ly_ctx) && (sidx.module_set_id == ly_ctx_get_module_set_id(ly_ctx));
+}
+
+int
+np_schema_index_update(const struct ly_ctx *ly_ctx)
+{
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&sidx.lock);
+    if (!np_schema_index_valid(ly_ctx)) {
+        ret = np_schema_index_build(ly_ctx);
+    }
+    pthread_rwlock_unlock(&sidx.lock);
+
+    return ret;
+}
+
+void
+np_schema_index_destroy(void)
+{
+    pthread_rwlock_wrlock(&sidx.lock);
+    np_schema_index_clear();
+    pthread_rwlock_unlock(&sidx.lock);
+}
+
+int
+np_schema_index_rdlock(const struct ly_ctx *ly_ctx)
+{
+    pthread_rwlock_rdlock(&sidx.lock);
+    while (!np_schema_index_valid(ly_ctx)) {
+        /* modules were installed or removed */
+        pthread_rwlock_unlock(&sidx.lock);
+        if (np_schema_index_update(ly_ctx)) {
+            return -1;
+        }
+        pthread_rwlock_rdlock(&sidx.lock);
+    }
+
+    return 0;
+}
+
+void
+np_schema_index_unlock(void)
+{
+    pthread_rwlock_unlock(&sidx.lock);
+}
+
+const struct lys_module **
+np_schema_index_top_modules(const char *name, uint32_t *module_count)
+{
+    struct np_schema_index_top rec, *match;
+
+    rec.name = name;
+    if (np_ht_find(sidx.top_nodes, &rec, np_schema_index_str_hash(name), (void **)&match)) {
+        *module_count = 0;
+        return NULL;
+    }
+
+    *module_count = match->module_count;
+    return match->modules;
+}
+
+const struct lys_module *
+np_schema_index_module_by_ns(const char *ns)
+{
+    struct np_schema_index_ns rec, *match;
+
+    rec.ns = ns;
+    if (np_ht_find(sidx.namespaces, &rec, np_schema_index_str_hash(ns), (void **)&match)) {
+        return NULL;
+    }
+
+    return match->module;
+}
+
+const struct lys_module **
+np_schema_index_notif_modules(uint32_t *module_count)
+{
+    *module_count = sidx.notif_mod_count;
+    return sidx.notif_mods;
+}
+
+uint16_t
+np_schema_index_module_set_id(void)
+{
+    return sidx.module_set_id;
+}
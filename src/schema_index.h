@@ -0,0 +1,81 @@
+/**
+ * @file schema_index.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server index of schema top-level nodes and namespaces header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_SCHEMA_INDEX_H_
+#define NP2SRV_SCHEMA_INDEX_H_
+
+#include <stdint.h>
+
+#include <libyang/libyang.h>
+
+/**
+ * @brief Build the index for a context, if not built for its current module set already.
+ *
+ * @param[in] ly_ctx libyang context.
+ * @return 0 on success, -1 on error.
+ */
+int np_schema_index_update(const struct ly_ctx *ly_ctx);
+
+/**
+ * @brief Free the index.
+ */
+void np_schema_index_destroy(void);
+
+/**
+ * @brief READ lock the index, it is rebuilt first if the module set of the context changed.
+ * Must be unlocked with ::np_schema_index_unlock().
+ *
+ * @param[in] ly_ctx libyang context.
+ * @return 0 on success, -1 on error (index is not locked).
+ */
+int np_schema_index_rdlock(const struct ly_ctx *ly_ctx);
+
+/**
+ * @brief Unlock the index.
+ */
+void np_schema_index_unlock(void);
+
+/**
+ * @brief Find all the modules with a top-level node of a name, index must be locked.
+ *
+ * @param[in] name Name of the top-level node.
+ * @param[out] module_count Number of returned modules.
+ * @return Array of the modules, NULL if there are none.
+ */
+const struct lys_module **np_schema_index_top_modules(const char *name, uint32_t *module_count);
+
+/**
+ * @brief Find an implemented module by its namespace, index must be locked.
+ *
+ * @param[in] ns Namespace of the module.
+ * @return Found module, NULL if there is none.
+ */
+const struct lys_module *np_schema_index_module_by_ns(const char *ns);
+
+/**
+ * @brief Get all the implemented modules with notifications, index must be locked.
+ *
+ * @param[out] module_count Number of returned modules.
+ * @return Array of the modules.
+ */
+const struct lys_module **np_schema_index_notif_modules(uint32_t *module_count);
+
+/**
+ * @brief Get the module set ID of the indexed context, index must be locked.
+ *
+ * @return Module set ID.
+ */
+uint16_t np_schema_index_module_set_id(void);
+
+#endif /* NP2SRV_SCHEMA_INDEX_H_ */
@@ -0,0 +1,552 @@
+/**
+ * @file session_setup.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server NETCONF session setup and teardown
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <libyang/libyang.h>
+#include <nc_server.h>
+#include <sysrepo.h>
+
+#include "common.h"
+#include "log.h"
+#include "session_setup.h"
+
+/**
+ * @brief Queued netconf-session-start or netconf-session-end notification.
+ */
+struct np_sess_event {
+    int start;                  /**< netconf-session-start if set, netconf-session-end otherwise */
+    char *username;             /**< NETCONF username */
+    uint32_t id;                /**< NETCONF session ID */
+    char *host;                 /**< source host, NULL if none */
+    uint32_t killed_by;         /**< ID of the session that killed this one, 0 if none */
+    const char *term_reason;    /**< termination reason of netconf-session-end */
+    struct np_sess_event *next; /**< next queued notification */
+};
+
+/**
+ * @brief Session setup state.
+ *
+ * Workers take pre-created sysrepo sessions and queue notifications, the setup thread
+ * creates new sysrepo sessions and sends the notifications outside of the accept path.
+ */
+static struct {
+    pthread_t tid;                      /**< session setup thread */
+    int running;                        /**< whether the thread is running, protected by lock */
+    pthread_mutex_t lock;               /**< lock for all the members below */
+    pthread_cond_t cond;                /**< condition signalled when the thread has work to do */
+
+    sr_session_ctx_t *pool[NP2SRV_SR_SESS_POOL_SIZE];   /**< pre-created sysrepo sessions */
+    uint32_t pool_count;                /**< number of pre-created sysrepo sessions */
+
+    struct np_sess_event *first;        /**< first queued notification */
+    struct np_sess_event *last;         /**< last queued notification */
+    uint32_t event_count;               /**< number of queued notifications */
+
+    ATOMIC_T accept_rate;               /**< maximum accepted sessions per second, 0 for no limit */
+    ATOMIC_T accept_burst;              /**< sessions accepted at once above the rate */
+    ATOMIC64_T tat;                     /**< theoretical arrival time of the next accepted session (us) */
+    ATOMIC64_T deferred_tat;            /**< tat of the last counted postponed accept period */
+
+    ATOMIC_T accepted;                  /**< number of accepted sessions */
+    ATOMIC_T deferred;                  /**< number of periods accepting was postponed for by the rate limit */
+    ATOMIC_T failed;                    /**< number of sessions whose setup failed */
+    ATOMIC_T pool_misses;               /**< number of sysrepo sessions created on the accept path */
+    ATOMIC64_T setup_time;              /**< total setup time of accepted sessions (us) */
+    ATOMIC64_T max_setup_time;          /**< longest setup time of an accepted session (us) */
+} setup = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .accept_burst = NP2SRV_ACCEPT_BURST
+};
+
+uint64_t
+np_sess_setup_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Free a queued notification.
+ *
+ * @param[in] ev Notification to free.
+ */
+static void
+np_sess_event_free(struct np_sess_event *ev)
+{
+    free(ev->username);
+    free(ev->host);
+    free(ev);
+}
+
+/**
+ * @brief Send queued session notifications.
+ *
+ * @param[in] first First notification to send, all are freed.
+ */
+static void
+np_sess_event_send(struct np_sess_event *first)
+{
+    struct np_sess_event *ev;
+    sr_val_t event_data[5];
+    const char *name;
+    uint32_t i;
+    int rc, send;
+
+    /* the notifications are generated for sysrepo only if the module is implemented */
+    send = ly_ctx_get_module(sr_get_context(np2srv.sr_conn), "ietf-netconf-notifications", NULL, 1) ? 1 : 0;
+
+    while ((ev = first)) {
+        first = ev->next;
+
+        if (!send) {
+            np_sess_event_free(ev);
+            continue;
+        }
+
+        memset(event_data, 0, sizeof event_data);
+        i = 0;
+
+        if (ev->start) {
+            name = "netconf-session-start";
+            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-start/username";
+            event_data[i].type = SR_STRING_T;
+            event_data[i++].data.string_val = ev->username;
+            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-start/session-id";
+            event_data[i].type = SR_UINT32_T;
+            event_data[i++].data.uint32_val = ev->id;
+            if (ev->host) {
+                event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-start/source-host";
+                event_data[i].type = SR_STRING_T;
+                event_data[i++].data.string_val = ev->host;
+            }
+        } else {
+            name = "netconf-session-end";
+            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/username";
+            event_data[i].type = SR_STRING_T;
+            event_data[i++].data.string_val = ev->username;
+            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/session-id";
+            event_data[i].type = SR_UINT32_T;
+            event_data[i++].data.uint32_val = ev->id;
+            if (ev->host) {
+                event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/source-host";
+                event_data[i].type = SR_STRING_T;
+                event_data[i++].data.string_val = ev->host;
+            }
+            if (ev->killed_by) {
+                event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/killed-by";
+                event_data[i].type = SR_UINT32_T;
+                event_data[i++].data.uint32_val = ev->killed_by;
+            }
+            event_data[i].xpath = "/ietf-netconf-notifications:netconf-session-end/termination-reason";
+            event_data[i].type = SR_ENUM_T;
+            event_data[i++].data.enum_val = (char *)ev->term_reason;
+        }
+
+        rc = sr_event_notif_send(np2srv.sr_sess, ev->start ? "/ietf-netconf-notifications:netconf-session-start" :
+                "/ietf-netconf-notifications:netconf-session-end", event_data, i);
+        if (rc != SR_ERR_OK) {
+            WRN("Failed to send a notification (%s).", sr_strerror(rc));
+        } else {
+            VRB("Generated new event (%s).", name);
+        }
+
+        np_sess_event_free(ev);
+    }
+}
+
+/**
+ * @brief Session setup thread.
+ */
+static void *
+np_sess_setup_thread(void *UNUSED(arg))
+{
+    struct np_sess_event *events;
+    sr_session_ctx_t *sr_sess;
+    int rc, refill;
+
+    pthread_mutex_lock(&setup.lock);
+    while (setup.running) {
+        /* take all the queued notifications */
+        events = setup.first;
+        setup.first = NULL;
+        setup.last = NULL;
+        setup.event_count = 0;
+        refill = (setup.pool_count < NP2SRV_SR_SESS_POOL_SIZE);
+        pthread_mutex_unlock(&setup.lock);
+
+        np_sess_event_send(events);
+
+        if (refill) {
+            /* create a new sysrepo session for the pool */
+            rc = sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, &sr_sess);
+            if (rc != SR_ERR_OK) {
+                ERR("Failed to start a sysrepo session (%s).", sr_strerror(rc));
+                np_sleep(NP2SRV_PS_BACKOFF_SLEEP);
+            }
+
+            pthread_mutex_lock(&setup.lock);
+            if (rc == SR_ERR_OK) {
+                assert(setup.pool_count < NP2SRV_SR_SESS_POOL_SIZE);
+                setup.pool[setup.pool_count++] = sr_sess;
+            }
+        } else {
+            pthread_mutex_lock(&setup.lock);
+        }
+
+        /* wait for more work */
+        while (setup.running && !setup.first && (setup.pool_count == NP2SRV_SR_SESS_POOL_SIZE)) {
+            pthread_cond_wait(&setup.cond, &setup.lock);
+        }
+    }
+
+    /* send the remaining notifications */
+    events = setup.first;
+    setup.first = NULL;
+    setup.last = NULL;
+    setup.event_count = 0;
+    pthread_mutex_unlock(&setup.lock);
+
+    np_sess_event_send(events);
+    return NULL;
+}
+
+int
+np_sess_setup_start(void)
+{
+    int r;
+
+    pthread_mutex_lock(&setup.lock);
+    setup.running = 1;
+    if ((r = pthread_create(&setup.tid, NULL, np_sess_setup_thread, NULL))) {
+        setup.running = 0;
+        pthread_mutex_unlock(&setup.lock);
+        ERR("Creating the session setup thread failed (%s).", strerror(r));
+        return -1;
+    }
+    pthread_mutex_unlock(&setup.lock);
+
+    return 0;
+}
+
+void
+np_sess_setup_stop(void)
+{
+    struct np_sess_event *events;
+
+    pthread_mutex_lock(&setup.lock);
+    if (setup.running) {
+        setup.running = 0;
+        pthread_cond_signal(&setup.cond);
+        pthread_mutex_unlock(&setup.lock);
+        pthread_join(setup.tid, NULL);
+        pthread_mutex_lock(&setup.lock);
+    }
+
+    /* notifications queued without the thread */
+    events = setup.first;
+    setup.first = NULL;
+    setup.last = NULL;
+    setup.event_count = 0;
+
+    while (setup.pool_count) {
+        sr_session_stop(setup.pool[--setup.pool_count]);
+    }
+    pthread_mutex_unlock(&setup.lock);
+
+    np_sess_event_send(events);
+}
+
+uint32_t
+np_sess_setup_admit(void)
+{
+    uint32_t rate;
+    uint64_t interval, limit, tat, wait;
+    uint_fast64_t counted;
+
+    rate = ATOMIC_LOAD_RELAXED(setup.accept_rate);
+    if (!rate) {
+        return 0;
+    }
+    interval = 1000000 / rate;
+
+    /* sessions arriving at the rate may be accepted up to burst of them ahead */
+    limit = np_sess_setup_now() + (ATOMIC_LOAD_RELAXED(setup.accept_burst) - 1) * interval;
+    tat = ATOMIC_LOAD_RELAXED(setup.tat);
+    if (tat <= limit) {
+        return 0;
+    }
+
+    /* count every period accepting is postponed for only once, no matter how many workers wait */
+    counted = ATOMIC_LOAD_RELAXED(setup.deferred_tat);
+    if ((counted != tat) && ATOMIC_CAS_RELAXED(setup.deferred_tat, counted, tat)) {
+        ATOMIC_INC_FENCE(setup.deferred);
+    }
+
+    wait = (tat - limit) / 1000 + 1;
+    return (wait < NP2SRV_PS_BACKOFF_SLEEP) ? wait : NP2SRV_PS_BACKOFF_SLEEP;
+}
+
+void
+np_sess_setup_accepted(void)
+{
+    uint32_t rate;
+    uint64_t interval, now, tat;
+    uint_fast64_t cur;
+
+    ATOMIC_INC_FENCE(setup.accepted);
+
+    rate = ATOMIC_LOAD_RELAXED(setup.accept_rate);
+    if (!rate) {
+        return;
+    }
+    interval = 1000000 / rate;
+    now = np_sess_setup_now();
+
+    do {
+        cur = ATOMIC_LOAD_RELAXED(setup.tat);
+        tat = (cur > now) ? cur : now;
+    } while (!ATOMIC_CAS_RELAXED(setup.tat, cur, tat + interval));
+}
+
+int
+np_sess_setup_sr_session(sr_session_ctx_t **sr_sess)
+{
+    *sr_sess = NULL;
+
+    pthread_mutex_lock(&setup.lock);
+    if (setup.pool_count) {
+        *sr_sess = setup.pool[--setup.pool_count];
+
+        /* create a replacement */
+        pthread_cond_signal(&setup.cond);
+    }
+    pthread_mutex_unlock(&setup.lock);
+
+    if (*sr_sess) {
+        return SR_ERR_OK;
+    }
+
+    /* none available, create it now */
+    ATOMIC_INC_FENCE(setup.pool_misses);
+    return sr_session_start(np2srv.sr_conn, SR_DS_RUNNING, sr_sess);
+}
+
+void
+np_sess_setup_done(uint64_t start, int failed)
+{
+    uint64_t duration;
+    uint_fast64_t max;
+
+    if (failed) {
+        ATOMIC_INC_FENCE(setup.failed);
+        return;
+    }
+
+    duration = np_sess_setup_now() - start;
+    ATOMIC_ADD_RELAXED(setup.setup_time, duration);
+    do {
+        max = ATOMIC_LOAD_RELAXED(setup.max_setup_time);
+        if (duration <= max) {
+            break;
+        }
+    } while (!ATOMIC_CAS_RELAXED(setup.max_setup_time, max, duration));
+}
+
+/**
+ * @brief Create and queue a session notification.
+ *
+ * @param[in] ncs NETCONF session.
+ * @param[in] start Whether it is netconf-session-start or netconf-session-end.
+ */
+static void
+np_sess_event_queue(const struct nc_session *ncs, int start)
+{
+    struct np_sess_event *ev;
+    const char *host = NULL;
+
+    ev = calloc(1, sizeof *ev);
+    if (!ev) {
+        EMEM;
+        return;
+    }
+
+    ev->start = start;
+    ev->username = strdup(nc_session_get_username(ncs));
+    ev->id = nc_session_get_id(ncs);
+    if (nc_session_get_ti(ncs) != NC_TI_UNIX) {
+        host = nc_session_get_host(ncs);
+    }
+    if (host) {
+        ev->host = strdup(host);
+    }
+    if (!ev->username || (host && !ev->host)) {
+        EMEM;
+        np_sess_event_free(ev);
+        return;
+    }
+
+    if (!start) {
+        ev->killed_by = nc_session_get_killed_by(ncs);
+        switch (nc_session_get_term_reason(ncs)) {
+        case NC_SESSION_TERM_CLOSED:
+            ev->term_reason = "closed";
+            break;
+        case NC_SESSION_TERM_KILLED:
+            ev->term_reason = "killed";
+            break;
+        case NC_SESSION_TERM_DROPPED:
+            ev->term_reason = "dropped";
+            break;
+        case NC_SESSION_TERM_TIMEOUT:
+            ev->term_reason = "timeout";
+            break;
+        default:
+            ev->term_reason = "other";
+            break;
+        }
+    }
+
+    /* keep the order of the notifications */
+    pthread_mutex_lock(&setup.lock);
+    if (setup.last) {
+        setup.last->next = ev;
+    } else {
+        setup.first = ev;
+    }
+    setup.last = ev;
+    ++setup.event_count;
+    pthread_cond_signal(&setup.cond);
+    pthread_mutex_unlock(&setup.lock);
+}
+
+void
+np_sess_setup_notif_start(const struct nc_session *ncs)
+{
+    np_sess_event_queue(ncs, 1);
+}
+
+void
+np_sess_setup_notif_end(const struct nc_session *ncs)
+{
+    np_sess_event_queue(ncs, 0);
+}
+
+/* /netopeer2-monitoring:netopeer2-server/sessions */
+int
+np_sess_setup_config_cb(sr_session_ctx_t *session, const char *UNUSED(module_name), const char *xpath,
+        sr_event_t UNUSED(event), uint32_t UNUSED(request_id), void *UNUSED(private_data))
+{
+    sr_change_iter_t *iter;
+    sr_change_oper_t op;
+    const struct lyd_node *node;
+    const char *prev_val, *prev_list;
+    bool prev_dflt;
+    int rc;
+
+    rc = sr_get_changes_iter(session, xpath, &iter);
+    if (rc != SR_ERR_OK) {
+        ERR("Getting changes iter failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    while ((rc = sr_get_change_tree_next(session, iter, &op, &node, &prev_val, &prev_list, &prev_dflt)) == SR_ERR_OK) {
+        if ((op != SR_OP_CREATED) && (op != SR_OP_MODIFIED)) {
+            /* both leaves have a default value */
+            continue;
+        }
+
+        if (!strcmp(node->schema->name, "accept-rate")) {
+            ATOMIC_STORE_RELAXED(setup.accept_rate, ((struct lyd_node_leaf_list *)node)->value.uint32);
+        } else if (!strcmp(node->schema->name, "accept-burst")) {
+            ATOMIC_STORE_RELAXED(setup.accept_burst, ((struct lyd_node_leaf_list *)node)->value.uint32);
+        }
+    }
+    sr_free_change_iter(iter);
+    if (rc != SR_ERR_NOT_FOUND) {
+        ERR("Getting next change failed (%s).", sr_strerror(rc));
+        return rc;
+    }
+
+    return SR_ERR_OK;
+}
+
+/* /netopeer2-monitoring:netopeer2-state/sessions */
+int
+np_sess_setup_state_data_cb(sr_session_ctx_t *UNUSED(session), const char *UNUSED(module_name), const char *UNUSED(path),
+        const char *UNUSED(request_xpath), uint32_t UNUSED(request_id), struct lyd_node **parent,
+        void *UNUSED(private_data))
+{
+    struct lyd_node *cont;
+    char num_str[21];
+    uint32_t pool_count, event_count;
+
+    assert(*parent);
+
+    pthread_mutex_lock(&setup.lock);
+    pool_count = setup.pool_count;
+    event_count = setup.event_count;
+    pthread_mutex_unlock(&setup.lock);
+
+    cont = lyd_new_path(*parent, NULL, "sessions", NULL, 0, 0);
+    if (!cont) {
+        return SR_ERR_INTERNAL;
+    }
+
+    sprintf(num_str, "%" PRIu32, (uint32_t)ATOMIC_LOAD_RELAXED(setup.accepted));
+    if (!lyd_new_leaf(cont, NULL, "accepted", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu32, (uint32_t)ATOMIC_LOAD_RELAXED(setup.deferred));
+    if (!lyd_new_leaf(cont, NULL, "deferred-accepts", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu32, (uint32_t)ATOMIC_LOAD_RELAXED(setup.failed));
+    if (!lyd_new_leaf(cont, NULL, "failed-setups", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu64, (uint64_t)ATOMIC_LOAD_RELAXED(setup.setup_time));
+    if (!lyd_new_leaf(cont, NULL, "setup-time", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu64, (uint64_t)ATOMIC_LOAD_RELAXED(setup.max_setup_time));
+    if (!lyd_new_leaf(cont, NULL, "max-setup-time", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu32, pool_count);
+    if (!lyd_new_leaf(cont, NULL, "pooled-sysrepo-sessions", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu32, (uint32_t)ATOMIC_LOAD_RELAXED(setup.pool_misses));
+    if (!lyd_new_leaf(cont, NULL, "sysrepo-session-pool-misses", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+    sprintf(num_str, "%" PRIu32, event_count);
+    if (!lyd_new_leaf(cont, NULL, "queued-notifications", num_str)) {
+        return SR_ERR_INTERNAL;
+    }
+
+    return SR_ERR_OK;
+}
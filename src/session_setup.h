@@ -0,0 +1,92 @@
+/**
+ * @file session_setup.h
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server NETCONF session setup and teardown header
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#ifndef NP2SRV_SESSION_SETUP_H_
+#define NP2SRV_SESSION_SETUP_H_
+
+#include <stdint.h>
+
+#include <libyang/libyang.h>
+#include <nc_server.h>
+#include <sysrepo.h>
+
+/**
+ * @brief Start the session setup thread, which pre-creates sysrepo sessions and sends
+ * the session start and end notifications.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int np_sess_setup_start(void);
+
+/**
+ * @brief Stop the session setup thread, send all the queued notifications and stop the pre-created sysrepo sessions.
+ */
+void np_sess_setup_stop(void);
+
+/**
+ * @brief Check whether a new NETCONF session can be accepted now by the admission rate limit.
+ *
+ * @return 0 if it can be accepted, otherwise time to wait before accepting (ms), at most ::NP2SRV_PS_BACKOFF_SLEEP.
+ */
+uint32_t np_sess_setup_admit(void);
+
+/**
+ * @brief Record an accepted NETCONF session for the admission rate limit.
+ */
+void np_sess_setup_accepted(void);
+
+/**
+ * @brief Get a sysrepo session for a new NETCONF session, a pre-created one if available.
+ *
+ * @param[out] sr_sess Sysrepo session.
+ * @return Sysrepo error value.
+ */
+int np_sess_setup_sr_session(sr_session_ctx_t **sr_sess);
+
+/**
+ * @brief Record the result of a new NETCONF session setup.
+ *
+ * @param[in] start Time the setup started returned by ::np_sess_setup_now().
+ * @param[in] failed Whether the setup failed.
+ */
+void np_sess_setup_done(uint64_t start, int failed);
+
+/**
+ * @brief Get current monotonic time to be passed to ::np_sess_setup_done().
+ *
+ * @return Current time (us).
+ */
+uint64_t np_sess_setup_now(void);
+
+/**
+ * @brief Queue ietf-netconf-notifications netconf-session-start notification.
+ *
+ * @param[in] ncs Started NETCONF session.
+ */
+void np_sess_setup_notif_start(const struct nc_session *ncs);
+
+/**
+ * @brief Queue ietf-netconf-notifications netconf-session-end notification.
+ *
+ * @param[in] ncs Terminated NETCONF session.
+ */
+void np_sess_setup_notif_end(const struct nc_session *ncs);
+
+int np_sess_setup_config_cb(sr_session_ctx_t *session, const char *module_name, const char *xpath, sr_event_t event,
+        uint32_t request_id, void *private_data);
+
+int np_sess_setup_state_data_cb(sr_session_ctx_t *session, const char *module_name, const char *path,
+        const char *request_xpath, uint32_t request_id, struct lyd_node **parent, void *private_data);
+
+#endif /* NP2SRV_SESSION_SETUP_H_ */
@@ -0,0 +1,178 @@
+/**
+ * @file test_filter_cache.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server cache of subtree filters tests
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#define _GNU_SOURCE
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <libyang/libyang.h>
+
+#include "config.h"
+#include "filter_cache.h"
+#include "log.h"
+
+void
+np2log_printf(NC_VERB_LEVEL UNUSED(level), const char *UNUSED(format), ...)
+{
+}
+
+static int
+setup_ctx(void **state)
+{
+    *state = ly_ctx_new(NULL, 0);
+    return *state ? 0 : 1;
+}
+
+static int
+teardown_ctx(void **state)
+{
+    np_filter_cache_destroy();
+    ly_ctx_destroy(*state, NULL);
+    return 0;
+}
+
+static void
+free_filters(char **filters, int filter_count)
+{
+    int i;
+
+    for (i = 0; i < filter_count; ++i) {
+        free(filters[i]);
+    }
+    free(filters);
+}
+
+/**
+ * @brief Store one filter for a key.
+ */
+static void
+put_key(struct ly_ctx *ly_ctx, int i)
+{
+    char key[32], xpath[32], *filter = xpath;
+
+    sprintf(key, "<top-%d/>", i);
+    sprintf(xpath, "/mod:top-%d", i);
+    np_filter_cache_put(ly_ctx, key, &filter, 1);
+}
+
+/**
+ * @brief Learn whether a key is cached.
+ */
+static int
+has_key(struct ly_ctx *ly_ctx, int i)
+{
+    char key[32], xpath[32], **filters = NULL;
+    int filter_count = 0, ret;
+
+    sprintf(key, "<top-%d/>", i);
+    ret = np_filter_cache_get(ly_ctx, key, &filters, &filter_count);
+    if (!ret) {
+        sprintf(xpath, "/mod:top-%d", i);
+        assert_int_equal(filter_count, 1);
+        assert_string_equal(filters[0], xpath);
+    }
+    free_filters(filters, filter_count);
+
+    return !ret;
+}
+
+static void
+test_key(void **state)
+{
+    char *key;
+
+    (void)state;
+
+    /* whitespace between elements is removed */
+    key = np_filter_cache_key("\n  <a xmlns=\"urn:a\">\n    <b/>\n  </a>\n");
+    assert_string_equal(key, "<a xmlns=\"urn:a\"><b/></a>");
+    free(key);
+
+    /* but not the content of elements */
+    key = np_filter_cache_key("<a> <b>x y</b> <c> z </c></a>");
+    assert_string_equal(key, "<a><b>x y</b><c> z </c></a>");
+    free(key);
+}
+
+static void
+test_get_put(void **state)
+{
+    struct ly_ctx *ly_ctx = *state;
+    char *src[2] = {"/a:x", "/a:y"}, **filters;
+    int filter_count;
+
+    filters = NULL;
+    filter_count = 0;
+    assert_int_equal(np_filter_cache_get(ly_ctx, "<x/><y/>", &filters, &filter_count), 1);
+    assert_int_equal(filter_count, 0);
+
+    np_filter_cache_put(ly_ctx, "<x/><y/>", src, 2);
+
+    /* cached filters are appended */
+    filters = malloc(sizeof *filters);
+    filters[0] = strdup("/a:z");
+    filter_count = 1;
+    assert_int_equal(np_filter_cache_get(ly_ctx, "<x/><y/>", &filters, &filter_count), 0);
+    assert_int_equal(filter_count, 3);
+    assert_string_equal(filters[0], "/a:z");
+    assert_string_equal(filters[1], "/a:x");
+    assert_string_equal(filters[2], "/a:y");
+    free_filters(filters, filter_count);
+}
+
+static void
+test_lru(void **state)
+{
+    struct ly_ctx *ly_ctx = *state;
+    int i;
+
+    for (i = 0; i < NP2SRV_FILTER_CACHE_SIZE; ++i) {
+        put_key(ly_ctx, i);
+    }
+
+    /* use the oldest entry so that the second oldest is evicted instead */
+    assert_true(has_key(ly_ctx, 0));
+    put_key(ly_ctx, NP2SRV_FILTER_CACHE_SIZE);
+
+    assert_true(has_key(ly_ctx, 0));
+    assert_false(has_key(ly_ctx, 1));
+    for (i = 2; i <= NP2SRV_FILTER_CACHE_SIZE; ++i) {
+        assert_true(has_key(ly_ctx, i));
+    }
+
+    /* storing a cached key again does not evict anything */
+    put_key(ly_ctx, 2);
+    for (i = 2; i <= NP2SRV_FILTER_CACHE_SIZE; ++i) {
+        assert_true(has_key(ly_ctx, i));
+    }
+    assert_true(has_key(ly_ctx, 0));
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_key),
+        cmocka_unit_test_setup_teardown(test_get_put, setup_ctx, teardown_ctx),
+        cmocka_unit_test_setup_teardown(test_lru, setup_ctx, teardown_ctx),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
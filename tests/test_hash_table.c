@@ -0,0 +1,195 @@
+/**
+ * @file test_hash_table.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server hash table tests
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "hash_table.h"
+
+struct test_rec {
+    uint32_t key;
+    uint32_t value;
+};
+
+static int
+test_rec_equal(void *val1_p, void *val2_p, void *cb_data)
+{
+    (void)cb_data;
+
+    return ((struct test_rec *)val1_p)->key == ((struct test_rec *)val2_p)->key;
+}
+
+static uint32_t
+test_rec_hash(uint32_t key)
+{
+    return np_hash_multi(np_hash_multi(0, &key, sizeof key), NULL, 0);
+}
+
+static void
+test_insert_find(void **state)
+{
+    struct np_ht *ht;
+    struct test_rec rec, *match;
+    uint32_t i;
+
+    (void)state;
+
+    ht = np_ht_new(8, sizeof rec, test_rec_equal, NULL);
+    assert_non_null(ht);
+
+    /* enough values for the table to be enlarged several times */
+    for (i = 0; i < 1000; ++i) {
+        rec.key = i;
+        rec.value = i * 2;
+        assert_int_equal(np_ht_insert(ht, &rec, test_rec_hash(i), NULL), 0);
+    }
+    assert_int_equal(ht->used, 1000);
+    assert_true(ht->size >= 1000);
+
+    for (i = 0; i < 1000; ++i) {
+        rec.key = i;
+        assert_int_equal(np_ht_find(ht, &rec, test_rec_hash(i), (void **)&match), 0);
+        assert_int_equal(match->value, i * 2);
+    }
+
+    rec.key = 1000;
+    assert_int_equal(np_ht_find(ht, &rec, test_rec_hash(1000), NULL), 1);
+
+    /* equal value is not inserted again, the existing one is returned */
+    rec.key = 7;
+    rec.value = 0;
+    assert_int_equal(np_ht_insert(ht, &rec, test_rec_hash(7), (void **)&match), 1);
+    assert_int_equal(match->value, 14);
+    assert_int_equal(ht->used, 1000);
+
+    np_ht_free(ht);
+}
+
+static void
+test_collisions(void **state)
+{
+    struct np_ht *ht;
+    struct test_rec rec, *match;
+    uint32_t i;
+
+    (void)state;
+
+    ht = np_ht_new(16, sizeof rec, test_rec_equal, NULL);
+    assert_non_null(ht);
+
+    /* all the values in one collision chain */
+    for (i = 0; i < 10; ++i) {
+        rec.key = i;
+        rec.value = i;
+        assert_int_equal(np_ht_insert(ht, &rec, 5, NULL), 0);
+    }
+
+    /* removing a value in the middle of the chain must not hide the following ones */
+    rec.key = 3;
+    assert_int_equal(np_ht_remove(ht, &rec, 5), 0);
+    assert_int_equal(np_ht_remove(ht, &rec, 5), 1);
+    assert_int_equal(np_ht_find(ht, &rec, 5, NULL), 1);
+    for (i = 4; i < 10; ++i) {
+        rec.key = i;
+        assert_int_equal(np_ht_find(ht, &rec, 5, (void **)&match), 0);
+        assert_int_equal(match->value, i);
+    }
+
+    /* the removed record is reused */
+    rec.key = 3;
+    assert_int_equal(np_ht_insert(ht, &rec, 5, NULL), 0);
+    assert_int_equal(ht->used, 10);
+
+    np_ht_free(ht);
+}
+
+static void
+test_remove_clear_iter(void **state)
+{
+    struct np_ht *ht;
+    struct test_rec rec, *val;
+    uint32_t i, idx, count, sum;
+
+    (void)state;
+
+    ht = np_ht_new(4, sizeof rec, test_rec_equal, NULL);
+    assert_non_null(ht);
+
+    for (i = 0; i < 100; ++i) {
+        rec.key = i;
+        rec.value = i;
+        assert_int_equal(np_ht_insert(ht, &rec, test_rec_hash(i), NULL), 0);
+    }
+
+    /* remove the odd values */
+    for (i = 1; i < 100; i += 2) {
+        rec.key = i;
+        assert_int_equal(np_ht_remove(ht, &rec, test_rec_hash(i)), 0);
+    }
+    assert_int_equal(ht->used, 50);
+
+    /* only the even values are iterated over */
+    idx = 0;
+    count = 0;
+    sum = 0;
+    while ((val = np_ht_iter_next(ht, &idx))) {
+        assert_int_equal(val->key % 2, 0);
+        ++count;
+        sum += val->value;
+    }
+    assert_int_equal(count, 50);
+    assert_int_equal(sum, 2450);
+
+    np_ht_clear(ht);
+    assert_int_equal(ht->used, 0);
+    idx = 0;
+    assert_null(np_ht_iter_next(ht, &idx));
+    rec.key = 0;
+    assert_int_equal(np_ht_find(ht, &rec, test_rec_hash(0), NULL), 1);
+
+    np_ht_free(ht);
+}
+
+static void
+test_hash_multi(void **state)
+{
+    uint32_t hash1, hash2;
+
+    (void)state;
+
+    /* hashing the parts separately is the same as hashing them at once */
+    hash1 = np_hash_multi(np_hash_multi(np_hash_multi(0, "ab", 2), "cd", 2), NULL, 0);
+    hash2 = np_hash_multi(np_hash_multi(0, "abcd", 4), NULL, 0);
+    assert_int_equal(hash1, hash2);
+
+    hash2 = np_hash_multi(np_hash_multi(0, "abce", 4), NULL, 0);
+    assert_int_not_equal(hash1, hash2);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_insert_find),
+        cmocka_unit_test(test_collisions),
+        cmocka_unit_test(test_remove_clear_iter),
+        cmocka_unit_test(test_hash_multi),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,167 @@
+/**
+ * @file test_log.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server log ring buffer tests
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+/* the ring buffer is internal */
+#include "log.c"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+/**
+ * @brief Prepare the ring buffer as the logging thread would without starting it.
+ */
+static int
+setup_ring(void **state)
+{
+    uint32_t i;
+
+    (void)state;
+
+    for (i = 0; i < NP2SRV_LOG_RING_SIZE; ++i) {
+        ATOMIC_STORE_RELAXED(logger.ring[i].seq, i);
+    }
+    ATOMIC_STORE_RELAXED(logger.tail, 0);
+    logger.head = 0;
+    memset(logger.rate, 0, sizeof logger.rate);
+    ATOMIC_STORE_RELAXED(logger.dropped, 0);
+    ATOMIC_STORE_RELAXED(logger.suppressed, 0);
+
+    np2_verbose_level = NC_VERB_DEBUG;
+    np2_stderr_log = 0;
+    ATOMIC_STORE_FENCE(logger.running, 1);
+    return 0;
+}
+
+static int
+teardown_ring(void **state)
+{
+    (void)state;
+
+    ATOMIC_STORE_FENCE(logger.running, 0);
+    np2log_drain();
+    return 0;
+}
+
+static void
+test_full(void **state)
+{
+    char last_msg[32];
+    uint32_t i;
+
+    (void)state;
+
+    for (i = 0; i < NP2SRV_LOG_RING_SIZE; ++i) {
+        ERR("Message %" PRIu32 ".", i);
+    }
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.dropped), 0);
+
+    /* no free record */
+    ERR("Dropped message.");
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.dropped), 1);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.tail), NP2SRV_LOG_RING_SIZE);
+
+    /* messages are read in the written order */
+    assert_string_equal(logger.ring[0].msg, "Message 0.");
+    sprintf(last_msg, "Message %d.", NP2SRV_LOG_RING_SIZE - 1);
+    assert_string_equal(logger.ring[NP2SRV_LOG_RING_SIZE - 1].msg, last_msg);
+    assert_int_equal(np2log_drain(), NP2SRV_LOG_RING_SIZE);
+    assert_int_equal(np2log_drain(), 0);
+
+    /* the records can be written again after wrapping around */
+    ERR("Message after wrap.");
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.dropped), 1);
+    assert_string_equal(logger.ring[0].msg, "Message after wrap.");
+    assert_int_equal(np2log_drain(), 1);
+}
+
+static void
+test_rate_limit(void **state)
+{
+    uint32_t i, count;
+
+    (void)state;
+
+    /* all the messages must fit into the ring buffer to be drained at once */
+    count = NP2SRV_LOG_RATE_LIMIT + 10;
+    if (count > NP2SRV_LOG_RING_SIZE) {
+        skip();
+    }
+
+    for (i = 0; i < count; ++i) {
+        ERR("Message %" PRIu32 ".", i);
+    }
+
+    /* only the messages above the limit are suppressed */
+    assert_int_equal(np2log_drain(), count);
+    assert_int_equal(logger.rate[NP2LOG_NP].count, NP2SRV_LOG_RATE_LIMIT);
+    assert_int_equal(logger.rate[NP2LOG_NP].suppressed, 10);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.suppressed), 10);
+
+    /* other sources are not limited */
+    np2_sr_verbose_level = SR_LL_ERR;
+    np2log_cb_sr(SR_LL_ERR, "sysrepo message");
+    assert_int_equal(np2log_drain(), 1);
+    assert_int_equal(logger.rate[NP2LOG_SR].suppressed, 0);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.suppressed), 10);
+}
+
+static void
+test_long_msg(void **state)
+{
+    char long_str[NP2SRV_MSG_LEN_START * 2];
+
+    (void)state;
+
+    memset(long_str, 'a', sizeof long_str - 1);
+    long_str[sizeof long_str - 1] = '\0';
+
+    ERR("%s", long_str);
+    ERR("%s", "short");
+
+    /* the long message is allocated, the short one is not */
+    assert_non_null(logger.ring[0].long_msg);
+    assert_string_equal(logger.ring[0].long_msg, long_str);
+    assert_null(logger.ring[1].long_msg);
+    assert_string_equal(logger.ring[1].msg, "short");
+
+    assert_int_equal(np2log_drain(), 2);
+    assert_null(logger.ring[0].long_msg);
+}
+
+static void
+test_direct(void **state)
+{
+    (void)state;
+
+    /* without the logging thread messages are printed directly */
+    ATOMIC_STORE_FENCE(logger.running, 0);
+    ERR("Direct message.");
+    assert_int_equal(ATOMIC_LOAD_RELAXED(logger.tail), 0);
+    assert_int_equal(np2log_drain(), 0);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown(test_full, setup_ring, teardown_ring),
+        cmocka_unit_test_setup_teardown(test_rate_limit, setup_ring, teardown_ring),
+        cmocka_unit_test_setup_teardown(test_long_msg, setup_ring, teardown_ring),
+        cmocka_unit_test_setup_teardown(test_direct, setup_ring, teardown_ring),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
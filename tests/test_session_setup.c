@@ -0,0 +1,139 @@
+/**
+ * @file test_session_setup.c
+ * @author Michal Vasko <mvasko@cesnet.cz>
+ * @brief netopeer2-server session accept rate limit tests
+ *
+ * Copyright (c) 2020 CESNET, z.s.p.o.
+ *
+ * This source code is licensed under BSD 3-Clause License (the "License").
+ * You may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     https://opensource.org/licenses/BSD-3-Clause
+ */
+
+/* the rate limit state is internal */
+#include "session_setup.c"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+struct np2srv np2srv;
+
+int
+np_sleep(uint32_t UNUSED(ms))
+{
+    return 0;
+}
+
+void
+np2log_printf(NC_VERB_LEVEL UNUSED(level), const char *UNUSED(format), ...)
+{
+}
+
+/**
+ * @brief Reset the rate limit, 10 sessions per second make every session interval 100 ms, long enough
+ * for the tests not to depend on timing.
+ */
+static int
+setup_limit(void **state)
+{
+    (void)state;
+
+    ATOMIC_STORE_RELAXED(setup.accept_rate, 10);
+    ATOMIC_STORE_RELAXED(setup.accept_burst, 3);
+    ATOMIC_STORE_RELAXED(setup.tat, 0);
+    ATOMIC_STORE_RELAXED(setup.deferred_tat, 0);
+    ATOMIC_STORE_RELAXED(setup.accepted, 0);
+    ATOMIC_STORE_RELAXED(setup.deferred, 0);
+    return 0;
+}
+
+static void
+test_no_limit(void **state)
+{
+    uint32_t i;
+
+    (void)state;
+
+    ATOMIC_STORE_RELAXED(setup.accept_rate, 0);
+    for (i = 0; i < 100; ++i) {
+        assert_int_equal(np_sess_setup_admit(), 0);
+        np_sess_setup_accepted();
+    }
+    assert_int_equal(ATOMIC_LOAD_RELAXED(setup.accepted), 100);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(setup.deferred), 0);
+}
+
+static void
+test_burst(void **state)
+{
+    uint32_t i, wait;
+
+    (void)state;
+
+    /* a burst of sessions is accepted at once */
+    for (i = 0; i < 3; ++i) {
+        assert_int_equal(np_sess_setup_admit(), 0);
+        np_sess_setup_accepted();
+    }
+
+    /* then the next one must wait for about one interval */
+    wait = np_sess_setup_admit();
+    assert_true(wait > 0);
+    assert_true(wait <= 101);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(setup.deferred), 1);
+
+    /* any more waiting workers do not count the same postponed period again */
+    assert_true(np_sess_setup_admit() > 0);
+    assert_true(np_sess_setup_admit() > 0);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(setup.deferred), 1);
+
+    /* an accepted session postpones the next one by another interval */
+    np_sess_setup_accepted();
+    assert_true(np_sess_setup_admit() > wait);
+    assert_int_equal(ATOMIC_LOAD_RELAXED(setup.deferred), 2);
+}
+
+static void
+test_idle(void **state)
+{
+    uint64_t now;
+
+    (void)state;
+
+    /* a theoretical arrival time in the past does not grant more than the burst */
+    now = np_sess_setup_now();
+    ATOMIC_STORE_RELAXED(setup.tat, now - 10000000);
+    np_sess_setup_accepted();
+    assert_true(ATOMIC_LOAD_RELAXED(setup.tat) >= now + 100000);
+
+    np_sess_setup_accepted();
+    np_sess_setup_accepted();
+    assert_true(np_sess_setup_admit() > 0);
+}
+
+static void
+test_wait_cap(void **state)
+{
+    (void)state;
+
+    /* workers never sleep longer than the backoff */
+    ATOMIC_STORE_RELAXED(setup.tat, np_sess_setup_now() + 10000000);
+    assert_int_equal(np_sess_setup_admit(), NP2SRV_PS_BACKOFF_SLEEP);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup(test_no_limit, setup_limit),
+        cmocka_unit_test_setup(test_burst, setup_limit),
+        cmocka_unit_test_setup(test_idle, setup_limit),
+        cmocka_unit_test_setup(test_wait_cap, setup_limit),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}